@@ -42,12 +42,13 @@
  * 
  * @subsection SD card logging
  * 
- * The format for SD card logging is:
+ * Every message sent and received is logged to datalog.bin by sdLogger, as binary records (see sdLogger.h). The file is kept open and synced every 10 seconds, so remove the card only after the last sync.
+ * 
+ * Convert the log to .csv with the sdLogToCsv tool from the host build. The columns are:
  * 
  * Timestamp | Source Address | Destination Address | Message ID | Message Flags | Acknowleged | Message | spreadingFactor | signalBandwidth | frequencyChannel | txPower
  *
  * SD card contents are preserved between each restart, but the timestamp resets to zero and a new header with the above categories, allowing for new data to be easily distinguished from the old.
- * Data is logged in .csv format.
  */
 
 #include <SPI.h>
@@ -58,6 +59,7 @@
 #include <RH_RF95.h>
 #include <RHReliableDatagram.h>
 #include <loraPoint2PointProtocol.h>
+#include <sdLogger.h>
 
 /**
  * @brief Start the USB serial on startup and blocks until connection is achieved.
@@ -117,9 +119,7 @@ loraPoint2Point point2point(RH_RELIABLE_DATAGRAM_ADDR,
                             RFM95_RST,
                             callbacks);
 Adafruit_SSD1306 display = Adafruit_SSD1306(128, 32, &Wire);
-File dataFile;
-String dataFileName = "datalog.csv";
-String dataFileHeader = "Timestamp,Source Address,Destination Address,Message ID,Message Flags,Acknowleged,Message,spreadingFactor,signalBandwidth,frequencyChannel,txPower";
+sdLogger logger("datalog.bin");
 
 //-----------------
 // Local functions
@@ -200,11 +200,9 @@ void setup()
 
   display.print("SD write: ");
   display.display();
-  dataFile = SD.open(dataFileName, FILE_WRITE);
-  if (dataFile)
+  if (logger.begin())
   {
-    dataFile.println(dataFileHeader);
-    Serial.println("Header written to SD card.");
+    Serial.println("Log file opened.");
     display.println("OK");
     display.display();
   }
@@ -214,7 +212,6 @@ void setup()
     display.println("failed");
     display.display();
   }
-  dataFile.close();
 
   display.println("Starting");
   display.display();
@@ -444,8 +441,8 @@ void loop()
     
     if (point2point.buildStringFromSerial(&Serial) || timeUp)
     {
-      point2point.serviceTx(0xEE);
-      timeUp = false;
+      // If a frame is still in flight, try again on the next pass.
+      timeUp = !point2point.serviceTx(0xEE);
     }
     /*
     if ((currentMillis - prevLinkChangeMillis) > 21010)
@@ -482,6 +479,7 @@ void loop()
     */
     point2point.serviceRx(); 
   }
+  logger.service();
 }
 
 //-------------------------------
@@ -493,40 +491,10 @@ void txInd (uint8_t const * txBuf,
             uint8_t const destAddr,
             bool ack)
 {
-  dataFile = SD.open(dataFileName, FILE_WRITE);
-  if (dataFile)
-  {
-    dataFile.print(millis());
-    dataFile.print(",");
-    dataFile.print(RH_RELIABLE_DATAGRAM_ADDR, HEX);
-    dataFile.print(",");
-    dataFile.print(destAddr, HEX);
-    dataFile.print(",");
-    dataFile.print((int)(txBuf[0]));
-    dataFile.print(",");
-    dataFile.print(",");
-    dataFile.print(ack);
-    dataFile.print(",");
-    for (uint8_t i = 1; i < bufLen; i++)
-    {
-      dataFile.print(char(txBuf[i]));
-    }
-    dataFile.print(",");
-    dataFile.print(spreadingFactor);
-    dataFile.print(",");
-    dataFile.print(signalBandwidth);
-    dataFile.print(",");
-    dataFile.print(frequencyChannel);
-    dataFile.print(",");
-    dataFile.print(txPower);
-    dataFile.println();
-    Serial.println("TX data written to SD card.");
-  }
-  else
+  if (!logger.logTx(point2point, RH_RELIABLE_DATAGRAM_ADDR, txBuf, bufLen, destAddr, ack))
   {
     Serial.println("SD card write failed.");
   }
-  dataFile.close();
   display.fillRect(DISPLAY_TX_START, 0, DISPLAY_TX_LEN, DISPLAY_Y, 0);
   display.setCursor(DISPLAY_TX_START, 0);
   display.print("To ");
@@ -559,41 +527,10 @@ void txInd (uint8_t const * txBuf,
 
 void rxInd (message_t const & rxMsg)
 {
-  dataFile = SD.open(dataFileName, FILE_WRITE);
-  if (dataFile)
-  {
-    dataFile.print(millis());
-    dataFile.print(",");
-    dataFile.print(rxMsg.srcAddr, HEX);
-    dataFile.print(",");
-    dataFile.print(rxMsg.destAddr, HEX);
-    dataFile.print(",");
-    dataFile.print(int(rxMsg.buf[0]));
-    dataFile.print(",");
-    dataFile.print(int(rxMsg.flags));
-    dataFile.print(",");
-    dataFile.print('1');
-    dataFile.print(",");
-    for (uint8_t i = 1; i < rxMsg.bufLen; i++)
-    {
-      dataFile.print(char(rxMsg.buf[i]));
-    }
-    dataFile.print(",");
-    dataFile.print(spreadingFactor);
-    dataFile.print(",");
-    dataFile.print(signalBandwidth);
-    dataFile.print(",");
-    dataFile.print(frequencyChannel);
-    dataFile.print(",");
-    dataFile.print(txPower);
-    dataFile.println();
-    Serial.println("RX data written to SD card.");
-  }
-  else
+  if (!logger.logRx(point2point, rxMsg))
   {
     Serial.println("SD card write failed.");
   }
-  dataFile.close();
   display.fillRect(DISPLAY_RX_START, 0, DISPLAY_RX_LEN, DISPLAY_CHAR_Y*3, 0);
   display.setCursor(DISPLAY_RX_START, 0);
   display.print("From ");
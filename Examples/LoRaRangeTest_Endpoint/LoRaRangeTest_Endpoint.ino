@@ -93,6 +93,7 @@ uint32_t currentMillis = 0;
 uint32_t lastAckMillis = 0;
 uint32_t prevLinkChangeMillis = 0;
 bool timeUp = false;
+bool txPending = false;
 uint8_t varToIncrement = 0;
 
 void loop()
@@ -100,9 +101,10 @@ void loop()
   currentMillis = millis();
   
   // Transmit a string!
-  if (point2point.buildStringFromSerial(&Serial))
+  if (point2point.buildStringFromSerial(&Serial) || txPending)
   {
-    point2point.serviceTx(0xBB);
+    // If a frame is still in flight, try again on the next pass.
+    txPending = !point2point.serviceTx(0xBB);
   }
 
   /*  
@@ -32,6 +32,10 @@
 #include <SPI.h>
 #include <RH_RF95.h>
 #include <sensors.h>
+#include <sensorAggregator.h>
+#include <proO.h>
+#include <seapHOx.h>
+#include <deltaCompressor.h>
 #include <loraPoint2PointProtocolLightweight.h>
 
 /**
@@ -190,6 +194,65 @@ bool joinTxComplete = false;
 #endif // DEBUG_ENABLE_DSSS
 sensors_t sendTo = sensor_none;
 
+deltaDecompressor procvDecompressor(dataFieldTable, NUM_dataFields, procvTimestampFields);
+deltaDecompressor seaphoxDecompressor(seapHOxFieldTable, NUM_seapHOxFields, seapHOxTimestampFields);
+
+/**
+ * @brief Prints one record unpacked from an aggregated frame, prefixed by its sensor.
+ * 
+ * @param sensor    The sensor the record came from.
+ * @param record    Pointer to the record.
+ * @param recordLen Length of the record.
+ * @param packed    Whether the record is delta compressed; compressed ProCV and SeapHOx records are printed as the original line.
+ */
+void printSensorRecord (sensors_t const sensor, uint8_t const * record, uint8_t const recordLen, bool const packed)
+{
+  switch (sensor)
+  {
+    case sensor_seapHOx:
+      Serial.print("seaphox: ");
+      break;
+    case sensor_proCV:
+      Serial.print("procv: ");
+      break;
+    default:
+      Serial.print("other: ");
+      break;
+  }
+  if (packed)
+  {
+    static ProCVData procvData;
+    static SeapHOxData seaphoxData;
+    int32_t values [DELTA_COMPRESSOR_MAX_FIELDS];
+    char line [SEAPHOX_READABLE_MAX_LEN];
+    if (sensor == sensor_proCV
+        && procvDecompressor.decompress(record, recordLen, values)
+        && procvData.setFields(values))
+    {
+      procvData.getReadableString(line);
+      Serial.println(line);
+    }
+    else if (sensor == sensor_seapHOx
+             && seaphoxDecompressor.decompress(record, recordLen, values)
+             && seaphoxData.setFields(values))
+    {
+      seaphoxData.getReadableString(line);
+      Serial.println(line);
+    }
+    else
+    {
+      // After a lost frame, samples are dropped until the sensor's next keyframe.
+      Serial.println("(dropped compressed record)");
+    }
+    return;
+  }
+  for (uint8_t i = 0; i < recordLen; i++)
+  {
+    Serial.print(char(record[i]));
+  }
+  Serial.println();
+}
+
 void setup()
 {
   pinMode(SD_CS, OUTPUT);
@@ -363,6 +426,10 @@ void loop() {
         Serial.print(")");
         break;
       #endif // ENABLE_ACK
+      case msgType_aggregatedDataRsp:
+        Serial.println();
+        sensorAggregator<RH_RF95_MAX_MESSAGE_LEN>::unpack(outputBuf, outputBufLen, printSensorRecord);
+        break;
       case msgType_dataRsp:
         #if DEBUG_ENABLE_DSSS
         rf95.advanceFrequencySequence(true, FREQ_CHANGE_INTERVAL_MS);
@@ -2,7 +2,7 @@
 /**
  * @file simpleSensorCommsEchoRadio_Endpoint.ino
  * @author Sophie Bernier (sophie.liz.ber@gmail.com)
- * @brief Radio messages from simpleSensorCommsEchoRadio_Base.ino are echoed to either the seapHOx (on serial port 1 - the default hardware serial) or the CO2 pro-CV (on serial port 2 - using pin 10 as TXD and pin 11 as TXD).
+ * @brief Radio messages from simpleSensorCommsEchoRadio_Base.ino are echoed to either the seapHOx (on serial port 3 - using pin 6 as TXD and pin A5 as RXD) or the CO2 pro-CV (on serial port 2 - using pin 10 as TXD and pin 11 as TXD).
  * @version 0.1
  * @date 2021-06-09
  * 
@@ -14,7 +14,7 @@
  * @subsection Sensor interface
  * The SeapHOx and proCV both have an RS232 serial interface.
  * The RS-232 interfaces operate between -12V (1) and 12V (0), outside the voltage tolerance of the Feather.
- * Therefore, you must connect serial1 and serial2 to the sensors through a level shifter, such as the MAX232 or MAX3232.
+ * Therefore, you must connect serial3 and serial2 to the sensors through a level shifter, such as the MAX232 or MAX3232.
  * To keep up with the radio, you must set the SeapHOx to *4800 baud* and the ProCV to *9600 baud*.
  * Both sensors use 8 data bits, 1 stop bit, and no parity bit.
  * 
@@ -27,7 +27,12 @@
 #include <SPI.h>
 #include <RH_RF95.h>
 #include <sensors.h>
+#include <sensorAggregator.h>
+#include <proO.h>
+#include <seapHOx.h>
+#include <deltaCompressor.h>
 #include <loraPoint2PointProtocolLightweight.h>
+#include <uartRing.h>
 #include "wiring_private.h" // Required for pinPeripheral function.
 
 /**
@@ -136,6 +141,35 @@ Uart Serial2(&sercom1,
              PAD_SERIAL2_RX,
              PAD_SERIAL2_TX);
 
+/**
+ * @brief Pin description number for PIO_SERCOM_ALT RX pin, set here to arduino pin A5 (PB02, SERCOM5 pad 0 on its alternate channel).
+ * 
+ */
+#define PIN_SERIAL3_RX       (19ul)
+
+/**
+ * @brief Pin description number for PIO_SERCOM TX pin, set here to arduino pin 6 (PA20, SERCOM5 pad 2).
+ * 
+ */
+#define PIN_SERIAL3_TX       (6ul)
+
+#define PAD_SERIAL3_TX       (UART_TX_PAD_2)      // Pin 6 is SERCOM pad 2 of this channel.
+#define PAD_SERIAL3_RX       (SERCOM_RX_PAD_0)    // Pin A5 is SERCOM pad 0 of this channel.
+
+/**
+ * @brief Construct Serial3 port, as Serial2 but on SERCOM5, which the Feather M0 leaves free.
+ * 
+ * Serial1's SERCOM0_Handler belongs to the Feather M0 variant, so a sensor on Serial1 could only be read from the core's
+ * buffer in loop(). On its own SERCOM, the SeapHOx is fed into its ring straight from the interrupt, as the ProCV is.
+ * 
+ * @return Uart object referencing the new hardware serial port.
+ */
+Uart Serial3(&sercom5,
+             PIN_SERIAL3_RX,
+             PIN_SERIAL3_TX,
+             PAD_SERIAL3_RX,
+             PAD_SERIAL3_TX);
+
 /**
  * @brief RFM95 SPI chip-select pin.
  * 
@@ -200,6 +234,38 @@ Uart Serial2(&sercom1,
  */
 #define RH_RF95_MAX_MESSAGE_LEN 255
 
+/**
+ * @brief Longest frame the RFM95 driver will actually send: its FIFO less RadioHead's 4 header bytes.
+ * 
+ */
+#define AGGREGATE_FRAME_LEN (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN)
+
+/**
+ * @brief Longest record an aggregate frame holds on its own: the frame less its message type byte and the record's tag and length.
+ * 
+ */
+#define AGGREGATE_MAX_RECORD_LEN (AGGREGATE_FRAME_LEN - 1 - SENSOR_AGGREGATOR_RECORD_OVERHEAD)
+
+/**
+ * @brief Longest a sensor record may wait for more records to share its frame.
+ * 
+ */
+#define AGGREGATE_MAX_AGE_MS 2000
+
+/**
+ * @brief Each sensor sends a full record at least this often; the samples in between are sent as changes.
+ * 
+ */
+#define COMPRESSION_KEYFRAME_INTERVAL 16
+
+/**
+ * @brief Bytes each sensor port's ring holds.
+ * 
+ * Over half a second of the ProCV at 9600 baud, and a second of the SeapHOx at 4800: the loop may be away sending a
+ * full frame at up to SF9, 500kHz without losing sensor data.
+ */
+#define SENSOR_RING_LEN 512
+
 /**
  * @brief SD card chip select pin.
  * 
@@ -228,7 +294,7 @@ Uart Serial2(&sercom1,
  * @brief Assign SeapHOx serial port.
  * 
  */
-#define SEAPHOX_SERIAL Serial1
+#define SEAPHOX_SERIAL Serial3
 
 /**
  * @brief Assign proCV serial port.
@@ -265,22 +331,38 @@ uint32_t inputBufCksum = 0;
 uint32_t ledMillis = 0;
 uint8_t rspBuf[RH_RF95_MAX_MESSAGE_LEN];
 uint8_t rspBufLen = 1;
-bool procvDone = true;
-bool seaphoxDone = true;
 bool ledOn = false;
+sensorAggregator<AGGREGATE_FRAME_LEN> aggregator(msgType_aggregatedDataRsp, AGGREGATE_MAX_AGE_MS);
+ProCVData procvData;
+SeapHOxData seaphoxData;
+deltaCompressor procvCompressor(dataFieldTable, NUM_dataFields, procvTimestampFields, COMPRESSION_KEYFRAME_INTERVAL);
+deltaCompressor seaphoxCompressor(seapHOxFieldTable, NUM_seapHOxFields, seapHOxTimestampFields, COMPRESSION_KEYFRAME_INTERVAL);
+uint8_t compressedBuf [DELTA_COMPRESSOR_MAX_LEN(SEAPHOX_BITFIELD_LEN)];
+static_assert(DELTA_COMPRESSOR_MAX_LEN(PROCV_BITFIELD_LEN) <= sizeof(compressedBuf), "compressedBuf must hold a ProCV record.");
+static_assert(sizeof(compressedBuf) <= AGGREGATE_MAX_RECORD_LEN, "A compressed record must fit an aggregate frame on its own.");
+uartRing<SENSOR_RING_LEN> seaphoxRing;
+uartRing<SENSOR_RING_LEN> procvRing;
+lineFramer<SENSOR_RING_LEN> seaphoxFramer(seaphoxRing, AGGREGATE_MAX_RECORD_LEN);
+lineFramer<SENSOR_RING_LEN> procvFramer(procvRing, AGGREGATE_MAX_RECORD_LEN);
 
 /**
- * @brief forwardUartToRadio
+ * @brief Takes the next whole line a sensor has sent from its ring and queues it to go over the radio.
  * 
  * Control characters:
+ * - Space (' ') and asterisk ('*') are dropped.
+ * 
+ * @param framer      The sensor's line framer.
+ * @param inputBuffer Where the line is put together, from index 1.
+ * @param inputBufIdx Next free index of inputBuffer.
+ * @param sensor      The sensor.
+ */
+void forwardUartToRadio (lineFramer<SENSOR_RING_LEN> & framer, uint8_t * inputBuffer, uint8_t & inputBufIdx, sensors_t sensor);
+
+/**
+ * @brief Sends the aggregated frame and starts a new one.
  * 
- * @param hwSerial 
- * @param inputBuffer 
- * @param inputBufIdx 
- * @param inputBufDone 
- * @param sensor 
  */
-void forwardUartToRadio (Uart & hwSerial, uint8_t * & inputBuffer, uint8_t & inputBufIdx, bool & inputBufDone, sensors_t sensor);
+void flushAggregator ();
 
 /**
  * @brief setup function
@@ -315,6 +397,8 @@ void setup()
   }
   pinPeripheral(PIN_SERIAL2_TX, PIO_SERCOM);
   pinPeripheral(PIN_SERIAL2_RX, PIO_SERCOM);
+  pinPeripheral(PIN_SERIAL3_TX, PIO_SERCOM);
+  pinPeripheral(PIN_SERIAL3_RX, PIO_SERCOM_ALT);
   delay(100);
 
   Serial.println("Feather LoRa Echo Test - Endpoint");
@@ -378,8 +462,12 @@ void loop() {
   #endif // DEBUG_ENABLE_DSSS
   
   // Transmit a string!
-  forwardUartToRadio(SEAPHOX_SERIAL, seaphoxBuf, seaphoxBufIdx, seaphoxDone, sensor_seapHOx);
-  forwardUartToRadio(PROCV_SERIAL, procvBuf, procvBufIdx, procvDone, sensor_proCV);
+  forwardUartToRadio(seaphoxFramer, seaphoxBuf, seaphoxBufIdx, sensor_seapHOx);
+  forwardUartToRadio(procvFramer, procvBuf, procvBufIdx, sensor_proCV);
+  if (aggregator.isDue(millis()))
+  {
+    flushAggregator();
+  }
   /*
   digitalWrite(16, HIGH);
   */
@@ -455,25 +543,28 @@ void loop() {
   */    
 }
 
-void forwardUartToRadio (Uart & hwSerial, uint8_t * inputBuf, uint8_t & inputBufIdx, bool & inputBufDone, sensors_t sensor)
+void forwardUartToRadio (lineFramer<SENSOR_RING_LEN> & framer, uint8_t * inputBuf, uint8_t & inputBufIdx, sensors_t sensor)
 {
-  uint8_t inputChar;
+  uartSlice_t line;
+  bool seaphoxRecord = false;
   /*
   digitalWrite(14, HIGH);
   */
-  if (hwSerial.available())
+  // One line per call; any others wait in the ring for the next loop.
+  if (!framer.nextLine(line))
   {
-    inputBufDone = false;
+    return;
   }
-  while(inputBufDone == false && hwSerial.available())
+  for (uint16_t idx = 0; idx < line.length(); idx++)
   {
-    inputChar = hwSerial.read();
+    uint8_t const inputChar = line[idx];
+    // The SeapHOx parser needs the spaces that are stripped below, so it sees the raw characters.
+    if (sensor == sensor_seapHOx)
+    {
+      seaphoxData.parseChar(char(inputChar));
+    }
     switch (inputChar)
     {
-      case '\n': // terminate and exit
-      case '\r':
-        Serial.print(char(inputChar));
-        inputBufDone = true;
       case ' ': // ignore
       case '*':
         break;
@@ -484,12 +575,17 @@ void forwardUartToRadio (Uart & hwSerial, uint8_t * inputBuf, uint8_t & inputBuf
         inputBufIdx++;
     }
   }
+  // The framer leaves out the line ending, which ends the SeapHOx parser's record.
+  if (sensor == sensor_seapHOx)
+  {
+    seaphoxRecord = seaphoxData.parseChar('\n');
+  }
+  Serial.println();
   /*
   digitalWrite(14, LOW);
   digitalWrite(15, HIGH);
   */
-  if (inputBufIdx > 1 
-      && inputBufDone == true)
+  if (inputBufIdx > 1)
   {
     Serial.print(": TX ");
     if (sensor == sensor_seapHOx)
@@ -520,11 +616,39 @@ void forwardUartToRadio (Uart & hwSerial, uint8_t * inputBuf, uint8_t & inputBuf
     {
       Serial.print(" other");
     }
-    rf95.waitCAD();
-    rf95.send(inputBuf, inputBufIdx);
+    // Records share frames; byte 0 is left out, as the frame carries its own message type.
+    uint8_t const * record = inputBuf + 1;
+    uint8_t recordLen = inputBufIdx - 1;
+    uint8_t compressedLen = 0;
+    // ProCV and SeapHOx data records go over the air delta compressed against the sensor's previous sample, a
+    // fraction of the ASCII length. Anything else the sensors print (prompts, command replies) is forwarded as is.
+    if (sensor == sensor_proCV
+        && procvData.setDataFromString((char const *)record, recordLen))
+    {
+      compressedLen = procvCompressor.compress(procvData.getFields(), compressedBuf);
+    }
+    else if (seaphoxRecord)
+    {
+      compressedLen = seaphoxCompressor.compress(seaphoxData.getFields(), compressedBuf);
+    }
+    bool packed = compressedLen > 0;
+    if (packed)
+    {
+      record = compressedBuf;
+      recordLen = compressedLen;
+      Serial.print(compressedBuf[0] & DELTA_COMPRESSOR_KEYFRAME_FLAG ? " keyframe" : " delta");
+    }
+    if (!aggregator.hasRoomFor(recordLen) && aggregator.getNumRecords() > 0)
+    {
+      flushAggregator();
+    }
+    // The framer caps lines at AGGREGATE_MAX_RECORD_LEN, and compressed records are shorter still, so after the flush above
+    // every record fits.
+    aggregator.addRecord(sensor, record, recordLen, millis(), packed);
+    Serial.print(" queued (");
+    Serial.print(aggregator.getNumRecords());
+    Serial.println(" in frame)");
     inputBufIdx = 1;
-    rf95.waitPacketSent();
-    Serial.println(" sent");
     Serial.print("inputBufCksum = ");
     Serial.println(inputBufCksum);
   }
@@ -533,7 +657,28 @@ void forwardUartToRadio (Uart & hwSerial, uint8_t * inputBuf, uint8_t & inputBuf
   */
 }
 
+void flushAggregator ()
+{
+  Serial.print("TX ");
+  Serial.print(msgTypeNames[msgType_aggregatedDataRsp]);
+  Serial.print(" with ");
+  Serial.print(aggregator.getNumRecords());
+  Serial.print(" records, ");
+  Serial.print(aggregator.getFrameLen());
+  Serial.print(" bytes");
+  // send waits for the previous frame and does its own CAD, then returns as soon as the frame is in the radio's FIFO, so
+  // the loop goes back to the sensors while it is on air.
+  rf95.send(aggregator.getFrame(), aggregator.getFrameLen());
+  aggregator.clear();
+  Serial.println(" queued");
+}
+
 void SERCOM1_Handler() // Interrupt handler for SERCOM1
 {
-  Serial2.IrqHandler();
+  uartRingIrqHandler(Serial2, sercom1, procvRing);
+}
+
+void SERCOM5_Handler() // Interrupt handler for SERCOM5
+{
+  uartRingIrqHandler(Serial3, sercom5, seaphoxRing);
 }
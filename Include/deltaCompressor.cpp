@@ -0,0 +1,243 @@
+/**
+ * @file deltaCompressor.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for deltaCompressor and deltaDecompressor.
+ * @version 0.1
+ * @date 2021-09-14
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <Arduino.h>
+#include <deltaCompressor.h>
+
+//---------
+// Helpers
+//---------
+
+/**
+ * @brief MSB-first bit writer over a fixed buffer. Writing past the end sets overflow instead.
+ *
+ */
+struct bitWriter_t
+{
+  uint8_t * buf;
+  uint16_t capacityBits;
+  uint16_t bitIdx;
+  bool overflow;
+};
+
+/**
+ * @brief MSB-first bit reader over a fixed buffer. Reading past the end sets overflow and returns zeros.
+ *
+ */
+struct bitReader_t
+{
+  uint8_t const * buf;
+  uint16_t capacityBits;
+  uint16_t bitIdx;
+  bool overflow;
+};
+
+static void writeBits (bitWriter_t & writer, uint64_t const value, uint8_t const bits)
+{
+  if (writer.bitIdx + bits > writer.capacityBits)
+  {
+    writer.overflow = true;
+    return;
+  }
+  for (int8_t bit = bits - 1; bit >= 0; bit--, writer.bitIdx++)
+  {
+    if ((value >> bit) & 1)
+    {
+      writer.buf[writer.bitIdx / 8] |= 0x80 >> (writer.bitIdx % 8);
+    }
+  }
+}
+
+static uint64_t readBits (bitReader_t & reader, uint8_t const bits)
+{
+  if (reader.bitIdx + bits > reader.capacityBits)
+  {
+    reader.overflow = true;
+    return 0;
+  }
+  uint64_t value = 0;
+  for (uint8_t bit = 0; bit < bits; bit++, reader.bitIdx++)
+  {
+    value = (value << 1) | ((reader.buf[reader.bitIdx / 8] >> (7 - reader.bitIdx % 8)) & 1);
+  }
+  return value;
+}
+
+/**
+ * @brief Writes a signed value as a zigzag mapped, order-0 exponential-Golomb code: 0 takes 1 bit, +-1 3 bits, +-2..+-3 5 bits...
+ *
+ */
+static void writeSigned (bitWriter_t & writer, int64_t const value)
+{
+  uint64_t zigzag = value < 0 ? (uint64_t(-(value + 1)) << 1) + 1 : uint64_t(value) << 1;
+  uint64_t code = zigzag + 1;
+  uint8_t codeBits = 0;
+  while ((code >> codeBits) > 1)
+  {
+    codeBits++;
+  }
+  writeBits(writer, 0, codeBits); // Length prefix: as many zeros as bits follow the leading 1.
+  writeBits(writer, code, codeBits + 1);
+}
+
+static int64_t readSigned (bitReader_t & reader)
+{
+  uint8_t codeBits = 0;
+  while (readBits(reader, 1) == 0)
+  {
+    if (reader.overflow || ++codeBits > 40)
+    {
+      reader.overflow = true;
+      return 0;
+    }
+  }
+  uint64_t zigzag = ((uint64_t(1) << codeBits) | readBits(reader, codeBits)) - 1;
+  return (zigzag & 1) ? -int64_t(zigzag >> 1) - 1 : int64_t(zigzag >> 1);
+}
+
+/**
+ * @brief Whether a field is one of the timestamp fields, which are sent as the timestamp instead.
+ *
+ */
+static bool isTimestampField (timestampFields_t const & timestamp, uint8_t const field)
+{
+  return field == timestamp.year
+         || field == timestamp.month
+         || field == timestamp.day
+         || field == timestamp.hour
+         || field == timestamp.minute
+         || field == timestamp.second;
+}
+
+//----------------------
+// Function Definitions
+//----------------------
+
+uint8_t deltaCompressor::compress (int32_t const * values,
+                                   uint8_t * buf)
+{
+  uint8_t bitfieldLen = (packedFieldsBits(table, numFields) + 7) / 8;
+  uint32_t seconds = 0;
+  bool timestampValid = getSecondsSince2000(values, timestamp, seconds);
+  int64_t secondsDelta = int64_t(seconds) - int64_t(prevSeconds);
+  uint8_t len = 0;
+  if (!keyframeDue
+      && timestampValid
+      && samplesSinceKeyframe < keyframeInterval)
+  {
+    buf[0] = seq;
+    memset(buf + 1, 0, bitfieldLen);
+    bitWriter_t writer = {buf + 1, uint16_t(bitfieldLen * 8), 0, false};
+    writeSigned(writer, secondsDelta - prevSecondsDelta);
+    for (uint8_t field = 0; field < numFields; field++)
+    {
+      if (!isTimestampField(timestamp, field))
+      {
+        if (!packedFieldFits(table[field], values[field]))
+        {
+          return 0;
+        }
+        writeSigned(writer, int64_t(values[field]) - prev[field]);
+      }
+    }
+    // A delta record that is no shorter than a keyframe is sent as a keyframe.
+    if (!writer.overflow && (writer.bitIdx + 7) / 8 < bitfieldLen)
+    {
+      len = 1 + (writer.bitIdx + 7) / 8;
+      samplesSinceKeyframe++;
+      prevSecondsDelta = secondsDelta;
+    }
+  }
+  if (len == 0)
+  {
+    if (!packFields(table, numFields, values, buf + 1))
+    {
+      return 0;
+    }
+    buf[0] = DELTA_COMPRESSOR_KEYFRAME_FLAG | seq;
+    len = 1 + bitfieldLen;
+    samplesSinceKeyframe = 1;
+    prevSecondsDelta = 0;
+    // Without a timestamp there is nothing to send the next sample's timestamp against.
+    keyframeDue = !timestampValid;
+  }
+  memcpy(prev, values, numFields * sizeof(int32_t));
+  prevSeconds = seconds;
+  seq = (seq + 1) & DELTA_COMPRESSOR_SEQ_MASK;
+  return len;
+}
+
+void deltaCompressor::requestKeyframe ()
+{
+  keyframeDue = true;
+}
+
+bool deltaDecompressor::decompress (uint8_t const * buf,
+                                    uint8_t const len,
+                                    int32_t * values)
+{
+  uint8_t bitfieldLen = (packedFieldsBits(table, numFields) + 7) / 8;
+  int32_t decoded [DELTA_COMPRESSOR_MAX_FIELDS];
+  uint32_t seconds = 0;
+  bool valid;
+  if (len >= 1 && (buf[0] & DELTA_COMPRESSOR_KEYFRAME_FLAG))
+  {
+    valid = len == 1 + bitfieldLen;
+    if (valid)
+    {
+      unpackFields(table, numFields, buf + 1, decoded);
+      // Only a keyframe with a real timestamp can be followed by delta records.
+      synced = getSecondsSince2000(decoded, timestamp, seconds);
+      prevSecondsDelta = 0;
+    }
+  }
+  else
+  {
+    valid = len >= 1
+            && synced
+            && buf[0] == ((prevSeq + 1) & DELTA_COMPRESSOR_SEQ_MASK);
+    if (valid)
+    {
+      bitReader_t reader = {buf + 1, uint16_t((len - 1) * 8), 0, false};
+      int64_t secondsDelta = prevSecondsDelta + readSigned(reader);
+      int64_t newSeconds = int64_t(prevSeconds) + secondsDelta;
+      valid = newSeconds >= 0 && newSeconds <= int64_t(UINT32_MAX);
+      seconds = uint32_t(newSeconds);
+      for (uint8_t field = 0; field < numFields && valid; field++)
+      {
+        if (!isTimestampField(timestamp, field))
+        {
+          int64_t value = prev[field] + readSigned(reader);
+          valid = value >= INT32_MIN && value <= INT32_MAX && packedFieldFits(table[field], int32_t(value));
+          decoded[field] = int32_t(value);
+        }
+      }
+      valid = valid && !reader.overflow;
+      if (valid)
+      {
+        setSecondsSince2000(decoded, timestamp, seconds);
+        prevSecondsDelta = secondsDelta;
+      }
+    }
+    // Anything that follows a lost or damaged record waits for the next keyframe.
+    synced = valid;
+  }
+  if (!valid)
+  {
+    numDropped++;
+    return false;
+  }
+  memcpy(prev, decoded, numFields * sizeof(int32_t));
+  memcpy(values, decoded, numFields * sizeof(int32_t));
+  prevSeconds = seconds;
+  prevSeq = buf[0] & DELTA_COMPRESSOR_SEQ_MASK;
+  return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * @file deltaCompressor.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for deltaCompressor and deltaDecompressor, which send a sensor's samples as changes from the previous sample.
+ * @version 0.1
+ * @date 2021-09-14
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Consecutive samples from the same sensor differ very little, so after a keyframe (the full packed record, see
+ * packFields) each sample is sent as:
+ *
+ * - the change in the sampling interval (the delta of the timestamp delta), which is 0 while sampling regularly, and
+ * - the change of every other field since the previous sample.
+ *
+ * Each of these is zigzag mapped to an unsigned value and written as an order-0 exponential-Golomb code, so an
+ * unchanged field costs a single bit and small changes a handful.
+ *
+ * Every record starts with a header byte: the top bit marks a keyframe and the low 7 bits are a sequence number.
+ * The decompressor drops delta records after a gap in the sequence until the next keyframe, so a lost frame
+ * corrupts nothing; it just costs the samples up to the next keyframe, which the compressor sends every
+ * keyframeInterval samples.
+ *
+ * | Byte | Keyframe                       | Delta                                        |
+ * | :--- | :----------------------------- | :------------------------------------------- |
+ * | 0    | 0x80 + sequence number         | Sequence number                              |
+ * | 1..  | packFields bitfield            | Codes: timestamp, then the other fields      |
+ */
+
+#ifndef DELTA_COMPRESSOR_H
+#define DELTA_COMPRESSOR_H
+
+#include <Arduino.h>
+#include <packedFields.h>
+
+/**
+ * @brief Most fields a record may have.
+ *
+ */
+#define DELTA_COMPRESSOR_MAX_FIELDS 24
+
+/**
+ * @brief Longest compressed record, for a record of the given packed length: a delta record is never longer than a keyframe.
+ *
+ */
+#define DELTA_COMPRESSOR_MAX_LEN(bitfieldLen) (1 + (bitfieldLen))
+
+#define DELTA_COMPRESSOR_KEYFRAME_FLAG 0x80
+#define DELTA_COMPRESSOR_SEQ_MASK      0x7F
+
+/**
+ * @brief Compresses one sensor's samples on the sending end.
+ *
+ */
+class deltaCompressor
+{
+  public:
+    /**
+     * @brief Constructs a new deltaCompressor object.
+     *
+     * @param _table            The record's fields.
+     * @param _numFields        Number of fields, at most DELTA_COMPRESSOR_MAX_FIELDS.
+     * @param _timestamp        Where the record's date and time are.
+     * @param _keyframeInterval Send a keyframe at least every this many samples.
+     */
+    deltaCompressor (packedFieldInfo_t const * _table,
+                     uint8_t const _numFields,
+                     timestampFields_t const & _timestamp,
+                     uint8_t const _keyframeInterval
+                     ):
+                       table{_table},
+                       numFields{_numFields},
+                       timestamp(_timestamp),
+                       keyframeInterval{_keyframeInterval} {}
+
+    /**
+     * @brief Compresses the next sample.
+     *
+     * @param values   The sample's values, one per field.
+     * @param buf      Output, at least DELTA_COMPRESSOR_MAX_LEN bytes.
+     * @return uint8_t Length of the compressed record, or 0 if a value does not fit its field.
+     */
+    uint8_t compress (int32_t const * values,
+                      uint8_t * buf);
+
+    /**
+     * @brief Makes the next sample a keyframe, e.g. after the receiving end has restarted.
+     *
+     */
+    void requestKeyframe ();
+
+  private:
+    packedFieldInfo_t const * table;
+    uint8_t numFields;
+    timestampFields_t timestamp;
+    uint8_t keyframeInterval;
+    int32_t prev [DELTA_COMPRESSOR_MAX_FIELDS];
+    uint32_t prevSeconds = 0;
+    int64_t prevSecondsDelta = 0;
+    uint8_t seq = 0;
+    uint8_t samplesSinceKeyframe = 0;
+    bool keyframeDue = true;
+};
+
+/**
+ * @brief Decompresses one sensor's samples on the receiving end.
+ *
+ */
+class deltaDecompressor
+{
+  public:
+    /**
+     * @brief Constructs a new deltaDecompressor object. The arguments must match the deltaCompressor's.
+     *
+     */
+    deltaDecompressor (packedFieldInfo_t const * _table,
+                       uint8_t const _numFields,
+                       timestampFields_t const & _timestamp
+                       ):
+                         table{_table},
+                         numFields{_numFields},
+                         timestamp(_timestamp) {}
+
+    /**
+     * @brief Decompresses the next received record.
+     *
+     * @param buf    The compressed record.
+     * @param len    Its length.
+     * @param values Output, one value per field.
+     * @return true  Decompressed.
+     * @return false Dropped: malformed, or a delta record that follows a lost record. Wait for the next keyframe.
+     */
+    bool decompress (uint8_t const * buf,
+                     uint8_t const len,
+                     int32_t * values);
+
+    /**
+     * @brief Whether delta records can be decompressed, i.e. no record has been lost since the last keyframe.
+     *
+     */
+    bool isSynced () const
+    {
+      return synced;
+    }
+
+    /**
+     * @brief Number of records dropped so far.
+     *
+     */
+    uint16_t getNumDropped () const
+    {
+      return numDropped;
+    }
+
+  private:
+    packedFieldInfo_t const * table;
+    uint8_t numFields;
+    timestampFields_t timestamp;
+    int32_t prev [DELTA_COMPRESSOR_MAX_FIELDS];
+    uint32_t prevSeconds = 0;
+    int64_t prevSecondsDelta = 0;
+    uint8_t prevSeq = 0;
+    bool synced = false;
+    uint16_t numDropped = 0;
+};
+
+#endif // DELTA_COMPRESSOR_H
@@ -1,4 +1,8 @@
-enum msgType_t
+/**
+ * @brief Requests to a ProCV over its serial port and their responses. Not message types on air: see msgRegistry.h for those.
+ * 
+ */
+enum proCVCommand_t
 {
 proCV_startSamplingReq,
 proCV_startSamplingRsp,
@@ -47,4 +51,4 @@ proCV_scheduleZeroRsp,
 
 proCV_startSingleSampleReq,
 proCV_startSingleSampleRsp
-}
\ No newline at end of file
+};
@@ -0,0 +1,272 @@
+/**
+ * @file packedFields.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the fixed-point and bit packing helpers shared by the sensor record codecs.
+ * @version 0.1
+ * @date 2021-09-13
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <Arduino.h>
+#include <packedFields.h>
+
+//---------
+// Helpers
+//---------
+
+/**
+ * @brief Days since 2000-01-01 of a date in the proleptic Gregorian calendar.
+ *
+ */
+static int32_t daysSince2000 (int32_t year, int32_t const month, int32_t const day)
+{
+  // Count from March so the leap day falls at the end of the year.
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yearOfEra = year - era * 400;
+  int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 730425;
+}
+
+/**
+ * @brief The inverse of daysSince2000, for days >= 0.
+ *
+ */
+static void dateFromDaysSince2000 (int32_t const days, int32_t & year, int32_t & month, int32_t & day)
+{
+  int32_t daysSinceEpoch = days + 730425; // Days since 0000-03-01.
+  int32_t era = daysSinceEpoch / 146097;
+  int32_t dayOfEra = daysSinceEpoch - era * 146097;
+  int32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  int32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  int32_t monthFromMarch = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * monthFromMarch + 2) / 5 + 1;
+  month = monthFromMarch < 10 ? monthFromMarch + 3 : monthFromMarch - 9;
+  year = yearOfEra + era * 400 + (month <= 2);
+}
+
+//----------------------
+// Function Definitions
+//----------------------
+
+bool packedFieldFits (packedFieldInfo_t const & info,
+                      int32_t const value)
+{
+  int32_t stored = value - info.offset;
+  if (info.isSigned)
+  {
+    int32_t limit = int32_t(1) << (info.bits - 1);
+    return stored >= -limit && stored < limit;
+  }
+  return stored >= 0 && stored < (int32_t(1) << info.bits);
+}
+
+bool parseFixedPoint (char const * str,
+                      uint8_t const len,
+                      uint8_t const decimals,
+                      int32_t & value)
+{
+  uint8_t idx = 0;
+  bool negative = false;
+  if (idx < len && (str[idx] == '-' || str[idx] == '+'))
+  {
+    negative = str[idx] == '-';
+    idx++;
+  }
+  int64_t result = 0;
+  uint8_t digits = 0;
+  uint8_t fracDigits = 0;
+  bool fraction = false;
+  bool roundUp = false;
+  for (; idx < len; idx++)
+  {
+    char c = str[idx];
+    if (c == '.' && !fraction)
+    {
+      fraction = true;
+      continue;
+    }
+    if (c < '0' || c > '9')
+    {
+      return false;
+    }
+    digits++;
+    if (fraction && fracDigits >= decimals)
+    {
+      // Only the first extra decimal decides the rounding.
+      if (fracDigits == decimals)
+      {
+        roundUp = c >= '5';
+      }
+      fracDigits++;
+      continue;
+    }
+    result = result * 10 + (c - '0');
+    fracDigits += fraction;
+    if (result > INT32_MAX)
+    {
+      return false;
+    }
+  }
+  if (digits == 0)
+  {
+    return false;
+  }
+  for (; fracDigits < decimals; fracDigits++)
+  {
+    result *= 10;
+  }
+  result += roundUp;
+  if (result > INT32_MAX)
+  {
+    return false;
+  }
+  value = negative ? -int32_t(result) : int32_t(result);
+  return true;
+}
+
+uint8_t formatFixedPoint (char * str,
+                          int32_t const value,
+                          uint8_t const decimals,
+                          uint8_t const minDigits)
+{
+  char digits [12];
+  uint8_t numDigits = 0;
+  uint8_t len = 0;
+  uint32_t magnitude = value < 0 ? uint32_t(-(value + 1)) + 1 : uint32_t(value);
+  if (value < 0)
+  {
+    str[len++] = '-';
+  }
+  do
+  {
+    digits[numDigits++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0);
+  // Enough digits for the fraction and at least minDigits before the point.
+  while (numDigits < decimals + minDigits && numDigits < sizeof(digits))
+  {
+    digits[numDigits++] = '0';
+  }
+  while (numDigits > 0)
+  {
+    if (numDigits == decimals)
+    {
+      str[len++] = '.';
+    }
+    str[len++] = digits[--numDigits];
+  }
+  return len;
+}
+
+uint16_t packedFieldsBits (packedFieldInfo_t const * table,
+                           uint8_t const numFields)
+{
+  uint16_t bits = 0;
+  for (uint8_t field = 0; field < numFields; field++)
+  {
+    bits += table[field].bits;
+  }
+  return bits;
+}
+
+bool packFields (packedFieldInfo_t const * table,
+                 uint8_t const numFields,
+                 int32_t const * values,
+                 uint8_t * buf)
+{
+  for (uint8_t field = 0; field < numFields; field++)
+  {
+    if (!packedFieldFits(table[field], values[field]))
+    {
+      return false;
+    }
+  }
+  memset(buf, 0, (packedFieldsBits(table, numFields) + 7) / 8);
+  uint16_t bitIdx = 0;
+  for (uint8_t field = 0; field < numFields; field++)
+  {
+    uint32_t stored = uint32_t(values[field] - table[field].offset);
+    // Most significant bit first.
+    for (int8_t bit = table[field].bits - 1; bit >= 0; bit--, bitIdx++)
+    {
+      if ((stored >> bit) & 1)
+      {
+        buf[bitIdx / 8] |= 0x80 >> (bitIdx % 8);
+      }
+    }
+  }
+  return true;
+}
+
+void unpackFields (packedFieldInfo_t const * table,
+                   uint8_t const numFields,
+                   uint8_t const * buf,
+                   int32_t * values)
+{
+  uint16_t bitIdx = 0;
+  for (uint8_t field = 0; field < numFields; field++)
+  {
+    packedFieldInfo_t const & info = table[field];
+    uint32_t stored = 0;
+    for (uint8_t bit = 0; bit < info.bits; bit++, bitIdx++)
+    {
+      stored = (stored << 1) | ((buf[bitIdx / 8] >> (7 - bitIdx % 8)) & 1);
+    }
+    int32_t value = int32_t(stored);
+    if (info.isSigned && (stored & (uint32_t(1) << (info.bits - 1))))
+    {
+      value -= int32_t(1) << info.bits; // Sign extend.
+    }
+    values[field] = value + info.offset;
+  }
+}
+
+bool getSecondsSince2000 (int32_t const * values,
+                          timestampFields_t const & timestamp,
+                          uint32_t & seconds)
+{
+  int32_t year = values[timestamp.year];
+  int32_t month = values[timestamp.month];
+  int32_t day = values[timestamp.day];
+  if (year < 2000 || year > 2135
+      || month < 1 || month > 12
+      || day < 1 || day > 31
+      || values[timestamp.hour] < 0 || values[timestamp.hour] > 23
+      || values[timestamp.minute] < 0 || values[timestamp.minute] > 59
+      || values[timestamp.second] < 0 || values[timestamp.second] > 59)
+  {
+    return false;
+  }
+  int32_t days = daysSince2000(year, month, day);
+  // Days past the end of the month roll into the next one, so do not come back the same.
+  int32_t checkYear, checkMonth, checkDay;
+  dateFromDaysSince2000(days, checkYear, checkMonth, checkDay);
+  if (checkDay != day)
+  {
+    return false;
+  }
+  seconds = uint32_t(days) * 86400
+            + uint32_t(values[timestamp.hour]) * 3600
+            + uint32_t(values[timestamp.minute]) * 60
+            + uint32_t(values[timestamp.second]);
+  return true;
+}
+
+void setSecondsSince2000 (int32_t * values,
+                          timestampFields_t const & timestamp,
+                          uint32_t const seconds)
+{
+  uint32_t timeOfDay = seconds % 86400;
+  values[timestamp.hour] = timeOfDay / 3600;
+  values[timestamp.minute] = (timeOfDay / 60) % 60;
+  values[timestamp.second] = timeOfDay % 60;
+  int32_t year, month, day;
+  dateFromDaysSince2000(int32_t(seconds / 86400), year, month, day);
+  values[timestamp.year] = year;
+  values[timestamp.month] = month;
+  values[timestamp.day] = day;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file packedFields.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Fixed-point parsing, formatting and bit packing shared by the sensor record codecs (proO.h, seapHOx.h).
+ * @version 0.1
+ * @date 2021-09-13
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * A sensor record is described by a table of packedFieldInfo_t, one per field. Each field's value is held as an
+ * int32_t in fixed point (e.g. 532.59 with 2 decimals is 53259) and is packed MSB-first into exactly `bits` bits
+ * after subtracting `offset`, so records cost only the bits their ranges need.
+ */
+
+#ifndef PACKED_FIELDS_H
+#define PACKED_FIELDS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief How one field is written on the line and stored in the bitfield.
+ *
+ */
+struct packedFieldInfo_t
+{
+  char const * name;
+  uint8_t bits;      ///< Width in the bitfield.
+  bool isSigned;     ///< Stored in two's complement.
+  uint8_t decimals;  ///< Fixed-point decimals.
+  uint8_t minDigits; ///< Zero padding of the integer part on the line.
+  int32_t offset;    ///< Subtracted before packing, e.g. 2000 for the year.
+};
+
+/**
+ * @brief Where a record keeps its date and time: the index of each field in the record's table.
+ *
+ * The year field holds the full year (e.g. 2021), not the year since the offset.
+ */
+struct timestampFields_t
+{
+  uint8_t year;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+};
+
+/**
+ * @brief Whether a value fits its field's width once the offset is removed.
+ *
+ * @param info   The field.
+ * @param value  The value, in the field's fixed point.
+ * @return true  Fits.
+ * @return false Out of range.
+ */
+bool packedFieldFits (packedFieldInfo_t const & info,
+                      int32_t const value);
+
+/**
+ * @brief Parses one decimal number into fixed point, rounding half up on the first extra decimal.
+ *
+ * @param str      Start of the number: an optional sign, digits and an optional decimal point.
+ * @param len      Length of the number.
+ * @param decimals Fixed-point decimals wanted.
+ * @param value    Output.
+ * @return true    Parsed.
+ * @return false   Empty, malformed or too large for an int32_t.
+ */
+bool parseFixedPoint (char const * str,
+                      uint8_t const len,
+                      uint8_t const decimals,
+                      int32_t & value);
+
+/**
+ * @brief Writes a fixed-point number, zero-padding the integer part to minDigits. Does not null-terminate.
+ *
+ * @param str       Output buffer, at least 12 + minDigits bytes.
+ * @param value     The value.
+ * @param decimals  Fixed-point decimals.
+ * @param minDigits Minimum digits before the decimal point.
+ * @return uint8_t  Number of characters written.
+ */
+uint8_t formatFixedPoint (char * str,
+                          int32_t const value,
+                          uint8_t const decimals,
+                          uint8_t const minDigits);
+
+/**
+ * @brief Total width of a table of fields, in bits.
+ *
+ */
+uint16_t packedFieldsBits (packedFieldInfo_t const * table,
+                           uint8_t const numFields);
+
+/**
+ * @brief Packs values into a bitfield, MSB first, in table order.
+ *
+ * @param table     The fields.
+ * @param numFields Number of fields.
+ * @param values    One value per field.
+ * @param buf       Output, at least (packedFieldsBits + 7) / 8 bytes. Left unchanged on failure.
+ * @return true     Packed.
+ * @return false    A value does not fit its field.
+ */
+bool packFields (packedFieldInfo_t const * table,
+                 uint8_t const numFields,
+                 int32_t const * values,
+                 uint8_t * buf);
+
+/**
+ * @brief Unpacks a bitfield written by packFields.
+ *
+ * @param table     The fields.
+ * @param numFields Number of fields.
+ * @param buf       The bitfield.
+ * @param values    Output, one value per field.
+ */
+void unpackFields (packedFieldInfo_t const * table,
+                   uint8_t const numFields,
+                   uint8_t const * buf,
+                   int32_t * values);
+
+/**
+ * @brief Converts a record's date and time into seconds since 2000-01-01 00:00:00.
+ *
+ * @param values    The record's values.
+ * @param timestamp Where the date and time are in values.
+ * @param seconds   Output.
+ * @return true     Converted.
+ * @return false    Not a real date and time (e.g. month 13 or February 30th), or before 2000.
+ */
+bool getSecondsSince2000 (int32_t const * values,
+                          timestampFields_t const & timestamp,
+                          uint32_t & seconds);
+
+/**
+ * @brief Sets a record's date and time from seconds since 2000-01-01 00:00:00.
+ *
+ * @param values    The record's values.
+ * @param timestamp Where the date and time are in values.
+ * @param seconds   The date and time.
+ */
+void setSecondsSince2000 (int32_t * values,
+                          timestampFields_t const & timestamp,
+                          uint32_t const seconds);
+
+#endif // PACKED_FIELDS_H
@@ -1,10 +1,226 @@
 /**
  * @file proO.cpp
- * @author your name (you@domain.com)
- * @brief There's nothing here.
- * @version 0.1
- * @date 2021-08-12
- * 
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for ProCVData: parsing ProCV data records and packing them into bitfields.
+ * @version 0.2
+ * @date 2021-09-12
+ *
  * @copyright Copyright (c) 2021
- * 
- */
\ No newline at end of file
+ *
+ */
+
+#include <Arduino.h>
+#include <proO.h>
+
+//------------------
+// Field Definitions
+//------------------
+
+packedFieldInfo_t const dataFieldTable [NUM_dataFields] =
+{
+  // name,                 bits, signed, decimals, digits, offset
+  {"Type",                  5,   false,  0,        1,      'A'},
+  {"Type",                  5,   false,  0,        1,      'A'},
+  {"Year",                  7,   false,  0,        4,      2000},
+  {"Month",                 4,   false,  0,        2,      0},
+  {"Day",                   5,   false,  0,        2,      0},
+  {"Hour",                  5,   false,  0,        2,      0},
+  {"Minute",                6,   false,  0,        2,      0},
+  {"Second",                6,   false,  0,        2,      0},
+  {"Zero A/D",              16,  false,  0,        1,      0},
+  {"Current A/D",           16,  false,  0,        1,      0},
+  {"CO2 (ppm)",             20,  false,  2,        1,      0},
+  {"IRGA temp (C)",         14,  true,   2,        1,      0},
+  {"Humidity (mbar)",       14,  false,  2,        1,      0},
+  {"Humidity temp (C)",     14,  true,   2,        1,      0},
+  {"Gas pressure (mbar)",   11,  false,  0,        4,      0},
+  {"Supply voltage (V)",    8,   false,  1,        1,      0}
+};
+
+timestampFields_t const procvTimestampFields =
+{dataField_year, dataField_month, dataField_day, dataField_hour, dataField_minute, dataField_second};
+
+//----------------------
+// Function Definitions
+//----------------------
+
+bool ProCVData::setDataFromString (char const * str)
+{
+  return setDataFromString(str, uint8_t(strnlen(str, 255)));
+}
+
+bool ProCVData::setDataFromString (char const * str,
+                                   uint8_t const len)
+{
+  int32_t parsed [NUM_dataFields];
+  uint8_t field = 0;
+  uint8_t idx = 0;
+  // The record type: two letters, possibly separated by a space.
+  while (idx < len && str[idx] != ',')
+  {
+    if (str[idx] != ' ')
+    {
+      if (field > dataField_typeChar1 || str[idx] < 'A' || str[idx] > 'Z')
+      {
+        return false;
+      }
+      parsed[field++] = str[idx];
+    }
+    idx++;
+  }
+  if (field != dataField_typeChar1 + 1)
+  {
+    return false;
+  }
+  while (idx < len && field < NUM_dataFields)
+  {
+    if (str[idx] != ',')
+    {
+      return false;
+    }
+    idx++;
+    char token [16];
+    uint8_t tokenLen = 0;
+    while (idx < len && str[idx] != ',' && str[idx] != '\r' && str[idx] != '\n')
+    {
+      if (str[idx] != ' ')
+      {
+        if (tokenLen >= sizeof(token))
+        {
+          return false;
+        }
+        token[tokenLen++] = str[idx];
+      }
+      idx++;
+    }
+    if (!parseFixedPoint(token, tokenLen, dataFieldTable[field].decimals, parsed[field])
+        || !packedFieldFits(dataFieldTable[field], parsed[field]))
+    {
+      return false;
+    }
+    field++;
+  }
+  // Only a line ending may follow the last field.
+  while (idx < len && (str[idx] == '\r' || str[idx] == '\n' || str[idx] == ' '))
+  {
+    idx++;
+  }
+  if (field != NUM_dataFields || idx != len)
+  {
+    return false;
+  }
+  memcpy(fields, parsed, sizeof(fields));
+  return true;
+}
+
+uint8_t ProCVData::getReadableString (char * str) const
+{
+  uint8_t len = 0;
+  str[len++] = char(fields[dataField_typeChar0]);
+  str[len++] = ' ';
+  str[len++] = char(fields[dataField_typeChar1]);
+  for (uint8_t field = dataField_year; field < NUM_dataFields; field++)
+  {
+    str[len++] = ',';
+    len += formatFixedPoint(str + len,
+                            fields[field],
+                            dataFieldTable[field].decimals,
+                            dataFieldTable[field].minDigits);
+  }
+  str[len] = 0;
+  return len;
+}
+
+int32_t ProCVData::getField (dataField_t const field) const
+{
+  return field < NUM_dataFields ? fields[field] : 0;
+}
+
+int32_t const * ProCVData::getFields () const
+{
+  return fields;
+}
+
+bool ProCVData::setFields (int32_t const * values)
+{
+  for (uint8_t field = 0; field < NUM_dataFields; field++)
+  {
+    if (!packedFieldFits(dataFieldTable[field], values[field]))
+    {
+      return false;
+    }
+  }
+  if (values[dataField_typeChar0] > 'Z' || values[dataField_typeChar1] > 'Z')
+  {
+    return false;
+  }
+  memcpy(fields, values, sizeof(fields));
+  return true;
+}
+
+void ProCVData::printAllData (Print & port) const
+{
+  char value [16];
+  for (uint8_t field = 0; field < NUM_dataFields; field++)
+  {
+    port.print(dataFieldTable[field].name);
+    port.print(": ");
+    if (field <= dataField_typeChar1)
+    {
+      port.println(char(fields[field]));
+      continue;
+    }
+    value[formatFixedPoint(value,
+                           fields[field],
+                           dataFieldTable[field].decimals,
+                           dataFieldTable[field].minDigits)] = 0;
+    port.println(value);
+  }
+}
+
+bool ProCVData::convertReadableToBitfield ()
+{
+  return packFields(dataFieldTable, NUM_dataFields, fields, bitfield);
+}
+
+void ProCVData::printAllBitfieldData (Print & port) const
+{
+  port.print("0x");
+  for (uint8_t i = 0; i < PROCV_BITFIELD_LEN; i++)
+  {
+    if (bitfield[i] < 0x10)
+    {
+      port.print('0');
+    }
+    port.print(bitfield[i], HEX);
+  }
+  port.println();
+}
+
+bool ProCVData::convertBitfieldToReadable ()
+{
+  int32_t unpacked [NUM_dataFields];
+  unpackFields(dataFieldTable, NUM_dataFields, bitfield, unpacked);
+  if (unpacked[dataField_typeChar0] > 'Z' || unpacked[dataField_typeChar1] > 'Z')
+  {
+    return false;
+  }
+  memcpy(fields, unpacked, sizeof(fields));
+  return true;
+}
+
+uint8_t const * ProCVData::getBitfield () const
+{
+  return bitfield;
+}
+
+bool ProCVData::setBitfield (uint8_t const * buf,
+                             uint8_t const len)
+{
+  if (len != PROCV_BITFIELD_LEN)
+  {
+    return false;
+  }
+  memcpy(bitfield, buf, PROCV_BITFIELD_LEN);
+  return true;
+}
@@ -1,14 +1,30 @@
 /**
  * @file proO.h
  * @author Sophie Bernier (sophie.liz.ber@gmail.com)
- * @brief Library to handle communication with the Pro-Oceanus CO2 Pro CV sensor. Currently unimplemented. Finishing implementation would mean locally implementing the proCV interface, resulting in a drastically lowered radio use.
- * @version 0.1
- * @date 2021-05-21
- * 
+ * @brief Library to handle communication with the Pro-Oceanus CO2 Pro CV sensor. Currently only parses and packs data records; the command interface is unimplemented.
+ * @version 0.2
+ * @date 2021-09-12
+ *
  * @copyright Copyright (c) 2021
- * 
+ *
+ * A ProCV data record is one ASCII line, for example:
+ *
+ * `W M,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1`
+ *
+ * which is the record type, the date and time, the zero and current A/D counts, CO2 in ppm, the average IRGA
+ * temperature in degrees C, humidity in mbar, the humidity sensor temperature in degrees C, the gas stream pressure
+ * in mbar and the supply voltage. ProCVData parses such a line into fixed-point fields and packs those into a
+ * PROCV_BITFIELD_LEN byte bitfield for the radio, about a third of the length of the ASCII line.
+ *
+ * @todo Implement the ProCV command interface (sampling modes, logged data, clock, baud rate...).
  */
 
+#ifndef PRO_O_H
+#define PRO_O_H
+
+#include <Arduino.h>
+#include <packedFields.h>
+
 enum sampleMode_t
 {
   sampleMode_continuous,
@@ -16,8 +32,15 @@ enum sampleMode_t
   sampleMode_command
 };
 
+/**
+ * @brief Fields of a ProCV data record, in the order they appear on the line and in the bitfield.
+ *
+ * Fractional quantities are kept in fixed point; see dataFieldTable for the number of decimals of each.
+ */
 enum dataField_t
 {
+  dataField_typeChar0,           ///< 'W' in "W M".
+  dataField_typeChar1,           ///< 'M' in "W M".
   dataField_year,
   dataField_month,
   dataField_day,
@@ -26,76 +49,140 @@ enum dataField_t
   dataField_second,
   dataField_zeroAD,
   dataField_currentAD,
-  dataField_CO2_int,
-  dataField_CO2_frac,
-  dataField_AvgIrgaTemp_int,
-  dataField_AvgIrgaTemp_frac,
-  dataField_Humidity_int,
-  dataField_Humidity_frac,
+  dataField_CO2,                 ///< ppm, 2 decimals.
+  dataField_AvgIrgaTemp,         ///< Degrees C, 2 decimals.
+  dataField_Humidity,            ///< mbar, 2 decimals.
+  dataField_HumiditySensorTemp,  ///< Degrees C, 2 decimals.
+  dataField_GasPressure,         ///< mbar.
+  dataField_SupplyVoltage,       ///< V, 1 decimal.
+  NUM_dataFields
 };
 
-#define DATA_FIELD_YEAR_BITS
+extern packedFieldInfo_t const dataFieldTable [NUM_dataFields];
 
-class ProCVData
-{
-  private:
-   uint8_t* dataBuffer;
-   uint8_t dataBufferIdx;
-   uint8_t addToBuffer (uint8_t);
-};
+/**
+ * @brief Where the date and time are in a record, for deltaCompressor.
+ *
+ */
+extern timestampFields_t const procvTimestampFields;
 
-/* addToBuffer pseudocode
-uint8_t addToBuffer (uint8_t *incomingChar)
-{
-  
-  
-  incomingDigit = incomingChar - 0x30;
-  dataField += incomingDigit*10^i;
-  return success
-}
-*/
-
-class ProCV
+/**
+ * @brief Total width of the bitfield in bits, the sum of dataFieldTable's widths.
+ *
+ */
+#define PROCV_BITFIELD_BITS 156
+#define PROCV_BITFIELD_LEN  ((PROCV_BITFIELD_BITS + 7) / 8)
+
+/**
+ * @brief Longest line produced by getReadableString, including the terminating null.
+ *
+ */
+#define PROCV_READABLE_MAX_LEN 96
+
+/**
+ * @brief One ProCV data record, either as parsed fields (readable) or packed (bitfield).
+ *
+ */
+class ProCVData
 {
-  private:
-    Serial DevSerial;
-    ProCVData Data;
-  protected:
   public:
-    ProCV (Serial);
-    uint8_t startSensor ();
-    uint8_t startSampling ();
-    uint8_t readData ();
-};
+    /**
+     * @brief Parses a data record line into the readable fields. Spaces are ignored, trailing CR/LF are allowed.
+     *
+     * @param str    Null-terminated line.
+     * @return true  Parsed.
+     * @return false Not a data record, or a field is malformed. The fields are left unchanged.
+     */
+    bool setDataFromString (char const * str);
+
+    /**
+     * @brief Parses a data record line that is not null-terminated.
+     *
+     * @param str    Pointer to the line.
+     * @param len    Length of the line.
+     * @overload
+     */
+    bool setDataFromString (char const * str,
+                            uint8_t const len);
+
+    /**
+     * @brief Writes the readable fields back out as a data record line, without line ending.
+     *
+     * @param str      Output buffer, at least PROCV_READABLE_MAX_LEN bytes.
+     * @return uint8_t Length of the line, excluding the terminating null.
+     */
+    uint8_t getReadableString (char * str) const;
+
+    /**
+     * @brief Get one readable field, in the fixed point described by dataFieldTable.
+     *
+     * @param field    The field.
+     * @return int32_t Its value.
+     */
+    int32_t getField (dataField_t const field) const;
 
+    /**
+     * @brief Get all the readable fields, e.g. to compress them.
+     *
+     * @return int32_t const* One value per field, in the order of dataFieldTable.
+     */
+    int32_t const * getFields () const;
 
+    /**
+     * @brief Sets all the readable fields, e.g. from a decompressed record.
+     *
+     * @param values One value per field.
+     * @return true  Set.
+     * @return false A value does not fit its field. The fields are left unchanged.
+     */
+    bool setFields (int32_t const * values);
 
-uint8_t ProCV::startSampling ();
-uint8_t ProCV::stopSampling ();
-
-uint8_t ProCV::setSampleModeContinuous (uint16_t samplesToSkip,
-                                        bool     clearZeroCount,
-                                        uint8_t  zeroIntervalHours);
-uint8_t ProCV::setSampleModeTimed (uint16_t sampleIntervalMins,
-                                   uint8_t  readingsPerSample,
-                                   uint8_t  firstSampleHour,
-                                   uint8_t  firstSampleMin,
-                                   uint8_t  firstSampleSec,
-                                   bool     logAverage,
-                                   bool     clearZeroCount,
-                                   uint8_t  zeroIntervalHours);
-uint8_t ProCV::setSampleModeCommand (uint8_t  readingsPerSample,
-                                     bool     logAverage,
-                                     bool     clearZeroCount,
-                                     uint8_t  zeroIntervalHours);
-uint8_t ProCV::viewLoggedData ();
-uint8_t ProCV::setLoggedDataLineCallback ();
-uint8_t ProCV::setLoggedDataSubstrCallback ();
-uint8_t ProCV::eraseLoggedData ();
-uint8_t ProCV::getStatus ();
-uint8_t ProCV::setClockTime ();
-uint8_t ProCV::setBaudRate ();
-uint8_t ProCV::restoreFactoryDefault ();
-uint8_t ProCV::scheduleZero ();
-uint8_t ProCV::startSingleSample ();
+    /**
+     * @brief Prints every readable field with its name, one per line.
+     *
+     * @param port Where to print.
+     */
+    void printAllData (Print & port) const;
+
+    /**
+     * @brief Packs the readable fields into the bitfield.
+     *
+     * @return true  Packed.
+     * @return false A field does not fit its width. The bitfield is left unchanged.
+     */
+    bool convertReadableToBitfield ();
+
+    /**
+     * @brief Prints the bitfield in hexadecimal.
+     *
+     * @param port Where to print.
+     */
+    void printAllBitfieldData (Print & port) const;
+
+    /**
+     * @brief Unpacks the bitfield into the readable fields.
+     *
+     * @return true  Unpacked.
+     * @return false The record type characters are invalid, i.e. this is not a packed ProCV record. The fields are left unchanged.
+     */
+    bool convertBitfieldToReadable ();
+
+    uint8_t const * getBitfield () const;
+
+    /**
+     * @brief Copies a received bitfield in. Call convertBitfieldToReadable afterwards.
+     *
+     * @param buf    Pointer to the packed record.
+     * @param len    Its length, which must be PROCV_BITFIELD_LEN.
+     * @return true  Copied.
+     * @return false Wrong length.
+     */
+    bool setBitfield (uint8_t const * buf,
+                      uint8_t const len);
+
+  private:
+    int32_t fields [NUM_dataFields] = {0};
+    uint8_t bitfield [PROCV_BITFIELD_LEN] = {0};
+};
 
+#endif // PRO_O_H
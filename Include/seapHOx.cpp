@@ -0,0 +1,300 @@
+/**
+ * @file seapHOx.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for SeapHOxData: parsing SeapHOx data records and packing them into bitfields.
+ * @version 0.1
+ * @date 2021-09-13
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <Arduino.h>
+#include <seapHOx.h>
+
+//------------------
+// Field Definitions
+//------------------
+
+packedFieldInfo_t const seapHOxFieldTable [NUM_seapHOxFields] =
+{
+  // name,                    bits, signed, decimals, digits, offset
+  {"Serial number",            17,  false,  0,        5,      0},
+  {"Month",                    4,   false,  0,        2,      0},
+  {"Day",                      5,   false,  0,        2,      0},
+  {"Year",                     7,   false,  0,        4,      2000},
+  {"Hour",                     5,   false,  0,        2,      0},
+  {"Minute",                   6,   false,  0,        2,      0},
+  {"Second",                   6,   false,  0,        2,      0},
+  {"Sample number",            24,  false,  0,        1,      0},
+  {"Error flags",              16,  false,  0,        4,      0},
+  {"Temperature (C)",          20,  true,   4,        1,      0},
+  {"External pH",              18,  false,  4,        1,      0},
+  {"Internal pH",              18,  false,  4,        1,      0},
+  {"External pH (V)",          23,  true,   6,        1,      0},
+  {"Internal pH (V)",          23,  true,   6,        1,      0},
+  {"pH temperature (C)",       20,  true,   4,        1,      0},
+  {"Pressure (dbar)",          20,  false,  3,        1,      0},
+  {"Salinity (psu)",           19,  false,  4,        1,      0},
+  {"Conductivity (S/m)",       20,  false,  5,        1,      0},
+  {"Oxygen (ml/L)",            15,  false,  3,        1,      0},
+  {"Relative humidity (%)",    10,  false,  1,        1,      0},
+  {"Internal temperature (C)", 10,  true,   1,        1,      0}
+};
+
+timestampFields_t const seapHOxTimestampFields =
+{seapHOxField_year, seapHOxField_month, seapHOxField_day, seapHOxField_hour, seapHOxField_minute, seapHOxField_second};
+
+/**
+ * @brief The character that ends each field on the line. The last field is ended by the line ending.
+ *
+ */
+static char const fieldSeparators [NUM_seapHOxFields] =
+{
+  ',', '/', '/', ' ', ':', ':', ',', ',', ',', ',', ',', ',', ',', ',', ',', ',', ',', ',', ',', ',', '\n'
+};
+
+static char const frameSync [] = "DSPHOX";
+#define FRAME_SYNC_LEN (sizeof(frameSync) - 1)
+
+/**
+ * @brief Parses up to 4 hexadecimal digits.
+ *
+ */
+static bool parseHex (char const * str, uint8_t const len, int32_t & value)
+{
+  if (len == 0 || len > 4)
+  {
+    return false;
+  }
+  value = 0;
+  for (uint8_t i = 0; i < len; i++)
+  {
+    char c = str[i];
+    uint8_t digit;
+    if (c >= '0' && c <= '9')
+    {
+      digit = c - '0';
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+      digit = c - 'A' + 10;
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      digit = c - 'a' + 10;
+    }
+    else
+    {
+      return false;
+    }
+    value = (value << 4) | digit;
+  }
+  return true;
+}
+
+/**
+ * @brief Writes one field as it appears on the line.
+ *
+ * @return uint8_t Number of characters written.
+ */
+static uint8_t formatField (char * str, seapHOxField_t const field, int32_t const value)
+{
+  uint8_t len = 0;
+  if (field == seapHOxField_serialNumber)
+  {
+    memcpy(str, frameSync, FRAME_SYNC_LEN);
+    len = FRAME_SYNC_LEN;
+  }
+  else if (field == seapHOxField_errorFlags)
+  {
+    for (int8_t shift = 12; shift >= 0; shift -= 4)
+    {
+      str[len++] = "0123456789ABCDEF"[(value >> shift) & 0xF];
+    }
+    return len;
+  }
+  return len + formatFixedPoint(str + len,
+                                value,
+                                seapHOxFieldTable[field].decimals,
+                                seapHOxFieldTable[field].minDigits);
+}
+
+//----------------------
+// Function Definitions
+//----------------------
+
+bool SeapHOxData::parseChar (char const c)
+{
+  if (c == '\r' || c == '\n')
+  {
+    bool complete = !parseError
+                    && parseField == NUM_seapHOxFields - 1
+                    && endField();
+    if (complete)
+    {
+      memcpy(fields, parsed, sizeof(fields));
+    }
+    resetParser();
+    return complete;
+  }
+  if (parseError)
+  {
+    return false; // Skip the rest of the line.
+  }
+  if (c == fieldSeparators[parseField]
+      && (c != ' ' || tokenLen > 0))
+  {
+    if (!endField())
+    {
+      parseError = true;
+      return false;
+    }
+    parseField++;
+    tokenLen = 0;
+    return false;
+  }
+  if (c == ' ')
+  {
+    return false; // Padding.
+  }
+  if (tokenLen >= sizeof(token))
+  {
+    parseError = true;
+    return false;
+  }
+  token[tokenLen++] = c;
+  return false;
+}
+
+void SeapHOxData::resetParser ()
+{
+  tokenLen = 0;
+  parseField = 0;
+  parseError = false;
+}
+
+bool SeapHOxData::endField ()
+{
+  packedFieldInfo_t const & info = seapHOxFieldTable[parseField];
+  int32_t & value = parsed[parseField];
+  bool valid;
+  if (parseField == seapHOxField_serialNumber)
+  {
+    valid = tokenLen > FRAME_SYNC_LEN
+            && memcmp(token, frameSync, FRAME_SYNC_LEN) == 0
+            && token[FRAME_SYNC_LEN] >= '0' && token[FRAME_SYNC_LEN] <= '9'
+            && parseFixedPoint(token + FRAME_SYNC_LEN, tokenLen - FRAME_SYNC_LEN, 0, value);
+  }
+  else if (parseField == seapHOxField_errorFlags)
+  {
+    valid = parseHex(token, tokenLen, value);
+  }
+  else
+  {
+    valid = parseFixedPoint(token, tokenLen, info.decimals, value);
+  }
+  return valid && packedFieldFits(info, value);
+}
+
+bool SeapHOxData::setDataFromString (char const * str,
+                                     uint8_t const len)
+{
+  resetParser();
+  for (uint8_t idx = 0; idx < len && str[idx] != '\r' && str[idx] != '\n'; idx++)
+  {
+    parseChar(str[idx]);
+  }
+  return parseChar('\n');
+}
+
+uint8_t SeapHOxData::getReadableString (char * str) const
+{
+  uint8_t len = 0;
+  for (uint8_t field = 0; field < NUM_seapHOxFields; field++)
+  {
+    len += formatField(str + len, seapHOxField_t(field), fields[field]);
+    if (field < NUM_seapHOxFields - 1)
+    {
+      str[len++] = fieldSeparators[field];
+      if (fieldSeparators[field] == ',')
+      {
+        str[len++] = ' ';
+      }
+    }
+  }
+  str[len] = 0;
+  return len;
+}
+
+int32_t SeapHOxData::getField (seapHOxField_t const field) const
+{
+  return field < NUM_seapHOxFields ? fields[field] : 0;
+}
+
+int32_t const * SeapHOxData::getFields () const
+{
+  return fields;
+}
+
+bool SeapHOxData::setFields (int32_t const * values)
+{
+  for (uint8_t field = 0; field < NUM_seapHOxFields; field++)
+  {
+    if (!packedFieldFits(seapHOxFieldTable[field], values[field]))
+    {
+      return false;
+    }
+  }
+  memcpy(fields, values, sizeof(fields));
+  return true;
+}
+
+void SeapHOxData::printAllData (Print & port) const
+{
+  char value [24];
+  for (uint8_t field = 0; field < NUM_seapHOxFields; field++)
+  {
+    port.print(seapHOxFieldTable[field].name);
+    port.print(": ");
+    value[formatField(value, seapHOxField_t(field), fields[field])] = 0;
+    port.println(value);
+  }
+}
+
+bool SeapHOxData::convertReadableToBitfield ()
+{
+  return packFields(seapHOxFieldTable, NUM_seapHOxFields, fields, bitfield);
+}
+
+bool SeapHOxData::convertBitfieldToReadable ()
+{
+  int32_t unpacked [NUM_seapHOxFields];
+  unpackFields(seapHOxFieldTable, NUM_seapHOxFields, bitfield, unpacked);
+  if (unpacked[seapHOxField_month] < 1 || unpacked[seapHOxField_month] > 12
+      || unpacked[seapHOxField_day] < 1
+      || unpacked[seapHOxField_hour] > 23
+      || unpacked[seapHOxField_minute] > 59
+      || unpacked[seapHOxField_second] > 59)
+  {
+    return false;
+  }
+  memcpy(fields, unpacked, sizeof(fields));
+  return true;
+}
+
+uint8_t const * SeapHOxData::getBitfield () const
+{
+  return bitfield;
+}
+
+bool SeapHOxData::setBitfield (uint8_t const * buf,
+                               uint8_t const len)
+{
+  if (len != SEAPHOX_BITFIELD_LEN)
+  {
+    return false;
+  }
+  memcpy(bitfield, buf, SEAPHOX_BITFIELD_LEN);
+  return true;
+}
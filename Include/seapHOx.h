@@ -0,0 +1,204 @@
+/**
+ * @file seapHOx.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Library to handle data records from the Sea-Bird SeapHOx V2 pH/O2 sensor. Parses records as they stream in and packs them for the radio.
+ * @version 0.1
+ * @date 2021-09-13
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * A SeapHOx data record is one ASCII line, for example:
+ *
+ * `DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6`
+ *
+ * which is the frame sync and serial number, the date and time, the sample number, the error flags (hexadecimal),
+ * the temperature in degrees C, the external and internal pH, the external and internal pH reference voltages, the
+ * pH sensor temperature in degrees C, the pressure in dbar, the salinity in psu, the conductivity in S/m, the
+ * dissolved oxygen in ml/L, the relative humidity in % and the internal temperature in degrees C.
+ *
+ * SeapHOxData parses such a line one character at a time, as it comes off the UART, into fixed-point fields, and
+ * packs those into a SEAPHOX_BITFIELD_LEN byte bitfield for the radio, about a third of the length of the line.
+ */
+
+#ifndef SEAPHOX_H
+#define SEAPHOX_H
+
+#include <Arduino.h>
+#include <packedFields.h>
+
+/**
+ * @brief Fields of a SeapHOx data record, in the order they appear on the line and in the bitfield.
+ *
+ * Fractional quantities are kept in fixed point; see seapHOxFieldTable for the number of decimals of each.
+ */
+enum seapHOxField_t
+{
+  seapHOxField_serialNumber,        ///< 23005 in "DSPHOX23005".
+  seapHOxField_month,
+  seapHOxField_day,
+  seapHOxField_year,
+  seapHOxField_hour,
+  seapHOxField_minute,
+  seapHOxField_second,
+  seapHOxField_sampleNumber,
+  seapHOxField_errorFlags,          ///< Hexadecimal on the line.
+  seapHOxField_temperature,         ///< Degrees C, 4 decimals.
+  seapHOxField_externalPH,          ///< 4 decimals.
+  seapHOxField_internalPH,          ///< 4 decimals.
+  seapHOxField_externalPHVolts,     ///< V, 6 decimals.
+  seapHOxField_internalPHVolts,     ///< V, 6 decimals.
+  seapHOxField_pHTemperature,       ///< Degrees C, 4 decimals.
+  seapHOxField_pressure,            ///< dbar, 3 decimals.
+  seapHOxField_salinity,            ///< psu, 4 decimals.
+  seapHOxField_conductivity,        ///< S/m, 5 decimals.
+  seapHOxField_oxygen,              ///< ml/L, 3 decimals.
+  seapHOxField_relativeHumidity,    ///< %, 1 decimal.
+  seapHOxField_internalTemperature, ///< Degrees C, 1 decimal.
+  NUM_seapHOxFields
+};
+
+extern packedFieldInfo_t const seapHOxFieldTable [NUM_seapHOxFields];
+
+/**
+ * @brief Where the date and time are in a record, for deltaCompressor.
+ *
+ */
+extern timestampFields_t const seapHOxTimestampFields;
+
+/**
+ * @brief Total width of the bitfield in bits, the sum of seapHOxFieldTable's widths.
+ *
+ */
+#define SEAPHOX_BITFIELD_BITS 306
+#define SEAPHOX_BITFIELD_LEN  ((SEAPHOX_BITFIELD_BITS + 7) / 8)
+
+/**
+ * @brief Longest line produced by getReadableString, including the terminating null.
+ *
+ */
+#define SEAPHOX_READABLE_MAX_LEN 160
+
+/**
+ * @brief One SeapHOx data record, either as parsed fields (readable) or packed (bitfield).
+ *
+ */
+class SeapHOxData
+{
+  public:
+    /**
+     * @brief Feeds one character from the sensor to the line parser.
+     *
+     * Lines that are not data records (prompts, command replies, lines cut short) are dropped at their line ending.
+     *
+     * @param c      The character.
+     * @return true  c ended a valid data record, which is now in the readable fields.
+     * @return false Otherwise. The readable fields are unchanged.
+     */
+    bool parseChar (char const c);
+
+    /**
+     * @brief Discards a partly parsed line, e.g. after switching the sensor's output on.
+     *
+     */
+    void resetParser ();
+
+    /**
+     * @brief Parses a whole data record line into the readable fields. A missing line ending is fine.
+     *
+     * @param str    Pointer to the line.
+     * @param len    Length of the line.
+     * @return true  Parsed.
+     * @return false Not a data record. The fields are left unchanged.
+     */
+    bool setDataFromString (char const * str,
+                            uint8_t const len);
+
+    /**
+     * @brief Writes the readable fields back out as a data record line, without line ending.
+     *
+     * @param str      Output buffer, at least SEAPHOX_READABLE_MAX_LEN bytes.
+     * @return uint8_t Length of the line, excluding the terminating null.
+     */
+    uint8_t getReadableString (char * str) const;
+
+    /**
+     * @brief Get one readable field, in the fixed point described by seapHOxFieldTable.
+     *
+     * @param field    The field.
+     * @return int32_t Its value.
+     */
+    int32_t getField (seapHOxField_t const field) const;
+
+    /**
+     * @brief Get all the readable fields, e.g. to compress them.
+     *
+     * @return int32_t const* One value per field, in the order of seapHOxFieldTable.
+     */
+    int32_t const * getFields () const;
+
+    /**
+     * @brief Sets all the readable fields, e.g. from a decompressed record.
+     *
+     * @param values One value per field.
+     * @return true  Set.
+     * @return false A value does not fit its field. The fields are left unchanged.
+     */
+    bool setFields (int32_t const * values);
+
+    /**
+     * @brief Prints every readable field with its name, one per line.
+     *
+     * @param port Where to print.
+     */
+    void printAllData (Print & port) const;
+
+    /**
+     * @brief Packs the readable fields into the bitfield.
+     *
+     * @return true  Packed.
+     * @return false A field does not fit its width. The bitfield is left unchanged.
+     */
+    bool convertReadableToBitfield ();
+
+    /**
+     * @brief Unpacks the bitfield into the readable fields.
+     *
+     * @return true  Unpacked.
+     * @return false The date or time is impossible, i.e. this is not a packed SeapHOx record. The fields are left unchanged.
+     */
+    bool convertBitfieldToReadable ();
+
+    uint8_t const * getBitfield () const;
+
+    /**
+     * @brief Copies a received bitfield in. Call convertBitfieldToReadable afterwards.
+     *
+     * @param buf    Pointer to the packed record.
+     * @param len    Its length, which must be SEAPHOX_BITFIELD_LEN.
+     * @return true  Copied.
+     * @return false Wrong length.
+     */
+    bool setBitfield (uint8_t const * buf,
+                      uint8_t const len);
+
+  private:
+    /**
+     * @brief Parses the token of the field being parsed into parsed[].
+     *
+     * @return true  Valid and in range.
+     * @return false Otherwise.
+     */
+    bool endField ();
+
+    int32_t fields [NUM_seapHOxFields] = {0};
+    uint8_t bitfield [SEAPHOX_BITFIELD_LEN] = {0};
+
+    // Line parser state.
+    int32_t parsed [NUM_seapHOxFields] = {0};
+    char token [16];
+    uint8_t tokenLen = 0;
+    uint8_t parseField = 0;
+    bool parseError = false;
+};
+
+#endif // SEAPHOX_H
@@ -0,0 +1,208 @@
+/**
+ * @file bench_linkSweep.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Benchmarks an endpoint sending records to a base on the simulated channel, for every spreading factor and bandwidth.
+ * @version 0.1
+ * @date 2021-09-17
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * For every SF7-SF12 x 125/250/500kHz combination, a fresh base and endpoint are set up on the same channel
+ * conditions and random seed, and the endpoint sends BENCH_RECORDS records of BENCH_RECORD_LEN bytes to the base,
+ * queueing the next as soon as the transmitter is free (the transmitter is stop-and-wait, so queueing deeper only
+ * adds latency). Reported per combination:
+ *
+ * - Records delivered per second.
+ * - Airtime efficiency: airtime of the delivered records' first transmissions over all airtime used on the channel.
+ * - P50 and P99 latency from queueing a record to the base receiving it.
+ * - Retries per record, from the endpoint's link statistics.
+ *
+ * Everything runs in virtual time with fixed seeds, so the numbers only change when the code does.
+ *
+ * Usage: bench_linkSweep [seed]
+ */
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+
+#define BENCH_SEED 1
+#define BENCH_RECORDS 200
+#define BENCH_RECORD_LEN 20 // A packed ProCV record.
+#define BENCH_MAX_SECONDS 3600
+#define BENCH_PATH_LOSS_dB 120
+#define BENCH_FADING_dB 3
+#define BENCH_LOSS_PROBABILITY 0.05
+#define BENCH_TX_POWER_dBm 14
+
+/**
+ * @brief Results of one combination.
+ *
+ */
+struct benchResult_t
+{
+  uint32_t delivered;
+  double seconds;
+  double recordsPerSecond;
+  double airtimeEfficiency;
+  double p50Millis;
+  double p99Millis;
+  double retriesPerRecord;
+};
+
+//-----------
+// Callbacks
+//-----------
+
+static std::map<uint32_t, uint64_t> queuedMicros;
+static std::vector<double> latencyMillis;
+static uint64_t lastDeliveredMicros = 0;
+
+void baseRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] != msgType_dataRsp || rxMsg.bufLen != BENCH_RECORD_LEN)
+  {
+    return;
+  }
+  uint32_t seq;
+  memcpy(&seq, rxMsg.buf + 1, sizeof(seq));
+  std::map<uint32_t, uint64_t>::iterator it = queuedMicros.find(seq);
+  if (it != queuedMicros.end())
+  {
+    lastDeliveredMicros = simScheduler::instance().nowMicros();
+    latencyMillis.push_back(double(lastDeliveredMicros - it->second) / 1000);
+    queuedMicros.erase(it);
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks();
+
+//---------
+// Helpers
+//---------
+
+static double percentile (std::vector<double> values, double const p)
+{
+  if (values.empty())
+  {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t idx = size_t(p / 100 * (values.size() - 1) + 0.5);
+  return values[idx];
+}
+
+static void setLink (loraPoint2Point & unit,
+                     spreadingFactor_t const spreadingFactor,
+                     signalBandwidth_t const signalBandwidth)
+{
+  CHECK(unit.setupRadio());
+  unit.setSpreadingFactor(spreadingFactor);
+  unit.setBandwidth(signalBandwidth);
+  unit.setTxPower(BENCH_TX_POWER_dBm);
+}
+
+static benchResult_t runOne (spreadingFactor_t const spreadingFactor,
+                             signalBandwidth_t const signalBandwidth,
+                             uint32_t const seed)
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(seed);
+  randomSeed(seed);
+  channel.resetStats();
+  queuedMicros.clear();
+  latencyMillis.clear();
+  lastDeliveredMicros = sched.nowMicros();
+
+  std::unique_ptr<loraPoint2Point> base(new loraPoint2Point(BASE_ADDR, 8, 3, 4, baseCallbacks));
+  std::unique_ptr<loraPoint2Point> endpoint(new loraPoint2Point(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks));
+  uint32_t nextSeq = 0;
+  sched.addNode([&]{ setLink(*base, spreadingFactor, signalBandwidth); },
+                [&]{ base->serviceRx(); },
+                1000);
+  sched.addNode([&]{ setLink(*endpoint, spreadingFactor, signalBandwidth); },
+                [&]{
+                  if (nextSeq < BENCH_RECORDS && !endpoint->isTxBusy())
+                  {
+                    uint8_t record [BENCH_RECORD_LEN] = {msgType_dataRsp};
+                    memcpy(record + 1, &nextSeq, sizeof(nextSeq));
+                    for (uint8_t idx = 1 + sizeof(nextSeq); idx < BENCH_RECORD_LEN; idx++)
+                    {
+                      record[idx] = uint8_t(nextSeq * 31 + idx);
+                    }
+                    if (endpoint->serviceTx(BASE_ADDR, record, BENCH_RECORD_LEN, false))
+                    {
+                      queuedMicros[nextSeq++] = micros();
+                    }
+                  }
+                  endpoint->serviceRx();
+                },
+                1000);
+
+  uint64_t startMicros = sched.nowMicros();
+  while (sched.nowMicros() - startMicros < BENCH_MAX_SECONDS * 1000000ULL
+         && (nextSeq < BENCH_RECORDS || endpoint->isTxBusy()))
+  {
+    sched.runFor(1000000ULL);
+  }
+  benchResult_t result;
+  result.delivered = latencyMillis.size();
+  result.seconds = double(lastDeliveredMicros - startMicros) / 1e6;
+  result.recordsPerSecond = result.seconds > 0 ? result.delivered / result.seconds : 0;
+  uint32_t recordAirtime = loraPoint2PointCommon::airtimeMicros(7 + spreadingFactor,
+                                                                signalBandwidth == signalBandwidth_125kHz ? 125000
+                                                                : signalBandwidth == signalBandwidth_250kHz ? 250000 : 500000,
+                                                                RH_RF95_HEADER_LEN + BENCH_RECORD_LEN);
+  result.airtimeEfficiency = double(result.delivered) * recordAirtime / channel.getStats().airtimeMicros;
+  result.p50Millis = percentile(latencyMillis, 50);
+  result.p99Millis = percentile(latencyMillis, 99);
+  linkStatsEntry_t const * stats = endpoint->getLinkStats(BASE_ADDR);
+  result.retriesPerRecord = stats == NULL ? 0 : stats->retriesPerFrame();
+  sched.stop();
+  return result;
+}
+
+int main (int argc, char ** argv)
+{
+  uint32_t seed = argc > 1 ? uint32_t(atol(argv[1])) : BENCH_SEED;
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  channel.setPathLoss(BENCH_PATH_LOSS_dB);
+  channel.setFadingStdDev(BENCH_FADING_dB);
+  channel.setLossProbability(BENCH_LOSS_PROBABILITY);
+
+  static char const * const bandwidthNames [NUM_signalBandwidths] = {"125", "250", "500"};
+  printf("Seed %u, %u records of %u bytes, %d dB path loss, %d dB fading, %.0f%% random loss\n",
+         seed, BENCH_RECORDS, BENCH_RECORD_LEN, BENCH_PATH_LOSS_dB, BENCH_FADING_dB, BENCH_LOSS_PROBABILITY * 100);
+  printf("  SF | BW kHz | delivered | records/s | airtime eff. | P50 ms | P99 ms | retries/record\n");
+  printf("---- | ------ | --------- | --------- | ------------ | ------ | ------ | --------------\n");
+  for (uint8_t sf = spreadingFactor_sf7; sf < NUM_spreadingFactors; sf++)
+  {
+    for (uint8_t bw = signalBandwidth_125kHz; bw < NUM_signalBandwidths; bw++)
+    {
+      benchResult_t result = runOne(spreadingFactor_t(sf), signalBandwidth_t(bw), seed);
+      printf("%4u | %6s | %9u | %9.3f | %11.1f%% | %6.0f | %6.0f | %14.3f\n",
+             7 + sf,
+             bandwidthNames[bw],
+             result.delivered,
+             result.recordsPerSecond,
+             result.airtimeEfficiency * 100,
+             result.p50Millis,
+             result.p99Millis,
+             result.retriesPerRecord);
+      // The benchmark is not a test of the link, but every combination should get its records through.
+      CHECK(result.delivered >= BENCH_RECORDS * 9 / 10);
+    }
+  }
+  return hostTestResult();
+}
@@ -0,0 +1,92 @@
+/**
+ * @file hostTest.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Minimal check macros for the host tests, and callbacks for the loraPoint2Point units they run. A test passes when main() returns hostTestResult().
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <loraPoint2PointProtocol.h>
+
+static int hostTestFailures = 0;
+
+#define CHECK(cond)                                                            \
+  do                                                                           \
+  {                                                                            \
+    if (!(cond))                                                               \
+    {                                                                          \
+      printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);         \
+      hostTestFailures++;                                                      \
+    }                                                                          \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+  do                                                                           \
+  {                                                                            \
+    long long _a = (long long)(a);                                             \
+    long long _b = (long long)(b);                                             \
+    if (_a != _b)                                                              \
+    {                                                                          \
+      printf("%s:%d: CHECK_EQ failed: %s == %s (%lld != %lld)\n",             \
+             __FILE__, __LINE__, #a, #b, _a, _b);                              \
+      hostTestFailures++;                                                      \
+    }                                                                          \
+  } while (0)
+
+inline int hostTestResult ()
+{
+  if (hostTestFailures)
+  {
+    printf("%d check(s) failed\n", hostTestFailures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
+
+//-----------
+// Callbacks
+//-----------
+
+inline void hostTestTxInd (uint8_t const * /*txBuf*/, uint8_t const /*bufLen*/, uint8_t const /*destAddr*/, bool /*ack*/)
+{
+}
+
+inline void hostTestRxInd (message_t const & /*rxMsg*/)
+{
+}
+
+inline void hostTestLinkChangeInd (spreadingFactor_t const /*newSpreadingFactor*/,
+                                   signalBandwidth_t const /*newSignalBandwidth*/,
+                                   frequencyChannel_t const /*newFrequencyChannel*/,
+                                   int8_t const /*newTxPower*/)
+{
+}
+
+/**
+ * @brief Callbacks for a unit under test: those given, and ones that do nothing for the rest. Pass NULL for any
+ * callback the test does not check, e.g. hostTestCallbacks(NULL, baseRxInd).
+ *
+ */
+inline userCallbacks_t hostTestCallbacks (decltype(userCallbacks_t::txInd) txInd = NULL,
+                                          decltype(userCallbacks_t::rxInd) rxInd = NULL,
+                                          decltype(userCallbacks_t::linkChangeInd) linkChangeInd = NULL,
+                                          decltype(userCallbacks_t::txBackpressureInd) txBackpressureInd = NULL,
+                                          decltype(userCallbacks_t::bulkTxInd) bulkTxInd = NULL)
+{
+  userCallbacks_t callbacks = {txInd != NULL ? txInd : hostTestTxInd,
+                               rxInd != NULL ? rxInd : hostTestRxInd,
+                               linkChangeInd != NULL ? linkChangeInd : hostTestLinkChangeInd,
+                               txBackpressureInd,
+                               bulkTxInd};
+  return callbacks;
+}
+
+#endif // HOST_TEST_H
@@ -0,0 +1,88 @@
+/**
+ * @file sdLogToCsv.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Converts a binary log written by sdLogger to CSV.
+ * @version 0.1
+ * @date 2021-09-19
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * The CSV has the columns LoRaRangeTest_Base used to log, with a header line at the start of every session (every
+ * time the logger was started), as before. Filler records are skipped.
+ *
+ * Usage: sdLogToCsv <log file> [CSV file]
+ *
+ * Without a CSV file, prints to stdout.
+ */
+
+#include <stdio.h>
+#include <sdLogger.h>
+
+/**
+ * @brief Print to a stdio file.
+ *
+ */
+class filePort : public Print
+{
+  public:
+    filePort (FILE * _out): out{_out} {}
+    size_t write (uint8_t c) override
+    {
+      return fputc(c, out) == EOF ? 0 : 1;
+    }
+  private:
+    FILE * out;
+};
+
+int main (int argc, char ** argv)
+{
+  if (argc < 2 || argc > 3)
+  {
+    fprintf(stderr, "Usage: %s <log file> [CSV file]\n", argv[0]);
+    return 2;
+  }
+  FILE * in = fopen(argv[1], "rb");
+  if (in == NULL)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  FILE * out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (out == NULL)
+  {
+    perror(argv[2]);
+    fclose(in);
+    return 1;
+  }
+  filePort port(out);
+  bool headerPrinted = false;
+  uint32_t numRows = 0;
+  sdLogRecord_t record;
+  while (fread(&record, sizeof(record), 1, in) == 1)
+  {
+    if (record.kind == sdLogKind_sessionStart)
+    {
+      sdLogger::printCsvHeader(port);
+      headerPrinted = true;
+      continue;
+    }
+    if (record.kind != sdLogKind_tx && record.kind != sdLogKind_rx)
+    {
+      continue;
+    }
+    if (!headerPrinted)
+    {
+      sdLogger::printCsvHeader(port);
+      headerPrinted = true;
+    }
+    sdLogger::printCsv(record, port);
+    numRows++;
+  }
+  fclose(in);
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  fprintf(stderr, "%u rows\n", numRows);
+  return 0;
+}
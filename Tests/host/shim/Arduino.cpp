@@ -0,0 +1,259 @@
+/**
+ * @file Arduino.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host (Linux) stand-in for the parts of the Arduino core used by this library.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <Arduino.h>
+#include <simScheduler.h>
+#include <stdio.h>
+
+Serial_ Serial;
+Uart Serial1;
+
+//------
+// Time
+//------
+
+unsigned long millis ()
+{
+  return (unsigned long)(uint32_t)(simScheduler::instance().nowMicros() / 1000);
+}
+
+unsigned long micros ()
+{
+  return (unsigned long)(uint32_t)(simScheduler::instance().nowMicros());
+}
+
+void delay (unsigned long ms)
+{
+  simScheduler & sched = simScheduler::instance();
+  sched.waitUntil(sched.nowMicros() + uint64_t(ms) * 1000);
+}
+
+void delayMicroseconds (unsigned int us)
+{
+  simScheduler & sched = simScheduler::instance();
+  sched.waitUntil(sched.nowMicros() + us);
+}
+
+void yield ()
+{
+}
+
+//------
+// GPIO
+//------
+
+void pinMode (uint32_t pin, uint32_t mode)
+{
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite (uint32_t pin, uint32_t value)
+{
+  (void)pin;
+  (void)value;
+}
+
+int digitalRead (uint32_t pin)
+{
+  (void)pin;
+  return HIGH;
+}
+
+//--------
+// Random
+//--------
+
+static uint32_t randomState = 0x2545F491;
+
+void randomSeed (unsigned long seed)
+{
+  randomState = seed ? uint32_t(seed) : 0x2545F491;
+}
+
+long random (long howBig)
+{
+  if (howBig <= 0)
+  {
+    return 0;
+  }
+  // xorshift32: deterministic on every host, unlike rand().
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return long(randomState % uint32_t(howBig));
+}
+
+long random (long howSmall, long howBig)
+{
+  if (howSmall >= howBig)
+  {
+    return howSmall;
+  }
+  return howSmall + random(howBig - howSmall);
+}
+
+//--------
+// String
+//--------
+
+String::String (int value, unsigned char base)
+{
+  char buf[34];
+  if (base == HEX)
+  {
+    snprintf(buf, sizeof(buf), "%X", (unsigned)value);
+  }
+  else
+  {
+    snprintf(buf, sizeof(buf), "%d", value);
+  }
+  str = buf;
+}
+
+int String::indexOf (char c, unsigned int from) const
+{
+  size_t i = str.find(c, from);
+  return (i == std::string::npos) ? -1 : int(i);
+}
+
+String String::substring (unsigned int from, unsigned int to) const
+{
+  if (from > to)
+  {
+    std::swap(from, to);
+  }
+  if (from >= str.length())
+  {
+    return String();
+  }
+  return String(str.substr(from, to - from));
+}
+
+//-------
+// Print
+//-------
+
+size_t Print::write (uint8_t const * buf, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    n += write(*buf++);
+  }
+  return n;
+}
+
+size_t Print::print (char const * str)
+{
+  return write(str);
+}
+
+size_t Print::print (String const & s)
+{
+  return write(s.c_str());
+}
+
+size_t Print::print (char c)
+{
+  return write(uint8_t(c));
+}
+
+size_t Print::print (unsigned char n, int base)
+{
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print (int n, int base)
+{
+  return print((long)n, base);
+}
+
+size_t Print::print (unsigned int n, int base)
+{
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print (long n, int base)
+{
+  if (base == DEC && n < 0)
+  {
+    return print('-') + printNumber((unsigned long)(-n), DEC);
+  }
+  if (base != DEC)
+  {
+    return printNumber((unsigned long)(uint32_t)n, uint8_t(base));
+  }
+  return printNumber((unsigned long)n, DEC);
+}
+
+size_t Print::print (unsigned long n, int base)
+{
+  return printNumber(n, uint8_t(base));
+}
+
+size_t Print::print (double n, int digits)
+{
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t Print::println ()
+{
+  return write("\r\n");
+}
+
+size_t Print::printNumber (unsigned long n, uint8_t base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char * str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2)
+  {
+    base = 10;
+  }
+  do
+  {
+    char c = char(n % base);
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+//-------------
+// Serial port
+//-------------
+
+int hostSerialPort::read ()
+{
+  if (rxFifo.empty())
+  {
+    return -1;
+  }
+  int c = rxFifo.front();
+  rxFifo.pop_front();
+  return c;
+}
+
+size_t hostSerialPort::write (uint8_t c)
+{
+  if (echo)
+  {
+    fputc(c, stdout);
+  }
+  if (capture)
+  {
+    txCapture += char(c);
+  }
+  return 1;
+}
@@ -0,0 +1,213 @@
+/**
+ * @file Arduino.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host (Linux) stand-in for the parts of the Arduino core used by this library.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Only used by the host build (see CMakeLists.txt). Time is virtual: millis(), micros() and delay() all
+ * read and advance the simulated clock kept by simScheduler, so blocking library calls cost no wall-clock time.
+ * Serial ports are in-memory streams. Bytes can be injected into their RX side and their TX side is either
+ * discarded, captured, or echoed to stdout.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <deque>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define F(string_literal) (string_literal)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+//------
+// Time
+//------
+
+unsigned long millis ();
+unsigned long micros ();
+void delay (unsigned long ms);
+void delayMicroseconds (unsigned int us);
+void yield ();
+
+//-----------------
+// GPIO, interrupts
+//-----------------
+
+void pinMode (uint32_t pin, uint32_t mode);
+void digitalWrite (uint32_t pin, uint32_t value);
+int digitalRead (uint32_t pin);
+inline void noInterrupts () {}
+inline void interrupts () {}
+
+//--------
+// Random
+//--------
+
+void randomSeed (unsigned long seed);
+long random (long howBig);
+long random (long howSmall, long howBig);
+
+//--------
+// String
+//--------
+
+/**
+ * @brief Minimal Arduino String, backed by std::string.
+ *
+ */
+class String
+{
+  public:
+    String () {}
+    String (char const * cstr): str{cstr ? cstr : ""} {}
+    String (std::string const & s): str{s} {}
+    String (char c): str(1, c) {}
+    String (int value, unsigned char base = DEC);
+    unsigned int length () const { return str.length(); }
+    char const * c_str () const { return str.c_str(); }
+    char charAt (unsigned int i) const { return i < str.length() ? str[i] : 0; }
+    char operator[] (unsigned int i) const { return charAt(i); }
+    bool concat (String const & s) { str += s.str; return true; }
+    bool concat (char c) { str += c; return true; }
+    String & operator+= (String const & s) { str += s.str; return *this; }
+    String & operator+= (char c) { str += c; return *this; }
+    bool operator== (String const & s) const { return str == s.str; }
+    bool operator!= (String const & s) const { return str != s.str; }
+    bool startsWith (String const & s) const { return str.compare(0, s.str.length(), s.str) == 0; }
+    int indexOf (char c, unsigned int from = 0) const;
+    String substring (unsigned int from, unsigned int to) const;
+    String substring (unsigned int from) const { return substring(from, str.length()); }
+    long toInt () const { return atol(str.c_str()); }
+    float toFloat () const { return float(atof(str.c_str())); }
+  private:
+    std::string str;
+};
+
+inline String operator+ (String const & a, String const & b)
+{
+  String s = a;
+  s += b;
+  return s;
+}
+
+//---------------
+// Print, Stream
+//---------------
+
+class Print
+{
+  public:
+    virtual ~Print () {}
+    virtual size_t write (uint8_t c) = 0;
+    virtual size_t write (uint8_t const * buf, size_t size);
+    size_t write (char const * str) { return write((uint8_t const *)str, strlen(str)); }
+    virtual int availableForWrite () { return 0; }
+    size_t print (char const * str);
+    size_t print (String const & s);
+    size_t print (char c);
+    size_t print (unsigned char n, int base = DEC);
+    size_t print (int n, int base = DEC);
+    size_t print (unsigned int n, int base = DEC);
+    size_t print (long n, int base = DEC);
+    size_t print (unsigned long n, int base = DEC);
+    size_t print (double n, int digits = 2);
+    size_t println ();
+    template <class T> size_t println (T const & value) { size_t n = print(value); return n + println(); }
+    template <class T> size_t println (T const & value, int format) { size_t n = print(value, format); return n + println(); }
+  private:
+    size_t printNumber (unsigned long n, uint8_t base);
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available () = 0;
+    virtual int read () = 0;
+    virtual int peek () = 0;
+    virtual void flush () {}
+};
+
+/**
+ * @brief In-memory serial port.
+ *
+ * The RX side is a FIFO fed by inject(). The TX side is discarded unless capture or echo is enabled.
+ */
+class hostSerialPort : public Stream
+{
+  public:
+    using Print::write;
+    void begin (unsigned long baud) { baudRate = baud; }
+    void end () {}
+    operator bool () const { return true; }
+    int available () override { return int(rxFifo.size()); }
+    int read () override;
+    int peek () override { return rxFifo.empty() ? -1 : rxFifo.front(); }
+    size_t write (uint8_t c) override;
+    /**
+     * @brief Room in the TX buffer. Like a USB host that is keeping up, there is always a packet's worth.
+     *
+     */
+    int availableForWrite () override { return 64; }
+    /**
+     * @brief Queue bytes as if they had arrived on the RX pin.
+     *
+     * @param buf Bytes to queue.
+     * @param len Number of bytes.
+     */
+    void inject (uint8_t const * buf, size_t len) { rxFifo.insert(rxFifo.end(), buf, buf + len); }
+    void inject (char const * str) { inject((uint8_t const *)str, strlen(str)); }
+    void setEcho (bool _echo) { echo = _echo; }
+    void setCapture (bool _capture) { capture = _capture; }
+    std::string & captured () { return txCapture; }
+    unsigned long getBaudRate () const { return baudRate; }
+  private:
+    std::deque<uint8_t> rxFifo;
+    std::string txCapture;
+    unsigned long baudRate = 0;
+    bool echo = false;
+    bool capture = false;
+};
+
+/**
+ * @brief USB CDC serial port type on the SAMD21 core.
+ *
+ */
+class Serial_ : public hostSerialPort {};
+
+/**
+ * @brief SERCOM hardware UART type on the SAMD21 core.
+ *
+ */
+class Uart : public hostSerialPort {};
+
+extern Serial_ Serial;
+extern Uart Serial1;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,55 @@
+/**
+ * @file RHDatagram.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RHDatagram manager.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef RHDatagram_h
+#define RHDatagram_h
+
+#include <RHGenericDriver.h>
+
+class RHDatagram
+{
+  public:
+    RHDatagram (RHGenericDriver & driver, uint8_t thisAddress = 0):
+      _driver(driver),
+      _thisAddress(thisAddress)
+    {
+    }
+    virtual ~RHDatagram () {}
+    bool init ();
+    void setThisAddress (uint8_t thisAddress);
+    bool sendto (uint8_t * buf, uint8_t len, uint8_t address);
+    bool recvfrom (uint8_t * buf,
+                   uint8_t * len,
+                   uint8_t * from = NULL,
+                   uint8_t * to = NULL,
+                   uint8_t * id = NULL,
+                   uint8_t * flags = NULL);
+    bool available () { return _driver.available(); }
+    void waitAvailable () { _driver.waitAvailable(); }
+    bool waitPacketSent () { return _driver.waitPacketSent(); }
+    bool waitPacketSent (uint16_t timeout) { return _driver.waitPacketSent(timeout); }
+    bool waitAvailableTimeout (uint16_t timeout) { return _driver.waitAvailableTimeout(timeout); }
+    void setHeaderTo (uint8_t to) { _driver.setHeaderTo(to); }
+    void setHeaderFrom (uint8_t from) { _driver.setHeaderFrom(from); }
+    void setHeaderId (uint8_t id) { _driver.setHeaderId(id); }
+    void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_NONE) { _driver.setHeaderFlags(set, clear); }
+    uint8_t headerTo () { return _driver.headerTo(); }
+    uint8_t headerFrom () { return _driver.headerFrom(); }
+    uint8_t headerId () { return _driver.headerId(); }
+    uint8_t headerFlags () { return _driver.headerFlags(); }
+    uint8_t thisAddress () { return _thisAddress; }
+
+  protected:
+    RHGenericDriver & _driver;
+    uint8_t _thisAddress;
+};
+
+#endif // RHDatagram_h
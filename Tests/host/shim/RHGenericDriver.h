@@ -0,0 +1,93 @@
+/**
+ * @file RHGenericDriver.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RHGenericDriver, with the same interface and header semantics.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Only used by the host build. Blocking waits are implemented on top of simScheduler, so they cost virtual time only.
+ */
+
+#ifndef RHGenericDriver_h
+#define RHGenericDriver_h
+
+#include <Arduino.h>
+
+#define RH_BROADCAST_ADDRESS 0xff
+
+#define RH_FLAGS_RESERVED             0xf0
+#define RH_FLAGS_APPLICATION_SPECIFIC 0x0f
+#define RH_FLAGS_NONE                 0
+#define RH_FLAGS_ACK                  0x80
+#define RH_FLAGS_RETRY                0x40
+
+#define YIELD yield()
+
+class RHGenericDriver
+{
+  public:
+    typedef enum
+    {
+      RHModeInitialising = 0,
+      RHModeSleep,
+      RHModeIdle,
+      RHModeTx,
+      RHModeRx,
+      RHModeCad
+    } RHMode;
+
+    RHGenericDriver ();
+    virtual ~RHGenericDriver () {}
+    virtual bool init () { return true; }
+    virtual bool available () = 0;
+    virtual bool recv (uint8_t * buf, uint8_t * len) = 0;
+    virtual bool send (uint8_t const * data, uint8_t len) = 0;
+    virtual uint8_t maxMessageLength () = 0;
+    virtual void waitAvailable ();
+    virtual bool waitPacketSent ();
+    virtual bool waitPacketSent (uint16_t timeout);
+    virtual bool waitAvailableTimeout (uint16_t timeout);
+    virtual bool waitCAD ();
+    void setCADTimeout (unsigned long cad_timeout) { _cad_timeout = cad_timeout; }
+    virtual bool isChannelActive () { return false; }
+    virtual void setThisAddress (uint8_t thisAddress) { _thisAddress = thisAddress; }
+    virtual void setHeaderTo (uint8_t to) { _txHeaderTo = to; }
+    virtual void setHeaderFrom (uint8_t from) { _txHeaderFrom = from; }
+    virtual void setHeaderId (uint8_t id) { _txHeaderId = id; }
+    virtual void setHeaderFlags (uint8_t set, uint8_t clear = RH_FLAGS_APPLICATION_SPECIFIC);
+    virtual void setPromiscuous (bool promiscuous) { _promiscuous = promiscuous; }
+    virtual uint8_t headerTo () { return _rxHeaderTo; }
+    virtual uint8_t headerFrom () { return _rxHeaderFrom; }
+    virtual uint8_t headerId () { return _rxHeaderId; }
+    virtual uint8_t headerFlags () { return _rxHeaderFlags; }
+    virtual int16_t lastRssi () { return _lastRssi; }
+    virtual RHMode mode () { return _mode; }
+    virtual void setMode (RHMode mode) { _mode = mode; }
+    virtual bool sleep () { return false; }
+    uint16_t rxBad () { return _rxBad; }
+    uint16_t rxGood () { return _rxGood; }
+    uint16_t txGood () { return _txGood; }
+
+  protected:
+    volatile RHMode _mode;
+    uint8_t _thisAddress;
+    bool _promiscuous;
+    volatile uint8_t _rxHeaderTo;
+    volatile uint8_t _rxHeaderFrom;
+    volatile uint8_t _rxHeaderId;
+    volatile uint8_t _rxHeaderFlags;
+    uint8_t _txHeaderTo;
+    uint8_t _txHeaderFrom;
+    uint8_t _txHeaderId;
+    uint8_t _txHeaderFlags;
+    volatile int16_t _lastRssi;
+    volatile uint16_t _rxBad;
+    volatile uint16_t _rxGood;
+    volatile uint16_t _txGood;
+    volatile bool _cad;
+    unsigned int _cad_timeout;
+};
+
+#endif // RHGenericDriver_h
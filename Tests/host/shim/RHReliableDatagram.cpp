@@ -0,0 +1,202 @@
+/**
+ * @file RHReliableDatagram.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RHDatagram and RHReliableDatagram managers.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <RHReliableDatagram.h>
+
+//------------
+// RHDatagram
+//------------
+
+bool RHDatagram::init ()
+{
+  bool ret = _driver.init();
+  if (ret)
+  {
+    setThisAddress(_thisAddress);
+  }
+  return ret;
+}
+
+void RHDatagram::setThisAddress (uint8_t thisAddress)
+{
+  _driver.setThisAddress(thisAddress);
+  _driver.setHeaderFrom(thisAddress);
+  _thisAddress = thisAddress;
+}
+
+bool RHDatagram::sendto (uint8_t * buf, uint8_t len, uint8_t address)
+{
+  setHeaderTo(address);
+  return _driver.send(buf, len);
+}
+
+bool RHDatagram::recvfrom (uint8_t * buf,
+                           uint8_t * len,
+                           uint8_t * from,
+                           uint8_t * to,
+                           uint8_t * id,
+                           uint8_t * flags)
+{
+  if (_driver.recv(buf, len))
+  {
+    if (from)  *from =  headerFrom();
+    if (to)    *to =    headerTo();
+    if (id)    *id =    headerId();
+    if (flags) *flags = headerFlags();
+    return true;
+  }
+  return false;
+}
+
+//--------------------
+// RHReliableDatagram
+//--------------------
+
+RHReliableDatagram::RHReliableDatagram (RHGenericDriver & driver, uint8_t thisAddress):
+  RHDatagram(driver, thisAddress),
+  _retransmissions(0),
+  _lastSequenceNumber(0),
+  _timeout(RH_DEFAULT_TIMEOUT),
+  _retries(RH_DEFAULT_RETRIES)
+{
+  memset(_seenIds, 0, sizeof(_seenIds));
+}
+
+bool RHReliableDatagram::sendtoWait (uint8_t * buf, uint8_t len, uint8_t address)
+{
+  uint8_t thisSequenceNumber = ++_lastSequenceNumber;
+  uint8_t retries = 0;
+  while (retries++ <= _retries)
+  {
+    setHeaderId(thisSequenceNumber);
+    uint8_t headerFlagsToSet = RH_FLAGS_NONE;
+    uint8_t headerFlagsToClear = RH_FLAGS_ACK;
+    if (retries == 1)
+    {
+      headerFlagsToClear |= RH_FLAGS_RETRY;
+    }
+    else
+    {
+      headerFlagsToSet = RH_FLAGS_RETRY;
+    }
+    setHeaderFlags(headerFlagsToSet, headerFlagsToClear);
+    sendto(buf, len, address);
+    waitPacketSent();
+    // Never wait for ACKs to broadcasts.
+    if (address == RH_BROADCAST_ADDRESS)
+    {
+      return true;
+    }
+    if (retries > 1)
+    {
+      _retransmissions++;
+    }
+    unsigned long thisSendTime = millis(); // Timeout does not include original transmit time.
+    // Random between _timeout and _timeout*2 to avoid colliding on every retransmission.
+    uint16_t timeout = _timeout + (_timeout * random(0, 256) / 256);
+    int32_t timeLeft;
+    while ((timeLeft = timeout - (millis() - thisSendTime)) > 0)
+    {
+      if (waitAvailableTimeout(timeLeft))
+      {
+        uint8_t from, to, id, flags;
+        if (recvfrom(0, 0, &from, &to, &id, &flags)) // Discards the message.
+        {
+          if (from == address
+              && to == _thisAddress
+              && (flags & RH_FLAGS_ACK)
+              && (id == thisSequenceNumber))
+          {
+            return true;
+          }
+          else if (!(flags & RH_FLAGS_ACK)
+                   && (id == _seenIds[from]))
+          {
+            // A request we have already received. ACK it again.
+            acknowledge(id, from);
+          }
+        }
+      }
+      YIELD;
+    }
+    YIELD;
+  }
+  return false;
+}
+
+bool RHReliableDatagram::recvfromAck (uint8_t * buf,
+                                      uint8_t * len,
+                                      uint8_t * from,
+                                      uint8_t * to,
+                                      uint8_t * id,
+                                      uint8_t * flags)
+{
+  uint8_t _from;
+  uint8_t _to;
+  uint8_t _id;
+  uint8_t _flags;
+  if (available() && recvfrom(buf, len, &_from, &_to, &_id, &_flags))
+  {
+    // Never ACK an ACK.
+    if (!(_flags & RH_FLAGS_ACK))
+    {
+      if (_to == _thisAddress)
+      {
+        acknowledge(_id, _from);
+      }
+      // Only deliver messages we have not seen before.
+      if ((RH_ENABLE_EXPLICIT_RETRY_DEDUP && !(_flags & RH_FLAGS_RETRY)) || _id != _seenIds[_from])
+      {
+        if (from)  *from =  _from;
+        if (to)    *to =    _to;
+        if (id)    *id =    _id;
+        if (flags) *flags = _flags;
+        _seenIds[_from] = _id;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool RHReliableDatagram::recvfromAckTimeout (uint8_t * buf,
+                                             uint8_t * len,
+                                             uint16_t timeout,
+                                             uint8_t * from,
+                                             uint8_t * to,
+                                             uint8_t * id,
+                                             uint8_t * flags)
+{
+  unsigned long starttime = millis();
+  int32_t timeLeft;
+  while ((timeLeft = timeout - (millis() - starttime)) > 0)
+  {
+    if (waitAvailableTimeout(timeLeft))
+    {
+      if (recvfromAck(buf, len, from, to, id, flags))
+      {
+        return true;
+      }
+    }
+    YIELD;
+  }
+  return false;
+}
+
+void RHReliableDatagram::acknowledge (uint8_t id, uint8_t from)
+{
+  setHeaderId(id);
+  setHeaderFlags(RH_FLAGS_ACK);
+  // RadioHead sends a 1 octet ACK rather than a zero length one.
+  uint8_t ack = '!';
+  sendto(&ack, sizeof(ack), from);
+  waitPacketSent();
+}
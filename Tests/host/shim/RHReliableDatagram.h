@@ -0,0 +1,60 @@
+/**
+ * @file RHReliableDatagram.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RHReliableDatagram manager: same retry, timeout, ACK and duplicate-detection rules.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef RHReliableDatagram_h
+#define RHReliableDatagram_h
+
+#include <RHDatagram.h>
+
+#define RH_DEFAULT_TIMEOUT 200
+#define RH_DEFAULT_RETRIES 3
+
+// Same default as RadioHead: duplicates are detected by message id alone.
+#ifndef RH_ENABLE_EXPLICIT_RETRY_DEDUP
+#define RH_ENABLE_EXPLICIT_RETRY_DEDUP 0
+#endif
+
+class RHReliableDatagram : public RHDatagram
+{
+  public:
+    RHReliableDatagram (RHGenericDriver & driver, uint8_t thisAddress = 0);
+    void setTimeout (uint16_t timeout) { _timeout = timeout; }
+    void setRetries (uint8_t retries) { _retries = retries; }
+    uint8_t retries () { return _retries; }
+    bool sendtoWait (uint8_t * buf, uint8_t len, uint8_t address);
+    bool recvfromAck (uint8_t * buf,
+                      uint8_t * len,
+                      uint8_t * from = NULL,
+                      uint8_t * to = NULL,
+                      uint8_t * id = NULL,
+                      uint8_t * flags = NULL);
+    bool recvfromAckTimeout (uint8_t * buf,
+                             uint8_t * len,
+                             uint16_t timeout,
+                             uint8_t * from = NULL,
+                             uint8_t * to = NULL,
+                             uint8_t * id = NULL,
+                             uint8_t * flags = NULL);
+    uint32_t retransmissions () { return _retransmissions; }
+    void resetRetransmissions () { _retransmissions = 0; }
+
+  protected:
+    void acknowledge (uint8_t id, uint8_t from);
+
+  private:
+    uint32_t _retransmissions;
+    uint8_t _lastSequenceNumber;
+    uint16_t _timeout;
+    uint8_t _retries;
+    uint8_t _seenIds[256];
+};
+
+#endif // RHReliableDatagram_h
@@ -0,0 +1,537 @@
+/**
+ * @file RH_RF95.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RH_RF95 driver, attached to the simulated LoRa channel.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <RH_RF95.h>
+#include <simScheduler.h>
+
+//-----------------
+// RHGenericDriver
+//-----------------
+
+RHGenericDriver::RHGenericDriver ():
+  _mode(RHModeInitialising),
+  _thisAddress(RH_BROADCAST_ADDRESS),
+  _promiscuous(false),
+  _rxHeaderTo(RH_BROADCAST_ADDRESS),
+  _rxHeaderFrom(RH_BROADCAST_ADDRESS),
+  _rxHeaderId(0),
+  _rxHeaderFlags(0),
+  _txHeaderTo(RH_BROADCAST_ADDRESS),
+  _txHeaderFrom(RH_BROADCAST_ADDRESS),
+  _txHeaderId(0),
+  _txHeaderFlags(0),
+  _lastRssi(0),
+  _rxBad(0),
+  _rxGood(0),
+  _txGood(0),
+  _cad(false),
+  _cad_timeout(0)
+{
+}
+
+void RHGenericDriver::setHeaderFlags (uint8_t set, uint8_t clear)
+{
+  _txHeaderFlags &= ~clear;
+  _txHeaderFlags |= set;
+}
+
+void RHGenericDriver::waitAvailable ()
+{
+  simScheduler::instance().waitFor([this]{ return available(); }, UINT64_MAX);
+}
+
+bool RHGenericDriver::waitAvailableTimeout (uint16_t timeout)
+{
+  simScheduler & sched = simScheduler::instance();
+  return sched.waitFor([this]{ return available(); },
+                       sched.nowMicros() + uint64_t(timeout) * 1000);
+}
+
+bool RHGenericDriver::waitPacketSent ()
+{
+  simScheduler::instance().waitFor([this]{ return _mode != RHModeTx; }, UINT64_MAX);
+  return true;
+}
+
+bool RHGenericDriver::waitPacketSent (uint16_t timeout)
+{
+  simScheduler & sched = simScheduler::instance();
+  return sched.waitFor([this]{ return _mode != RHModeTx; },
+                       sched.nowMicros() + uint64_t(timeout) * 1000);
+}
+
+bool RHGenericDriver::waitCAD ()
+{
+  if (!_cad_timeout)
+  {
+    return true;
+  }
+  unsigned long t = millis();
+  while (isChannelActive())
+  {
+    if (millis() - t > _cad_timeout)
+    {
+      return false;
+    }
+    delay(random(1, 10) * 100);
+  }
+  return true;
+}
+
+//---------
+// RH_RF95
+//---------
+
+RH_RF95::RH_RF95 (uint8_t slaveSelectPin,
+                  uint8_t interruptPin)
+{
+  (void)slaveSelectPin;
+  (void)interruptPin;
+  radioIndex = simLoRaChannel::instance().attach(this);
+}
+
+RH_RF95::~RH_RF95 ()
+{
+  simLoRaChannel::instance().detach(radioIndex);
+}
+
+uint8_t RH_RF95::spiWrite (uint8_t reg, uint8_t value)
+{
+  registerWrites++;
+  writeRegister(reg, value);
+  return 0;
+}
+
+uint8_t RH_RF95::spiRead (uint8_t reg)
+{
+  switch (reg)
+  {
+    case RH_RF95_REG_12_IRQ_FLAGS:
+      serviceCad();
+      return irqFlags;
+    case RH_RF95_REG_1D_MODEM_CONFIG1:
+      return reg1d;
+    case RH_RF95_REG_1E_MODEM_CONFIG2:
+      return reg1e;
+    case RH_RF95_REG_26_MODEM_CONFIG3:
+      return reg26;
+    case RH_RF95_REG_09_PA_CONFIG:
+      return paConfig;
+    case RH_RF95_REG_4D_PA_DAC:
+      return paDac;
+    default:
+      return 0;
+  }
+}
+
+uint8_t RH_RF95::spiBurstWrite (uint8_t reg, uint8_t const * src, uint8_t len)
+{
+  registerWrites++;
+  for (uint8_t idx = 0; idx < len; idx++)
+  {
+    writeRegister(uint8_t(reg + idx), src[idx]);
+  }
+  return 0;
+}
+
+void RH_RF95::writeRegister (uint8_t reg, uint8_t value)
+{
+  switch (reg)
+  {
+    case RH_RF95_REG_01_OP_MODE:
+      cadEndMicros = UINT64_MAX;
+      if ((value & RH_RF95_MODE) == RH_RF95_MODE_CAD)
+      {
+        // As isChannelActive, without the wait: CAD takes about two symbols.
+        simRadioSettings_t s = simSettings();
+        uint32_t symbolMicros = (uint32_t(1) << s.spreadingFactor) * 1000000UL / s.bandwidthHz;
+        cadEndMicros = simScheduler::instance().nowMicros() + 2 * symbolMicros;
+        cadHeard = simLoRaChannel::instance().channelActive(radioIndex);
+        changeMode(RHModeCad);
+      }
+      break;
+    case RH_RF95_REG_12_IRQ_FLAGS:
+      irqFlags &= ~value; // Write 1 to clear.
+      break;
+    case RH_RF95_REG_1D_MODEM_CONFIG1:
+      reg1d = value;
+      break;
+    case RH_RF95_REG_1E_MODEM_CONFIG2:
+      reg1e = value;
+      break;
+    case RH_RF95_REG_26_MODEM_CONFIG3:
+      reg26 = value;
+      break;
+    case RH_RF95_REG_09_PA_CONFIG:
+    case RH_RF95_REG_4D_PA_DAC:
+      (reg == RH_RF95_REG_09_PA_CONFIG ? paConfig : paDac) = value;
+      txPowerdBm = int8_t((paConfig & RH_RF95_OUTPUT_POWER) + 2 + (paDac == RH_RF95_PA_DAC_ENABLE ? 3 : 0));
+      break;
+    default:
+      break;
+  }
+}
+
+void RH_RF95::serviceCad ()
+{
+  if (simScheduler::instance().nowMicros() < cadEndMicros)
+  {
+    return;
+  }
+  cadHeard = cadHeard || simLoRaChannel::instance().channelActive(radioIndex);
+  irqFlags |= RH_RF95_CAD_DONE | (cadHeard ? RH_RF95_CAD_DETECTED : 0);
+  // The modem went to standby when the CAD was done, not when the flags were read.
+  uint64_t now = simScheduler::instance().nowMicros();
+  microsInMode[RHModeCad] += cadEndMicros - modeSince;
+  microsInMode[RHModeIdle] += now - cadEndMicros;
+  modeSince = now;
+  cadEndMicros = UINT64_MAX;
+}
+
+void RH_RF95::changeMode (RHMode m)
+{
+  uint64_t now = simScheduler::instance().nowMicros();
+  microsInMode[_mode] += now - modeSince;
+  modeSince = now;
+  if (m == RHModeRx && _mode != RHModeRx)
+  {
+    listeningSince = now;
+  }
+  if (m != RHModeRx)
+  {
+    listeningSince = UINT64_MAX;
+  }
+  _mode = m;
+}
+
+uint64_t RH_RF95::simMicrosInMode (RHMode m)
+{
+  uint64_t total = microsInMode[m];
+  if (m == _mode)
+  {
+    total += simScheduler::instance().nowMicros() - modeSince;
+  }
+  return total;
+}
+
+bool RH_RF95::init ()
+{
+  // Same defaults as RadioHead: 434MHz, 13dBm, Bw125 Cr4/5 Sf128, CRC on, 8 symbol preamble.
+  setModeIdle();
+  setModemConfig(Bw125Cr45Sf128);
+  setPreambleLength(8);
+  setFrequency(434.0);
+  setTxPower(13);
+  return true;
+}
+
+bool RH_RF95::available ()
+{
+  if (_mode == RHModeTx)
+  {
+    return false;
+  }
+  setModeRx();
+  return _rxBufValid;
+}
+
+bool RH_RF95::recv (uint8_t * buf, uint8_t * len)
+{
+  if (!available())
+  {
+    return false;
+  }
+  if (buf && len)
+  {
+    if (*len > _bufLen - RH_RF95_HEADER_LEN)
+    {
+      *len = _bufLen - RH_RF95_HEADER_LEN;
+    }
+    memcpy(buf, _buf + RH_RF95_HEADER_LEN, *len);
+  }
+  _rxBufValid = false;
+  return true;
+}
+
+bool RH_RF95::send (uint8_t const * data, uint8_t len)
+{
+  if (len > maxMessageLength())
+  {
+    return false;
+  }
+  waitPacketSent();
+  setModeIdle();
+  if (!waitCAD())
+  {
+    return false;
+  }
+  uint8_t frame[RH_RF95_MAX_PAYLOAD_LEN];
+  frame[0] = _txHeaderTo;
+  frame[1] = _txHeaderFrom;
+  frame[2] = _txHeaderId;
+  frame[3] = _txHeaderFlags;
+  memcpy(frame + RH_RF95_HEADER_LEN, data, len);
+  registerWrites += 2; // FIFO burst + payload length
+  setModeTx();
+  simLoRaChannel::instance().transmit(radioIndex,
+                                      simSettings(),
+                                      frame,
+                                      uint8_t(len + RH_RF95_HEADER_LEN));
+  return true;
+}
+
+uint8_t RH_RF95::maxMessageLength ()
+{
+  return RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN;
+}
+
+bool RH_RF95::isChannelActive ()
+{
+  if (_mode == RHModeCad)
+  {
+    return _cad;
+  }
+  changeMode(RHModeCad);
+  registerWrites++;
+  // CAD takes about two symbols.
+  simRadioSettings_t s = simSettings();
+  uint32_t symbolMicros = (uint32_t(1) << s.spreadingFactor) * 1000000UL / s.bandwidthHz;
+  simScheduler & sched = simScheduler::instance();
+  _cad = simLoRaChannel::instance().channelActive(radioIndex);
+  sched.waitUntil(sched.nowMicros() + 2 * symbolMicros);
+  _cad = _cad || simLoRaChannel::instance().channelActive(radioIndex);
+  changeMode(RHModeIdle);
+  return _cad;
+}
+
+bool RH_RF95::sleep ()
+{
+  if (_mode != RHModeSleep)
+  {
+    spiWrite(0x01, 0x00);
+    changeMode(RHModeSleep);
+  }
+  return true;
+}
+
+bool RH_RF95::setFrequency (float centre)
+{
+  uint32_t frf = uint32_t((centre * 1000000.0) / RH_RF95_FSTEP);
+  spiWrite(0x06, (frf >> 16) & 0xff);
+  spiWrite(0x07, (frf >> 8) & 0xff);
+  spiWrite(0x08, frf & 0xff);
+  frequencyHz = uint32_t(lround(double(centre) * 1000000.0));
+  return true;
+}
+
+void RH_RF95::setModeIdle ()
+{
+  if (_mode != RHModeIdle)
+  {
+    spiWrite(0x01, 0x01);
+    changeMode(RHModeIdle);
+  }
+}
+
+void RH_RF95::setModeRx ()
+{
+  if (_mode != RHModeRx)
+  {
+    spiWrite(0x01, 0x05);
+    spiWrite(0x40, 0x00);
+    changeMode(RHModeRx);
+  }
+}
+
+void RH_RF95::setModeTx ()
+{
+  if (_mode != RHModeTx)
+  {
+    spiWrite(0x01, 0x03);
+    spiWrite(0x40, 0x40);
+    changeMode(RHModeTx);
+  }
+}
+
+void RH_RF95::setTxPower (int8_t power, bool useRFO)
+{
+  (void)useRFO;
+  if (power > 20)
+  {
+    power = 20;
+  }
+  if (power < 2)
+  {
+    power = 2;
+  }
+  // As RadioHead: the PA DAC adds 3dB above 17dBm.
+  spiWrite(RH_RF95_REG_4D_PA_DAC, power > 17 ? RH_RF95_PA_DAC_ENABLE : RH_RF95_PA_DAC_DISABLE);
+  spiWrite(RH_RF95_REG_09_PA_CONFIG, RH_RF95_PA_SELECT | ((power > 17 ? power - 3 : power) - 2));
+  txPowerdBm = power;
+}
+
+void RH_RF95::setModemRegisters (ModemConfig const * config)
+{
+  spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, config->reg_1d);
+  spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, config->reg_1e);
+  spiWrite(RH_RF95_REG_26_MODEM_CONFIG3, config->reg_26);
+  reg1d = config->reg_1d;
+  reg1e = config->reg_1e;
+  reg26 = config->reg_26;
+}
+
+bool RH_RF95::setModemConfig (ModemConfigChoice index)
+{
+  static ModemConfig const table[] =
+  {
+    {0x72, 0x74, 0x04}, // Bw125Cr45Sf128
+    {0x92, 0x74, 0x04}, // Bw500Cr45Sf128
+    {0x48, 0x94, 0x04}, // Bw31_25Cr48Sf512
+    {0x78, 0xc4, 0x0c}, // Bw125Cr48Sf4096
+  };
+  if (index > Bw125Cr48Sf4096)
+  {
+    return false;
+  }
+  setModemRegisters(&table[index]);
+  return true;
+}
+
+void RH_RF95::setPreambleLength (uint16_t bytes)
+{
+  spiWrite(0x20, bytes >> 8);
+  spiWrite(0x21, bytes & 0xff);
+  preambleLength = bytes;
+}
+
+void RH_RF95::setSpreadingFactor (uint8_t sf)
+{
+  if (sf <= 6)
+  {
+    sf = 6;
+  }
+  else if (sf >= 12)
+  {
+    sf = 12;
+  }
+  reg1e = (reg1e & ~RH_RF95_SPREADING_FACTOR) | uint8_t(sf << 4);
+  spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, reg1e);
+  setLowDatarate();
+}
+
+void RH_RF95::setSignalBandwidth (long sbw)
+{
+  uint8_t bw;
+  if (sbw <= 7800) bw = 0x00;
+  else if (sbw <= 10400) bw = 0x10;
+  else if (sbw <= 15600) bw = 0x20;
+  else if (sbw <= 20800) bw = 0x30;
+  else if (sbw <= 31250) bw = 0x40;
+  else if (sbw <= 41700) bw = 0x50;
+  else if (sbw <= 62500) bw = 0x60;
+  else if (sbw <= 125000) bw = RH_RF95_BW_125KHZ;
+  else if (sbw <= 250000) bw = RH_RF95_BW_250KHZ;
+  else bw = RH_RF95_BW_500KHZ;
+  reg1d = (reg1d & ~RH_RF95_BW) | bw;
+  spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, reg1d);
+  setLowDatarate();
+}
+
+void RH_RF95::setCodingRate4 (uint8_t denominator)
+{
+  uint8_t cr = RH_RF95_CODING_RATE_4_5;
+  if (denominator == 6) cr = RH_RF95_CODING_RATE_4_6;
+  else if (denominator == 7) cr = RH_RF95_CODING_RATE_4_7;
+  else if (denominator >= 8) cr = RH_RF95_CODING_RATE_4_8;
+  reg1d = (reg1d & ~RH_RF95_CODING_RATE) | cr;
+  spiWrite(RH_RF95_REG_1D_MODEM_CONFIG1, reg1d);
+}
+
+void RH_RF95::setLowDatarate ()
+{
+  simRadioSettings_t s = simSettings();
+  uint32_t symbolMicros = (uint32_t(1) << s.spreadingFactor) * 1000000UL / s.bandwidthHz;
+  if (symbolMicros > 16000)
+  {
+    reg26 |= RH_RF95_LOW_DATA_RATE_OPTIMIZE;
+  }
+  else
+  {
+    reg26 &= ~RH_RF95_LOW_DATA_RATE_OPTIMIZE;
+  }
+  spiWrite(RH_RF95_REG_26_MODEM_CONFIG3, reg26);
+}
+
+void RH_RF95::setPayloadCRC (bool on)
+{
+  if (on)
+  {
+    reg1e |= RH_RF95_PAYLOAD_CRC_ON;
+  }
+  else
+  {
+    reg1e &= ~RH_RF95_PAYLOAD_CRC_ON;
+  }
+  spiWrite(RH_RF95_REG_1E_MODEM_CONFIG2, reg1e);
+}
+
+simRadioSettings_t RH_RF95::simSettings () const
+{
+  static uint32_t const bandwidthTable[] = {7800, 10400, 15600, 20800, 31250, 41700, 62500, 125000, 250000, 500000};
+  simRadioSettings_t s;
+  s.frequencyHz = frequencyHz;
+  s.spreadingFactor = reg1e >> 4;
+  uint8_t bwCode = reg1d >> 4;
+  s.bandwidthHz = bandwidthTable[bwCode < 10 ? bwCode : 9];
+  s.codingRate4 = uint8_t(((reg1d & RH_RF95_CODING_RATE) >> 1) + 4);
+  s.preambleLength = preambleLength;
+  s.txPowerdBm = txPowerdBm;
+  s.crcOn = (reg1e & RH_RF95_PAYLOAD_CRC_ON) != 0;
+  return s;
+}
+
+uint64_t RH_RF95::simListeningSince () const
+{
+  return (_mode == RHModeRx && !_rxBufValid) ? listeningSince : UINT64_MAX;
+}
+
+void RH_RF95::simDeliver (simFrame_t const & frame, int16_t rssi, int8_t snr)
+{
+  if (frame.bytes.size() < RH_RF95_HEADER_LEN)
+  {
+    _rxBad++;
+    return;
+  }
+  uint8_t to = frame.bytes[0];
+  if (!_promiscuous && to != _thisAddress && to != RH_BROADCAST_ADDRESS)
+  {
+    // Not for us: the modem stays in RX.
+    return;
+  }
+  memcpy(_buf, frame.bytes.data(), frame.bytes.size());
+  _bufLen = uint8_t(frame.bytes.size());
+  _rxHeaderTo = frame.bytes[0];
+  _rxHeaderFrom = frame.bytes[1];
+  _rxHeaderId = frame.bytes[2];
+  _rxHeaderFlags = frame.bytes[3];
+  _lastRssi = rssi;
+  _lastSNR = snr;
+  _rxGood++;
+  _rxBufValid = true;
+  changeMode(RHModeIdle);
+}
+
+void RH_RF95::simTxDone (simFrame_t const & frame)
+{
+  (void)frame;
+  _txGood++;
+  changeMode(RHModeIdle);
+}
@@ -0,0 +1,166 @@
+/**
+ * @file RH_RF95.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for RadioHead's RH_RF95 driver, attached to the simulated LoRa channel.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Only used by the host build. Follows the real driver's behaviour where it matters for timing:
+ * - send() waits for any previous packet, runs waitCAD(), starts the transmission and returns; the radio goes idle when TX is done.
+ * - available() puts the radio in RX; a valid packet for this node leaves it idle, holding the packet, until recv().
+ * - The modem configuration registers (0x1D, 0x1E, 0x26) are the source of truth for SF/BW/CR.
+ * - Writing CAD to the op mode register starts a CAD; CadDone and CadDetected show in the IRQ flags two symbols later.
+ */
+
+#ifndef RH_RF95_h
+#define RH_RF95_h
+
+#include <RHGenericDriver.h>
+#include <simLoRaChannel.h>
+
+#define RH_RF95_FIFO_SIZE        255
+#define RH_RF95_MAX_PAYLOAD_LEN  RH_RF95_FIFO_SIZE
+#define RH_RF95_HEADER_LEN       4
+#define RH_RF95_FXOSC            32000000.0
+#define RH_RF95_FSTEP            (RH_RF95_FXOSC / 524288)
+
+#define RH_RF95_REG_01_OP_MODE       0x01
+#define RH_RF95_REG_09_PA_CONFIG     0x09
+#define RH_RF95_REG_12_IRQ_FLAGS     0x12
+#define RH_RF95_REG_1D_MODEM_CONFIG1 0x1d
+#define RH_RF95_REG_1E_MODEM_CONFIG2 0x1e
+#define RH_RF95_REG_26_MODEM_CONFIG3 0x26
+#define RH_RF95_REG_40_DIO_MAPPING1  0x40
+#define RH_RF95_REG_4D_PA_DAC        0x4d
+
+#define RH_RF95_MODE                 0x07
+#define RH_RF95_MODE_CAD             0x07
+#define RH_RF95_CAD_DONE             0x04
+#define RH_RF95_CAD_DETECTED         0x01
+
+#define RH_RF95_PA_SELECT            0x80
+#define RH_RF95_OUTPUT_POWER         0x0f
+#define RH_RF95_PA_DAC_DISABLE       0x04
+#define RH_RF95_PA_DAC_ENABLE        0x07
+
+#define RH_RF95_BW                   0xf0
+#define RH_RF95_BW_125KHZ            0x70
+#define RH_RF95_BW_250KHZ            0x80
+#define RH_RF95_BW_500KHZ            0x90
+#define RH_RF95_CODING_RATE          0x0e
+#define RH_RF95_CODING_RATE_4_5      0x02
+#define RH_RF95_CODING_RATE_4_6      0x04
+#define RH_RF95_CODING_RATE_4_7      0x06
+#define RH_RF95_CODING_RATE_4_8      0x08
+#define RH_RF95_SPREADING_FACTOR     0xf0
+#define RH_RF95_PAYLOAD_CRC_ON       0x04
+#define RH_RF95_LOW_DATA_RATE_OPTIMIZE 0x08
+#define RH_RF95_AGC_AUTO_ON          0x04
+
+class RH_RF95 : public RHGenericDriver, public simRadioPort
+{
+  public:
+    /**
+     * @brief Modem register values, as in RadioHead.
+     *
+     */
+    typedef struct
+    {
+      uint8_t reg_1d;
+      uint8_t reg_1e;
+      uint8_t reg_26;
+    } ModemConfig;
+
+    typedef enum
+    {
+      Bw125Cr45Sf128 = 0,
+      Bw500Cr45Sf128,
+      Bw31_25Cr48Sf512,
+      Bw125Cr48Sf4096
+    } ModemConfigChoice;
+
+    RH_RF95 (uint8_t slaveSelectPin = 8,
+             uint8_t interruptPin = 3);
+    ~RH_RF95 ();
+    bool init () override;
+    bool available () override;
+    bool recv (uint8_t * buf, uint8_t * len) override;
+    bool send (uint8_t const * data, uint8_t len) override;
+    uint8_t maxMessageLength () override;
+    bool isChannelActive () override;
+    bool sleep () override;
+    bool setFrequency (float centre);
+    void setModeIdle ();
+    void setModeRx ();
+    void setModeTx ();
+    void setTxPower (int8_t power, bool useRFO = false);
+    void setModemRegisters (ModemConfig const * config);
+    bool setModemConfig (ModemConfigChoice index);
+    void setPreambleLength (uint16_t bytes);
+    void setSpreadingFactor (uint8_t sf);
+    void setSignalBandwidth (long sbw);
+    void setCodingRate4 (uint8_t denominator);
+    void setLowDatarate ();
+    void setPayloadCRC (bool on);
+    /**
+     * @brief Register access, public as in RadioHead's RHSPIDriver. Writes to the modem and PA registers take effect in the simulation.
+     *
+     */
+    uint8_t spiRead (uint8_t reg);
+    uint8_t spiWrite (uint8_t reg, uint8_t value);
+    uint8_t spiBurstWrite (uint8_t reg, uint8_t const * src, uint8_t len);
+    int lastSNR () { return _lastSNR; }
+    int frequencyError () { return 0; }
+
+    //----------------------
+    // Simulation extras
+    //----------------------
+
+    /**
+     * @brief Number of SPI register writes issued since construction. A burst counts once.
+     *
+     */
+    uint32_t simRegisterWrites () const { return registerWrites; }
+    /**
+     * @brief Virtual time spent in each RHMode since construction, in microseconds.
+     *
+     */
+    uint64_t simMicrosInMode (RHMode m);
+    int simRadioIndex () const { return radioIndex; }
+
+    // simRadioPort
+    simRadioSettings_t simSettings () const override;
+    uint64_t simListeningSince () const override;
+    void simDeliver (simFrame_t const & frame, int16_t rssi, int8_t snr) override;
+    void simTxDone (simFrame_t const & frame) override;
+
+  private:
+    void writeRegister (uint8_t reg, uint8_t value);
+    void serviceCad ();
+    void changeMode (RHMode m);
+
+    int radioIndex;
+    uint8_t reg1d = RH_RF95_BW_125KHZ | RH_RF95_CODING_RATE_4_5;
+    uint8_t reg1e = (7 << 4) | RH_RF95_PAYLOAD_CRC_ON;
+    uint8_t reg26 = RH_RF95_AGC_AUTO_ON;
+    uint32_t frequencyHz = 434000000;
+    int8_t txPowerdBm = 13;
+    uint8_t paConfig = RH_RF95_PA_SELECT | (13 - 2);
+    uint8_t paDac = RH_RF95_PA_DAC_DISABLE;
+    uint16_t preambleLength = 8;
+    uint8_t _buf[RH_RF95_MAX_PAYLOAD_LEN];
+    uint8_t _bufLen = 0;
+    bool _rxBufValid = false;
+    int _lastSNR = 0;
+    uint64_t listeningSince = UINT64_MAX;
+    uint64_t modeSince = 0;
+    uint64_t microsInMode[RHModeCad + 1] = {0};
+    uint32_t registerWrites = 0;
+    uint8_t irqFlags = 0;
+    uint64_t cadEndMicros = UINT64_MAX; ///< When the CAD started through the op mode register is done.
+    bool cadHeard = false;
+};
+
+#endif // RH_RF95_h
@@ -0,0 +1,76 @@
+/**
+ * @file SD.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for the Arduino SD library.
+ * @version 0.1
+ * @date 2021-09-19
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <SD.h>
+
+SDClass SD;
+
+size_t File::write (uint8_t const * buf, size_t size)
+{
+  if (data == NULL || !(mode & 0x02))
+  {
+    return 0;
+  }
+  SD.numWrites++;
+  data->insert(data->end(), buf, buf + size);
+  return size;
+}
+
+int File::read ()
+{
+  if (available() <= 0)
+  {
+    return -1;
+  }
+  return (*data)[readPosition++];
+}
+
+int File::read (void * buf, uint16_t len)
+{
+  uint16_t count = min(uint16_t(available()), len);
+  if (count > 0)
+  {
+    memcpy(buf, data->data() + readPosition, count);
+    readPosition += count;
+  }
+  return count;
+}
+
+bool File::seek (uint32_t const pos)
+{
+  if (data == NULL || pos > data->size())
+  {
+    return false;
+  }
+  readPosition = pos;
+  return true;
+}
+
+void File::flush ()
+{
+  if (data != NULL)
+  {
+    SD.numFlushes++;
+  }
+}
+
+File SDClass::open (char const * fileName, uint8_t const mode)
+{
+  if (!present)
+  {
+    return File();
+  }
+  if (!(mode & 0x02) && !exists(fileName))
+  {
+    return File();
+  }
+  return File(&files[fileName], mode);
+}
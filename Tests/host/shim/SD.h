@@ -0,0 +1,81 @@
+/**
+ * @file SD.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Host stand-in for the Arduino SD library. Files live in memory, and writes and syncs are counted.
+ * @version 0.1
+ * @date 2021-09-19
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Only the calls used by this library are here. Like the real library, FILE_WRITE appends.
+ */
+
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+
+#define FILE_READ  0x01
+#define FILE_WRITE 0x13
+
+class File : public Stream
+{
+  public:
+    File () {}
+    File (std::vector<uint8_t> * _data,
+          uint8_t const _mode):
+          data{_data},
+          mode{_mode} {}
+    size_t write (uint8_t c) override { return write(&c, 1); }
+    size_t write (uint8_t const * buf, size_t size) override;
+    int available () override { return data == NULL ? 0 : int(data->size() - readPosition); }
+    int read () override;
+    int read (void * buf, uint16_t len);
+    int peek () override { return available() > 0 ? (*data)[readPosition] : -1; }
+    void flush () override;
+    void close () { data = NULL; }
+    bool seek (uint32_t const pos);
+    uint32_t position () const { return readPosition; }
+    uint32_t size () const { return data == NULL ? 0 : data->size(); }
+    operator bool () const { return data != NULL; }
+  private:
+    std::vector<uint8_t> * data = NULL;
+    uint8_t mode = 0;
+    size_t readPosition = 0; ///< Where reads start. Writes always append, as with FILE_WRITE on the real library.
+};
+
+class SDClass
+{
+  public:
+    bool begin (uint8_t const csPin) { return present; }
+    File open (char const * fileName, uint8_t const mode = FILE_READ);
+    File open (String const & fileName, uint8_t const mode = FILE_READ) { return open(fileName.c_str(), mode); }
+    bool exists (char const * fileName) { return files.count(fileName) != 0; }
+    bool remove (char const * fileName) { return files.erase(fileName) != 0; }
+
+    //------------------
+    // Host-only extras
+    //------------------
+
+    /**
+     * @brief Contents of a file, created empty if it does not exist.
+     *
+     */
+    std::vector<uint8_t> & contents (char const * fileName) { return files[fileName]; }
+    /**
+     * @brief Forget every file and count.
+     *
+     */
+    void reset () { files.clear(); numWrites = 0; numFlushes = 0; present = true; }
+    uint32_t numWrites = 0;  ///< Calls to File::write.
+    uint32_t numFlushes = 0; ///< Calls to File::flush.
+    bool present = true;     ///< False to fail begin() and open(), as with no card in the slot.
+  private:
+    std::map<std::string, std::vector<uint8_t>> files;
+};
+
+extern SDClass SD;
+
+#endif // HOST_SD_H
@@ -0,0 +1,277 @@
+/**
+ * @file simLoRaChannel.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief In-process model of the LoRa channel shared by every simulated RFM95.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <simLoRaChannel.h>
+#include <loraPoint2PointCommon.h>
+#include <math.h>
+
+simLoRaChannel & simLoRaChannel::instance ()
+{
+  static simLoRaChannel channel;
+  return channel;
+}
+
+simLoRaChannel::simLoRaChannel ()
+{
+  rng.seed(1);
+  simScheduler::instance().addEventSource(this);
+}
+
+int simLoRaChannel::attach (simRadioPort * radio)
+{
+  radios.push_back(radio);
+  return int(radios.size()) - 1;
+}
+
+void simLoRaChannel::detach (int radio)
+{
+  if (radio >= 0 && radio < int(radios.size()))
+  {
+    radios[radio] = NULL;
+  }
+}
+
+void simLoRaChannel::setPathLoss (int a, int b, double dB)
+{
+  pathLossTable[std::make_pair(std::min(a, b), std::max(a, b))] = dB;
+}
+
+void simLoRaChannel::setInterference (double framesPerSecond,
+                                      uint32_t durationMicros)
+{
+  interferenceRate = framesPerSecond;
+  interferenceDurationMicros = durationMicros;
+}
+
+double simLoRaChannel::noiseFloordBm (uint32_t bandwidthHz,
+                                      double noiseFiguredB)
+{
+  return -174.0 + 10.0 * log10(double(bandwidthHz)) + noiseFiguredB;
+}
+
+double simLoRaChannel::demodulationFloordB (uint8_t spreadingFactor)
+{
+  // SX1276 datasheet, table 13.
+  return -2.5 * (double(spreadingFactor) - 4.0);
+}
+
+double simLoRaChannel::pathLoss (int a, int b) const
+{
+  std::map<std::pair<int, int>, double>::const_iterator it =
+    pathLossTable.find(std::make_pair(std::min(a, b), std::max(a, b)));
+  return (it == pathLossTable.end()) ? defaultPathLossdB : it->second;
+}
+
+double simLoRaChannel::receivedPowerdBm (simFrame_t const & frame, int receiver) const
+{
+  return double(frame.settings.txPowerdBm) - pathLoss(frame.sender, receiver);
+}
+
+bool simLoRaChannel::sameChannel (simRadioSettings_t const & a,
+                                  simRadioSettings_t const & b) const
+{
+  uint32_t df = (a.frequencyHz > b.frequencyHz) ? a.frequencyHz - b.frequencyHz
+                                                : b.frequencyHz - a.frequencyHz;
+  return df < 10000
+         && a.spreadingFactor == b.spreadingFactor
+         && a.bandwidthHz == b.bandwidthHz;
+}
+
+uint64_t simLoRaChannel::transmit (int radio,
+                                   simRadioSettings_t const & settings,
+                                   uint8_t const * bytes,
+                                   uint8_t len)
+{
+  simFrame_t frame;
+  frame.id = nextFrameId++;
+  frame.sender = radio;
+  frame.settings = settings;
+  frame.startMicros = simScheduler::instance().nowMicros();
+  uint32_t airtime = loraPoint2PointCommon::airtimeMicros(settings.spreadingFactor,
+                                                          settings.bandwidthHz,
+                                                          len,
+                                                          settings.codingRate4,
+                                                          settings.preambleLength,
+                                                          settings.crcOn);
+  frame.endMicros = frame.startMicros + airtime;
+  frame.bytes.assign(bytes, bytes + len);
+  frame.delivered = false;
+  frames.push_back(frame);
+  stats.framesSent++;
+  stats.airtimeMicros += airtime;
+  return frame.endMicros;
+}
+
+bool simLoRaChannel::channelActive (int radio)
+{
+  simRadioPort * r = radios[radio];
+  simRadioSettings_t s = r->simSettings();
+  uint64_t now = simScheduler::instance().nowMicros();
+  double floordBm = noiseFloordBm(s.bandwidthHz, noiseFiguredB)
+                    + demodulationFloordB(s.spreadingFactor);
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    simFrame_t const & f = frames[i];
+    if (f.sender != radio
+        && f.startMicros <= now
+        && f.endMicros > now
+        && sameChannel(f.settings, s)
+        && receivedPowerdBm(f, radio) >= floordBm)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t simLoRaChannel::nextEventMicros ()
+{
+  uint64_t next = UINT64_MAX;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (!frames[i].delivered)
+    {
+      next = std::min(next, frames[i].endMicros);
+    }
+  }
+  return next;
+}
+
+void simLoRaChannel::processEvents (uint64_t now)
+{
+  // Deliver in order of end time; ties in order of transmission.
+  for (;;)
+  {
+    simFrame_t * due = NULL;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      if (!frames[i].delivered
+          && frames[i].endMicros <= now
+          && (due == NULL || frames[i].endMicros < due->endMicros))
+      {
+        due = &frames[i];
+      }
+    }
+    if (due == NULL)
+    {
+      break;
+    }
+    deliver(*due);
+  }
+  // Keep finished frames around for as long as they can still overlap a frame in flight.
+  uint64_t oldestStart = now;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (!frames[i].delivered)
+    {
+      oldestStart = std::min(oldestStart, frames[i].startMicros);
+    }
+  }
+  std::vector<simFrame_t> keep;
+  for (size_t i = 0; i < frames.size(); i++)
+  {
+    if (!frames[i].delivered || frames[i].endMicros > oldestStart)
+    {
+      keep.push_back(frames[i]);
+    }
+  }
+  frames.swap(keep);
+}
+
+void simLoRaChannel::deliver (simFrame_t & frame)
+{
+  frame.delivered = true;
+  simFrame_t const copy = frame; // radios may transmit from their callbacks and reallocate frames.
+  if (copy.sender >= 0 && copy.sender < int(radios.size()) && radios[copy.sender] != NULL)
+  {
+    radios[copy.sender]->simTxDone(copy);
+  }
+  uint32_t airtime = uint32_t(copy.endMicros - copy.startMicros);
+  uint32_t symbolMicros = (uint32_t(1) << copy.settings.spreadingFactor) * 1000000UL
+                          / copy.settings.bandwidthHz;
+  // A receiver has to be listening before the last few preamble symbols to lock on.
+  uint64_t latestLockMicros = copy.startMicros
+                              + uint64_t(copy.settings.preambleLength > 4 ? copy.settings.preambleLength - 4 : 0)
+                                * symbolMicros;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::normal_distribution<double> fading(0.0, fadingStdDevdB > 0 ? fadingStdDevdB : 1.0);
+  for (size_t r = 0; r < radios.size(); r++)
+  {
+    simRadioPort * rx = radios[r];
+    if (rx == NULL || int(r) == copy.sender)
+    {
+      continue;
+    }
+    if (!sameChannel(rx->simSettings(), copy.settings))
+    {
+      continue;
+    }
+    if (rx->simListeningSince() > latestLockMicros)
+    {
+      stats.lostNotListening++;
+      continue;
+    }
+    double fadedB = (fadingStdDevdB > 0) ? fading(rng) : 0.0;
+    double rssi = receivedPowerdBm(copy, int(r)) + fadedB;
+    double snr = rssi - noiseFloordBm(copy.settings.bandwidthHz, noiseFiguredB);
+    bool collided = false;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      simFrame_t const & other = frames[i];
+      if (other.id == copy.id
+          || other.sender == int(r)
+          || !sameChannel(other.settings, copy.settings)
+          || other.endMicros <= copy.startMicros
+          || other.startMicros >= copy.endMicros)
+      {
+        continue;
+      }
+      if (rssi - receivedPowerdBm(other, int(r)) < captureThresholddB)
+      {
+        collided = true;
+        break;
+      }
+    }
+    if (collided)
+    {
+      stats.lostCollision++;
+      continue;
+    }
+    if (interferenceRate > 0)
+    {
+      double window = double(airtime + interferenceDurationMicros) / 1e6;
+      if (uniform(rng) < 1.0 - exp(-interferenceRate * window))
+      {
+        stats.lostInterference++;
+        continue;
+      }
+    }
+    if (snr < demodulationFloordB(copy.settings.spreadingFactor))
+    {
+      stats.lostSnr++;
+      continue;
+    }
+    if (lossProbability > 0 && uniform(rng) < lossProbability)
+    {
+      stats.lostRandom++;
+      continue;
+    }
+    if (dropFilter && dropFilter(copy, int(r)))
+    {
+      stats.lostFilter++;
+      continue;
+    }
+    stats.framesDelivered++;
+    rx->simDeliver(copy,
+                   int16_t(lround(rssi)),
+                   int8_t(std::max(-128L, std::min(127L, lround(snr)))));
+  }
+}
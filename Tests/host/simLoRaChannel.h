@@ -0,0 +1,198 @@
+/**
+ * @file simLoRaChannel.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief In-process model of the LoRa channel shared by every simulated RFM95.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Models, per frame:
+ * - Time on air from spreading factor, bandwidth, coding rate, preamble and payload length (Semtech AN1200.13).
+ * - Received power from TX power and a configurable path loss, with optional Gaussian fading.
+ * - SNR against the thermal noise floor of the bandwidth, and the per-SF demodulation floor of the SX1276.
+ * - Collisions between overlapping frames on the same frequency and spreading factor, with a capture threshold.
+ * - Background interference as a Poisson process, and a flat random loss probability.
+ * - Receivers must already be listening when the preamble starts and keep listening until the frame ends.
+ */
+
+#ifndef SIM_LORA_CHANNEL_H
+#define SIM_LORA_CHANNEL_H
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <random>
+#include <vector>
+#include <simScheduler.h>
+
+/**
+ * @brief Modulation settings of one radio, as decoded from its registers.
+ *
+ */
+struct simRadioSettings_t
+{
+  uint32_t frequencyHz;
+  uint8_t  spreadingFactor;
+  uint32_t bandwidthHz;
+  uint8_t  codingRate4;
+  uint16_t preambleLength;
+  int8_t   txPowerdBm;
+  bool     crcOn;
+};
+
+/**
+ * @brief One transmission on the channel. bytes holds the 4 RadioHead header octets followed by the payload.
+ *
+ */
+struct simFrame_t
+{
+  uint32_t id;
+  int sender;
+  simRadioSettings_t settings;
+  uint64_t startMicros;
+  uint64_t endMicros;
+  std::vector<uint8_t> bytes;
+  bool delivered;
+};
+
+/**
+ * @brief Interface the simulated radio driver exposes to the channel.
+ *
+ */
+class simRadioPort
+{
+  public:
+    virtual ~simRadioPort () {}
+    virtual simRadioSettings_t simSettings () const = 0;
+    /**
+     * @brief Time since which the radio has been continuously receiving.
+     *
+     * @return uint64_t Virtual time in microseconds, or UINT64_MAX if it is not receiving now.
+     */
+    virtual uint64_t simListeningSince () const = 0;
+    virtual void simDeliver (simFrame_t const & frame, int16_t rssi, int8_t snr) = 0;
+    virtual void simTxDone (simFrame_t const & frame) = 0;
+};
+
+/**
+ * @brief Shared simulated channel. One instance per process.
+ *
+ */
+class simLoRaChannel : public simEventSource
+{
+  public:
+    static simLoRaChannel & instance ();
+
+    /**
+     * @brief Counters for the whole channel.
+     *
+     */
+    struct stats_t
+    {
+      uint32_t framesSent;
+      uint32_t framesDelivered;
+      uint32_t lostRandom;
+      uint32_t lostCollision;
+      uint32_t lostInterference;
+      uint32_t lostSnr;
+      uint32_t lostNotListening;
+      uint32_t lostFilter;
+      uint64_t airtimeMicros;
+    };
+
+    //----------
+    // Radios
+    //----------
+
+    int attach (simRadioPort * radio);
+    void detach (int radio);
+    /**
+     * @brief A radio attached to the channel, e.g. to read its time in each mode. Radios attach in the order they are constructed.
+     *
+     * @return simRadioPort* The radio, or NULL if there is no such radio.
+     */
+    simRadioPort * getRadio (int radio) { return (radio >= 0 && radio < int(radios.size())) ? radios[radio] : NULL; }
+
+    /**
+     * @brief Put a frame on the air from the given radio, starting now.
+     *
+     * @return uint64_t Virtual time in microseconds at which the frame ends.
+     */
+    uint64_t transmit (int radio,
+                       simRadioSettings_t const & settings,
+                       uint8_t const * bytes,
+                       uint8_t len);
+
+    /**
+     * @brief Channel activity detection as seen by a radio: is a LoRa preamble on its settings audible now?
+     *
+     */
+    bool channelActive (int radio);
+
+    //---------------
+    // Configuration
+    //---------------
+
+    void seed (uint32_t seed) { rng.seed(seed); }
+    void setPathLoss (double dB) { defaultPathLossdB = dB; }
+    void setPathLoss (int a, int b, double dB);
+    void setFadingStdDev (double dB) { fadingStdDevdB = dB; }
+    void setLossProbability (double p) { lossProbability = p; }
+    void setNoiseFigure (double dB) { noiseFiguredB = dB; }
+    void setCaptureThreshold (double dB) { captureThresholddB = dB; }
+    /**
+     * @brief Background interferers (other LoRa networks, etc.) on every channel.
+     *
+     * @param framesPerSecond Mean rate of interfering frames.
+     * @param durationMicros  Time on air of each interfering frame.
+     */
+    void setInterference (double framesPerSecond,
+                          uint32_t durationMicros);
+    /**
+     * @brief Drop frames for which filter returns true. Used to inject specific failures.
+     *
+     * @param filter Called with the frame and the index of the receiving radio.
+     */
+    void setDropFilter (std::function<bool(simFrame_t const &, int)> filter) { dropFilter = filter; }
+
+    stats_t const & getStats () const { return stats; }
+    void resetStats () { stats = stats_t(); }
+
+    //---------
+    // Helpers
+    //---------
+
+    static double noiseFloordBm (uint32_t bandwidthHz,
+                                 double noiseFiguredB);
+    static double demodulationFloordB (uint8_t spreadingFactor);
+
+    // simEventSource
+    uint64_t nextEventMicros () override;
+    void processEvents (uint64_t now) override;
+
+  private:
+    simLoRaChannel ();
+    double pathLoss (int a, int b) const;
+    double receivedPowerdBm (simFrame_t const & frame, int receiver) const;
+    void deliver (simFrame_t & frame);
+    bool sameChannel (simRadioSettings_t const & a,
+                      simRadioSettings_t const & b) const;
+
+    std::vector<simRadioPort *> radios;
+    std::vector<simFrame_t> frames;
+    std::map<std::pair<int, int>, double> pathLossTable;
+    std::mt19937 rng;
+    std::function<bool(simFrame_t const &, int)> dropFilter;
+    stats_t stats = stats_t();
+    uint32_t nextFrameId = 1;
+    double defaultPathLossdB = 100;
+    double fadingStdDevdB = 0;
+    double lossProbability = 0;
+    double noiseFiguredB = 6;
+    double captureThresholddB = 6;
+    double interferenceRate = 0;
+    uint32_t interferenceDurationMicros = 0;
+};
+
+#endif // SIM_LORA_CHANNEL_H
@@ -0,0 +1,258 @@
+/**
+ * @file simScheduler.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Virtual-time scheduler for running several sketches (nodes) against each other in one host process.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <simScheduler.h>
+
+simScheduler & simScheduler::instance ()
+{
+  static simScheduler sched;
+  return sched;
+}
+
+simScheduler::~simScheduler ()
+{
+  stop();
+}
+
+void simScheduler::addEventSource (simEventSource * source)
+{
+  sources.push_back(source);
+}
+
+int simScheduler::currentNode () const
+{
+  return running;
+}
+
+int simScheduler::addNode (std::function<void()> setup,
+                           std::function<void()> loop,
+                           uint32_t loopCostMicros)
+{
+  node_t * n = new node_t;
+  n->setup = setup;
+  n->loop = loop;
+  n->loopCostMicros = loopCostMicros ? loopCostMicros : 1;
+  n->wakeAt = now;
+  n->started = false;
+  n->finished = false;
+  n->stack.resize(stackBytes);
+  getcontext(&n->context);
+  n->context.uc_stack.ss_sp = n->stack.data();
+  n->context.uc_stack.ss_size = n->stack.size();
+  n->context.uc_link = &schedulerContext;
+  makecontext(&n->context, &simScheduler::nodeEntry, 0);
+  nodes.push_back(n);
+  return int(nodes.size() - 1);
+}
+
+void simScheduler::nodeEntry ()
+{
+  instance().nodeMain();
+}
+
+void simScheduler::nodeMain ()
+{
+  node_t * n = nodes[running];
+  try
+  {
+    if (stopping)
+    {
+      throw stopped_t();
+    }
+    n->setup();
+    for (;;)
+    {
+      n->loop();
+      waitUntil(now + n->loopCostMicros);
+    }
+  }
+  catch (stopped_t &)
+  {
+  }
+  n->finished = true;
+  // Returning resumes uc_link, i.e. the scheduler.
+}
+
+void simScheduler::resume (int idx)
+{
+  running = idx;
+  nodes[idx]->started = true;
+  swapcontext(&schedulerContext, &nodes[idx]->context);
+  running = -1;
+}
+
+void simScheduler::park ()
+{
+  node_t * n = nodes[running];
+  swapcontext(&n->context, &schedulerContext);
+  if (stopping)
+  {
+    throw stopped_t();
+  }
+}
+
+uint64_t simScheduler::nextEventMicros ()
+{
+  uint64_t next = UINT64_MAX;
+  for (simEventSource * s : sources)
+  {
+    next = std::min(next, s->nextEventMicros());
+  }
+  return next;
+}
+
+void simScheduler::processEvents ()
+{
+  for (simEventSource * s : sources)
+  {
+    if (s->nextEventMicros() <= now)
+    {
+      s->processEvents(now);
+    }
+  }
+}
+
+uint64_t simScheduler::soonestOther (int idx)
+{
+  uint64_t next = std::min(nextEventMicros(), runLimit);
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    node_t * n = nodes[i];
+    if (int(i) == idx || n->finished)
+    {
+      continue;
+    }
+    if (n->condition && n->condition())
+    {
+      return now;
+    }
+    next = std::min(next, n->wakeAt);
+  }
+  return next;
+}
+
+void simScheduler::waitUntil (uint64_t deadline)
+{
+  waitFor(std::function<bool()>(), deadline);
+}
+
+bool simScheduler::waitFor (std::function<bool()> condition,
+                            uint64_t deadline)
+{
+  if (condition && condition())
+  {
+    return true;
+  }
+  int idx = running;
+  if (idx < 0)
+  {
+    advanceMainThread(condition, deadline);
+    return condition ? condition() : false;
+  }
+  node_t * n = nodes[idx];
+  if (deadline < soonestOther(idx))
+  {
+    // Nothing else can happen before the deadline, so skip the hand-off to the scheduler.
+    now = std::max(now, deadline);
+    n->wakeAt = now;
+    return condition ? condition() : false;
+  }
+  n->condition = condition;
+  n->wakeAt = deadline;
+  park();
+  n->condition = std::function<bool()>();
+  return condition ? condition() : false;
+}
+
+void simScheduler::advanceMainThread (std::function<bool()> condition,
+                                      uint64_t deadline)
+{
+  for (;;)
+  {
+    processEvents();
+    if (condition && condition())
+    {
+      return;
+    }
+    uint64_t next = nextEventMicros();
+    if (next > deadline)
+    {
+      now = std::max(now, deadline);
+      return;
+    }
+    now = std::max(now, next);
+  }
+}
+
+void simScheduler::runUntil (uint64_t t)
+{
+  runLimit = t;
+  for (;;)
+  {
+    processEvents();
+    // Round-robin over the nodes that are ready, starting after the one that ran last.
+    int ready = -1;
+    for (size_t i = 1; i <= nodes.size(); i++)
+    {
+      int idx = int((lastRun + i) % nodes.size());
+      node_t * n = nodes[idx];
+      if (n->finished)
+      {
+        continue;
+      }
+      if (n->wakeAt <= now || (n->condition && n->condition()))
+      {
+        ready = idx;
+        break;
+      }
+    }
+    if (ready >= 0)
+    {
+      lastRun = ready;
+      resume(ready);
+      continue;
+    }
+    uint64_t next = nextEventMicros();
+    for (node_t * n : nodes)
+    {
+      if (!n->finished)
+      {
+        next = std::min(next, n->wakeAt);
+      }
+    }
+    if (next > t)
+    {
+      now = std::max(now, t);
+      return;
+    }
+    now = std::max(now, next);
+  }
+}
+
+void simScheduler::stop ()
+{
+  // Resume every node that has started so that stopped_t unwinds its stack.
+  stopping = true;
+  for (size_t i = 0; i < nodes.size(); i++)
+  {
+    if (nodes[i]->started && !nodes[i]->finished)
+    {
+      resume(int(i));
+    }
+  }
+  for (node_t * n : nodes)
+  {
+    delete n;
+  }
+  nodes.clear();
+  stopping = false;
+  lastRun = -1;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file simScheduler.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Virtual-time scheduler for running several sketches (nodes) against each other in one host process.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Each node runs its setup() and loop() as a coroutine with its own stack (ucontext), and only one ever executes at
+ * a time, so runs are deterministic and switching between nodes costs no more than a function call or two. Whenever a node blocks (delay(), waitPacketSent(), waiting for a packet...) it hands control
+ * back to the scheduler, which runs the next node that is ready or, if none are, jumps the virtual clock straight
+ * to the next wake-up or channel event. Idle time therefore costs no wall-clock time.
+ */
+
+#ifndef SIM_SCHEDULER_H
+#define SIM_SCHEDULER_H
+
+#include <stdint.h>
+#include <ucontext.h>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Something that produces timed events, such as the simulated LoRa channel.
+ *
+ */
+class simEventSource
+{
+  public:
+    virtual ~simEventSource () {}
+    /**
+     * @brief Time of the next pending event.
+     *
+     * @return uint64_t Virtual time in microseconds, or UINT64_MAX if nothing is pending.
+     */
+    virtual uint64_t nextEventMicros () = 0;
+    /**
+     * @brief Process every event due at or before now.
+     *
+     * @param now Current virtual time in microseconds.
+     */
+    virtual void processEvents (uint64_t now) = 0;
+};
+
+/**
+ * @brief Virtual clock and cooperative node scheduler. One instance per process.
+ *
+ */
+class simScheduler
+{
+  public:
+    static simScheduler & instance ();
+
+    /**
+     * @brief Current virtual time.
+     *
+     * @return uint64_t Microseconds since the start of the simulation.
+     */
+    uint64_t nowMicros () const { return now; }
+
+    /**
+     * @brief Move the clock, e.g. to just before a millis() wrap. Only call while no nodes are running.
+     *
+     * @param t New virtual time in microseconds.
+     */
+    void setNowMicros (uint64_t t) { now = t; }
+
+    void addEventSource (simEventSource * source);
+
+    /**
+     * @brief Add a node. It only runs inside runUntil/runFor.
+     *
+     * @param setup          Called once when the node first runs.
+     * @param loop           Called repeatedly afterwards.
+     * @param loopCostMicros Virtual CPU time charged for every pass through loop, so busy-polling nodes still let time advance.
+     * @return int           Node index.
+     */
+    int addNode (std::function<void()> setup,
+                 std::function<void()> loop,
+                 uint32_t loopCostMicros = 100);
+
+    /**
+     * @brief Run all nodes until the virtual clock reaches t.
+     *
+     * @param t Virtual time in microseconds.
+     */
+    void runUntil (uint64_t t);
+    void runFor (uint64_t durationMicros) { runUntil(now + durationMicros); }
+
+    /**
+     * @brief Stop all nodes, unwinding their stacks.
+     *
+     */
+    void stop ();
+
+    /**
+     * @brief Block the calling node until the virtual clock reaches deadline.
+     *
+     * Called from outside any node (e.g. from a test's main), this just advances the clock and processes channel events.
+     *
+     * @param deadline Virtual time in microseconds.
+     */
+    void waitUntil (uint64_t deadline);
+
+    /**
+     * @brief Block the calling node until condition() is true or the deadline passes.
+     *
+     * condition() is re-evaluated after every event, which is equivalent to the node polling continuously.
+     *
+     * @param condition Predicate on simulated hardware state.
+     * @param deadline  Virtual time in microseconds.
+     * @return true     Condition became true.
+     * @return false    Deadline passed first.
+     */
+    bool waitFor (std::function<bool()> condition,
+                  uint64_t deadline);
+
+    /**
+     * @brief Index of the node that is currently running.
+     *
+     * @return int Node index, or -1 when called from outside a node.
+     */
+    int currentNode () const;
+
+    ~simScheduler ();
+
+  private:
+    struct node_t
+    {
+      std::function<void()> setup;
+      std::function<void()> loop;
+      uint32_t loopCostMicros;
+      std::function<bool()> condition;
+      uint64_t wakeAt;
+      bool started;
+      bool finished;
+      ucontext_t context;
+      std::vector<char> stack;
+    };
+
+    struct stopped_t {};
+
+    static size_t const stackBytes = 256 * 1024;
+
+    simScheduler () {}
+    static void nodeEntry ();
+    void nodeMain ();
+    void park ();
+    void resume (int idx);
+    uint64_t nextEventMicros ();
+    uint64_t soonestOther (int idx);
+    void processEvents ();
+    void advanceMainThread (std::function<bool()> condition, uint64_t deadline);
+
+    uint64_t now = 0;
+    uint64_t runLimit = 0;
+    int running = -1;
+    int lastRun = -1;
+    bool stopping = false;
+    ucontext_t schedulerContext;
+    std::vector<node_t *> nodes;
+    std::vector<simEventSource *> sources;
+};
+
+#endif // SIM_SCHEDULER_H
@@ -0,0 +1,159 @@
+/**
+ * @file test_adr.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Runs a base with adaptive data rate against an endpoint on the simulated channel.
+ * @version 0.1
+ * @date 2021-09-15
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseTxCount = 0;
+static uint32_t baseAckCount = 0;
+static std::vector<spreadingFactor_t> baseSpreadingFactors;
+
+void baseTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (destAddr != RH_BROADCAST_ADDRESS && txBuf[0] != msgType_linkChangeReq)
+  {
+    baseTxCount++;
+    baseAckCount += ack;
+  }
+}
+
+void baseLinkChangeInd (spreadingFactor_t const newSpreadingFactor,
+                        signalBandwidth_t const newSignalBandwidth,
+                        frequencyChannel_t const newFrequencyChannel,
+                        int8_t const newTxPower)
+{
+  if (baseSpreadingFactors.empty() || baseSpreadingFactors.back() != newSpreadingFactor)
+  {
+    baseSpreadingFactors.push_back(newSpreadingFactor);
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(baseTxInd, NULL, baseLinkChangeInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks();
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+static void startOn (loraPoint2Point & unit)
+{
+  CHECK(unit.setupRadio());
+  unit.setSpreadingFactor(spreadingFactor_sf12);
+  unit.setBandwidth(signalBandwidth_125kHz);
+  unit.setTxPower(MIN_txPower);
+}
+
+static uint32_t countSteps (size_t from, spreadingFactor_t const spreadingFactor)
+{
+  uint32_t steps = 0;
+  for (; from < baseSpreadingFactors.size(); from++)
+  {
+    steps += baseSpreadingFactors[from] == spreadingFactor;
+  }
+  return steps;
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(3);
+  // SNR at 2dBm on 125kHz is -6dB: SF10 on the lowest power, or SF7 with 9dB more.
+  channel.setPathLoss(125);
+  // Half the frames at SF7 are lost, even though the SNR is fine there.
+  uint32_t sf7Frames = 0;
+  channel.setDropFilter([&](simFrame_t const & frame, int receiver)
+                        {
+                          return frame.settings.spreadingFactor == 7 && (sf7Frames++ % 2 == 0);
+                        });
+
+  uint32_t lastDataMillis = 0;
+  sched.addNode([]{ startOn(base); base.startHeartbeats(); base.startAdr(ENDPOINT_ADDR); },
+                [&]{
+                  if (millis() - lastDataMillis > 2000)
+                  {
+                    base.setTxMessage((uint8_t const *)"foobar", 6);
+                    if (base.serviceTx(ENDPOINT_ADDR))
+                    {
+                      lastDataMillis = millis();
+                    }
+                  }
+                  base.serviceRx();
+                },
+                1000);
+  sched.addNode([]{ startOn(endpoint); },
+                []{ endpoint.serviceRx(); },
+                1000);
+
+  // From SF12 toward the fastest setting; SF7 is worse than it looks, so it is rolled back and left alone.
+  sched.runFor(400000000ULL);
+  // SF7 is tried again after each holdoff; let a trial under way be judged before looking.
+  for (int second = 0; second < 30 && base.getSpreadingfactor() == spreadingFactor_sf7; second++)
+  {
+    sched.runFor(1000000ULL);
+  }
+  CHECK_EQ(base.getSpreadingfactor(), spreadingFactor_sf8);
+  CHECK_EQ(endpoint.getSpreadingfactor(), spreadingFactor_sf8);
+  CHECK_EQ(base.getTxPower(), endpoint.getTxPower());
+  CHECK(base.getTxPower() > MIN_txPower);
+  CHECK(countSteps(0, spreadingFactor_sf7) >= 1);
+  CHECK(countSteps(0, spreadingFactor_sf7) <= 400000 / ADR_ROLLBACK_HOLDOFF_MILLIS + 1);
+  CHECK_EQ(baseSpreadingFactors[1], spreadingFactor_sf12); // After the default set by setupRadio.
+  for (size_t i = 2; i < baseSpreadingFactors.size(); i++)
+  {
+    // One step at a time.
+    CHECK(baseSpreadingFactors[i] == baseSpreadingFactors[i - 1] + 1
+          || baseSpreadingFactors[i] + 1 == baseSpreadingFactors[i - 1]);
+  }
+
+  // Once SF7 is as good as it looks, the link settles there.
+  channel.setDropFilter(nullptr);
+  sched.runFor(ADR_ROLLBACK_HOLDOFF_MILLIS * 1000ULL + 120000000ULL);
+  CHECK_EQ(base.getSpreadingfactor(), spreadingFactor_sf7);
+  CHECK_EQ(endpoint.getSpreadingfactor(), spreadingFactor_sf7);
+  CHECK_EQ(base.getTxPower(), endpoint.getTxPower());
+  size_t settled = baseSpreadingFactors.size();
+  uint32_t txBefore = baseTxCount;
+  uint32_t acksBefore = baseAckCount;
+  sched.runFor(300000000ULL);
+  CHECK_EQ(baseSpreadingFactors.size(), settled); // No flapping.
+  CHECK(baseAckCount - acksBefore >= 0.95 * (baseTxCount - txBefore));
+
+  // The link gets worse: ADR buys the margin back with power first, then spreading factor.
+  int8_t txPowerBefore = base.getTxPower();
+  channel.setPathLoss(132);
+  sched.runFor(300000000ULL);
+  CHECK(base.getTxPower() > txPowerBefore || base.getSpreadingfactor() > spreadingFactor_sf7);
+  CHECK_EQ(base.getSpreadingfactor(), endpoint.getSpreadingfactor());
+  CHECK_EQ(base.getTxPower(), endpoint.getTxPower());
+  txBefore = baseTxCount;
+  acksBefore = baseAckCount;
+  sched.runFor(120000000ULL);
+  CHECK(baseAckCount - acksBefore >= 0.95 * (baseTxCount - txBefore));
+
+  sched.stop();
+  printf("Spreading factors:");
+  for (size_t i = 0; i < baseSpreadingFactors.size(); i++)
+  {
+    printf(" %u", 7 + baseSpreadingFactors[i]);
+  }
+  printf("\nSettled on SF%u at %d dBm\n", 7 + base.getSpreadingfactor(), base.getTxPower());
+  return hostTestResult();
+}
@@ -0,0 +1,369 @@
+/**
+ * @file test_bulkTransfer.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the selective-repeat windows, and a bulk transfer of logged data on the simulated channel: throughput against stop-and-wait, loss, and giving up.
+ * @version 0.1
+ * @date 2021-09-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+#define NUM_LINES     200
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t linesReceived = 0;
+static uint32_t linesOutOfOrder = 0;
+static bool lastReceived = false;
+static uint32_t linesAcked = 0;
+static uint32_t bulkDone = 0;
+static bool bulkSucceeded = false;
+static uint32_t doneMillis = 0;
+
+/**
+ * @brief A line of a ProCV logged data dump.
+ *
+ */
+static std::string logLine (uint32_t number)
+{
+  char text [64];
+  snprintf(text, sizeof(text), "2021/09/%02u %02u:%02u:00,%5u,7.%03u,14.%02u,412.%u",
+           unsigned(1 + number / 1440), unsigned(number / 60 % 24), unsigned(number % 60),
+           unsigned(number), unsigned(900 + number % 97), unsigned(number % 89), unsigned(number % 10));
+  return std::string(text);
+}
+
+void baseRxInd (message_t const & rxMsg)
+{
+  std::string line;
+  if (rxMsg.buf[0] == msgType_bulkData)
+  {
+    line.assign((char const *)rxMsg.buf + BULK_HEADER_LEN, rxMsg.bufLen - BULK_HEADER_LEN);
+    lastReceived = rxMsg.buf[3] & BULK_FLAG_LAST;
+  }
+  else if (rxMsg.buf[0] == msgType_dataReq)
+  {
+    line.assign((char const *)rxMsg.buf + 1, rxMsg.bufLen - 1);
+  }
+  else
+  {
+    return;
+  }
+  linesOutOfOrder += line != logLine(linesReceived);
+  linesReceived++;
+}
+
+void endpointTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (txBuf[0] == msgType_dataReq && ack)
+  {
+    linesAcked++;
+    doneMillis = millis();
+  }
+}
+
+void endpointBulkTxInd (uint8_t const destAddr, bool const success)
+{
+  bulkDone++;
+  bulkSucceeded = success;
+  doneMillis = millis();
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(endpointTxInd, NULL, NULL, NULL, endpointBulkTxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+bulkRxContext_t baseBulkRx;
+bulkTxContext_t endpointBulkTx;
+
+//---------
+// Helpers
+//---------
+
+static void testTxWindow ()
+{
+  bulkTxWindow<8, 4> window;
+  uint8_t const frame [4] = {1, 2, 3, 4};
+  for (uint8_t idx = 0; idx < 8; idx++)
+  {
+    CHECK(window.push(frame, sizeof(frame), false));
+  }
+  CHECK(!window.push(frame, sizeof(frame), false));
+  CHECK(!window.push(frame, 5, false));
+  CHECK_EQ(window.space(), 0);
+  uint8_t seq = 0xFF;
+  CHECK(window.nextPending(seq));
+  CHECK_EQ(seq, 0);
+  for (uint8_t idx = 0; idx < 8; idx++)
+  {
+    window.markSent(idx);
+  }
+  CHECK(!window.nextPending(seq));
+
+  // 0 and 1 arrived, then 3 and 5: only 2, 4, 6 and 7 go again.
+  CHECK(window.acknowlege(2, 0x05));
+  CHECK_EQ(window.count(), 6);
+  CHECK_EQ(window.countPending(), 4);
+  CHECK(window.nextPending(seq));
+  CHECK_EQ(seq, 2);
+  CHECK_EQ(window.space(), 2);
+  // Stale and repeated acknowlegements change nothing.
+  CHECK(!window.acknowlege(0, 0));
+  CHECK(!window.acknowlege(2, 0x05));
+  CHECK_EQ(window.count(), 6);
+
+  // An unanswered poll is followed by the oldest frame still in flight.
+  window.markSent(2);
+  window.markSent(4);
+  CHECK(window.resendOldest());
+  CHECK(window.nextPending(seq));
+  CHECK_EQ(seq, 2);
+  CHECK_EQ(window.countPending(), 3);
+  window.markSent(2);
+  window.markSent(6);
+  window.markSent(7);
+  CHECK_EQ(window.countPending(), 0);
+  CHECK(window.resendOldest());
+  CHECK_EQ(window.countPending(), 1);
+
+  // The last frame ends the transfer once everything before it has arrived.
+  CHECK(window.push(frame, 0, true));
+  CHECK(!window.push(frame, 1, false));
+  CHECK_EQ(window.space(), 0);
+  for (uint8_t idx = 2; idx < 9; idx++)
+  {
+    window.markSent(idx);
+  }
+  CHECK(window.acknowlege(9, 0));
+  CHECK(window.isDone());
+
+  // Sequence numbers wrap round.
+  window.clear();
+  uint32_t sent = 0;
+  for (uint32_t round = 0; round < 100; round++)
+  {
+    while (window.push(frame, sizeof(frame), false))
+    {
+    }
+    while (window.nextPending(seq))
+    {
+      window.markSent(seq);
+      sent++;
+    }
+    CHECK(window.acknowlege(uint8_t(sent), 0));
+    CHECK_EQ(window.count(), 0);
+  }
+  CHECK_EQ(sent, 800);
+}
+
+static void testRxWindow ()
+{
+  bulkRxWindow<message_t, 8> window;
+  message_t frame = {0, 0, 0, 0, 1, {0}};
+  window.start(ENDPOINT_ADDR, 7);
+  CHECK(window.isTransfer(ENDPOINT_ADDR, 7));
+  CHECK(!window.isTransfer(ENDPOINT_ADDR, 8));
+  frame.buf[0] = 2;
+  CHECK(window.store(2, frame));
+  frame.buf[0] = 1;
+  CHECK(window.store(1, frame));
+  CHECK(!window.store(1, frame));
+  CHECK(!window.store(0, frame)); // Delivered straight from the RX buffer instead.
+  CHECK(!window.store(8, frame)); // Beyond the window.
+  CHECK(window.nextStored() == NULL);
+  CHECK_EQ(window.getCumulative(), 0);
+  CHECK_EQ(window.getBitmap(), 0x03);
+
+  // Frame 0 arrives: 1 and 2 follow it out.
+  window.advance();
+  CHECK(window.nextStored() != NULL && window.nextStored()->buf[0] == 1);
+  window.advance();
+  CHECK(window.nextStored() != NULL && window.nextStored()->buf[0] == 2);
+  window.advance();
+  CHECK(window.nextStored() == NULL);
+  CHECK_EQ(window.getCumulative(), 3);
+  CHECK_EQ(window.getBitmap(), 0);
+  CHECK(!window.store(1, frame)); // Already delivered.
+  CHECK(window.store(10, frame));
+  CHECK_EQ(window.getBitmap(), 0x40);
+}
+
+static uint32_t bulkFramesOnAir = 0;
+static uint32_t bulkFramesDropped = 0;
+static uint32_t bulkAcksDropped = 0;
+static bool lossy = false;
+static bool deaf = false;
+
+static bool watchChannel (simFrame_t const & frame, int receiver)
+{
+  // bytes holds the 4 header octets (to, from, id, flags) first.
+  if (frame.bytes.size() <= 4)
+  {
+    return false;
+  }
+  if (frame.bytes[4] == msgType_bulkData)
+  {
+    static bool droppedBefore [256] = {false};
+    uint8_t seq = frame.bytes[6];
+    bulkFramesOnAir++;
+    if (deaf || (lossy && seq % 10 == 3 && !droppedBefore[seq]))
+    {
+      droppedBefore[seq] = !deaf;
+      bulkFramesDropped++;
+      return true;
+    }
+  }
+  if (frame.bytes[4] == msgType_bulkAck && lossy && bulkAcksDropped == 0)
+  {
+    bulkAcksDropped++;
+    return true;
+  }
+  return false;
+}
+
+int main ()
+{
+  testTxWindow();
+  testRxWindow();
+
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(5);
+  channel.setPathLoss(100);
+  channel.setDropFilter(watchChannel);
+
+  enum {mode_idle, mode_stopAndWait, mode_bulk} mode = mode_idle;
+  uint32_t linesQueued = 0;
+  sched.addNode([]{ CHECK(base.setupRadio()); base.setBulkRx(&baseBulkRx); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                [&]{
+                  if (mode == mode_stopAndWait)
+                  {
+                    while (linesQueued < NUM_LINES && endpoint.getTxQueueSpace() > 0)
+                    {
+                      std::string line = char(msgType_dataReq) + logLine(linesQueued);
+                      CHECK(endpoint.serviceTx(BASE_ADDR, (uint8_t *)&line[0], line.size(), true));
+                      linesQueued++;
+                    }
+                  }
+                  else if (mode == mode_bulk)
+                  {
+                    while (linesQueued < NUM_LINES && endpoint.getBulkTxSpace() > 0)
+                    {
+                      std::string line = logLine(linesQueued);
+                      CHECK(endpoint.bulkTx((uint8_t const *)line.data(), line.size(), linesQueued == NUM_LINES - 1));
+                      linesQueued++;
+                    }
+                  }
+                  endpoint.serviceRx();
+                },
+                1000);
+  sched.runFor(1000000ULL);
+  // A longer range setting, where acknowlegement turnarounds cost the most.
+  for (loraPoint2Point * unit : {&base, &endpoint})
+  {
+    unit->setSpreadingFactor(spreadingFactor_sf9);
+    unit->setBandwidth(signalBandwidth_125kHz);
+  }
+  sched.runFor(1000000ULL);
+  uint32_t linesAirtimeMicros = 0;
+  for (uint32_t number = 0; number < NUM_LINES; number++)
+  {
+    linesAirtimeMicros += loraPoint2PointCommon::airtimeMicros(9, 125000, RH_RF95_HEADER_LEN + BULK_HEADER_LEN + logLine(number).size());
+  }
+
+  // Stop-and-wait: every line waits for its acknowlegement.
+  uint32_t startMillis = millis();
+  mode = mode_stopAndWait;
+  sched.runFor(200000000ULL);
+  CHECK_EQ(linesAcked, NUM_LINES);
+  CHECK_EQ(linesReceived, NUM_LINES);
+  CHECK_EQ(linesOutOfOrder, 0);
+  uint32_t stopAndWaitMillis = doneMillis - startMillis;
+
+  // Bulk: one acknowlegement per window.
+  mode = mode_idle;
+  linesQueued = 0;
+  linesReceived = 0;
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  CHECK(!endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  startMillis = millis();
+  mode = mode_bulk;
+  sched.runFor(200000000ULL);
+  CHECK_EQ(bulkDone, 1);
+  CHECK(bulkSucceeded);
+  CHECK_EQ(linesReceived, NUM_LINES);
+  CHECK_EQ(linesOutOfOrder, 0);
+  CHECK(lastReceived);
+  CHECK_EQ(bulkFramesOnAir, NUM_LINES);
+  CHECK(!endpoint.isBulkTxActive());
+  uint32_t bulkMillis = doneMillis - startMillis;
+  printf("%u lines: %u ms stop-and-wait, %u ms bulk; %u ms of it data airtime\n",
+         NUM_LINES, stopAndWaitMillis, bulkMillis, linesAirtimeMicros / 1000);
+  // Most of the channel carries data.
+  CHECK(linesAirtimeMicros / 1000 * 10 >= bulkMillis * 8);
+  CHECK(bulkMillis * 10 <= stopAndWaitMillis * 9);
+
+  // Lossy: the first try of one frame in ten, and the first acknowlegement, are lost. Only those go again.
+  mode = mode_idle;
+  linesQueued = 0;
+  linesReceived = 0;
+  lastReceived = false;
+  bulkFramesOnAir = 0;
+  lossy = true;
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  mode = mode_bulk;
+  sched.runFor(200000000ULL);
+  printf("Lossy: %u frames on air for %u lines, %u dropped, %u acknowlegements dropped\n",
+         bulkFramesOnAir, NUM_LINES, bulkFramesDropped, bulkAcksDropped);
+  CHECK_EQ(bulkDone, 2);
+  CHECK(bulkSucceeded);
+  CHECK_EQ(linesReceived, NUM_LINES);
+  CHECK_EQ(linesOutOfOrder, 0);
+  CHECK(lastReceived);
+  CHECK(bulkFramesDropped > 0);
+  // Frames that arrive after a gap are kept in RX buffers, all but one of which can be spared. Those that found none
+  // are sent again, as is the poll whose acknowlegement was lost.
+  CHECK(bulkFramesOnAir <= NUM_LINES + bulkFramesDropped * (1 + BULK_WINDOW_LEN - RX_FRAME_POOL_LEN) + 1);
+
+  // Nobody listening: given up on after BULK_TX_RETRIES polls go unanswered.
+  mode = mode_idle;
+  lossy = false;
+  deaf = true;
+  bulkFramesOnAir = 0;
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  uint8_t const line [] = "gone";
+  CHECK(endpoint.bulkTx(line, sizeof(line), true));
+  CHECK(!endpoint.bulkTx(line, sizeof(line)));
+  sched.runFor(30000000ULL);
+  CHECK_EQ(bulkDone, 3);
+  CHECK(!bulkSucceeded);
+  CHECK_EQ(bulkFramesOnAir, BULK_TX_RETRIES + 1);
+
+  // Stopped by the application.
+  deaf = false;
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  endpoint.stopBulkTx();
+  CHECK_EQ(bulkDone, 4);
+  CHECK(!bulkSucceeded);
+  CHECK_EQ(endpoint.getBulkTxSpace(), 0);
+  CHECK(!endpoint.bulkTx(line, sizeof(line)));
+
+  sched.stop();
+  return hostTestResult();
+}
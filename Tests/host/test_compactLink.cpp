@@ -0,0 +1,244 @@
+/**
+ * @file test_compactLink.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the compact frame header of the lightweight path: frames and acknowlegements on air, repeats and lost acknowlegements, and airtime against RadioHead's header plus a message type byte.
+ * @version 0.1
+ * @date 2021-10-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <deque>
+#include <vector>
+#include <loraCompactLink.h>
+#include <commonMacros.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_RADIO     0 ///< Radios attach in the order they are constructed.
+#define ENDPOINT_RADIO 1
+#define MSG_TYPE_LEN   1 ///< The message type byte of the current framing.
+
+RH_RF95 baseRadio;
+RH_RF95 endpointRadio;
+loraCompactLink baseLink(baseRadio);
+loraCompactLink endpointLink(endpointRadio);
+
+//---------
+// Helpers
+//---------
+
+/**
+ * @brief A frame for the endpoint to send.
+ *
+ */
+struct outgoing_t
+{
+  msgType_t msgType;
+  uint8_t sensorId;
+  std::vector<uint8_t> payload;
+  bool more;
+  bool acked;
+};
+
+static std::deque<outgoing_t> toSend;
+static std::vector<bool> sendResults;
+static std::vector<compactFrame_t> received;
+static std::vector<size_t> dataOnAir; ///< Bytes on air of each frame the endpoint sent.
+static std::vector<size_t> acksOnAir; ///< Bytes on air of each frame the base sent.
+static int acksToDrop = 0;
+static bool dropAll = false;
+
+static void setupRadio (RH_RF95 & radio,
+                        loraCompactLink & link)
+{
+  CHECK(radio.init());
+  radio.setSpreadingFactor(9);
+  radio.setSignalBandwidth(125000);
+  link.init();
+}
+
+static void sendNext ()
+{
+  if (toSend.empty())
+  {
+    return;
+  }
+  outgoing_t const out = toSend.front();
+  toSend.pop_front();
+  if (out.acked)
+  {
+    sendResults.push_back(endpointLink.sendAcked(out.msgType, out.sensorId, out.payload.data(), out.payload.size(), out.more));
+  }
+  else
+  {
+    sendResults.push_back(endpointLink.send(out.msgType, out.sensorId, out.payload.data(), out.payload.size(), out.more));
+  }
+}
+
+static std::vector<uint8_t> payload (uint8_t const len)
+{
+  std::vector<uint8_t> bytes(len);
+  for (uint8_t idx = 0; idx < len; idx++)
+  {
+    bytes[idx] = uint8_t(len + idx * 7);
+  }
+  return bytes;
+}
+
+static bool dropFilter (simFrame_t const & frame,
+                        int receiver)
+{
+  if (frame.sender == ENDPOINT_RADIO)
+  {
+    dataOnAir.push_back(frame.bytes.size());
+    return dropAll;
+  }
+  acksOnAir.push_back(frame.bytes.size());
+  if (acksToDrop > 0)
+  {
+    acksToDrop--;
+    return true;
+  }
+  return dropAll;
+}
+
+static void resetCounts ()
+{
+  sendResults.clear();
+  received.clear();
+  dataOnAir.clear();
+  acksOnAir.clear();
+}
+
+/**
+ * @brief Airtime of a frame and its acknowlegement with RadioHead's header and a message type byte, and with the
+ * compact header, at one setting.
+ *
+ */
+static void compareAirtime (uint8_t const spreadingFactor,
+                            uint32_t const bandwidthHz)
+{
+  uint8_t const payloadLens [] = {1, 8, 24, 60, 120, RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN - MSG_TYPE_LEN};
+  // RHReliableDatagram acknowleges with its header and one byte.
+  uint32_t const currentAck = loraPoint2PointCommon::airtimeMicros(spreadingFactor, bandwidthHz, RH_RF95_HEADER_LEN + 1);
+  uint32_t const compactAck = loraPoint2PointCommon::airtimeMicros(spreadingFactor, bandwidthHz, COMPACT_HEADER_LEN + COMPACT_ACK_LEN);
+  printf("SF%u, %u kHz: acknowlegement %u us -> %u us\n", spreadingFactor, bandwidthHz / 1000, currentAck, compactAck);
+  CHECK(compactAck <= currentAck);
+  for (uint8_t payloadLen : payloadLens)
+  {
+    uint32_t const current = loraPoint2PointCommon::airtimeMicros(spreadingFactor, bandwidthHz, RH_RF95_HEADER_LEN + MSG_TYPE_LEN + payloadLen);
+    uint32_t const compact = loraPoint2PointCommon::airtimeMicros(spreadingFactor, bandwidthHz, COMPACT_HEADER_LEN + MAX(payloadLen, COMPACT_HEADER_LEN));
+    printf("  %3u-byte payload: %7u us -> %7u us (%4.1f%% less), with acknowlegement %7u us -> %7u us\n",
+           payloadLen, current, compact, 100.0 * (current - compact) / current, current + currentAck, compact + compactAck);
+    CHECK(compact <= current);
+  }
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(19);
+  channel.setPathLoss(100);
+  channel.setDropFilter(dropFilter);
+
+  sched.addNode([]{ setupRadio(baseRadio, baseLink); },
+                []{
+                  compactFrame_t frame;
+                  while (baseLink.recv(frame))
+                  {
+                    received.push_back(frame);
+                  }
+                },
+                1000);
+  sched.addNode([]{ setupRadio(endpointRadio, endpointLink); },
+                []{ sendNext(); },
+                1000);
+  sched.runFor(1000000ULL);
+
+  // Every length, type, sensor and flag arrives as sent, two bytes of header on air.
+  std::vector<outgoing_t> const frames = {{msgType_ack, sensor_none, payload(1), false, true},
+                                          {msgType_dataRsp, sensor_proCV, payload(2), false, true},
+                                          {msgType_seaphoxDataRsp, sensor_seapHOx, payload(3), true, true},
+                                          {msgType_aggregatedDataRsp, sensor_none, payload(40), false, true},
+                                          {msgType_procvDataRsp, sensor_proCV, payload(COMPACT_MAX_PAYLOAD_LEN), false, true},
+                                          {msgType_dataReq, sensor_none, payload(10), false, false}};
+  toSend.assign(frames.begin(), frames.end());
+  sched.runFor(10000000ULL);
+  CHECK_EQ(sendResults.size(), frames.size());
+  CHECK_EQ(received.size(), frames.size());
+  for (size_t idx = 0; idx < MIN(received.size(), frames.size()); idx++)
+  {
+    CHECK(sendResults[idx]);
+    CHECK_EQ(received[idx].msgType, frames[idx].msgType);
+    CHECK_EQ(received[idx].sensorId, frames[idx].sensorId);
+    CHECK_EQ(received[idx].more, frames[idx].more);
+    CHECK_EQ(received[idx].seq, (idx + 1) & COMPACT_SEQ_MASK);
+    CHECK(std::vector<uint8_t>(received[idx].buf, received[idx].buf + received[idx].bufLen) == frames[idx].payload);
+    CHECK_EQ(dataOnAir[idx], COMPACT_HEADER_LEN + MAX(frames[idx].payload.size(), size_t(COMPACT_HEADER_LEN)));
+  }
+  // One acknowlegement per acknowleged frame, telling how it was heard.
+  CHECK_EQ(acksOnAir.size(), frames.size() - 1);
+  for (size_t ackLen : acksOnAir)
+  {
+    CHECK_EQ(ackLen, COMPACT_HEADER_LEN + COMPACT_ACK_LEN);
+  }
+  CHECK_EQ(endpointLink.getLastAckSnr(), baseRadio.lastSNR());
+  CHECK_EQ(endpointLink.getLastAckRssi(), baseRadio.lastRssi());
+  CHECK_EQ(endpointLink.getNumRetransmissions(), 0);
+
+  // Nothing to send, or too much.
+  CHECK(!endpointLink.send(msgType_dataRsp, sensor_none, NULL, 0));
+  CHECK(!endpointLink.send(msgType_dataRsp, sensor_none, payload(COMPACT_MAX_PAYLOAD_LEN).data(), COMPACT_MAX_PAYLOAD_LEN + 1));
+  CHECK(!endpointLink.send(NUM_msgTypes, sensor_none, payload(4).data(), 4));
+
+  // Acknowlegements lost: the frame is sent again, and handed to the base once.
+  resetCounts();
+  acksToDrop = 2;
+  toSend.push_back({msgType_procvDataRsp, sensor_proCV, payload(30), false, true});
+  toSend.push_back({msgType_procvDataRsp, sensor_proCV, payload(31), false, true});
+  sched.runFor(10000000ULL);
+  CHECK_EQ(sendResults.size(), 2);
+  CHECK(sendResults[0] && sendResults[1]);
+  CHECK_EQ(endpointLink.getNumRetransmissions(), 2);
+  CHECK_EQ(dataOnAir.size(), 4);
+  CHECK_EQ(received.size(), 2);
+  CHECK(received.size() == 2 && received[0].bufLen == 30 && received[1].bufLen == 31);
+
+  // A sensor the base does not take: neither acknowleged nor handed back, and the others still are.
+  resetCounts();
+  baseLink.setSensorFilter((1 << sensor_none) | (1 << sensor_proCV));
+  toSend.push_back({msgType_seaphoxDataRsp, sensor_seapHOx, payload(20), false, true});
+  toSend.push_back({msgType_procvDataRsp, sensor_proCV, payload(21), false, true});
+  sched.runFor(10000000ULL);
+  CHECK_EQ(sendResults.size(), 2);
+  CHECK(sendResults.size() == 2 && !sendResults[0] && sendResults[1]);
+  CHECK_EQ(dataOnAir.size(), COMPACT_DFLT_RETRIES + 2);
+  CHECK_EQ(acksOnAir.size(), 1);
+  CHECK_EQ(received.size(), 1);
+  CHECK(received.size() == 1 && received[0].sensorId == sensor_proCV);
+  baseLink.setSensorFilter(COMPACT_SENSOR_FILTER_ALL);
+
+  // Nothing gets through: given up once the retries are spent.
+  resetCounts();
+  dropAll = true;
+  toSend.push_back({msgType_dataRsp, sensor_none, payload(12), false, true});
+  sched.runFor(10000000ULL);
+  CHECK_EQ(sendResults.size(), 1);
+  CHECK(sendResults.size() == 1 && !sendResults[0]);
+  CHECK_EQ(dataOnAir.size(), COMPACT_DFLT_RETRIES + 1);
+  CHECK_EQ(received.size(), 0);
+  dropAll = false;
+
+  sched.stop();
+
+  // What the compact header saves, at the lightweight sketches' settings and slower ones.
+  compareAirtime(7, 500000);
+  compareAirtime(9, 125000);
+  compareAirtime(12, 125000);
+  return hostTestResult();
+}
@@ -0,0 +1,249 @@
+/**
+ * @file test_deltaCompressor.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests delta compression of consecutive ProCV and SeapHOx samples, including lost records.
+ * @version 0.1
+ * @date 2021-09-14
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <vector>
+#include <deltaCompressor.h>
+#include <proO.h>
+#include <seapHOx.h>
+#include <hostTest.h>
+
+#define KEYFRAME_INTERVAL 16
+
+static uint32_t rngState = 12345;
+
+/**
+ * @brief Deterministic random value in [-range, range].
+ *
+ */
+static int32_t jitter (int32_t const range)
+{
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return int32_t(rngState % uint32_t(2 * range + 1)) - range;
+}
+
+/**
+ * @brief A run of ProCV samples every 10 minutes, drifting slowly.
+ *
+ */
+static std::vector<std::vector<int32_t> > procvSamples (uint16_t const numSamples)
+{
+  ProCVData data;
+  CHECK(data.setDataFromString("W M,2020,02,28,23,20,00,55651,51716,532.59,4.00,5.60,3.90,0981,12.1"));
+  std::vector<int32_t> values(data.getFields(), data.getFields() + NUM_dataFields);
+  std::vector<std::vector<int32_t> > samples;
+  uint32_t seconds;
+  CHECK(getSecondsSince2000(values.data(), procvTimestampFields, seconds));
+  for (uint16_t i = 0; i < numSamples; i++)
+  {
+    samples.push_back(values);
+    seconds += 600;
+    setSecondsSince2000(values.data(), procvTimestampFields, seconds);
+    values[dataField_zeroAD] += jitter(8);
+    values[dataField_currentAD] += jitter(40);
+    values[dataField_CO2] += jitter(150);
+    values[dataField_AvgIrgaTemp] += jitter(3);
+    values[dataField_Humidity] += jitter(4);
+    values[dataField_HumiditySensorTemp] += jitter(3);
+    values[dataField_GasPressure] += jitter(1);
+    values[dataField_SupplyVoltage] += (i % 8 == 0) ? jitter(1) : 0;
+  }
+  return samples;
+}
+
+/**
+ * @brief A run of SeapHOx samples every 10 minutes, drifting slowly.
+ *
+ */
+static std::vector<std::vector<int32_t> > seapHOxSamples (uint16_t const numSamples)
+{
+  SeapHOxData data;
+  char const * line = "DSPHOX23005, 12/31/2023 23:00:00, 1442, 0000, 4.6021, 7.9512, 7.9498, -0.981234, -1.020145, 4.7113, 10.532, 31.2045, 3.18342, 7.021, 12.3, 5.1";
+  CHECK(data.setDataFromString(line, strlen(line)));
+  std::vector<int32_t> values(data.getFields(), data.getFields() + NUM_seapHOxFields);
+  std::vector<std::vector<int32_t> > samples;
+  uint32_t seconds;
+  CHECK(getSecondsSince2000(values.data(), seapHOxTimestampFields, seconds));
+  for (uint16_t i = 0; i < numSamples; i++)
+  {
+    samples.push_back(values);
+    seconds += 600;
+    setSecondsSince2000(values.data(), seapHOxTimestampFields, seconds);
+    values[seapHOxField_sampleNumber]++;
+    values[seapHOxField_temperature] += jitter(30);
+    values[seapHOxField_externalPH] += jitter(8);
+    values[seapHOxField_internalPH] += jitter(8);
+    values[seapHOxField_externalPHVolts] += jitter(60);
+    values[seapHOxField_internalPHVolts] += jitter(60);
+    values[seapHOxField_pHTemperature] += jitter(30);
+    values[seapHOxField_pressure] += jitter(4);
+    values[seapHOxField_salinity] += jitter(10);
+    values[seapHOxField_conductivity] += jitter(20);
+    values[seapHOxField_oxygen] += jitter(5);
+  }
+  return samples;
+}
+
+static void testTimestamp ()
+{
+  timestampFields_t const ts = {0, 1, 2, 3, 4, 5};
+  int32_t values [6] = {2000, 1, 1, 0, 0, 0};
+  uint32_t seconds = 1;
+  CHECK(getSecondsSince2000(values, ts, seconds));
+  CHECK_EQ(seconds, 0);
+  int32_t leapDay [6] = {2024, 2, 29, 12, 30, 15};
+  CHECK(getSecondsSince2000(leapDay, ts, seconds));
+  CHECK_EQ(seconds, 762525015UL); // date -u -d 2024-02-29T12:30:15 +%s, minus 946684800.
+  int32_t back [6] = {0};
+  setSecondsSince2000(back, ts, seconds);
+  CHECK(memcmp(back, leapDay, sizeof(back)) == 0);
+
+  int32_t const bad [][6] =
+  {
+    {2023, 2, 29, 0, 0, 0},
+    {2024, 2, 30, 0, 0, 0},
+    {2024, 4, 31, 0, 0, 0},
+    {2024, 13, 1, 0, 0, 0},
+    {2024, 0, 1, 0, 0, 0},
+    {2024, 1, 0, 0, 0, 0},
+    {2024, 1, 1, 24, 0, 0},
+    {1999, 12, 31, 0, 0, 0},
+  };
+  for (uint8_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    CHECK(!getSecondsSince2000(bad[i], ts, seconds));
+  }
+
+  // Every day for a few years comes back the same.
+  for (uint32_t day = 0; day < 366 * 30; day += 1)
+  {
+    setSecondsSince2000(back, ts, day * 86400 + 3661);
+    CHECK(getSecondsSince2000(back, ts, seconds) && seconds == day * 86400 + 3661);
+  }
+}
+
+/**
+ * @brief Compresses and decompresses samples, checking every one comes back exactly.
+ *
+ * @return double Average compressed bytes per sample.
+ */
+static double roundTrip (packedFieldInfo_t const * table,
+                         uint8_t const numFields,
+                         timestampFields_t const & timestamp,
+                         std::vector<std::vector<int32_t> > const & samples,
+                         uint16_t & keyframes)
+{
+  uint8_t const bitfieldLen = (packedFieldsBits(table, numFields) + 7) / 8;
+  deltaCompressor compressor(table, numFields, timestamp, KEYFRAME_INTERVAL);
+  deltaDecompressor decompressor(table, numFields, timestamp);
+  uint32_t totalLen = 0;
+  keyframes = 0;
+  for (size_t i = 0; i < samples.size(); i++)
+  {
+    uint8_t buf [DELTA_COMPRESSOR_MAX_LEN(64)];
+    uint8_t len = compressor.compress(samples[i].data(), buf);
+    CHECK(len > 0 && len <= DELTA_COMPRESSOR_MAX_LEN(bitfieldLen));
+    keyframes += (buf[0] & DELTA_COMPRESSOR_KEYFRAME_FLAG) != 0;
+    totalLen += len;
+    int32_t values [DELTA_COMPRESSOR_MAX_FIELDS];
+    CHECK(decompressor.decompress(buf, len, values));
+    CHECK(memcmp(values, samples[i].data(), numFields * sizeof(int32_t)) == 0);
+  }
+  CHECK(decompressor.isSynced());
+  CHECK_EQ(decompressor.getNumDropped(), 0);
+  return double(totalLen) / samples.size();
+}
+
+static void testRoundTrip ()
+{
+  uint16_t keyframes;
+  double procvBytes = roundTrip(dataFieldTable, NUM_dataFields, procvTimestampFields, procvSamples(200), keyframes);
+  CHECK_EQ(keyframes, (200 + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL);
+  double seapHOxBytes = roundTrip(seapHOxFieldTable, NUM_seapHOxFields, seapHOxTimestampFields, seapHOxSamples(200), keyframes);
+  CHECK_EQ(keyframes, (200 + KEYFRAME_INTERVAL - 1) / KEYFRAME_INTERVAL);
+  printf("ProCV: %.1f bytes per sample (packed %u)\n", procvBytes, PROCV_BITFIELD_LEN);
+  printf("SeapHOx: %.1f bytes per sample (packed %u)\n", seapHOxBytes, SEAPHOX_BITFIELD_LEN);
+  CHECK(procvBytes < 0.6 * PROCV_BITFIELD_LEN);
+  CHECK(seapHOxBytes < 0.6 * SEAPHOX_BITFIELD_LEN);
+}
+
+static void testLoss ()
+{
+  std::vector<std::vector<int32_t> > samples = procvSamples(3 * KEYFRAME_INTERVAL);
+  deltaCompressor compressor(dataFieldTable, NUM_dataFields, procvTimestampFields, KEYFRAME_INTERVAL);
+  deltaDecompressor decompressor(dataFieldTable, NUM_dataFields, procvTimestampFields);
+  uint16_t lost = 5;
+  uint16_t decoded = 0;
+  for (uint16_t i = 0; i < samples.size(); i++)
+  {
+    uint8_t buf [DELTA_COMPRESSOR_MAX_LEN(PROCV_BITFIELD_LEN)];
+    uint8_t len = compressor.compress(samples[i].data(), buf);
+    if (i == lost)
+    {
+      continue;
+    }
+    int32_t values [NUM_dataFields];
+    bool ok = decompressor.decompress(buf, len, values);
+    // Nothing between the lost record and the next keyframe gets through, everything else does, unchanged.
+    CHECK_EQ(ok, i < lost || i >= KEYFRAME_INTERVAL);
+    if (ok)
+    {
+      decoded++;
+      CHECK(memcmp(values, samples[i].data(), sizeof(values)) == 0);
+    }
+  }
+  CHECK_EQ(decoded, samples.size() - (KEYFRAME_INTERVAL - lost));
+  CHECK_EQ(decompressor.getNumDropped(), KEYFRAME_INTERVAL - lost - 1);
+
+  // A damaged delta record is dropped rather than decoded into garbage.
+  deltaCompressor compressor2(dataFieldTable, NUM_dataFields, procvTimestampFields, KEYFRAME_INTERVAL);
+  deltaDecompressor decompressor2(dataFieldTable, NUM_dataFields, procvTimestampFields);
+  uint8_t buf [DELTA_COMPRESSOR_MAX_LEN(PROCV_BITFIELD_LEN)];
+  int32_t values [NUM_dataFields];
+  uint8_t len = compressor2.compress(samples[0].data(), buf);
+  CHECK(decompressor2.decompress(buf, len, values));
+  len = compressor2.compress(samples[1].data(), buf);
+  CHECK(!(buf[0] & DELTA_COMPRESSOR_KEYFRAME_FLAG));
+  CHECK(!decompressor2.decompress(buf, 1, values));
+  CHECK(!decompressor2.isSynced());
+
+  // A keyframe can be asked for, e.g. when the base restarts.
+  compressor2.requestKeyframe();
+  len = compressor2.compress(samples[2].data(), buf);
+  CHECK(buf[0] & DELTA_COMPRESSOR_KEYFRAME_FLAG);
+  CHECK(decompressor2.decompress(buf, len, values));
+  CHECK(decompressor2.isSynced());
+}
+
+static void testIrregular ()
+{
+  // Clock adjustments, a missed sample and an impossible date all still come back exactly.
+  std::vector<std::vector<int32_t> > samples = procvSamples(12);
+  uint32_t seconds;
+  CHECK(getSecondsSince2000(samples[4].data(), procvTimestampFields, seconds));
+  setSecondsSince2000(samples[4].data(), procvTimestampFields, seconds - 3600 * 24 * 40);
+  CHECK(getSecondsSince2000(samples[7].data(), procvTimestampFields, seconds));
+  setSecondsSince2000(samples[7].data(), procvTimestampFields, seconds + 1200);
+  samples[9][dataField_month] = 14;
+  uint16_t keyframes;
+  roundTrip(dataFieldTable, NUM_dataFields, procvTimestampFields, samples, keyframes);
+  CHECK_EQ(keyframes, 3); // Samples 0, 9 and 10: nothing to send 10's timestamp against.
+}
+
+int main ()
+{
+  testTimestamp();
+  testRoundTrip();
+  testLoss();
+  testIrregular();
+  return hostTestResult();
+}
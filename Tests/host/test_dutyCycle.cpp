@@ -0,0 +1,203 @@
+/**
+ * @file test_dutyCycle.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Runs a base and a duty-cycled endpoint on the simulated channel: sleep and wake requests, long wake-up preambles, time to first byte and radio current.
+ * @version 0.1
+ * @date 2021-09-22
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+#define LISTEN_PERIOD_MILLIS 1000
+
+// SX1276 supply currents (datasheet section 2.5.1), in mA.
+#define SLEEP_mA 0.0002
+#define IDLE_mA  1.6
+#define RX_mA    11.5
+#define TX_mA    120.0 // PA_BOOST at full power, to be safe.
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseDataTx = 0;
+static uint32_t baseDataAcked = 0;
+static uint32_t endpointDataRx = 0;
+static uint32_t lastQueuedMillis = 0;
+static uint32_t worstFirstByteMillis = 0;
+
+void baseTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (txBuf[0] == msgType_dataReq)
+  {
+    baseDataTx++;
+    baseDataAcked += ack;
+  }
+}
+
+void endpointRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] == msgType_dataReq)
+  {
+    endpointDataRx++;
+    worstFirstByteMillis = MAX(worstFirstByteMillis, millis() - lastQueuedMillis);
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(baseTxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(NULL, endpointRxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+//---------
+// Helpers
+//---------
+
+static std::vector<uint16_t> preamblesToEndpoint; ///< Preamble length of every data frame the base sent the endpoint.
+
+static bool watchChannel (simFrame_t const & frame, int receiver)
+{
+  // bytes holds the 4 header octets (to, from, id, flags) first.
+  if (frame.bytes[0] == ENDPOINT_ADDR
+      && frame.bytes.size() > 4
+      && frame.bytes[4] == msgType_dataReq
+      && (frame.bytes[3] & RH_FLAGS_RETRY) == 0)
+  {
+    preamblesToEndpoint.push_back(frame.settings.preambleLength);
+  }
+  return false;
+}
+
+static RH_RF95 & endpointRadio ()
+{
+  // Radios attach in the order they are constructed.
+  return *static_cast<RH_RF95 *>(simLoRaChannel::instance().getRadio(1));
+}
+
+/**
+ * @brief Radio time in each mode since the last call, and the average current over it.
+ *
+ */
+static double averageCurrentmA ()
+{
+  static uint64_t last [RHGenericDriver::RHModeCad + 1] = {0};
+  double charge = 0;
+  uint64_t total = 0;
+  double const modeCurrent [RHGenericDriver::RHModeCad + 1] = {0, SLEEP_mA, IDLE_mA, TX_mA, RX_mA, RX_mA};
+  for (uint8_t mode = RHGenericDriver::RHModeSleep; mode <= RHGenericDriver::RHModeCad; mode++)
+  {
+    uint64_t micros = endpointRadio().simMicrosInMode(RHGenericDriver::RHMode(mode));
+    charge += (micros - last[mode]) * modeCurrent[mode];
+    total += micros - last[mode];
+    last[mode] = micros;
+  }
+  return charge / total;
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(3);
+  channel.setPathLoss(110);
+  channel.setDropFilter(watchChannel);
+
+  uint32_t sendsWanted = 0;
+  uint32_t sendsQueued = 0;
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                [&]{
+                  while (sendsQueued < sendsWanted)
+                  {
+                    base.setTxMessage((uint8_t const *)"sample now", 10);
+                    CHECK(base.serviceTx(ENDPOINT_ADDR));
+                    lastQueuedMillis = millis();
+                    sendsQueued++;
+                  }
+                  base.serviceRx();
+                },
+                1000);
+  uint32_t endpointLoops = 0;
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                [&]{
+                  endpoint.serviceRx();
+                  endpointLoops++;
+                  if (endpoint.isRadioAsleep())
+                  {
+                    // The processor can sleep too, until the next listen.
+                    delay(MIN(endpoint.getMillisUntilNextDeadline(), 60000));
+                  }
+                },
+                1000);
+  sched.runFor(1000000ULL);
+  averageCurrentmA();
+  sched.runFor(10000000ULL);
+  double alwaysOnmA = averageCurrentmA();
+  CHECK(!endpoint.isRadioAsleep());
+
+  // The endpoint sleeps once it has acknowleged the request and lingered.
+  CHECK(base.sleepReq(ENDPOINT_ADDR, LISTEN_PERIOD_MILLIS));
+  sched.runFor(2000000ULL);
+  CHECK(endpoint.isRadioAsleep());
+  averageCurrentmA();
+
+  // A sample request every minute gets through within a listen period and the frame's own airtime.
+  for (uint8_t count = 0; count < 10; count++)
+  {
+    sched.runFor(60000000ULL);
+    sendsWanted++;
+  }
+  sched.runFor(3000000ULL);
+  double dutyCycledmA = averageCurrentmA();
+  uint32_t frameMillis = loraPoint2PointCommon::airtimeMicros(7, 500000, RH_RF95_HEADER_LEN + 11) / 1000;
+  printf("Radio current: %.3f mA always on, %.3f mA duty-cycled; worst time to first byte %u ms\n",
+         alwaysOnmA, dutyCycledmA, unsigned(worstFirstByteMillis));
+  printf("Endpoint loop ran %u times in %u s\n", unsigned(endpointLoops), unsigned(millis() / 1000));
+  CHECK_EQ(endpointDataRx, 10);
+  CHECK_EQ(baseDataAcked, 10);
+  CHECK(worstFirstByteMillis <= LISTEN_PERIOD_MILLIS + frameMillis + 20);
+  CHECK(dutyCycledmA * 10 <= alwaysOnmA);
+  CHECK(endpoint.isRadioAsleep());
+  // Every frame to the sleeping endpoint needed the long preamble.
+  CHECK_EQ(preamblesToEndpoint.size(), 10);
+  for (size_t idx = 0; idx < preamblesToEndpoint.size(); idx++)
+  {
+    CHECK(preamblesToEndpoint[idx] * 256 >= LISTEN_PERIOD_MILLIS * 1000); // 256us symbols at SF7, 500kHz.
+  }
+
+  // Frames that follow closely find the endpoint still listening, and go out with the usual preamble.
+  preamblesToEndpoint.clear();
+  sendsWanted += 3;
+  sched.runFor(3000000ULL);
+  CHECK_EQ(endpointDataRx, 13);
+  CHECK_EQ(preamblesToEndpoint.size(), 3);
+  CHECK(preamblesToEndpoint[0] > RFM95_DFLT_PREAMBLE_LENGTH);
+  CHECK_EQ(preamblesToEndpoint[1], RFM95_DFLT_PREAMBLE_LENGTH);
+  CHECK_EQ(preamblesToEndpoint[2], RFM95_DFLT_PREAMBLE_LENGTH);
+
+  // Woken for good: listens continuously, and is sent to with short preambles.
+  CHECK(base.wakeReq(ENDPOINT_ADDR));
+  sched.runFor(3000000ULL);
+  CHECK(!endpoint.isRadioAsleep());
+  preamblesToEndpoint.clear();
+  sched.runFor(10000000ULL);
+  CHECK(!endpoint.isRadioAsleep());
+  sendsWanted++;
+  sched.runFor(1000000ULL);
+  CHECK_EQ(endpointDataRx, 14);
+  CHECK_EQ(preamblesToEndpoint.size(), 1);
+  CHECK_EQ(preamblesToEndpoint[0], RFM95_DFLT_PREAMBLE_LENGTH);
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,283 @@
+/**
+ * @file test_fec.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the erasure code, and bulk transfers with and without forward error correction over a simulated lossy link.
+ * @version 0.1
+ * @date 2021-09-25
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <random>
+#include <string>
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR       0xBB
+#define ENDPOINT_ADDR   0xEE
+#define NUM_LINES       200
+#define LOSS_PERCENT    20
+#define FEC_GROUP_LEN   4
+#define FEC_PARITY      2
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t linesReceived = 0;
+static uint32_t linesOutOfOrder = 0;
+static uint32_t bulkDone = 0;
+static bool bulkSucceeded = false;
+static uint32_t doneMillis = 0;
+
+static std::string logLine (uint32_t number)
+{
+  char text [64];
+  snprintf(text, sizeof(text), "2021/09/%02u %02u:%02u:00,%5u,7.%03u,14.%02u,412.%u",
+           unsigned(1 + number / 1440), unsigned(number / 60 % 24), unsigned(number % 60),
+           unsigned(number), unsigned(900 + number % 97), unsigned(number % 89), unsigned(number % 10));
+  return std::string(text);
+}
+
+void baseRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] != msgType_bulkData)
+  {
+    return;
+  }
+  std::string line((char const *)rxMsg.buf + BULK_HEADER_LEN, rxMsg.bufLen - BULK_HEADER_LEN);
+  linesOutOfOrder += line != logLine(linesReceived);
+  linesReceived++;
+}
+
+void endpointBulkTxInd (uint8_t const destAddr, bool const success)
+{
+  bulkDone++;
+  bulkSucceeded = success;
+  doneMillis = millis();
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(NULL, NULL, NULL, NULL, endpointBulkTxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+bulkRxContext_t baseBulkRx;
+bulkTxContext_t endpointBulkTx;
+
+//---------
+// Helpers
+//---------
+
+static void testField ()
+{
+  CHECK_EQ(erasureCode::multiply(0x80, 0x02), 0x1D);
+  CHECK_EQ(erasureCode::inverse(0), 0);
+  for (uint32_t a = 1; a < 256; a++)
+  {
+    CHECK_EQ(erasureCode::multiply(uint8_t(a), erasureCode::inverse(uint8_t(a))), 1);
+  }
+}
+
+/**
+ * @brief Loses every combination of up to three data frames of a group of eight, and rebuilds them from as few parity frames.
+ *
+ */
+static void testRecovery ()
+{
+  uint8_t const groupLen = 8;
+  uint8_t const parityFrames = 3;
+  uint8_t frames [groupLen][20];
+  uint8_t frameLens [groupLen];
+  for (uint8_t index = 0; index < groupLen; index++)
+  {
+    frameLens[index] = 5 + 2 * index; // Shorter frames count as padded with zeros.
+    for (uint8_t idx = 0; idx < sizeof(frames[index]); idx++)
+    {
+      frames[index][idx] = idx < frameLens[index] ? uint8_t(37 * index + 11 * idx + 1) : 0;
+    }
+  }
+  fecEncoder<4, 20> encoder;
+  encoder.start(parityFrames);
+  for (uint8_t index = 0; index < groupLen; index++)
+  {
+    encoder.add(index, frames[index], frameLens[index]);
+  }
+  CHECK_EQ(encoder.getNumParity(), parityFrames);
+  CHECK_EQ(encoder.getParityLen(), frameLens[groupLen - 1]);
+
+  fecDecoder<4, 20> decoder;
+  uint32_t groupsRebuilt = 0;
+  for (uint32_t lostMask = 1; lostMask < (1u << groupLen); lostMask++)
+  {
+    uint8_t numLost = __builtin_popcount(lostMask);
+    if (numLost > parityFrames)
+    {
+      continue;
+    }
+    decoder.start(uint8_t(lostMask), parityFrames);
+    for (uint8_t index = 0; index < groupLen; index++)
+    {
+      if (!((lostMask >> index) & 1))
+      {
+        decoder.addData(index, frames[index], frameLens[index]);
+        decoder.addData(index, frames[index], frameLens[index]); // Duplicates are ignored.
+      }
+    }
+    CHECK(!decoder.canRecover());
+    // Only the last numLost parity frames arrive.
+    for (uint8_t j = parityFrames - numLost; j < parityFrames; j++)
+    {
+      decoder.addParity(j, groupLen, encoder.getParity(j), encoder.getParityLen());
+    }
+    CHECK(decoder.canRecover());
+    uint8_t lostIndices [4];
+    CHECK_EQ(decoder.recover(lostIndices), numLost);
+    CHECK(!decoder.canRecover());
+    bool intact = true;
+    for (uint8_t k = 0; k < numLost; k++)
+    {
+      CHECK((lostMask >> lostIndices[k]) & 1);
+      intact = intact && memcmp(decoder.getRecovered(k), frames[lostIndices[k]], decoder.getRecoveredLen()) == 0;
+    }
+    CHECK(intact);
+    groupsRebuilt += intact;
+  }
+  CHECK_EQ(groupsRebuilt, 8 + 28 + 56);
+
+  // One parity frame short: nothing to rebuild from.
+  decoder.start(0, parityFrames);
+  for (uint8_t index = 2; index < groupLen; index++)
+  {
+    decoder.addData(index, frames[index], frameLens[index]);
+  }
+  decoder.addParity(0, groupLen, encoder.getParity(0), encoder.getParityLen());
+  CHECK(!decoder.canRecover());
+}
+
+static std::mt19937 lossRng;
+static uint32_t dataFramesOnAir = 0;
+static uint32_t parityFramesOnAir = 0;
+static uint32_t acksOnAir = 0;
+
+/**
+ * @brief Loses LOSS_PERCENT of the bulk data and parity frames, the same ones run after run.
+ *
+ */
+static bool loseFrames (simFrame_t const & frame, int receiver)
+{
+  // bytes holds the 4 header octets (to, from, id, flags) first.
+  if (frame.bytes.size() <= 4)
+  {
+    return false;
+  }
+  switch (frame.bytes[4])
+  {
+    case msgType_bulkData:
+      dataFramesOnAir++;
+      break;
+    case msgType_bulkParity:
+      parityFramesOnAir++;
+      break;
+    case msgType_bulkAck:
+      acksOnAir++;
+      return false;
+    default:
+      return false;
+  }
+  return lossRng() % 100 < LOSS_PERCENT;
+}
+
+struct transferResult_t
+{
+  uint32_t millis;
+  uint32_t dataFrames;
+  uint32_t parityFrames;
+  uint32_t acks;
+};
+
+int main ()
+{
+  testField();
+  testRecovery();
+
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(3);
+  channel.setPathLoss(100);
+  channel.setDropFilter(loseFrames);
+
+  bool sending = false;
+  uint32_t linesQueued = 0;
+  sched.addNode([]{ CHECK(base.setupRadio()); base.setBulkRx(&baseBulkRx); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                [&]{
+                  while (sending && linesQueued < NUM_LINES && endpoint.getBulkTxSpace() > 0)
+                  {
+                    std::string line = logLine(linesQueued);
+                    CHECK(endpoint.bulkTx((uint8_t const *)line.data(), line.size(), linesQueued == NUM_LINES - 1));
+                    linesQueued++;
+                  }
+                  endpoint.serviceRx();
+                },
+                1000);
+  sched.runFor(1000000ULL);
+  for (loraPoint2Point * unit : {&base, &endpoint})
+  {
+    unit->setSpreadingFactor(spreadingFactor_sf9);
+    unit->setBandwidth(signalBandwidth_125kHz);
+  }
+  sched.runFor(1000000ULL);
+
+  CHECK(!endpoint.setBulkFec(3, 1));
+  CHECK(!endpoint.setBulkFec(2 * BULK_WINDOW_LEN, 1));
+  CHECK(!endpoint.setBulkFec(FEC_GROUP_LEN, BULK_FEC_MAX_PARITY + 1));
+
+  transferResult_t results [2];
+  for (uint8_t run = 0; run < 2; run++)
+  {
+    CHECK(endpoint.setBulkFec(FEC_GROUP_LEN, run == 0 ? 0 : FEC_PARITY));
+    lossRng.seed(7);
+    linesQueued = 0;
+    linesReceived = 0;
+    linesOutOfOrder = 0;
+    dataFramesOnAir = 0;
+    parityFramesOnAir = 0;
+    acksOnAir = 0;
+    CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+    uint32_t startMillis = millis();
+    sending = true;
+    sched.runFor(300000000ULL);
+    sending = false;
+    CHECK_EQ(bulkDone, run + 1);
+    CHECK(bulkSucceeded);
+    CHECK_EQ(linesReceived, NUM_LINES);
+    CHECK_EQ(linesOutOfOrder, 0);
+    results[run] = {doneMillis - startMillis, dataFramesOnAir, parityFramesOnAir, acksOnAir};
+    printf("%s: %u ms, %u data frames, %u parity frames, %u acknowlegements for %u lines\n",
+           run == 0 ? "Without FEC" : "With FEC", results[run].millis, results[run].dataFrames,
+           results[run].parityFrames, results[run].acks, NUM_LINES);
+  }
+  // Lost frames are rebuilt instead of sent again, which saves acknowlegement round trips. Frames after a gap still
+  // need an RX buffer to wait in, so those that found none are sent again either way.
+  CHECK_EQ(results[0].parityFrames, 0);
+  CHECK_EQ(results[1].parityFrames, NUM_LINES / FEC_GROUP_LEN * FEC_PARITY);
+  CHECK((results[1].dataFrames - NUM_LINES) * 3 < (results[0].dataFrames - NUM_LINES) * 2);
+  CHECK(results[1].acks < results[0].acks);
+
+  // Frames too long to be covered are refused.
+  uint8_t longLine [BULK_FEC_MAX_PAYLOAD_LEN + 1] = {0};
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  CHECK(!endpoint.bulkTx(longLine, sizeof(longLine)));
+  CHECK(endpoint.bulkTx(longLine, sizeof(longLine) - 1));
+  CHECK_EQ(endpoint.getBulkTxSpace(), BULK_WINDOW_LEN - 1);
+  endpoint.stopBulkTx();
+
+  sched.stop();
+  return hostTestResult();
+}
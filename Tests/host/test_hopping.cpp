@@ -0,0 +1,227 @@
+/**
+ * @file test_hopping.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Runs a hopping base and endpoint on the simulated channel: the hop sequence, joining, dwell limits and resyncing.
+ * @version 0.1
+ * @date 2021-09-20
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <map>
+#include <set>
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+#define HOP_SEED      0x5EED
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseDataRx = 0;
+static uint32_t endpointDataTx = 0;
+static uint32_t endpointDataAcked = 0;
+static uint32_t endpointJoinedMillis = 0;     ///< When the last join request was acknowleged.
+static uint32_t endpointDirectSyncMillis = 0; ///< When the last beacon sent to the endpoint alone arrived.
+
+void baseRxInd (message_t const & rxMsg)
+{
+  baseDataRx += rxMsg.buf[0] == msgType_dataReq;
+}
+
+void endpointTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (txBuf[0] == msgType_dataReq)
+  {
+    endpointDataTx++;
+    endpointDataAcked += ack;
+  }
+  if (txBuf[0] == msgType_hopJoinReq && ack)
+  {
+    endpointJoinedMillis = millis();
+  }
+}
+
+void endpointRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] == msgType_hopSyncInd && rxMsg.destAddr == ENDPOINT_ADDR)
+  {
+    endpointDirectSyncMillis = millis();
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(endpointTxInd, endpointRxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+//---------
+// Helpers
+//---------
+
+struct airtime_t
+{
+  uint64_t startMicros;
+  uint64_t durationMicros;
+};
+
+static std::map<std::pair<int, uint32_t>, std::vector<airtime_t>> airtimeByFrequency; ///< By sender and frequency.
+static std::set<uint32_t> framesSeen;
+static bool dropBeacons = false;
+
+static bool watchChannel (simFrame_t const & frame, int receiver)
+{
+  if (framesSeen.insert(frame.id).second)
+  {
+    airtime_t airtime = {frame.startMicros, frame.endMicros - frame.startMicros};
+    airtimeByFrequency[std::make_pair(frame.sender, frame.settings.frequencyHz)].push_back(airtime);
+  }
+  // bytes holds the 4 header octets first.
+  return dropBeacons && frame.bytes.size() > 4 && frame.bytes[4] == msgType_hopSyncInd;
+}
+
+/**
+ * @brief Most airtime of one radio on any one frequency within any HOP_DWELL_WINDOW_MILLIS, in micros. The dwell limit is per transmitter.
+ *
+ */
+static uint64_t worstDwellMicros ()
+{
+  uint64_t worst = 0;
+  for (std::map<std::pair<int, uint32_t>, std::vector<airtime_t>>::const_iterator it = airtimeByFrequency.begin(); it != airtimeByFrequency.end(); it++)
+  {
+    std::vector<airtime_t> const & frames = it->second;
+    for (size_t first = 0; first < frames.size(); first++)
+    {
+      uint64_t sum = 0;
+      for (size_t idx = first;
+           idx < frames.size() && frames[idx].startMicros < frames[first].startMicros + HOP_DWELL_WINDOW_MILLIS * 1000ULL;
+           idx++)
+      {
+        sum += frames[idx].durationMicros;
+      }
+      worst = MAX(worst, sum);
+    }
+  }
+  return worst;
+}
+
+static void testSequence ()
+{
+  // Every channel once per cycle, starting on the rendezvous channel.
+  std::set<uint8_t> channels;
+  for (uint32_t slot = 0; slot < NUM_frequencyChannels; slot++)
+  {
+    channels.insert(base.getHopChannel(slot));
+    CHECK_EQ(base.getHopChannel(slot + 7 * NUM_frequencyChannels), base.getHopChannel(slot));
+  }
+  CHECK_EQ(channels.size(), NUM_frequencyChannels);
+  CHECK_EQ(base.getHopChannel(0), RFM95_DFLT_FREQ_CHANNEL);
+  // The endpoint took the same sequence from the beacon.
+  for (uint32_t slot = 0; slot < NUM_frequencyChannels; slot++)
+  {
+    CHECK_EQ(endpoint.getHopChannel(slot), base.getHopChannel(slot));
+  }
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(5);
+  channel.setPathLoss(110);
+  channel.setDropFilter(watchChannel);
+
+  bool sending = false;
+  sched.addNode([]{ CHECK(base.setupRadio()); base.startHopping(HOP_SEED); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); endpoint.joinHopping(BASE_ADDR); },
+                [&]{
+                  if (sending && endpoint.getTxQueueSpace() > 0)
+                  {
+                    endpoint.setTxMessage((uint8_t const *)"a packed sensor rec", 19);
+                    endpoint.serviceTx(BASE_ADDR);
+                  }
+                  endpoint.serviceRx();
+                },
+                1000);
+
+  // Joins within two cycles: the first beacon is at the start of the next cycle.
+  uint32_t cycleMillis = NUM_frequencyChannels * HOP_DFLT_DWELL_MILLIS;
+  CHECK(!endpoint.isHopSynced());
+  sched.runFor(2 * cycleMillis * 1000ULL);
+  CHECK(base.isHopSynced());
+  CHECK(endpoint.isHopSynced());
+  CHECK(int32_t(endpoint.getHopClockMillis() - base.getHopClockMillis()) <= 2);
+  CHECK(int32_t(base.getHopClockMillis() - endpoint.getHopClockMillis()) <= 2);
+  testSequence();
+
+  // Saturate the link: traffic spreads over every channel, and no channel goes over its dwell limit.
+  sending = true;
+  sched.runFor(60000000ULL);
+  sending = false;
+  sched.runFor(2000000ULL);
+  printf("Endpoint sent %u data frames, %u acknowleged; base received %u\n", endpointDataTx, endpointDataAcked, baseDataRx);
+  printf("Worst dwell: %.1f ms per %u ms\n", worstDwellMicros() / 1000.0, HOP_DWELL_WINDOW_MILLIS);
+  CHECK(endpointDataTx > 500);
+  CHECK(endpointDataAcked >= 0.95 * endpointDataTx);
+  CHECK(baseDataRx >= endpointDataAcked);
+  CHECK_EQ(airtimeByFrequency.size(), 2 * NUM_frequencyChannels);
+  CHECK(worstDwellMicros() <= HOP_MAX_DWELL_MILLIS * 1000ULL);
+  CHECK(base.getChannelDwellMicros(base.getFrequencyChannel()) <= HOP_MAX_DWELL_MILLIS * 1000UL);
+
+  // Without beacons the endpoint falls back to the rendezvous channel...
+  dropBeacons = true;
+  sched.runFor((HOP_SYNC_TIMEOUT_CYCLES + 1) * cycleMillis * 1000ULL);
+  CHECK(!endpoint.isHopSynced());
+  CHECK_EQ(endpoint.getFrequencyChannel(), RFM95_DFLT_FREQ_CHANNEL);
+  // ...and picks the hop sequence up again at the next one.
+  dropBeacons = false;
+  sched.runFor(2 * cycleMillis * 1000ULL);
+  CHECK(endpoint.isHopSynced());
+  uint32_t ackedBefore = endpointDataAcked;
+  sending = true;
+  sched.runFor(10000000ULL);
+  sending = false;
+  CHECK(endpointDataAcked > ackedBefore + 50);
+
+  // Joining mid-sequence: the master answers the join with a beacon of its own, on the hop channel, within the dwell.
+  endpoint.stopHopping();
+  while (base.getHopClockMillis() / HOP_DFLT_DWELL_MILLIS % NUM_frequencyChannels != NUM_frequencyChannels / 2)
+  {
+    sched.runFor(10000ULL);
+  }
+  endpointJoinedMillis = 0;
+  endpointDirectSyncMillis = 0;
+  endpoint.joinHopping(BASE_ADDR);
+  sched.runFor(2 * cycleMillis * 1000ULL);
+  CHECK(endpoint.isHopSynced());
+  CHECK(endpointJoinedMillis != 0);
+  CHECK(endpointDirectSyncMillis >= endpointJoinedMillis);
+  CHECK(endpointDirectSyncMillis - endpointJoinedMillis <= HOP_DFLT_DWELL_MILLIS);
+  CHECK(int32_t(endpoint.getHopClockMillis() - base.getHopClockMillis()) <= 2);
+  CHECK(int32_t(base.getHopClockMillis() - endpoint.getHopClockMillis()) <= 2);
+
+  // Back to a fixed channel.
+  base.stopHopping();
+  endpoint.stopHopping();
+  sched.runFor(1000000ULL);
+  CHECK_EQ(base.getFrequencyChannel(), RFM95_DFLT_FREQ_CHANNEL);
+  CHECK_EQ(endpoint.getFrequencyChannel(), RFM95_DFLT_FREQ_CHANNEL);
+  ackedBefore = endpointDataAcked;
+  endpoint.setTxMessage((uint8_t const *)"fixed", 5);
+  CHECK(endpoint.serviceTx(BASE_ADDR));
+  sched.runFor(1000000ULL);
+  CHECK_EQ(endpointDataAcked, ackedBefore + 1);
+
+  sched.stop();
+  return hostTestResult();
+}
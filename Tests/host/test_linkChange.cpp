@@ -0,0 +1,193 @@
+/**
+ * @file test_linkChange.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests link changes confirmed with probes: every request, acknowlegement and probe lost in turn, and both units ending on the same settings each time.
+ * @version 0.1
+ * @date 2021-09-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR      0xBB
+#define ENDPOINT_ADDR  0xEE
+#define BASE_RADIO     0 ///< Radios attach in the order they are constructed.
+#define ENDPOINT_RADIO 1
+
+//-----------
+// Callbacks
+//-----------
+
+userCallbacks_t callbacks = hostTestCallbacks();
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, callbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, callbacks);
+
+//---------
+// Helpers
+//---------
+
+static linkSettings_t const oldSettings = {spreadingFactor_sf8, signalBandwidth_125kHz, frequencyChannel_500kHz_Uplink_1, 14};
+static linkSettings_t const newSettings = {spreadingFactor_sf9, signalBandwidth_125kHz, frequencyChannel_500kHz_Uplink_3, 17};
+static linkSettings_t const rendezvousSettings = {LINK_RENDEZVOUS_SPREADING_FACTOR,
+                                                  LINK_RENDEZVOUS_SIGNAL_BANDWIDTH,
+                                                  LINK_RENDEZVOUS_FREQ_CHANNEL,
+                                                  LINK_RENDEZVOUS_TX_POWER_dBm};
+static uint32_t probesSent = 0;
+
+static bool sameSettings (linkSettings_t const & a,
+                          linkSettings_t const & b)
+{
+  return a.spreadingFactor == b.spreadingFactor
+         && a.signalBandwidth == b.signalBandwidth
+         && a.frequencyChannel == b.frequencyChannel
+         && a.txPower == b.txPower;
+}
+
+static bool isMsgType (simFrame_t const & frame,
+                       msgType_t const msgType)
+{
+  return frame.bytes.size() > RH_RF95_HEADER_LEN
+         && !(frame.bytes[3] & RH_FLAGS_ACK)
+         && frame.bytes[RH_RF95_HEADER_LEN] == msgType;
+}
+
+static bool isOn (simFrame_t const & frame,
+                  linkSettings_t const & settings)
+{
+  return frame.settings.spreadingFactor == settings.spreadingFactor + 7;
+}
+
+/**
+ * @brief Puts both units on oldSettings, then has the base request newSettings with the given frames lost.
+ *
+ * @return linkSettings_t Where both units ended, once settled on the same settings.
+ */
+static linkSettings_t change (simScheduler & sched,
+                              std::function<bool(simFrame_t const &, int)> drop)
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  channel.setDropFilter(NULL);
+  CHECK(base.applyLinkSettings(oldSettings));
+  CHECK(endpoint.applyLinkSettings(oldSettings));
+  sched.runFor(1000000ULL);
+  probesSent = 0;
+  channel.setDropFilter([drop](simFrame_t const & frame, int receiver)
+                        {
+                          probesSent += isMsgType(frame, msgType_linkProbe);
+                          return drop(frame, receiver);
+                        });
+  CHECK(base.linkChangeReq(ENDPOINT_ADDR, newSettings.spreadingFactor, newSettings.signalBandwidth,
+                           newSettings.frequencyChannel, newSettings.txPower));
+  // The request is acknowleged and both units are on the new settings well within this.
+  sched.runFor(2000000ULL);
+  for (int second = 0; second < 60 && (base.getLinkChangeState() != linkChangeState_idle
+                                      || endpoint.getLinkChangeState() != linkChangeState_idle); second++)
+  {
+    sched.runFor(1000000ULL);
+  }
+  channel.setDropFilter(NULL);
+  CHECK_EQ(base.getLinkChangeState(), linkChangeState_idle);
+  CHECK_EQ(endpoint.getLinkChangeState(), linkChangeState_idle);
+  CHECK(sameSettings(base.getLinkSettings(), endpoint.getLinkSettings()));
+  return base.getLinkSettings();
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(17);
+  channel.setPathLoss(100);
+
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                []{ endpoint.serviceRx(); },
+                1000);
+  sched.runFor(1000000ULL);
+
+  // Nothing lost.
+  CHECK(sameSettings(change(sched, [](simFrame_t const &, int){ return false; }), newSettings));
+  // A probe and its answers each way.
+  CHECK(probesSent <= 2 * (1 + LINK_PROBE_ANSWER_REPEATS));
+
+  // Every attempt at the request lost: the base tries the new settings alone, then both stay on the old.
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     return isMsgType(frame, msgType_linkChangeReq);
+                                   }),
+                     oldSettings));
+
+  // Every acknowlegement lost: the base moves anyway, and meets the endpoint on the new settings.
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     return frame.sender == ENDPOINT_RADIO && (frame.bytes[3] & RH_FLAGS_ACK);
+                                   }),
+                     newSettings));
+
+  // The first probes of each end lost: later ones get through.
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     static int numDropped = 0;
+                                     return isMsgType(frame, msgType_linkProbe) && numDropped++ < 2;
+                                   }),
+                     newSettings));
+
+  // Only one way works on the new settings: both fall back to the old.
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     return frame.sender == BASE_RADIO && isOn(frame, newSettings);
+                                   }),
+                     oldSettings));
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     return frame.sender == ENDPOINT_RADIO && isOn(frame, newSettings);
+                                   }),
+                     oldSettings));
+
+  // Neither the new nor the old settings carry probes: both meet on the rendezvous settings.
+  CHECK(sameSettings(change(sched, [](simFrame_t const & frame, int)
+                                   {
+                                     return isMsgType(frame, msgType_linkProbe) && !isOn(frame, rendezvousSettings);
+                                   }),
+                     rendezvousSettings));
+
+  // Both units can still talk after all that.
+  CHECK(sameSettings(change(sched, [](simFrame_t const &, int){ return false; }), newSettings));
+
+  // A change to the settings already in place needs no probing.
+  CHECK(base.linkChangeReq(ENDPOINT_ADDR, newSettings.spreadingFactor, newSettings.signalBandwidth,
+                           newSettings.frequencyChannel, newSettings.txPower));
+  probesSent = 0;
+  channel.setDropFilter([](simFrame_t const & frame, int)
+                        {
+                          probesSent += isMsgType(frame, msgType_linkProbe);
+                          return false;
+                        });
+  sched.runFor(5000000ULL);
+  CHECK_EQ(probesSent, 0);
+  CHECK(sameSettings(base.getLinkSettings(), newSettings));
+  CHECK(sameSettings(endpoint.getLinkSettings(), newSettings));
+
+  // One change at a time, and only valid settings.
+  CHECK(base.linkChangeReq(ENDPOINT_ADDR, oldSettings.spreadingFactor, oldSettings.signalBandwidth,
+                           oldSettings.frequencyChannel, oldSettings.txPower));
+  CHECK_EQ(base.getLinkChangeState(), linkChangeState_requesting);
+  CHECK(!base.linkChangeReq(ENDPOINT_ADDR, newSettings.spreadingFactor, newSettings.signalBandwidth,
+                            newSettings.frequencyChannel, newSettings.txPower));
+  sched.runFor(10000000ULL);
+  CHECK(!base.linkChangeReq(ENDPOINT_ADDR, NUM_spreadingFactors, newSettings.signalBandwidth,
+                            newSettings.frequencyChannel, newSettings.txPower));
+  CHECK(sameSettings(base.getLinkSettings(), oldSettings));
+  CHECK(sameSettings(endpoint.getLinkSettings(), oldSettings));
+
+  sched.stop();
+  return hostTestResult();
+}
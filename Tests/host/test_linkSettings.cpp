@@ -0,0 +1,181 @@
+/**
+ * @file test_linkSettings.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests applying link settings in one step: the registers written, the indications given, invalid settings refused and a link change between two units.
+ * @version 0.1
+ * @date 2021-09-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR      0xBB
+#define ENDPOINT_ADDR  0xEE
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseLinkChanges = 0;
+static uint32_t endpointLinkChanges = 0;
+static uint32_t baseDataReceived = 0;
+
+void baseRxInd (message_t const & rxMsg)
+{
+  baseDataReceived += rxMsg.buf[0] == msgType_dataReq;
+}
+
+void baseLinkChangeInd (spreadingFactor_t const newSpreadingFactor,
+                        signalBandwidth_t const newSignalBandwidth,
+                        frequencyChannel_t const newFrequencyChannel,
+                        int8_t const newTxPower)
+{
+  baseLinkChanges++;
+}
+
+void endpointLinkChangeInd (spreadingFactor_t const newSpreadingFactor,
+                            signalBandwidth_t const newSignalBandwidth,
+                            frequencyChannel_t const newFrequencyChannel,
+                            int8_t const newTxPower)
+{
+  endpointLinkChanges++;
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd, baseLinkChangeInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(NULL, NULL, endpointLinkChangeInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+//---------
+// Helpers
+//---------
+
+static RH_RF95 & radio (int index)
+{
+  // Radios attach in the order they are constructed.
+  return *static_cast<RH_RF95 *>(simLoRaChannel::instance().getRadio(index));
+}
+
+static bool sameSettings (linkSettings_t const & a,
+                          linkSettings_t const & b)
+{
+  return a.spreadingFactor == b.spreadingFactor
+         && a.signalBandwidth == b.signalBandwidth
+         && a.frequencyChannel == b.frequencyChannel
+         && a.txPower == b.txPower;
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(13);
+  channel.setPathLoss(100);
+
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                []{ endpoint.serviceRx(); },
+                1000);
+  sched.runFor(1000000ULL);
+  // setupRadio applies the defaults in one go.
+  CHECK_EQ(baseLinkChanges, 1);
+  CHECK_EQ(endpointLinkChanges, 1);
+
+  // The settings already in place: nothing written, nothing indicated.
+  uint32_t writes = radio(0).simRegisterWrites();
+  CHECK(base.applyLinkSettings(base.getLinkSettings()));
+  base.setSpreadingFactor(base.getSpreadingfactor());
+  CHECK_EQ(radio(0).simRegisterWrites(), writes);
+  CHECK_EQ(baseLinkChanges, 1);
+
+  // Only the spreading factor: its register, and the radio to standby.
+  linkSettings_t settings = base.getLinkSettings();
+  settings.spreadingFactor = spreadingFactor_t((settings.spreadingFactor + 1) % spreadingFactor_sf10);
+  writes = radio(0).simRegisterWrites();
+  CHECK(base.applyLinkSettings(settings));
+  CHECK(radio(0).simRegisterWrites() - writes <= 2);
+  CHECK_EQ(baseLinkChanges, 2);
+  CHECK_EQ(radio(0).simSettings().spreadingFactor, settings.spreadingFactor + 7);
+
+  // Everything at once: one burst for both modem config registers, one retune, one indication.
+  settings = {spreadingFactor_sf12, signalBandwidth_250kHz, frequencyChannel_500kHz_Uplink_5, 20};
+  writes = radio(0).simRegisterWrites();
+  CHECK(base.applyLinkSettings(settings));
+  uint32_t fullWrites = radio(0).simRegisterWrites() - writes;
+  CHECK(fullWrites <= 8);
+  CHECK_EQ(baseLinkChanges, 3);
+  CHECK(sameSettings(base.getLinkSettings(), settings));
+  simRadioSettings_t simSettings = radio(0).simSettings();
+  CHECK_EQ(simSettings.spreadingFactor, 12);
+  CHECK_EQ(simSettings.bandwidthHz, 250000);
+  CHECK_EQ(simSettings.frequencyHz, 911000000);
+  CHECK_EQ(simSettings.txPowerdBm, 20);
+  CHECK_EQ(simSettings.codingRate4, 5);
+  CHECK(simSettings.crcOn);
+
+  // The same through the setters one by one: each change is written and indicated on its own.
+  base.setSpreadingFactor(spreadingFactor_sf7);
+  base.setBandwidth(signalBandwidth_125kHz);
+  base.setTxPower(13);
+  base.setFrequencyChannel(frequencyChannel_500kHz_Uplink_0);
+  CHECK_EQ(baseLinkChanges, 7);
+  writes = radio(0).simRegisterWrites();
+  base.setSpreadingFactor(settings.spreadingFactor);
+  base.setBandwidth(settings.signalBandwidth);
+  base.setTxPower(settings.txPower);
+  base.setFrequencyChannel(settings.frequencyChannel);
+  uint32_t stepWrites = radio(0).simRegisterWrites() - writes;
+  printf("Full link change: %u SPI transactions applied at once, %u setting by setting\n", fullWrites, stepWrites);
+  CHECK(fullWrites < stepWrites);
+  CHECK_EQ(baseLinkChanges, 11);
+
+  // Power above 17dBm goes through the PA DAC.
+  settings.txPower = 18;
+  CHECK(base.applyLinkSettings(settings));
+  CHECK_EQ(radio(0).simSettings().txPowerdBm, 18);
+
+  // One invalid setting: nothing changes.
+  linkSettings_t const before = base.getLinkSettings();
+  linkSettings_t const invalid [] = {{NUM_spreadingFactors, signalBandwidth_125kHz, frequencyChannel_500kHz_Uplink_0, 10},
+                                     {spreadingFactor_sf7, NUM_signalBandwidths, frequencyChannel_500kHz_Uplink_0, 10},
+                                     {spreadingFactor_sf7, signalBandwidth_125kHz, NUM_frequencyChannels, 10},
+                                     {spreadingFactor_sf7, signalBandwidth_125kHz, frequencyChannel_500kHz_Uplink_0, MAX_txPower + 1}};
+  writes = radio(0).simRegisterWrites();
+  for (linkSettings_t const & bad : invalid)
+  {
+    CHECK(!base.applyLinkSettings(bad));
+  }
+  CHECK_EQ(radio(0).simRegisterWrites(), writes);
+  CHECK(sameSettings(base.getLinkSettings(), before));
+  CHECK_EQ(baseLinkChanges, 12);
+
+  // A link change between two units: one indication each, both radios on the new settings.
+  CHECK(base.applyLinkSettings(endpoint.getLinkSettings()));
+  baseLinkChanges = 0;
+  endpointLinkChanges = 0;
+  linkSettings_t const target = {spreadingFactor_sf9, signalBandwidth_125kHz, frequencyChannel_500kHz_Uplink_3, 17};
+  CHECK(base.linkChangeReq(ENDPOINT_ADDR, target.spreadingFactor, target.signalBandwidth, target.frequencyChannel, target.txPower));
+  sched.runFor(10000000ULL);
+  CHECK_EQ(baseLinkChanges, 1);
+  CHECK_EQ(endpointLinkChanges, 1);
+  CHECK(sameSettings(base.getLinkSettings(), target));
+  CHECK(sameSettings(endpoint.getLinkSettings(), target));
+  CHECK(radio(0).simSettings().frequencyHz == radio(1).simSettings().frequencyHz);
+  CHECK_EQ(radio(1).simSettings().spreadingFactor, 9);
+  CHECK_EQ(radio(1).simSettings().txPowerdBm, 17);
+  uint8_t frame [] = {msgType_dataReq, 'o', 'k'};
+  endpoint.serviceTx(BASE_ADDR, frame, sizeof(frame), true);
+  sched.runFor(5000000ULL);
+  CHECK_EQ(baseDataReceived, 1);
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,119 @@
+/**
+ * @file test_linkStats.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the link statistics table: per-key counters, the outcome window, the latency histogram and eviction.
+ * @version 0.1
+ * @date 2021-09-16
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <linkStats.h>
+#include <hostTest.h>
+
+static linkStatsKey_t key (uint8_t const peer, uint8_t const spreadingFactor)
+{
+  linkStatsKey_t k = {peer, spreadingFactor, 2, 0, 10};
+  return k;
+}
+
+static void testCounters ()
+{
+  linkStats<4> stats;
+  CHECK(stats.find(key(1, 0)) == NULL);
+  // 10 frames: every other one needs a retry, the last two are lost after 4 tries.
+  for (uint8_t frame = 0; frame < 10; frame++)
+  {
+    bool lost = frame >= 8;
+    uint8_t tries = lost ? 4 : 1 + frame % 2;
+    for (uint8_t attempt = 0; attempt < tries; attempt++)
+    {
+      stats.recordTransmission(key(1, 0), 20000, false);
+    }
+    if (!lost)
+    {
+      stats.recordRx(key(1, 0), -3 + frame, -100 - frame, true);
+      stats.recordTransmission(key(1, 0), 5000, true); // Its data frame, answered.
+    }
+    stats.recordTxOutcome(key(1, 0), !lost, 10 + frame * 30);
+  }
+  linkStatsEntry_t const * entry = stats.find(key(1, 0));
+  CHECK(entry != NULL);
+  CHECK_EQ(entry->framesSent, 10);
+  CHECK_EQ(entry->framesAcked, 8);
+  CHECK_EQ(entry->transmissions, 4 * 1 + 4 * 2 + 2 * 4);
+  CHECK(entry->deliveryRatio() == 0.8f);
+  CHECK(entry->windowDeliveryRatio() == 0.8f);
+  CHECK(entry->retriesPerFrame() == 1.0f);
+  CHECK_EQ(entry->framesReceived, 0);
+  CHECK_EQ(entry->signalCount, 8);
+  CHECK_EQ(entry->snrMin, -3);
+  CHECK_EQ(entry->snrMax, 4);
+  CHECK(entry->snrMean() == 0.5f);
+  CHECK_EQ(entry->rssiMin, -107);
+  CHECK_EQ(entry->rssiMax, -100);
+  CHECK_EQ(entry->airtimeMicros, 20 * 20000 + 8 * 5000);
+  // Round trips 10, 40, 70 ... 220ms: under 16, 4 under 128, all under 256.
+  CHECK_EQ(entry->latencyHistogram[0], 1);
+  CHECK_EQ(entry->latencyPercentileMillis(50), 128);
+  CHECK_EQ(entry->latencyPercentileMillis(100), 256);
+  CHECK_EQ(entry->latencyPercentileMillis(10), 16);
+
+  // Another setting of the same peer is kept apart.
+  stats.recordRx(key(1, 1), 5, -90, false);
+  CHECK_EQ(stats.count(), 2);
+  CHECK_EQ(stats.find(key(1, 1))->framesReceived, 1);
+  CHECK_EQ(stats.find(key(1, 1))->framesSent, 0);
+  CHECK(stats.find(key(1, 1))->deliveryRatio() == 1.0f);
+  CHECK_EQ(stats.find(key(1, 1))->latencyPercentileMillis(99), 0);
+
+  // Very long round trips land in the last bucket.
+  stats.recordTxOutcome(key(2, 5), true, 60000);
+  CHECK_EQ(stats.find(key(2, 5))->latencyHistogram[LINK_STATS_LATENCY_BUCKETS - 1], 1);
+  CHECK_EQ(stats.find(key(2, 5))->latencyPercentileMillis(50), UINT32_MAX);
+}
+
+static void testWindow ()
+{
+  linkStats<1> stats;
+  // 40 losses then 24 successes: the window only remembers the last 32 frames.
+  for (uint8_t frame = 0; frame < 64; frame++)
+  {
+    stats.recordTxOutcome(key(1, 0), frame >= 40, 100);
+  }
+  linkStatsEntry_t const * entry = stats.find(key(1, 0));
+  CHECK_EQ(entry->outcomeWindowLen, LINK_STATS_WINDOW_LEN);
+  CHECK(entry->windowDeliveryRatio() == 24.0f / 32);
+  CHECK(entry->deliveryRatio() == 24.0f / 64);
+}
+
+static void testEviction ()
+{
+  linkStats<3> stats;
+  stats.recordRx(key(1, 0), 0, -100, false);
+  stats.recordRx(key(2, 0), 0, -100, false);
+  stats.recordRx(key(3, 0), 0, -100, false);
+  stats.recordRx(key(1, 0), 0, -100, false);
+  // Peer 2 is the least recently used, so it goes.
+  stats.recordRx(key(4, 0), 0, -100, false);
+  CHECK_EQ(stats.count(), 3);
+  CHECK(stats.find(key(2, 0)) == NULL);
+  CHECK_EQ(stats.find(key(1, 0))->framesReceived, 2);
+  CHECK(stats.find(key(3, 0)) != NULL);
+  CHECK_EQ(stats.find(key(4, 0))->framesReceived, 1);
+  // A key that comes back starts afresh.
+  stats.recordRx(key(2, 0), 0, -100, false);
+  CHECK(stats.find(key(3, 0)) == NULL);
+  CHECK_EQ(stats.find(key(2, 0))->framesReceived, 1);
+  stats.clear();
+  CHECK_EQ(stats.count(), 0);
+}
+
+int main ()
+{
+  testCounters();
+  testWindow();
+  testEviction();
+  return hostTestResult();
+}
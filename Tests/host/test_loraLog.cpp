@@ -0,0 +1,115 @@
+/**
+ * @file test_loraLog.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the leveled log macros and the deferred ring sink: buffering, chunked flushing, dropping when full, and levels compiled out.
+ * @version 0.1
+ * @date 2021-09-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#define LOG_LEVEL LOG_LEVEL_WARN
+#include <string>
+#include <loraLog.h>
+#include <hostTest.h>
+
+/**
+ * @brief Port that keeps what is written to it and has as much room as the test says.
+ *
+ */
+class capturePort : public Print
+{
+  public:
+    size_t write (uint8_t c) override
+    {
+      text += char(c);
+      return 1;
+    }
+    int availableForWrite () override
+    {
+      return room;
+    }
+    std::string text;
+    int room = 64;
+};
+
+static int evaluations = 0;
+
+static int sideEffect ()
+{
+  evaluations++;
+  return 42;
+}
+
+static void drain (capturePort & port)
+{
+  while (loraLog::flush(port) > 0)
+  {
+  }
+}
+
+static void testLevels ()
+{
+  capturePort port;
+  drain(port);
+  port.text.clear();
+  LOG_ERRORLN("init failed");
+  LOG_WARNLN("queue full: ", sideEffect(), " entries");
+  LOG_INFOLN("Set SF to: ", sideEffect());
+  LOG_DEBUG("frame ", sideEffect());
+  // Nothing reaches the port until flushed, and the levels above WARN are not even evaluated.
+  CHECK(port.text.empty());
+  CHECK_EQ(evaluations, 1);
+  CHECK_EQ(loraLog::pending(), strlen("init failed\r\nqueue full: 42 entries\r\n"));
+  drain(port);
+  CHECK(port.text == "init failed\r\nqueue full: 42 entries\r\n");
+  CHECK_EQ(loraLog::pending(), 0);
+}
+
+static void testChunkedFlush ()
+{
+  capturePort port;
+  std::string expected;
+  for (uint8_t line = 0; line < 10; line++)
+  {
+    LOG_WARNLN("line ", line, " of the chunked flush test");
+    expected += "line " + std::to_string(line) + " of the chunked flush test\r\n";
+  }
+  // Never more than a chunk, nor more than the port has room for.
+  CHECK_EQ(loraLog::flush(port), LOG_FLUSH_CHUNK);
+  port.room = 10;
+  CHECK_EQ(loraLog::flush(port), 10);
+  port.room = 0;
+  CHECK_EQ(loraLog::flush(port), 0);
+  CHECK_EQ(port.text.size(), LOG_FLUSH_CHUNK + 10);
+  port.room = 64;
+  drain(port);
+  // Wrapping around the end of the ring loses nothing.
+  CHECK(port.text == expected);
+}
+
+static void testDrop ()
+{
+  capturePort port;
+  uint32_t droppedBefore = loraLog::getNumDropped();
+  std::string line(99, 'x'); // 101 bytes with the line end.
+  for (uint8_t count = 0; count < 6; count++)
+  {
+    LOG_ERRORLN(line.c_str());
+  }
+  CHECK_EQ(loraLog::pending(), LOG_RING_LEN);
+  CHECK_EQ(loraLog::getNumDropped() - droppedBefore, 6 * 101 - LOG_RING_LEN);
+  drain(port);
+  // The oldest messages are kept whole, the newest cut off.
+  CHECK(port.text.compare(0, 101, line + "\r\n") == 0);
+  CHECK_EQ(port.text.size(), LOG_RING_LEN);
+}
+
+int main ()
+{
+  testLevels();
+  testChunkedFlush();
+  testDrop();
+  return hostTestResult();
+}
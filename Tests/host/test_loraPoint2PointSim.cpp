@@ -0,0 +1,177 @@
+/**
+ * @file test_loraPoint2PointSim.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Runs a LoRaRangeTest-style base and endpoint against each other on the simulated channel.
+ * @version 0.1
+ * @date 2021-09-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseTxCount = 0;
+static uint32_t baseAckCount = 0;
+static uint32_t baseRxCount = 0;
+static uint32_t endpointRxCount = 0;
+static std::string endpointLastRx;
+
+void baseTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (destAddr != RH_BROADCAST_ADDRESS)
+  {
+    baseTxCount++;
+    baseAckCount += ack;
+  }
+}
+
+void baseRxInd (message_t const & rxMsg)
+{
+  baseRxCount++;
+}
+
+void endpointRxInd (message_t const & rxMsg)
+{
+  endpointRxCount++;
+  endpointLastRx.assign((char const *)rxMsg.buf + 1, rxMsg.bufLen - 1);
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(baseTxInd, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(NULL, endpointRxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+static bool requestLinkChange = false;
+static uint32_t baseLastLoopMicros = 0;
+static uint32_t baseMaxLoopGapMicros = 0;
+
+//-------
+// Tests
+//-------
+
+static void testAirtime ()
+{
+  // Reference values from the Semtech LoRa calculator (explicit header, CRC on, CR 4/5, 8 symbol preamble).
+  CHECK_EQ(loraPoint2PointCommon::airtimeMicros(7, 125000, 10), 41216);
+  CHECK_EQ(loraPoint2PointCommon::airtimeMicros(12, 125000, 10), 991232);
+  CHECK_EQ(loraPoint2PointCommon::airtimeMicros(7, 500000, 50), 24384);
+}
+
+int main ()
+{
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(1);
+  channel.setPathLoss(110);
+
+  testAirtime();
+
+  uint32_t lastDataMillis = 0;
+  sched.addNode([]{ CHECK(base.setupRadio()); base.startHeartbeats(); },
+                [&]{
+                  uint32_t nowMicros = micros();
+                  if (baseLastLoopMicros != 0)
+                  {
+                    baseMaxLoopGapMicros = std::max(baseMaxLoopGapMicros, nowMicros - baseLastLoopMicros);
+                  }
+                  baseLastLoopMicros = nowMicros;
+                  if (requestLinkChange)
+                  {
+                    requestLinkChange = false;
+                    base.linkChangeReq(ENDPOINT_ADDR,
+                                       spreadingFactor_sf8,
+                                       signalBandwidth_250kHz,
+                                       frequencyChannel_500kHz_Uplink_1,
+                                       10);
+                  }
+                  if (millis() - lastDataMillis > 5000)
+                  {
+                    base.setTxMessage((uint8_t const *)"foobar", 6);
+                    if (base.serviceTx(ENDPOINT_ADDR))
+                    {
+                      lastDataMillis = millis();
+                    }
+                  }
+                  base.serviceRx();
+                },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                []{ endpoint.serviceRx(); },
+                1000);
+
+  // Plain data exchange on the default settings.
+  sched.runFor(60000000ULL);
+  CHECK(baseTxCount >= 11);
+  CHECK_EQ(baseAckCount, baseTxCount);
+  CHECK(endpointRxCount >= baseTxCount);
+  CHECK(endpointLastRx == "foobar" || endpointLastRx.size() == 1);
+  CHECK(baseRxCount > 0); // heartbeat responses
+  CHECK(base.getPacketErrorFraction() < 0.01);
+  linkStatsEntry_t const * stats = base.getLinkStats(ENDPOINT_ADDR);
+  CHECK(stats != NULL);
+  CHECK_EQ(stats->framesSent, baseTxCount);
+  CHECK(stats->deliveryRatio() == 1.0f);
+  CHECK(stats->retriesPerFrame() < 0.01);
+  CHECK(stats->signalCount >= stats->framesAcked + stats->framesReceived);
+  CHECK(stats->snrMin <= stats->snrMean() && stats->snrMean() <= stats->snrMax);
+  CHECK(stats->airtimeMicros > stats->transmissions * loraPoint2PointCommon::airtimeMicros(7, 500000, 10));
+  CHECK(stats->latencyPercentileMillis(99) > 0 && stats->latencyPercentileMillis(99) <= 256);
+
+  // Link change: both ends should move and stay on the new settings.
+  requestLinkChange = true;
+  sched.runFor(60000000ULL);
+  CHECK_EQ(base.getSpreadingfactor(), spreadingFactor_sf8);
+  CHECK_EQ(endpoint.getSpreadingfactor(), spreadingFactor_sf8);
+  CHECK_EQ(base.getSignalBandwidth(), signalBandwidth_250kHz);
+  CHECK_EQ(endpoint.getSignalBandwidth(), signalBandwidth_250kHz);
+  CHECK_EQ(base.getFrequencyChannel(), frequencyChannel_500kHz_Uplink_1);
+  CHECK_EQ(endpoint.getFrequencyChannel(), frequencyChannel_500kHz_Uplink_1);
+  CHECK_EQ(base.getTxPower(), 10);
+  CHECK_EQ(endpoint.getTxPower(), 10);
+
+  // Total loss: every data frame goes unacknowledged.
+  uint32_t acksBefore = baseAckCount;
+  channel.setLossProbability(1.0);
+  sched.runFor(30000000ULL);
+  CHECK_EQ(baseAckCount, acksBefore);
+  CHECK(base.getPacketErrorFraction() > 0.6); // moving average over 6 packets
+  channel.setLossProbability(0);
+
+  // SF12: a data frame and its retries take seconds, but serviceTx must not hold up the loop.
+  base.setSpreadingFactor(spreadingFactor_sf12);
+  endpoint.setSpreadingFactor(spreadingFactor_sf12);
+  acksBefore = baseAckCount;
+  baseMaxLoopGapMicros = 0;
+  sched.runFor(30000000ULL);
+  CHECK(baseAckCount > acksBefore);
+  CHECK(baseMaxLoopGapMicros <= 1000); // Not even for CAD: it is polled, so the loop keeps its own pace.
+
+  sched.stop();
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  double simSeconds = double(sched.nowMicros()) / 1e6;
+  printf("Simulated %.0f s in %.3f s wall time (%.0fx real time)\n",
+         simSeconds, wallSeconds, simSeconds / wallSeconds);
+  printf("Channel: %u sent, %u delivered, %.1f s airtime\n",
+         channel.getStats().framesSent,
+         channel.getStats().framesDelivered,
+         double(channel.getStats().airtimeMicros) / 1e6);
+  return hostTestResult();
+}
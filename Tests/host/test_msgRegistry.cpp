@@ -0,0 +1,233 @@
+/**
+ * @file test_msgRegistry.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the message registry: the values and layouts on air, the generated packers and unpackers, and handlers set by the application being called without touching serviceRx.
+ * @version 0.1
+ * @date 2021-10-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointProtocolLightweight.h>
+#include <storeAndForward.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+#define BULK_FRAMES   12
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t baseRxInds = 0;
+static std::vector<msgType_t> baseHandled; ///< Message types seen by the application's handlers, in order.
+static std::vector<uint8_t> bulkSeqs;
+static uint32_t endpointHeartbeatRsps = 0;
+
+void baseRxInd (message_t const & rxMsg)
+{
+  baseRxInds++;
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks();
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+bulkRxContext_t baseBulkRx;
+bulkTxContext_t endpointBulkTx;
+
+static void recordType (message_t const & rxMsg,
+                        void * context)
+{
+  static_cast<std::vector<msgType_t> *>(context)->push_back(msgType_t(rxMsg.buf[0]));
+}
+
+static void recordBulk (message_t const & rxMsg,
+                        void * context)
+{
+  msg_bulkData_t header;
+  CHECK(header.unpack(rxMsg.buf, rxMsg.bufLen));
+  bulkSeqs.push_back(header.seq);
+}
+
+static void countHeartbeatRsp (message_t const & rxMsg,
+                               void * context)
+{
+  msg_heartbeatRsp_t rsp;
+  CHECK(rsp.unpack(rxMsg.buf, rxMsg.bufLen));
+  CHECK_EQ(rsp.address, BASE_ADDR);
+  endpointHeartbeatRsps++;
+}
+
+//---------
+// Helpers
+//---------
+
+static std::vector<uint8_t> packed (uint8_t const * buf,
+                                    uint8_t const len)
+{
+  return std::vector<uint8_t>(buf, buf + len);
+}
+
+/**
+ * @brief The values on air: those of the lightweight sketches first, as they were, then the rest of loraPoint2Point's.
+ *
+ */
+static void testValues ()
+{
+  CHECK_EQ(msgType_undefined, 0);
+  CHECK_EQ(msgType_dataReq, 1);
+  CHECK_EQ(msgType_linkChangeReq, 3);
+  CHECK_EQ(msgType_heartbeatRsp, 8);
+  CHECK_EQ(msgType_procvDataReq, 9);
+  CHECK_EQ(msgType_seaphoxDataRsp, 12);
+  CHECK_EQ(msgType_ack, 13);
+  CHECK_EQ(msgType_aggregatedDataRsp, 14);
+  CHECK_EQ(msgType_hopSyncInd, 15);
+  CHECK_EQ(msgType_bulkData, 17);
+  CHECK_EQ(msgType_pollEnd, 22);
+  CHECK_EQ(NUM_msgTypes, 23);
+  CHECK(std::string(msgTypeNames[msgType_linkProbe]) == "linkProbe");
+  CHECK(std::string(msgTypeNames[msgType_aggregatedDataRsp]) == "aggregatedDataRsp");
+  CHECK(std::string(msgTypeNames[NUM_msgTypes - 1]) == "pollEnd");
+  CHECK_EQ(msgTypeQueues[msgType_sleepRequest], msgQueue_control);
+  CHECK_EQ(msgTypeQueues[msgType_pollReq], msgQueue_control);
+  CHECK_EQ(msgTypeQueues[msgType_dataReq], msgQueue_data);
+  CHECK_EQ(msgTypeQueues[msgType_bulkData], msgQueue_data);
+}
+
+/**
+ * @brief Lengths and bytes as the frames were laid out by hand before, and unpack refusing what is not the type or is too short.
+ *
+ */
+static void testCodecs ()
+{
+  CHECK_EQ(LINK_PROBE_LEN, 7);
+  CHECK_EQ(POLL_REQ_LEN, 4);
+  CHECK_EQ(BULK_HEADER_LEN, 4);
+  CHECK_EQ(BULK_ACK_LEN, 7);
+  CHECK_EQ(BULK_PARITY_HEADER_LEN, 6);
+  CHECK_EQ(STORE_FORWARD_FRAME_HEADER_LEN, 5);
+  CHECK_EQ(msg_hopSyncInd_t::LEN, 9);
+  CHECK_EQ(msg_dataReq_t::LEN, 1);
+
+  uint8_t buf [RH_RF95_MAX_MESSAGE_LEN];
+  msg_linkChangeReq_t req;
+  req.spreadingFactor = spreadingFactor_sf9;
+  req.signalBandwidth = signalBandwidth_125kHz;
+  req.frequencyChannel = frequencyChannel_500kHz_Uplink_3;
+  req.txPower = -3;
+  CHECK_EQ(req.pack(buf), 5);
+  CHECK(packed(buf, 5) == std::vector<uint8_t>({msgType_linkChangeReq,
+                                                 spreadingFactor_sf9,
+                                                 signalBandwidth_125kHz,
+                                                 frequencyChannel_500kHz_Uplink_3,
+                                                 0xFD}));
+  msg_linkChangeReq_t reqBack;
+  CHECK(reqBack.unpack(buf, 5));
+  CHECK_EQ(reqBack.txPower, -3);
+  CHECK_EQ(reqBack.frequencyChannel, frequencyChannel_500kHz_Uplink_3);
+  CHECK(!reqBack.unpack(buf, 4));
+
+  // Multi-byte fields are little-endian.
+  msg_hopSyncInd_t beacon;
+  beacon.clockMillis = 0x12345678;
+  beacon.seed = 0xBEEF;
+  beacon.dwellMillis = 400;
+  CHECK_EQ(beacon.pack(buf), msg_hopSyncInd_t::LEN);
+  CHECK(packed(buf, msg_hopSyncInd_t::LEN) == std::vector<uint8_t>({msgType_hopSyncInd,
+                                                                     0x78, 0x56, 0x34, 0x12,
+                                                                     0xEF, 0xBE,
+                                                                     0x90, 0x01}));
+  msg_bulkAck_t ack;
+  ack.transferId = 7;
+  ack.cumulative = 200;
+  ack.bitmap = 0x80000001;
+  ack.pack(buf);
+  msg_bulkAck_t ackBack;
+  CHECK(ackBack.unpack(buf, BULK_ACK_LEN));
+  CHECK_EQ(ackBack.transferId, 7);
+  CHECK_EQ(ackBack.cumulative, 200);
+  CHECK_EQ(ackBack.bitmap, 0x80000001);
+  // Another type's frame, however long, is not this one.
+  CHECK(!beacon.unpack(buf, sizeof(buf)));
+
+  // Types without fields are the type byte alone; what follows is theirs.
+  uint8_t const ackLight [] = {msgType_ack, msgType_procvDataRsp};
+  msg_ack_t lightAck;
+  CHECK(lightAck.unpack(ackLight, sizeof(ackLight)));
+  CHECK_EQ(lightAck.ackedType, msgType_procvDataRsp);
+  uint8_t const data [] = {msgType_dataReq, 'o', 'k'};
+  CHECK(msg_dataReq_t().unpack(data, sizeof(data)));
+  CHECK(!msg_dataRsp_t().unpack(data, sizeof(data)));
+}
+
+int main ()
+{
+  testValues();
+  testCodecs();
+
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(25);
+  channel.setPathLoss(100);
+
+  sched.addNode([]{ CHECK(base.setupRadio()); base.setBulkRx(&baseBulkRx); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                []{ endpoint.serviceRx(); },
+                1000);
+  sched.runFor(1000000ULL);
+
+  // Handlers for a type left to the application and for one the library handles too: both still answered.
+  CHECK(base.setRxHandler(msgType_dataReq, recordType, &baseHandled));
+  CHECK(base.setRxHandler(msgType_heartbeatReq, recordType, &baseHandled));
+  CHECK(endpoint.setRxHandler(msgType_heartbeatRsp, countHeartbeatRsp));
+  CHECK(!base.setRxHandler(NUM_msgTypes, recordType));
+  uint8_t frame [] = {msgType_dataReq, 'o', 'k'};
+  CHECK(endpoint.serviceTx(BASE_ADDR, frame, sizeof(frame), true));
+  sched.runFor(2000000ULL);
+  endpoint.startHeartbeats();
+  sched.runFor((HEARTBEAT_TIMEOUT_MILLIS + 2000) * 1000ULL);
+  endpoint.stopHeartbeats();
+  CHECK(baseHandled == std::vector<msgType_t>({msgType_dataReq, msgType_heartbeatReq}));
+  CHECK_EQ(baseRxInds, 2);
+  CHECK_EQ(endpointHeartbeatRsps, 1);
+
+  // Removed: rxInd alone.
+  CHECK(base.setRxHandler(msgType_dataReq, NULL));
+  CHECK(endpoint.serviceTx(BASE_ADDR, frame, sizeof(frame), true));
+  sched.runFor(2000000ULL);
+  CHECK_EQ(baseHandled.size(), 2);
+  CHECK_EQ(baseRxInds, 3);
+
+  // Bulk data reaches its handler in order, once each, like rxInd.
+  CHECK(base.setRxHandler(msgType_bulkData, recordBulk));
+  CHECK(endpoint.startBulkTx(BASE_ADDR, endpointBulkTx));
+  for (uint8_t idx = 0; idx < BULK_FRAMES; idx++)
+  {
+    uint8_t payload [] = {idx, idx, idx};
+    while (!endpoint.bulkTx(payload, sizeof(payload), idx == BULK_FRAMES - 1))
+    {
+      sched.runFor(100000ULL);
+    }
+  }
+  sched.runFor(10000000ULL);
+  CHECK_EQ(bulkSeqs.size(), BULK_FRAMES);
+  for (uint8_t idx = 0; idx < MIN(bulkSeqs.size(), size_t(BULK_FRAMES)); idx++)
+  {
+    CHECK_EQ(bulkSeqs[idx], idx);
+  }
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,219 @@
+/**
+ * @file test_multiEndpoint.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Runs a base and up to six endpoints that cannot hear each other on the simulated channel: throughput with every endpoint sending at will and with the base polling them, per-endpoint settings and sessions.
+ * @version 0.1
+ * @date 2021-09-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR      0xBB
+#define ENDPOINT_ADDR  0xE0 ///< Plus the endpoint's index.
+#define NUM_ENDPOINTS  6
+#define FRAME_LEN      40
+#define RUN_MILLIS     60000
+#define SLOT_MILLIS    1500
+
+//-----------
+// Callbacks
+//-----------
+
+static uint32_t delivered [NUM_ENDPOINTS]; ///< Frames the base received from each endpoint.
+
+void baseRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] == msgType_dataReq
+      && rxMsg.srcAddr >= ENDPOINT_ADDR
+      && rxMsg.srcAddr < ENDPOINT_ADDR + NUM_ENDPOINTS)
+  {
+    delivered[rxMsg.srcAddr - ENDPOINT_ADDR]++;
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks();
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoints [NUM_ENDPOINTS] = {{ENDPOINT_ADDR + 0, 8, 3, 4, endpointCallbacks},
+                                             {ENDPOINT_ADDR + 1, 8, 3, 4, endpointCallbacks},
+                                             {ENDPOINT_ADDR + 2, 8, 3, 4, endpointCallbacks},
+                                             {ENDPOINT_ADDR + 3, 8, 3, 4, endpointCallbacks},
+                                             {ENDPOINT_ADDR + 4, 8, 3, 4, endpointCallbacks},
+                                             {ENDPOINT_ADDR + 5, 8, 3, 4, endpointCallbacks}};
+
+//---------
+// Helpers
+//---------
+
+static uint8_t numSending = 0; ///< The first numSending endpoints keep their TX queues full.
+
+static void fillTxQueue (uint8_t const index)
+{
+  uint8_t frame [FRAME_LEN];
+  frame[0] = msgType_dataReq;
+  memset(frame + 1, 'a' + index, sizeof(frame) - 1);
+  while (index < numSending && endpoints[index].getTxQueueSpace() > 0)
+  {
+    endpoints[index].serviceTx(BASE_ADDR, frame, sizeof(frame), true);
+  }
+}
+
+struct runResult_t
+{
+  uint32_t total;
+  uint32_t fewest;
+  uint32_t most;
+};
+
+/**
+ * @brief Lets the first numEndpoints endpoints send flat out for RUN_MILLIS, then drains their queues.
+ *
+ */
+static runResult_t run (simScheduler & sched,
+                        uint8_t const numEndpoints)
+{
+  memset(delivered, 0, sizeof(delivered));
+  numSending = numEndpoints;
+  sched.runFor(uint64_t(RUN_MILLIS) * 1000);
+  runResult_t result = {0, 0xFFFFFFFF, 0};
+  for (uint8_t index = 0; index < numEndpoints; index++)
+  {
+    result.total += delivered[index];
+    result.fewest = MIN(result.fewest, delivered[index]);
+    result.most = MAX(result.most, delivered[index]);
+  }
+  numSending = 0;
+  sched.runFor(30000000ULL);
+  for (uint8_t index = 0; index < NUM_ENDPOINTS; index++)
+  {
+    CHECK_EQ(endpoints[index].getTxQueueSpace(), TX_QUEUE_DATA_LEN);
+  }
+  return result;
+}
+
+int main ()
+{
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(5);
+  channel.setPathLoss(100);
+  // Every endpoint reaches the base, but none can hear another, so CAD does not keep them apart.
+  for (int a = 1; a <= NUM_ENDPOINTS; a++)
+  {
+    for (int b = a + 1; b <= NUM_ENDPOINTS; b++)
+    {
+      channel.setPathLoss(a, b, 200);
+      channel.setPathLoss(b, a, 200);
+    }
+  }
+
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                []{ base.serviceRx(); },
+                1000);
+  for (uint8_t index = 0; index < NUM_ENDPOINTS; index++)
+  {
+    sched.addNode([index]{ CHECK(endpoints[index].setupRadio()); },
+                  [index]{
+                    fillTxQueue(index);
+                    endpoints[index].serviceRx();
+                  },
+                  1000);
+  }
+  sched.runFor(1000000ULL);
+  base.setSpreadingFactor(spreadingFactor_sf8);
+  base.setBandwidth(signalBandwidth_125kHz);
+  for (loraPoint2Point & endpoint : endpoints)
+  {
+    endpoint.setSpreadingFactor(spreadingFactor_sf8);
+    endpoint.setBandwidth(signalBandwidth_125kHz);
+  }
+  sched.runFor(1000000ULL);
+
+  // Every endpoint sends when it likes.
+  uint8_t const counts [] = {1, 2, 4, NUM_ENDPOINTS};
+  runResult_t aloha [sizeof(counts)];
+  for (uint8_t idx = 0; idx < sizeof(counts); idx++)
+  {
+    aloha[idx] = run(sched, counts[idx]);
+  }
+
+  // The base polls them in turn.
+  for (loraPoint2Point & endpoint : endpoints)
+  {
+    endpoint.setPolledTx(true);
+  }
+  base.startPolling(SLOT_MILLIS);
+  runResult_t polled [sizeof(counts)];
+  for (uint8_t idx = 0; idx < sizeof(counts); idx++)
+  {
+    for (uint8_t index = 0; index < counts[idx]; index++)
+    {
+      CHECK(base.addPolledPeer(ENDPOINT_ADDR + index));
+    }
+    polled[idx] = run(sched, counts[idx]);
+  }
+  for (uint8_t idx = 0; idx < sizeof(counts); idx++)
+  {
+    printf("%u endpoints: %u frames/min sending at will (%u to %u each), %u frames/min polled (%u to %u each)\n",
+           counts[idx], aloha[idx].total, aloha[idx].fewest, aloha[idx].most,
+           polled[idx].total, polled[idx].fewest, polled[idx].most);
+  }
+  uint8_t const last = sizeof(counts) - 1;
+  // Sending at will, hidden endpoints collide more the more there are...
+  CHECK(aloha[last].total * 2 < aloha[0].total);
+  // ...while polled, the channel stays busy with frames that get through, however many endpoints share it...
+  for (uint8_t idx = 1; idx < sizeof(counts); idx++)
+  {
+    CHECK(polled[idx].total * 10 >= polled[0].total * 9);
+  }
+  CHECK(polled[last].total > 3 * aloha[last].total);
+  // ...and shared fairly.
+  CHECK(polled[last].fewest * 10 >= polled[last].most * 8);
+
+  // Sessions: what the base knows of each endpoint.
+  for (uint8_t index = 0; index < NUM_ENDPOINTS; index++)
+  {
+    peerSession_t const * session = base.getPeerSession(ENDPOINT_ADDR + index);
+    CHECK(session != NULL);
+    if (session != NULL)
+    {
+      CHECK(session->polled);
+      CHECK(session->polls > 0);
+      CHECK(session->rxFrames > 0);
+      CHECK_EQ(session->pollsUnanswered, 0);
+    }
+  }
+  CHECK(base.getPeerSession(0x42) == NULL);
+
+  // The farthest endpoint needs a slower spreading factor; the base polls it on that.
+  channel.setPathLoss(0, NUM_ENDPOINTS, 130);
+  channel.setPathLoss(NUM_ENDPOINTS, 0, 130);
+  endpoints[NUM_ENDPOINTS - 1].setSpreadingFactor(spreadingFactor_sf11);
+  CHECK(base.setPeerLinkSettings(ENDPOINT_ADDR + NUM_ENDPOINTS - 1, spreadingFactor_sf11, signalBandwidth_125kHz, RFM95_DFLT_TX_POWER_dBm));
+  runResult_t mixed = run(sched, NUM_ENDPOINTS);
+  printf("With one endpoint on SF11: %u frames/min (%u to %u each)\n", mixed.total, mixed.fewest, mixed.most);
+  CHECK(mixed.fewest > 0);
+  CHECK_EQ(base.getPeerSession(ENDPOINT_ADDR + NUM_ENDPOINTS - 1)->linkSettings.spreadingFactor, spreadingFactor_sf11);
+
+  // Stopped: back on the settings polling started on, and endpoints no longer wait to be polled.
+  base.stopPolling();
+  CHECK(!base.isPolling());
+  sched.runFor(5000000ULL);
+  CHECK_EQ(base.getSpreadingfactor(), spreadingFactor_sf8);
+  for (loraPoint2Point & endpoint : endpoints)
+  {
+    endpoint.setPolledTx(false);
+  }
+  runResult_t unpolled = run(sched, 1);
+  CHECK(unpolled.total > 0);
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,159 @@
+/**
+ * @file test_proO.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests parsing ProCV data records and packing them into bitfields.
+ * @version 0.1
+ * @date 2021-09-12
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <proO.h>
+#include <RH_RF95.h>
+#include <loraPoint2PointCommon.h>
+#include <sensorAggregator.h>
+#include <hostTest.h>
+
+#define SAMPLE_LINE "W M,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1"
+
+static std::string readable (ProCVData const & data)
+{
+  char line [PROCV_READABLE_MAX_LEN];
+  uint8_t len = data.getReadableString(line);
+  CHECK_EQ(len, strlen(line));
+  return std::string(line, len);
+}
+
+/**
+ * @brief Packs a line, unpacks it into a fresh record and returns the line that comes back out.
+ *
+ */
+static std::string roundTrip (char const * line)
+{
+  ProCVData tx;
+  ProCVData rx;
+  CHECK(tx.setDataFromString(line));
+  CHECK(tx.convertReadableToBitfield());
+  CHECK(rx.setBitfield(tx.getBitfield(), PROCV_BITFIELD_LEN));
+  CHECK(rx.convertBitfieldToReadable());
+  return readable(rx);
+}
+
+static void testLayout ()
+{
+  uint16_t bits = 0;
+  for (uint8_t field = 0; field < NUM_dataFields; field++)
+  {
+    bits += dataFieldTable[field].bits;
+  }
+  CHECK_EQ(bits, PROCV_BITFIELD_BITS);
+  CHECK_EQ(PROCV_BITFIELD_LEN, 20);
+}
+
+static void testParse ()
+{
+  ProCVData data;
+  CHECK(data.setDataFromString(SAMPLE_LINE));
+  CHECK_EQ(data.getField(dataField_typeChar0), 'W');
+  CHECK_EQ(data.getField(dataField_typeChar1), 'M');
+  CHECK_EQ(data.getField(dataField_year), 2020);
+  CHECK_EQ(data.getField(dataField_minute), 20);
+  CHECK_EQ(data.getField(dataField_zeroAD), 55651);
+  CHECK_EQ(data.getField(dataField_CO2), 53259);
+  CHECK_EQ(data.getField(dataField_AvgIrgaTemp), 4000);
+  CHECK_EQ(data.getField(dataField_GasPressure), 981);
+  CHECK_EQ(data.getField(dataField_SupplyVoltage), 121);
+  CHECK(readable(data) == SAMPLE_LINE);
+
+  // The endpoint strips spaces; line endings and extra decimals are tolerated.
+  CHECK(data.setDataFromString("WM,2020,01,17,00,20,00,55651,51716,532.594,40.005,5.6,0.9,981,12.1\r\n"));
+  CHECK_EQ(data.getField(dataField_CO2), 53259);
+  CHECK_EQ(data.getField(dataField_AvgIrgaTemp), 4001);
+  CHECK(readable(data) == "W M,2020,01,17,00,20,00,55651,51716,532.59,40.01,5.60,0.90,0981,12.1");
+
+  // Not data records: the fields must be left alone.
+  char const * const bad [] =
+  {
+    "",
+    "Sampling mode: continuous",
+    "W,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1",
+    "w m,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1",
+    "W M,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981",
+    "W M,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1,7",
+    "W M,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,,0981,12.1",
+    "W M,2020,01,17,00,20,00,5565x,51716,532.59,40.00,5.60,0.90,0981,12.1",
+    "W M,2020,01,17,00,20,00,55651,51716,53.2.59,40.00,5.60,0.90,0981,12.1",
+    "W M,2020,01,17,00,20,00,65536,51716,532.59,40.00,5.60,0.90,0981,12.1", // A/D past 16 bits.
+    "W M,1999,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1", // Before the year offset.
+    "W M,2020,01,17,00,20,00,55651,51716,-532.59,40.00,5.60,0.90,0981,12.1", // Negative CO2.
+  };
+  for (uint8_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    if (data.setDataFromString(bad[i]))
+    {
+      printf("accepted: \"%s\"\n", bad[i]);
+      CHECK(false);
+    }
+  }
+  CHECK(readable(data) == "W M,2020,01,17,00,20,00,55651,51716,532.59,40.01,5.60,0.90,0981,12.1");
+}
+
+static void testRoundTrip ()
+{
+  CHECK(roundTrip(SAMPLE_LINE) == SAMPLE_LINE);
+  // Negative temperatures, and the extremes of each field.
+  char const * const lines [] =
+  {
+    "A Z,2000,01,01,00,00,00,0,0,0.00,-5.25,0.00,-0.07,0000,0.0",
+    "Z A,2127,12,31,23,59,59,65535,65535,10485.75,81.91,163.83,-81.92,2047,25.5",
+  };
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    std::string back = roundTrip(lines[i]);
+    if (back != lines[i])
+    {
+      printf("\"%s\" came back as \"%s\"\n", lines[i], back.c_str());
+      CHECK(false);
+    }
+  }
+
+  // A bitfield that does not hold a record is refused.
+  ProCVData data;
+  uint8_t ones [PROCV_BITFIELD_LEN];
+  memset(ones, 0xFF, sizeof(ones));
+  CHECK(!data.setBitfield(ones, PROCV_BITFIELD_LEN - 1));
+  CHECK(data.setBitfield(ones, PROCV_BITFIELD_LEN));
+  CHECK(!data.convertBitfieldToReadable());
+}
+
+static void testAirtime ()
+{
+  // Payload per record inside an aggregated frame, ASCII as the endpoint forwards it (spaces stripped) vs packed.
+  uint8_t asciiLen = SENSOR_AGGREGATOR_RECORD_OVERHEAD + strlen(SAMPLE_LINE) - 1;
+  uint8_t packedLen = SENSOR_AGGREGATOR_RECORD_OVERHEAD + PROCV_BITFIELD_LEN;
+  CHECK(asciiLen >= 3 * packedLen);
+  for (uint8_t sf = 7; sf <= 12; sf++)
+  {
+    // A full frame of each, per record.
+    uint8_t asciiRecords = (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN - 1) / asciiLen;
+    uint8_t packedRecords = (RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN - 1) / packedLen;
+    double ascii = double(loraPoint2PointCommon::airtimeMicros(sf, 125000, 1 + asciiRecords * asciiLen + 4)) / asciiRecords;
+    double packed = double(loraPoint2PointCommon::airtimeMicros(sf, 125000, 1 + packedRecords * packedLen + 4)) / packedRecords;
+    if (sf == 9)
+    {
+      printf("ProCV records at SF9/125kHz: %.1f ms ASCII, %.1f ms packed\n", ascii / 1000, packed / 1000);
+    }
+    CHECK(ascii >= 2.8 * packed);
+  }
+}
+
+int main ()
+{
+  testLayout();
+  testParse();
+  testRoundTrip();
+  testAirtime();
+  return hostTestResult();
+}
@@ -0,0 +1,199 @@
+/**
+ * @file test_rxFramePool.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the rxFramePool, and an endpoint that holds received messages for a slow UART while more arrive.
+ * @version 0.1
+ * @date 2021-09-23
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <deque>
+#include <string>
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+#define UART_BAUD     4800
+#define NUM_FRAMES    12
+
+//-----------
+// Callbacks
+//-----------
+
+static std::deque<message_t const *> heldFrames; ///< Waiting for the UART, oldest first.
+static uint32_t numHeld = 0;
+static uint32_t numCopied = 0;
+static uint32_t numWritten = 0;
+static uint32_t numCorrupted = 0;
+static uint32_t uartBusyUntilMillis = 0;
+static bool uartPaused = false; ///< Flow control from the instrument.
+static uint32_t endpointAcked = 0;
+
+loraPoint2Point * endpointUnit;
+
+static std::string expectedFrame (uint32_t number)
+{
+  char text [48];
+  snprintf(text, sizeof(text), "sample %02u: 0123456789abcdefghijklmnopqrstu", unsigned(number));
+  return std::string(text);
+}
+
+/**
+ * @brief Writes a message out of the simulated UART: takes ten bit times per byte.
+ *
+ */
+static void writeToUart (message_t const & msg)
+{
+  if (std::string((char const *)msg.buf + 1, msg.bufLen - 1) != expectedFrame(numWritten))
+  {
+    numCorrupted++;
+  }
+  numWritten++;
+  uartBusyUntilMillis = millis() + uint32_t(msg.bufLen) * 10 * 1000 / UART_BAUD;
+}
+
+void endpointTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  endpointAcked += ack;
+}
+
+void endpointRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] != msgType_dataReq)
+  {
+    return;
+  }
+  if (endpointUnit->holdRxFrame(rxMsg))
+  {
+    heldFrames.push_back(&rxMsg);
+    numHeld++;
+  }
+  else
+  {
+    // No buffer to spare: copy it, as every message had to be before.
+    static message_t copies [NUM_FRAMES];
+    copies[numCopied] = rxMsg;
+    heldFrames.push_back(&copies[numCopied]);
+    numCopied++;
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks();
+userCallbacks_t endpointCallbacks = hostTestCallbacks(endpointTxInd, endpointRxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+//---------
+// Helpers
+//---------
+
+struct testFrame_t
+{
+  uint8_t bufLen;
+  uint8_t buf [8];
+};
+
+static void testPool ()
+{
+  rxFramePool<testFrame_t, 3> pool;
+  CHECK_EQ(pool.countFree(), 3);
+  testFrame_t * a = pool.acquire();
+  testFrame_t * b = pool.acquire();
+  CHECK(a != NULL && b != NULL && a != b);
+  CHECK_EQ(pool.countFree(), 1);
+  CHECK(pool.hold(*a));
+  CHECK(pool.isHeld(*a));
+  // Holding b would leave nothing to receive into.
+  testFrame_t * c = pool.acquire();
+  CHECK(c != NULL);
+  CHECK(pool.acquire() == NULL);
+  CHECK(!pool.hold(*b));
+  pool.release(*c);
+  CHECK(pool.hold(*b));
+  CHECK_EQ(pool.countHeld(), 2);
+  CHECK_EQ(pool.countFree(), 1);
+  // Holding again is harmless, and frames from elsewhere are refused.
+  CHECK(pool.hold(*b));
+  testFrame_t other;
+  CHECK(!pool.hold(other));
+  CHECK(!pool.isHeld(other));
+  pool.release(other);
+  CHECK_EQ(pool.countHeld(), 2);
+  // Released frames are handed out again.
+  pool.release(*a);
+  CHECK(pool.acquire() == a);
+}
+
+int main ()
+{
+  testPool();
+
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(1);
+  channel.setPathLoss(100);
+  endpointUnit = &endpoint;
+
+  uint32_t numQueued = 0;
+  bool sending = false;
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                [&]{
+                  if (sending && numQueued < NUM_FRAMES && base.getTxQueueSpace() > 0)
+                  {
+                    std::string text = expectedFrame(numQueued);
+                    base.setTxMessage((uint8_t const *)text.data(), text.size());
+                    base.serviceTx(ENDPOINT_ADDR);
+                    numQueued++;
+                  }
+                  base.serviceRx();
+                },
+                1000);
+  uint32_t fewestFree = RX_FRAME_POOL_LEN;
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                [&]{
+                  endpoint.serviceRx();
+                  fewestFree = MIN(fewestFree, endpoint.getRxFramesFree());
+                  if (!heldFrames.empty() && !uartPaused && int32_t(millis() - uartBusyUntilMillis) >= 0)
+                  {
+                    message_t const & msg = *heldFrames.front();
+                    writeToUart(msg);
+                    heldFrames.pop_front();
+                    endpoint.releaseRxFrame(msg);
+                  }
+                },
+                1000);
+  sched.runFor(1000000ULL);
+
+  // The base sends faster than the UART drains: the endpoint holds what it can and copies the rest.
+  sending = true;
+  sched.runFor(100000ULL);
+  CHECK(numHeld > 0);
+  // While the instrument holds the UART up, the application holds all it can...
+  uartPaused = true;
+  sched.runFor(1000000ULL);
+  CHECK_EQ(fewestFree, 1);
+  CHECK_EQ(endpoint.getRxFramesFree(), 1);
+  // ...and acknowlegements still get through.
+  uint8_t report [] = {msgType_dataReq, 'o', 'k'};
+  CHECK(endpoint.serviceTx(BASE_ADDR, report, sizeof(report), true));
+  sched.runFor(1000000ULL);
+  CHECK_EQ(endpointAcked, 1);
+
+  uartPaused = false;
+  sched.runFor(5000000ULL);
+  printf("%u written to the UART: %u held, %u copied\n", numWritten, numHeld, numCopied);
+  CHECK_EQ(numWritten, NUM_FRAMES);
+  CHECK_EQ(numHeld + numCopied, NUM_FRAMES);
+  CHECK(numHeld >= RX_FRAME_POOL_LEN - 1);
+  CHECK_EQ(numCorrupted, 0);
+  CHECK_EQ(endpoint.getRxFramesFree(), RX_FRAME_POOL_LEN);
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,193 @@
+/**
+ * @file test_sdLogger.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the SD card logger: whole-sector writes, periodic syncs, appending across sessions, and CSV output.
+ * @version 0.1
+ * @date 2021-09-19
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <sdLogger.h>
+#include <hostTest.h>
+
+#define LOG_FILE "datalog.bin"
+
+//-----------
+// Callbacks
+//-----------
+
+userCallbacks_t callbacks = hostTestCallbacks();
+
+loraPoint2Point unit(0xBB, 8, 3, 4, callbacks);
+
+//---------
+// Helpers
+//---------
+
+/**
+ * @brief Port that keeps what is printed to it.
+ *
+ */
+class capturePort : public Print
+{
+  public:
+    size_t write (uint8_t c) override
+    {
+      text += char(c);
+      return 1;
+    }
+    std::string text;
+};
+
+static std::vector<sdLogRecord_t> readBack ()
+{
+  std::vector<uint8_t> & data = SD.contents(LOG_FILE);
+  std::vector<sdLogRecord_t> records(data.size() / sizeof(sdLogRecord_t));
+  memcpy(records.data(), data.data(), records.size() * sizeof(sdLogRecord_t));
+  return records;
+}
+
+static void testSectors ()
+{
+  SD.reset();
+  sdLogger logger(LOG_FILE, 10000);
+  CHECK(logger.begin());
+  uint8_t msg [100];
+  for (uint8_t idx = 0; idx < sizeof(msg); idx++)
+  {
+    msg[idx] = 'a' + idx % 26;
+  }
+  // The session start and 7 messages fill a sector, which is written in one go, but not synced.
+  for (uint8_t count = 0; count < 6; count++)
+  {
+    CHECK(logger.logTx(unit, 0xBB, msg, count == 0 ? sizeof(msg) : 6, 0xEE, count % 2));
+    CHECK_EQ(SD.numWrites, 0);
+    delay(100);
+  }
+  message_t rxMsg = {0xEE, 0xBB, 7, 0x40, 4, {1, 'b', 'a', 'r'}};
+  CHECK(logger.logRx(unit, rxMsg));
+  CHECK_EQ(SD.numWrites, 1);
+  CHECK_EQ(SD.contents(LOG_FILE).size(), SD_LOGGER_SECTOR_LEN);
+  CHECK_EQ(logger.getNumSectorsWritten(), 1);
+  CHECK_EQ(SD.numFlushes, 0);
+
+  // Nothing is synced before the sync period is up.
+  CHECK(logger.logRx(unit, rxMsg));
+  logger.service();
+  CHECK_EQ(SD.numFlushes, 0);
+  delay(10000);
+  logger.service();
+  CHECK_EQ(SD.numFlushes, 1);
+  CHECK_EQ(SD.numWrites, 2);
+  CHECK_EQ(SD.contents(LOG_FILE).size(), 2 * SD_LOGGER_SECTOR_LEN);
+  // ...nor when nothing new was logged.
+  delay(20000);
+  logger.service();
+  CHECK_EQ(SD.numFlushes, 1);
+  CHECK_EQ(logger.getNumRecords(), 9);
+  CHECK_EQ(logger.getNumDropped(), 0);
+
+  std::vector<sdLogRecord_t> records = readBack();
+  CHECK_EQ(records.size(), 16);
+  CHECK_EQ(records[0].kind, sdLogKind_sessionStart);
+  CHECK_EQ(records[1].kind, sdLogKind_tx);
+  CHECK_EQ(records[1].payloadLen, sizeof(msg));
+  CHECK(memcmp(records[1].payload, msg, SD_LOGGER_PAYLOAD_LEN) == 0);
+  CHECK_EQ(records[2].ack, 1);
+  CHECK_EQ(records[2].timestampMillis - records[1].timestampMillis, 100);
+  CHECK_EQ(records[7].kind, sdLogKind_rx);
+  CHECK_EQ(records[7].msgId, 7);
+  CHECK_EQ(records[7].flags, 0x40);
+  CHECK_EQ(records[8].kind, sdLogKind_rx);
+  for (uint8_t idx = 9; idx < records.size(); idx++)
+  {
+    CHECK_EQ(records[idx].kind, sdLogKind_none);
+  }
+
+  // A new session appends, starting on a sector boundary.
+  logger.end();
+  sdLogger restarted(LOG_FILE);
+  CHECK(restarted.begin());
+  restarted.end();
+  records = readBack();
+  CHECK_EQ(records.size(), 24);
+  CHECK_EQ(records[16].kind, sdLogKind_sessionStart);
+}
+
+static void testAlignment ()
+{
+  SD.reset();
+  SD.contents(LOG_FILE).resize(100, 'x');
+  sdLogger logger(LOG_FILE);
+  CHECK(logger.begin());
+  CHECK_EQ(SD.contents(LOG_FILE).size(), SD_LOGGER_SECTOR_LEN);
+  CHECK(logger.sync());
+  CHECK_EQ(SD.contents(LOG_FILE).size(), 2 * SD_LOGGER_SECTOR_LEN);
+  CHECK_EQ(readBack()[8].kind, sdLogKind_sessionStart);
+}
+
+static void testNoCard ()
+{
+  SD.reset();
+  SD.present = false;
+  sdLogger logger(LOG_FILE);
+  CHECK(!logger.begin());
+  uint8_t msg [] = {1, 'x'};
+  CHECK(!logger.logTx(unit, 0xBB, msg, sizeof(msg), 0xEE, true));
+  CHECK(!logger.sync());
+  CHECK_EQ(logger.getNumDropped(), 1);
+}
+
+static void testCsv ()
+{
+  capturePort port;
+  sdLogger::printCsvHeader(port);
+  CHECK(port.text == "Timestamp,Source Address,Destination Address,Message ID,Message Flags,Acknowleged,Message,"
+                     "spreadingFactor,signalBandwidth,frequencyChannel,txPower\r\n");
+  sdLogRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.timestampMillis = 123456;
+  record.kind = sdLogKind_tx;
+  record.srcAddr = 0xBB;
+  record.destAddr = 0xE;
+  record.flags = 0x40; // Not printed for sent messages.
+  record.ack = 1;
+  record.spreadingFactor = spreadingFactor_sf9;
+  record.signalBandwidth = signalBandwidth_500kHz;
+  record.frequencyChannel = 3;
+  record.txPower = -2;
+  record.payloadLen = 7;
+  memcpy(record.payload, "\x02" "foobar", 7);
+  port.text.clear();
+  CHECK(sdLogger::printCsv(record, port));
+  CHECK(port.text == "123456,BB,E,2,,1,foobar,2,2,3,-2\r\n");
+
+  record.kind = sdLogKind_rx;
+  port.text.clear();
+  CHECK(sdLogger::printCsv(record, port));
+  CHECK(port.text == "123456,BB,E,2,64,1,foobar,2,2,3,-2\r\n");
+
+  // Messages longer than a record holds are cut off.
+  record.payloadLen = 200;
+  memset(record.payload, 'z', SD_LOGGER_PAYLOAD_LEN);
+  port.text.clear();
+  CHECK(sdLogger::printCsv(record, port));
+  CHECK(port.text.find(std::string(SD_LOGGER_PAYLOAD_LEN - 1, 'z') + ",") != std::string::npos);
+
+  record.kind = sdLogKind_none;
+  port.text.clear();
+  CHECK(!sdLogger::printCsv(record, port));
+  CHECK(port.text.empty());
+}
+
+int main ()
+{
+  testSectors();
+  testAlignment();
+  testNoCard();
+  testCsv();
+  return hostTestResult();
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_seapHOx.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests parsing streamed SeapHOx output and packing the records into bitfields.
+ * @version 0.1
+ * @date 2021-09-13
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <seapHOx.h>
+#include <RH_RF95.h>
+#include <loraPoint2PointCommon.h>
+#include <sensorAggregator.h>
+#include <hostTest.h>
+
+/**
+ * @brief Data records as the SeapHOx prints them.
+ *
+ */
+static char const * const records [] =
+{
+  "DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6",
+  "DSPHOX23005, 01/17/2020 00:20:00, 1442, 0000, 4.6021, 7.9512, 7.9498, -0.981234, -1.020145, 4.7113, 10.532, 31.2045, 3.18342, 7.021, 12.3, 5.1",
+  "DSPHOX23005, 01/17/2020 00:40:00, 1443, 0004, -1.4021, 8.0412, 8.0398, -0.958000, -0.999871, -1.3890, 10.528, 33.9012, 2.80011, 8.112, 12.4, -0.9",
+};
+
+/**
+ * @brief A recorded session: the wake-up banner and prompt, a command echo, records, a line lost to a framing
+ * error and a record cut off when logging stopped.
+ *
+ */
+static std::string recording ()
+{
+  std::string s;
+  s += "\r\nSeapHOx V2 SN 23005\r\nS>";
+  s += "startnow\r\n";
+  s += std::string(records[0]) + "\r\n";
+  s += std::string(records[1]) + "\r\n";
+  s += "DSPHOX23005, 01/17/2020 00:30:00, 14\x91" "2, 0000, 4.6020, 7.9511, 7.9497, -0.981230, -1.020141, 4.7110, 10.530, 31.2044, 3.18341, 7.020, 12.3, 5.1\r\n";
+  s += std::string(records[2]) + "\r\n";
+  s += "DSPHOX23005, 01/17/2020 00:50:00, 1444, 0000, -1.40";
+  return s;
+}
+
+static std::string readable (SeapHOxData const & data)
+{
+  char line [SEAPHOX_READABLE_MAX_LEN];
+  uint8_t len = data.getReadableString(line);
+  CHECK(len < SEAPHOX_READABLE_MAX_LEN);
+  CHECK_EQ(len, strlen(line));
+  return std::string(line, len);
+}
+
+static void testLayout ()
+{
+  CHECK_EQ(packedFieldsBits(seapHOxFieldTable, NUM_seapHOxFields), SEAPHOX_BITFIELD_BITS);
+  CHECK_EQ(SEAPHOX_BITFIELD_LEN, 39);
+}
+
+static void testStream ()
+{
+  SeapHOxData data;
+  std::string stream = recording();
+  std::vector<std::string> parsed;
+  for (size_t i = 0; i < stream.size(); i++)
+  {
+    if (data.parseChar(stream[i]))
+    {
+      parsed.push_back(readable(data));
+    }
+  }
+  CHECK_EQ(parsed.size(), 3);
+  for (uint8_t i = 0; i < parsed.size() && i < 3; i++)
+  {
+    if (parsed[i] != records[i])
+    {
+      printf("\"%s\" parsed as \"%s\"\n", records[i], parsed[i].c_str());
+      CHECK(false);
+    }
+  }
+  CHECK_EQ(data.getField(seapHOxField_serialNumber), 23005);
+  CHECK_EQ(data.getField(seapHOxField_year), 2020);
+  CHECK_EQ(data.getField(seapHOxField_minute), 40);
+  CHECK_EQ(data.getField(seapHOxField_sampleNumber), 1443);
+  CHECK_EQ(data.getField(seapHOxField_errorFlags), 4);
+  CHECK_EQ(data.getField(seapHOxField_temperature), -14021);
+  CHECK_EQ(data.getField(seapHOxField_externalPH), 80412);
+  CHECK_EQ(data.getField(seapHOxField_externalPHVolts), -958000);
+  CHECK_EQ(data.getField(seapHOxField_salinity), 339012);
+  CHECK_EQ(data.getField(seapHOxField_oxygen), 8112);
+  CHECK_EQ(data.getField(seapHOxField_internalTemperature), -9);
+
+  // The cut-off record is dropped at the next line ending.
+  CHECK(!data.parseChar('\n'));
+  data.resetParser();
+
+  // Whole lines.
+  CHECK(data.setDataFromString(records[0], strlen(records[0])));
+  CHECK(readable(data) == records[0]);
+  char const * const bad [] =
+  {
+    "",
+    "S>",
+    "DSPHOX, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6",
+    "XSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6",
+    "DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4",
+    "DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6, 1",
+    "DSPHOX23005, 09/28/201814:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6", // Spaces stripped.
+    "DSPHOX23005, 09/28/2018 14:07:22, 1, 000G, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6",
+    "DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, -8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 18.4, 22.6", // Negative pH.
+    "DSPHOX23005, 09/28/2018 14:07:22, 1, 0000, 21.4829, 8.0000, 8.0000, -0.973178, -1.012355, 21.1932, 0.008, 0.0010, 0.00001, 6.563, 103.4, 22.6", // RH past 10 bits.
+  };
+  for (uint8_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    if (data.setDataFromString(bad[i], strlen(bad[i])))
+    {
+      printf("accepted: \"%s\"\n", bad[i]);
+      CHECK(false);
+    }
+  }
+  CHECK(readable(data) == records[0]);
+}
+
+static void testRoundTrip ()
+{
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    SeapHOxData tx;
+    SeapHOxData rx;
+    CHECK(tx.setDataFromString(records[i], strlen(records[i])));
+    CHECK(tx.convertReadableToBitfield());
+    CHECK(rx.setBitfield(tx.getBitfield(), SEAPHOX_BITFIELD_LEN));
+    CHECK(rx.convertBitfieldToReadable());
+    if (readable(rx) != records[i])
+    {
+      printf("\"%s\" came back as \"%s\"\n", records[i], readable(rx).c_str());
+      CHECK(false);
+    }
+  }
+
+  // A bitfield that does not hold a record is refused.
+  SeapHOxData data;
+  uint8_t ones [SEAPHOX_BITFIELD_LEN];
+  memset(ones, 0xFF, sizeof(ones));
+  CHECK(!data.setBitfield(ones, SEAPHOX_BITFIELD_LEN + 1));
+  CHECK(data.setBitfield(ones, SEAPHOX_BITFIELD_LEN));
+  CHECK(!data.convertBitfieldToReadable());
+}
+
+static void testAirtime ()
+{
+  // Payload per record inside an aggregated frame, ASCII as the endpoint forwards it (spaces stripped) vs packed.
+  std::string ascii = records[1];
+  ascii.erase(std::remove(ascii.begin(), ascii.end(), ' '), ascii.end());
+  uint8_t asciiLen = SENSOR_AGGREGATOR_RECORD_OVERHEAD + ascii.size();
+  uint8_t packedLen = SENSOR_AGGREGATOR_RECORD_OVERHEAD + SEAPHOX_BITFIELD_LEN;
+  uint8_t const frameLen = RH_RF95_MAX_PAYLOAD_LEN - RH_RF95_HEADER_LEN - 1;
+  for (uint8_t sf = 7; sf <= 12; sf++)
+  {
+    uint8_t asciiRecords = frameLen / asciiLen;
+    uint8_t packedRecords = frameLen / packedLen;
+    double asciiMicros = double(loraPoint2PointCommon::airtimeMicros(sf, 125000, 1 + asciiRecords * asciiLen + 4)) / asciiRecords;
+    double packedMicros = double(loraPoint2PointCommon::airtimeMicros(sf, 125000, 1 + packedRecords * packedLen + 4)) / packedRecords;
+    if (sf == 9)
+    {
+      printf("SeapHOx records at SF9/125kHz: %.1f ms ASCII (%u bytes), %.1f ms packed\n", asciiMicros / 1000, asciiLen, packedMicros / 1000);
+    }
+    CHECK(asciiMicros >= 2.5 * packedMicros);
+  }
+}
+
+int main ()
+{
+  testLayout();
+  testStream();
+  testRoundTrip();
+  testAirtime();
+  return hostTestResult();
+}
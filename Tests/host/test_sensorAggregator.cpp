@@ -0,0 +1,141 @@
+/**
+ * @file test_sensorAggregator.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests packing sensor records into shared frames, and how much airtime that saves.
+ * @version 0.1
+ * @date 2021-09-10
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <sensorAggregator.h>
+#include <loraPoint2PointCommon.h>
+#include <hostTest.h>
+
+#define FRAME_LEN 251
+#define MSG_TYPE  14
+
+static std::vector<std::pair<sensors_t, std::string> > unpacked;
+static std::vector<bool> unpackedPacked;
+
+void recordInd (sensors_t const sensor, uint8_t const * record, uint8_t const recordLen, bool const packed)
+{
+  unpacked.push_back(std::make_pair(sensor, std::string((char const *)record, recordLen)));
+  unpackedPacked.push_back(packed);
+}
+
+static bool addString (sensorAggregator<FRAME_LEN> & aggregator, sensors_t sensor, std::string const & s, uint32_t nowMillis)
+{
+  return aggregator.addRecord(sensor, (uint8_t const *)s.data(), uint8_t(s.size()), nowMillis);
+}
+
+static void testRoundTrip ()
+{
+  sensorAggregator<FRAME_LEN> aggregator(MSG_TYPE, 2000);
+  std::string procv = "WM,2020,01,17,00,20,00,55651,51716,532.59,40.00,5.60,0.90,0981,12.1";
+  std::string seaphox = "DSPHOX01234,2020/01/17,00:20:00,1,12.3456,7.8901";
+  CHECK_EQ(aggregator.getFrameLen(), 1);
+  CHECK(addString(aggregator, sensor_proCV, procv, 0));
+  CHECK(addString(aggregator, sensor_seapHOx, seaphox, 0));
+  CHECK(addString(aggregator, sensor_none, "", 0)); // Empty records survive too.
+  uint8_t const bitfield [4] = {0x80, 0x00, 0xFF, 0x01};
+  CHECK(aggregator.addRecord(sensor_proCV, bitfield, sizeof(bitfield), 0, true));
+  CHECK_EQ(aggregator.getNumRecords(), 4);
+  CHECK_EQ(aggregator.getFrame()[0], MSG_TYPE);
+  CHECK_EQ(aggregator.getFrameLen(), 1 + 4 * SENSOR_AGGREGATOR_RECORD_OVERHEAD + procv.size() + seaphox.size() + sizeof(bitfield));
+
+  unpacked.clear();
+  unpackedPacked.clear();
+  CHECK_EQ(sensorAggregator<FRAME_LEN>::unpack(aggregator.getFrame(), aggregator.getFrameLen(), recordInd), 4);
+  CHECK_EQ(unpacked.size(), 4);
+  CHECK(unpacked[0].first == sensor_proCV && unpacked[0].second == procv);
+  CHECK(unpacked[1].first == sensor_seapHOx && unpacked[1].second == seaphox);
+  CHECK(unpacked[2].first == sensor_none && unpacked[2].second.empty());
+  CHECK(unpacked[3].first == sensor_proCV && unpacked[3].second == std::string((char const *)bitfield, sizeof(bitfield)));
+  std::vector<bool> expectedPacked = {false, false, false, true};
+  CHECK(unpackedPacked == expectedPacked);
+
+  // A truncated frame still yields its complete records.
+  unpacked.clear();
+  CHECK_EQ(sensorAggregator<FRAME_LEN>::unpack(aggregator.getFrame(), aggregator.getFrameLen() - SENSOR_AGGREGATOR_RECORD_OVERHEAD - sizeof(bitfield) - 3, recordInd), 1);
+  CHECK(unpacked.size() == 1 && unpacked[0].second == procv);
+
+  aggregator.clear();
+  CHECK_EQ(aggregator.getFrameLen(), 1);
+  CHECK_EQ(aggregator.getNumRecords(), 0);
+}
+
+static void testFlush ()
+{
+  // Age deadline.
+  sensorAggregator<FRAME_LEN> aggregator(MSG_TYPE, 2000);
+  CHECK(!aggregator.isDue(0)); // Nothing to send.
+  CHECK(addString(aggregator, sensor_proCV, "abc", 0xFFFFF000UL));
+  CHECK(addString(aggregator, sensor_proCV, "def", 0xFFFFF500UL));
+  CHECK(!aggregator.isDue(0xFFFFF000UL + 1999));
+  CHECK(aggregator.isDue(0xFFFFF000UL + 2000)); // Measured from the oldest record, across the millis() wrap.
+
+  // Size: addRecord refuses what does not fit, isDue fires at the flush length.
+  sensorAggregator<FRAME_LEN> sized(MSG_TYPE, 60000, 200);
+  std::string record(48, 'x');
+  uint8_t added = 0;
+  while (sized.hasRoomFor(record.size()))
+  {
+    CHECK(!sized.isDue(0) || sized.getFrameLen() >= 200);
+    CHECK(addString(sized, sensor_seapHOx, record, 0));
+    added++;
+  }
+  CHECK_EQ(added, (FRAME_LEN - 1) / (record.size() + SENSOR_AGGREGATOR_RECORD_OVERHEAD));
+  CHECK(!addString(sized, sensor_seapHOx, record, 0));
+  CHECK_EQ(sized.getNumRecords(), added);
+  CHECK(sized.isDue(0));
+  CHECK(sized.getFrameLen() <= FRAME_LEN);
+}
+
+/**
+ * @brief Airtime per record, each frame being followed by a 1-byte RHReliableDatagram-style acknowlegement.
+ *
+ */
+static double microsPerRecord (uint8_t recordLen, bool aggregated, uint8_t sf, uint32_t bw)
+{
+  uint8_t records = 1;
+  uint8_t payloadLen = 1 + recordLen;
+  if (aggregated)
+  {
+    records = (FRAME_LEN - 1) / (recordLen + SENSOR_AGGREGATOR_RECORD_OVERHEAD);
+    payloadLen = 1 + records * (recordLen + SENSOR_AGGREGATOR_RECORD_OVERHEAD);
+  }
+  uint32_t frame = loraPoint2PointCommon::airtimeMicros(sf, bw, payloadLen + 4);
+  uint32_t ack = loraPoint2PointCommon::airtimeMicros(sf, bw, 1 + 4);
+  return double(frame + ack) / records;
+}
+
+static void testAirtime ()
+{
+  // Short (binary) records gain the most; full ASCII ProCV lines still gain something.
+  uint8_t const recordLens [] = {12, 20, 66};
+  double const minGain [] = {3.0, 2.0, 1.3};
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    for (uint8_t sf = 7; sf <= 12; sf++)
+    {
+      double gain = microsPerRecord(recordLens[i], false, sf, 125000) / microsPerRecord(recordLens[i], true, sf, 125000);
+      if (sf == 9)
+      {
+        printf("%u byte records at SF9/125kHz: %.1fx records per airtime second\n", recordLens[i], gain);
+      }
+      CHECK(gain >= minGain[i]);
+    }
+  }
+}
+
+int main ()
+{
+  testRoundTrip();
+  testFlush();
+  testAirtime();
+  return hostTestResult();
+}
@@ -0,0 +1,279 @@
+/**
+ * @file test_storeAndForward.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the store-and-forward FIFO: records kept across a link outage and a reset, the backlog drained alongside live records, and what it costs on the SD card.
+ * @version 0.1
+ * @date 2021-09-26
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <storeAndForward.h>
+#include <loraPoint2PointCommon.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR          0xBB
+#define ENDPOINT_ADDR      0xEE
+#define FIFO_FILE          "fifo.bin"
+#define HEAD_FILE          "fifohead.bin"
+#define RECORD_PERIOD_MS   2000
+#define OUTAGE_MS          600000
+
+//-----------
+// Callbacks
+//-----------
+
+static std::vector<uint32_t> receivedAt; ///< By sequence number: when the base first had it, 0 if not yet.
+static uint32_t numDuplicates = 0;
+static uint32_t numCorrupted = 0;
+static std::vector<uint32_t> pushedAt;
+static bool outage = false;
+
+static std::string record (uint32_t seq)
+{
+  char text [48];
+  snprintf(text, sizeof(text), "%6u,7.%03u,14.%02u,412.%u,35.%02u", unsigned(seq),
+           unsigned(900 + seq % 97), unsigned(seq % 89), unsigned(seq % 10), unsigned(seq % 71));
+  return std::string(text);
+}
+
+storeAndForward * fifo;
+
+void baseRxInd (message_t const & rxMsg)
+{
+  uint32_t seq;
+  uint8_t const * data;
+  uint8_t dataLen;
+  if (!storeAndForward::parse(rxMsg, seq, data, dataLen))
+  {
+    return;
+  }
+  if (seq >= receivedAt.size())
+  {
+    receivedAt.resize(seq + 1, 0);
+  }
+  if (receivedAt[seq] != 0)
+  {
+    numDuplicates++;
+    return;
+  }
+  receivedAt[seq] = millis();
+  numCorrupted += std::string((char const *)data, dataLen) != record(seq);
+}
+
+void endpointTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  fifo->txInd(txBuf, bufLen, ack);
+}
+
+void endpointBulkTxInd (uint8_t const destAddr, bool const success)
+{
+  fifo->bulkTxInd(success);
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(NULL, baseRxInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(endpointTxInd, NULL, NULL, NULL, endpointBulkTxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+bulkRxContext_t baseBulkRx;
+
+//---------
+// Helpers
+//---------
+
+static bool pushRecord (storeAndForward & store)
+{
+  std::string text = record(pushedAt.size());
+  pushedAt.push_back(millis());
+  return store.push((uint8_t const *)text.data(), text.size());
+}
+
+/**
+ * @brief Records survive closing and reopening, and a record cut short does not read back.
+ *
+ */
+static void testFile ()
+{
+  SD.reset();
+  {
+    storeAndForward store(FIFO_FILE, HEAD_FILE);
+    CHECK(store.begin());
+    uint8_t longRecord [STORE_FORWARD_MAX_DATA_LEN + 1] = {0};
+    CHECK(!store.push(longRecord, sizeof(longRecord)));
+    for (uint8_t seq = 0; seq < 5; seq++)
+    {
+      std::string text = record(seq);
+      CHECK(store.push((uint8_t const *)text.data(), text.size()));
+    }
+    CHECK_EQ(store.getNumPending(), 5);
+    CHECK_EQ(SD.contents(FIFO_FILE).size(), 5 * STORE_FORWARD_RECORD_LEN);
+    store.end();
+  }
+  // A reset part way through writing a record.
+  std::vector<uint8_t> & data = SD.contents(FIFO_FILE);
+  data.insert(data.end(), data.begin(), data.begin() + 10);
+  storeAndForward store(FIFO_FILE, HEAD_FILE);
+  CHECK(store.begin());
+  CHECK_EQ(store.getNumPending(), 6);
+  storedRecord_t stored;
+  CHECK(store.read(3, stored));
+  CHECK(std::string((char const *)stored.data, stored.dataLen) == record(3));
+  CHECK(!store.read(5, stored));
+  std::string text = record(6);
+  CHECK(store.push((uint8_t const *)text.data(), text.size()));
+  CHECK(store.read(6, stored));
+  CHECK(std::string((char const *)stored.data, stored.dataLen) == record(6));
+  store.end();
+  SD.reset();
+}
+
+static uint32_t countReceived ()
+{
+  uint32_t num = 0;
+  for (uint32_t at : receivedAt)
+  {
+    num += at != 0;
+  }
+  return num;
+}
+
+static bool dropAll (simFrame_t const & frame, int receiver)
+{
+  return outage;
+}
+
+int main ()
+{
+  testFile();
+
+  simLoRaChannel & channel = simLoRaChannel::instance();
+  simScheduler & sched = simScheduler::instance();
+  channel.seed(11);
+  channel.setPathLoss(100);
+  channel.setDropFilter(dropAll);
+
+  storeAndForward store(FIFO_FILE, HEAD_FILE);
+  fifo = &store;
+  CHECK(store.begin());
+  bool sampling = false;
+  uint32_t lastSampleMillis = 0;
+  uint32_t peakFileLen = 0;
+  uint32_t peakHeadFileLen = 0;
+  sched.addNode([]{ CHECK(base.setupRadio()); base.setBulkRx(&baseBulkRx); },
+                []{ base.serviceRx(); },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                [&]{
+                  if (sampling && millis() - lastSampleMillis >= RECORD_PERIOD_MS)
+                  {
+                    lastSampleMillis = millis();
+                    CHECK(pushRecord(*fifo));
+                  }
+                  fifo->service(endpoint, BASE_ADDR);
+                  endpoint.serviceRx();
+                  peakFileLen = MAX(peakFileLen, uint32_t(SD.contents(FIFO_FILE).size()));
+                  peakHeadFileLen = MAX(peakHeadFileLen, uint32_t(SD.contents(HEAD_FILE).size()));
+                },
+                1000);
+  sched.runFor(1000000ULL);
+  for (loraPoint2Point * unit : {&base, &endpoint})
+  {
+    unit->setSpreadingFactor(spreadingFactor_sf9);
+    unit->setBandwidth(signalBandwidth_125kHz);
+  }
+  sched.runFor(1000000ULL);
+
+  // Link up: records go out live, one by one, as they are taken.
+  sampling = true;
+  sched.runFor(60000000ULL);
+  CHECK(store.isLinkUp());
+  CHECK(store.getNumPending() <= 1);
+  CHECK_EQ(countReceived(), store.getNumAcked());
+  uint32_t liveRecords = pushedAt.size();
+
+  // Outage: everything taken is kept.
+  outage = true;
+  sched.runFor(uint64_t(OUTAGE_MS) * 1000);
+  CHECK(!store.isLinkUp());
+  uint32_t backlog = store.getNumPending();
+  CHECK(backlog >= OUTAGE_MS / RECORD_PERIOD_MS - 1);
+  uint32_t storedBytes = peakFileLen;
+  uint32_t writesBefore = SD.numWrites;
+
+  // Back up: the backlog drains while new records keep going out live.
+  outage = false;
+  uint32_t restoredMillis = millis();
+  uint32_t firstAfter = 0; // First record taken once the endpoint knows the link is back; the ones before it join the backlog.
+  uint32_t drainedMillis = 0;
+  for (uint32_t second = 0; second < 300 && drainedMillis == 0; second++)
+  {
+    sched.runFor(1000000ULL);
+    if (firstAfter == 0 && store.isLinkUp())
+    {
+      firstAfter = pushedAt.size();
+    }
+    if (store.getNumPending() <= 1)
+    {
+      drainedMillis = millis() - restoredMillis;
+    }
+  }
+  CHECK(drainedMillis > 0);
+  CHECK(store.isLinkUp());
+  uint32_t maxLiveLatency = 0;
+  for (uint32_t seq = firstAfter; seq + 1 < pushedAt.size(); seq++)
+  {
+    CHECK(seq < receivedAt.size() && receivedAt[seq] != 0);
+    if (seq < receivedAt.size() && receivedAt[seq] != 0)
+    {
+      maxLiveLatency = MAX(maxLiveLatency, receivedAt[seq] - pushedAt[seq]);
+    }
+  }
+  // The backlog's share of the channel, against what the frames need on air back to back.
+  uint32_t frameAirtimeMicros = loraPoint2PointCommon::airtimeMicros(9, 125000, RH_RF95_HEADER_LEN + BULK_HEADER_LEN + STORE_FORWARD_FRAME_HEADER_LEN + record(0).size());
+  uint32_t drainAirtimeMillis = backlog * frameAirtimeMicros / 1000;
+  printf("Backlog of %u records drained in %u ms, %u ms of it airtime; live records delivered within %u ms; %u duplicates\n",
+         backlog, drainedMillis, drainAirtimeMillis, maxLiveLatency, numDuplicates);
+  printf("SD: %u bytes for %u records of %u bytes, %u-byte head file, %u writes while draining\n",
+         storedBytes, liveRecords + backlog, unsigned(record(0).size()), peakHeadFileLen, SD.numWrites - writesBefore);
+  // Drained within the retry wait and twice the airtime the backlog needs...
+  CHECK(drainedMillis <= STORE_FORWARD_RETRY_MILLIS + 2 * drainAirtimeMillis);
+  // ...without holding up live records...
+  CHECK(maxLiveLatency < 5000);
+  // ...and every record arrived, once, whole.
+  sched.runFor(10000000ULL);
+  CHECK_EQ(countReceived(), pushedAt.size());
+  CHECK_EQ(numCorrupted, 0);
+  CHECK(numDuplicates <= 1);
+  // One record slot each on the card, and the head file stays small.
+  CHECK(storedBytes <= (liveRecords + backlog + 1) * STORE_FORWARD_RECORD_LEN);
+  CHECK(peakHeadFileLen <= STORE_FORWARD_HEAD_FILE_LEN + 2 * sizeof(uint32_t));
+  // Once all is acknowleged the files start afresh.
+  CHECK(SD.contents(FIFO_FILE).size() < STORE_FORWARD_COMPACT_RECORDS * STORE_FORWARD_RECORD_LEN);
+
+  // A reset during an outage: the records taken are still sent, with the sequence numbers going on.
+  outage = true;
+  sched.runFor(60000000ULL);
+  uint32_t pendingAtReset = store.getNumPending();
+  CHECK(pendingAtReset >= 25);
+  store.end();
+  storeAndForward restarted(FIFO_FILE, HEAD_FILE);
+  CHECK(restarted.begin());
+  CHECK_EQ(restarted.getNumPending(), pendingAtReset);
+  fifo = &restarted;
+  outage = false;
+  sched.runFor(60000000ULL);
+  sampling = false;
+  sched.runFor(10000000ULL);
+  CHECK_EQ(restarted.getNumPending(), 0);
+  CHECK_EQ(countReceived(), pushedAt.size());
+  CHECK_EQ(numCorrupted, 0);
+
+  sched.stop();
+  return hostTestResult();
+}
@@ -0,0 +1,201 @@
+/**
+ * @file test_taskScheduler.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the taskScheduler min-heap: deadline order, one-shot and periodic tasks, millis() wraparound, and a loraPoint2Point main loop that sleeps between deadlines.
+ * @version 0.1
+ * @date 2021-09-21
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <loraPoint2PointProtocol.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR 0xBB
+
+//-----------
+// Callbacks
+//-----------
+
+static std::string runLog;
+static uint32_t heartbeatsSent = 0;
+
+static void logTask (void * context)
+{
+  runLog += *static_cast<char const *>(context);
+}
+
+void txInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  heartbeatsSent += txBuf[0] == msgType_heartbeatReq;
+}
+
+userCallbacks_t callbacks = hostTestCallbacks(txInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, callbacks);
+
+//---------
+// Helpers
+//---------
+
+static char const names [] = "abcdefgh";
+
+static void testOrder ()
+{
+  taskScheduler<8> sched;
+  taskId_t ids [8];
+  for (uint8_t idx = 0; idx < 8; idx++)
+  {
+    ids[idx] = sched.add(logTask, (void *)&names[idx]);
+    CHECK_EQ(ids[idx], idx);
+  }
+  CHECK_EQ(sched.add(logTask, NULL), TASK_SCHEDULER_INVALID_ID);
+  CHECK_EQ(sched.millisUntilNext(0), TASK_SCHEDULER_IDLE_MILLIS);
+
+  // Started out of order, run in deadline order.
+  uint32_t const delays [8] = {70, 10, 50, 30, 80, 20, 60, 40};
+  for (uint8_t idx = 0; idx < 8; idx++)
+  {
+    CHECK(sched.start(ids[idx], 1000, delays[idx]));
+  }
+  CHECK_EQ(sched.countRunning(), 8);
+  CHECK_EQ(sched.millisUntilNext(1000), 10);
+  CHECK_EQ(sched.run(1009), 0);
+  CHECK_EQ(sched.run(1045), 4);
+  CHECK(runLog == "bfdh");
+  CHECK_EQ(sched.millisUntilNext(1045), 5);
+
+  // Stopping from the middle of the heap, and restarting a running task, keep the order.
+  sched.stop(ids[6]);
+  sched.stop(ids[6]);
+  CHECK(!sched.isRunning(ids[6]));
+  CHECK(sched.start(ids[0], 1045, 100));
+  CHECK_EQ(sched.run(2000), 3);
+  CHECK(runLog == "bfdhcea");
+  CHECK_EQ(sched.countRunning(), 0);
+  CHECK(!sched.start(TASK_SCHEDULER_INVALID_ID, 0, 0));
+}
+
+static void testPeriodic ()
+{
+  taskScheduler<2> sched;
+  runLog.clear();
+  taskId_t tick = sched.add(logTask, (void *)"t");
+  taskId_t once = sched.add(logTask, (void *)"o");
+  sched.start(tick, 0, 100, 100);
+  sched.start(once, 0, 150);
+  for (uint32_t now = 0; now <= 400; now += 10)
+  {
+    sched.run(now);
+  }
+  CHECK(runLog == "tottt");
+  CHECK(sched.isRunning(tick));
+  CHECK(!sched.isRunning(once));
+
+  // Periods are kept from the deadline, not from when run() got round to it...
+  runLog.clear();
+  sched.run(503);
+  CHECK_EQ(sched.millisUntilNext(503), 97);
+  // ...unless it has fallen a whole period behind: no burst of catch-up runs.
+  sched.run(1250);
+  CHECK(runLog == "tt");
+  CHECK_EQ(sched.millisUntilNext(1250), 100);
+  CHECK_EQ(sched.millisUntilNext(1400), 0);
+}
+
+static uint8_t selfStops = 0;
+static taskScheduler<2> * selfSched;
+
+static void stopSelfTask (void * context)
+{
+  selfStops++;
+  selfSched->stop(*static_cast<taskId_t *>(context));
+}
+
+static void restartSelfTask (void * context)
+{
+  selfSched->start(*static_cast<taskId_t *>(context), 0, 0);
+}
+
+static void testCallbacks ()
+{
+  taskScheduler<2> sched;
+  selfSched = &sched;
+  static taskId_t stopper;
+  static taskId_t restarter;
+  stopper = sched.add(stopSelfTask, &stopper);
+  restarter = sched.add(restartSelfTask, &restarter);
+  sched.start(stopper, 0, 10, 10);
+  sched.run(10);
+  CHECK_EQ(selfStops, 1);
+  CHECK(!sched.isRunning(stopper));
+
+  // A task that keeps restarting itself with no delay does not hang run().
+  sched.start(restarter, 0, 0);
+  CHECK_EQ(sched.run(0), 2);
+  CHECK(sched.isRunning(restarter));
+}
+
+static void testWraparound ()
+{
+  taskScheduler<3> sched;
+  runLog.clear();
+  taskId_t a = sched.add(logTask, (void *)&names[0]);
+  taskId_t b = sched.add(logTask, (void *)&names[1]);
+  taskId_t c = sched.add(logTask, (void *)&names[2]);
+  uint32_t now = 0xFFFFFFFF - 50;
+  sched.start(c, now, 210);
+  sched.start(a, now, 20);
+  sched.start(b, now, 100, 100);
+  // b and c are due after millis() wraps, but not before a.
+  CHECK_EQ(sched.millisUntilNext(now), 20);
+  CHECK_EQ(sched.run(now + 30), 1);
+  CHECK_EQ(sched.millisUntilNext(now + 30), 70);
+  now += 150; // Wrapped round to 99.
+  CHECK(now < 100);
+  CHECK_EQ(sched.run(now), 1);
+  CHECK_EQ(sched.millisUntilNext(now), 50);
+  CHECK_EQ(sched.run(now + 50), 1);
+  CHECK_EQ(sched.run(now + 60), 1);
+  CHECK(runLog == "abbc");
+}
+
+static void testSleepyLoop ()
+{
+  simScheduler & sim = simScheduler::instance();
+  // Start just before millis() wraps.
+  sim.setNowMicros((0xFFFFFFFFULL - 20000) * 1000ULL);
+  uint32_t numLoops = 0;
+  sim.addNode([]{ CHECK(base.setupRadio()); base.startHeartbeats(); },
+              [&]{
+                base.serviceRx();
+                numLoops++;
+                uint32_t sleepMillis = base.getMillisUntilNextDeadline();
+                delay(MIN(sleepMillis, 60000));
+              });
+  sim.runFor(HEARTBEAT_TIMEOUT_MILLIS * 10 * 1000ULL + 500000);
+  printf("%u heartbeats in %u passes through loop\n", heartbeatsSent, numLoops);
+  CHECK_EQ(heartbeatsSent, 10);
+  // Woken for each heartbeat, the end of its CAD and the end of its transmission, not for every millisecond.
+  CHECK(numLoops <= 4 * heartbeatsSent);
+
+  base.stopHeartbeats();
+  numLoops = 0;
+  sim.runFor(120000000ULL);
+  CHECK_EQ(heartbeatsSent, 10);
+  CHECK(numLoops <= 3);
+  sim.stop();
+}
+
+int main ()
+{
+  testOrder();
+  testPeriodic();
+  testCallbacks();
+  testWraparound();
+  testSleepyLoop();
+  return hostTestResult();
+}
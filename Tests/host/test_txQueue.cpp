@@ -0,0 +1,155 @@
+/**
+ * @file test_txQueue.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the txQueue ring buffer and loraPoint2Point's TX priorities and backpressure.
+ * @version 0.1
+ * @date 2021-09-08
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <loraPoint2PointProtocol.h>
+#include <simLoRaChannel.h>
+#include <simScheduler.h>
+#include <hostTest.h>
+
+#define BASE_ADDR     0xBB
+#define ENDPOINT_ADDR 0xEE
+
+//-----------
+// Callbacks
+//-----------
+
+static std::vector<std::string> baseTxLog;
+static std::vector<bool> backpressureLog;
+static std::vector<std::string> endpointRxLog;
+
+static std::string frameName (uint8_t const * buf, uint8_t const bufLen)
+{
+  if (buf[0] == msgType_dataReq)
+  {
+    return std::string((char const *)buf + 1, bufLen - 1);
+  }
+  return "type" + std::to_string(buf[0]);
+}
+
+void baseTxInd (uint8_t const * txBuf, uint8_t const bufLen, uint8_t const destAddr, bool ack)
+{
+  if (destAddr != RH_BROADCAST_ADDRESS)
+  {
+    baseTxLog.push_back(frameName(txBuf, bufLen) + (ack ? "" : "!"));
+  }
+}
+
+void baseBackpressureInd (bool const backpressured)
+{
+  backpressureLog.push_back(backpressured);
+}
+
+void endpointRxInd (message_t const & rxMsg)
+{
+  if (rxMsg.buf[0] == msgType_dataReq)
+  {
+    endpointRxLog.push_back(frameName(rxMsg.buf, rxMsg.bufLen));
+  }
+}
+
+userCallbacks_t baseCallbacks = hostTestCallbacks(baseTxInd, NULL, NULL, baseBackpressureInd);
+userCallbacks_t endpointCallbacks = hostTestCallbacks(NULL, endpointRxInd);
+
+loraPoint2Point base(BASE_ADDR, 8, 3, 4, baseCallbacks);
+loraPoint2Point endpoint(ENDPOINT_ADDR, 8, 3, 4, endpointCallbacks);
+
+//-------
+// Tests
+//-------
+
+static void testRing ()
+{
+  txQueue<3, 8> q;
+  uint8_t buf [9] = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+  CHECK(q.isEmpty());
+  CHECK(!q.push(0x01, buf, 9, false, 0)); // too long
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    CHECK(q.push(i, buf + i, 1, false, 0));
+  }
+  CHECK(q.isFull());
+  CHECK(!q.push(0x03, buf, 1, false, 0));
+  // Wrap around a few times, checking FIFO order.
+  for (uint8_t i = 3; i < 10; i++)
+  {
+    CHECK_EQ(q.front().destAddr, i - 3);
+    CHECK_EQ(q.front().buf[0], buf[i - 3]);
+    q.pop();
+    CHECK_EQ(q.space(), 1);
+    CHECK(q.push(i, buf + (i % 9), 1, false, i));
+  }
+  CHECK_EQ(q.count(), 3);
+  CHECK_EQ(q.front().holdoffMillis, 7);
+  q.clear();
+  CHECK(q.isEmpty());
+  q.pop(); // Popping an empty queue is harmless.
+  CHECK_EQ(q.count(), 0);
+}
+
+int main ()
+{
+  simScheduler & sched = simScheduler::instance();
+  simLoRaChannel::instance().seed(3);
+
+  testRing();
+
+  static bool burst = false;
+  static bool burstRefused = false;
+  sched.addNode([]{ CHECK(base.setupRadio()); },
+                []{
+                  if (burst)
+                  {
+                    // A burst of sensor lines: the first goes straight to the transmitter, six fill the data queue.
+                    burst = false;
+                    char line [3] = {'d', '0', 0};
+                    for (uint8_t i = 0; i < 8; i++)
+                    {
+                      line[1] = '0' + i;
+                      base.setTxMessage((uint8_t const *)line, 2);
+                      if (!base.serviceTx(ENDPOINT_ADDR))
+                      {
+                        burstRefused = true;
+                        CHECK(base.isTxBackpressured());
+                        CHECK_EQ(base.getTxQueueSpace(), 0);
+                      }
+                    }
+                    // Control traffic jumps ahead of the queued data.
+                    CHECK(base.linkChangeReq(ENDPOINT_ADDR,
+                                             spreadingFactor_sf7,
+                                             signalBandwidth_500kHz,
+                                             frequencyChannel_500kHz_Uplink_0,
+                                             2));
+                  }
+                  base.serviceRx();
+                },
+                1000);
+  sched.addNode([]{ CHECK(endpoint.setupRadio()); },
+                []{ endpoint.serviceRx(); },
+                1000);
+
+  sched.runFor(1000000ULL);
+  burst = true;
+  sched.runFor(20000000ULL);
+  sched.stop();
+
+  CHECK(burstRefused);
+  std::vector<std::string> expectedTx = {"d0", "type3", "d1", "d2", "d3", "d4", "d5", "d6"};
+  CHECK(baseTxLog == expectedTx);
+  std::vector<std::string> expectedRx = {"d0", "d1", "d2", "d3", "d4", "d5", "d6"};
+  CHECK(endpointRxLog == expectedRx);
+  std::vector<bool> expectedBackpressure = {true, false};
+  CHECK(backpressureLog == expectedBackpressure);
+  CHECK(!base.isTxBusy());
+  CHECK(!base.isTxBackpressured());
+  return hostTestResult();
+}
@@ -0,0 +1,309 @@
+/**
+ * @file test_uartRing.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Tests the uartRing and lineFramer: wrapping, full rings and split lines, a producer and consumer on two threads, and a main loop away for a packet's airtime at 9600 baud.
+ * @version 0.1
+ * @date 2021-09-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <string>
+#include <thread>
+#include <uartRing.h>
+#include <RH_RF95.h>
+#include <loraPoint2PointCommon.h>
+#include <hostTest.h>
+
+#define RING_LEN        64
+#define THREAD_LINES    200000
+#define SENSOR_BAUD     9600
+#define SENSOR_RING_LEN 512
+
+//---------
+// Helpers
+//---------
+
+static std::string sliceText (uartSlice_t const & slice)
+{
+  std::string text;
+  for (uint16_t idx = 0; idx < slice.length(); idx++)
+  {
+    text += char(slice[idx]);
+  }
+  return text;
+}
+
+/**
+ * @brief A sensor record of varying length, numbered so that a lost or repeated line shows.
+ *
+ */
+static std::string sensorLine (uint32_t const number)
+{
+  char text [64];
+  snprintf(text, sizeof(text), "%u,7.%03u,14.%0*u", unsigned(number), unsigned(number % 1000), int(number % 23), 0u);
+  return std::string(text);
+}
+
+template <uint16_t capacity>
+static void pushText (uartRing<capacity> & ring,
+                      std::string const & text)
+{
+  for (char c : text)
+  {
+    CHECK(ring.push(uint8_t(c)));
+  }
+}
+
+/**
+ * @brief Bytes in and out, full and empty, and slices across the end of the ring.
+ *
+ */
+static void testRing ()
+{
+  uartRing<RING_LEN> ring;
+  uint8_t byte = 0;
+  CHECK(!ring.pop(byte));
+  CHECK_EQ(ring.count(), 0);
+  for (uint16_t idx = 0; idx < RING_LEN; idx++)
+  {
+    CHECK(ring.push(uint8_t(idx)));
+  }
+  CHECK_EQ(ring.space(), 0);
+  CHECK(!ring.push(0xFF));
+  CHECK_EQ(ring.getNumDropped(), 1);
+  CHECK(ring.pop(byte));
+  CHECK_EQ(byte, 0);
+  ring.release(RING_LEN - 11);
+  CHECK_EQ(ring.count(), 10);
+  CHECK_EQ(ring.peek(0), RING_LEN - 10);
+
+  // Ten bytes at the end of the ring and five at its start.
+  for (uint8_t idx = 0; idx < 5; idx++)
+  {
+    CHECK(ring.push(uint8_t(100 + idx)));
+  }
+  uartSlice_t slice = ring.slice(2, 12);
+  CHECK_EQ(slice.length(), 12);
+  CHECK_EQ(slice.firstLen, 8);
+  CHECK_EQ(slice.secondLen, 4);
+  CHECK_EQ(slice[0], RING_LEN - 8);
+  CHECK_EQ(slice[11], 103);
+  uint8_t copy [6];
+  CHECK_EQ(slice.copyTo(copy, sizeof(copy)), sizeof(copy));
+  CHECK_EQ(copy[5], RING_LEN - 3);
+  CHECK(slice.first >= (uint8_t const *)&ring && slice.first < (uint8_t const *)(&ring + 1));
+
+  // The indices wrap at 2^16 many times over.
+  ring.release(ring.count());
+  for (uint32_t idx = 0; idx < 70000; idx++)
+  {
+    ring.push(uint8_t(idx));
+    ring.pop(byte);
+    if (byte != uint8_t(idx))
+    {
+      CHECK_EQ(byte, uint8_t(idx));
+      break;
+    }
+  }
+  CHECK_EQ(ring.count(), 0);
+}
+
+/**
+ * @brief Lines handed back once whole, CRLFs, wrapped lines and lines too long.
+ *
+ */
+static void testFramer ()
+{
+  uartRing<RING_LEN> ring;
+  lineFramer<RING_LEN> framer(ring, 40);
+  uartSlice_t line;
+  CHECK(!framer.nextLine(line));
+  pushText(ring, "\r\nfirst\r\nsec");
+  CHECK(framer.nextLine(line));
+  CHECK(sliceText(line) == "first");
+  CHECK(!framer.nextLine(line));
+  CHECK_EQ(ring.count(), 3);
+  pushText(ring, "ond\n\n\n");
+  CHECK(framer.nextLine(line));
+  CHECK(sliceText(line) == "second");
+  CHECK(!framer.nextLine(line));
+  CHECK_EQ(ring.count(), 0);
+
+  // A line across the end of the ring is handed back in two runs, in place.
+  pushText(ring, std::string(RING_LEN - 30, 'x') + "\n");
+  CHECK(framer.nextLine(line));
+  CHECK(!framer.nextLine(line));
+  pushText(ring, "0123456789abcdefghijklmnopqrstuvwxyz\r");
+  CHECK(framer.nextLine(line));
+  CHECK(line.secondLen > 0);
+  CHECK(sliceText(line) == "0123456789abcdefghijklmnopqrstuvwxyz");
+  CHECK(!framer.nextLine(line));
+
+  // A line longer than the framer allows comes back in pieces.
+  pushText(ring, std::string(50, 'y') + "\n");
+  CHECK(framer.nextLine(line));
+  CHECK_EQ(line.length(), 40);
+  CHECK(framer.nextLine(line));
+  CHECK_EQ(line.length(), 10);
+  CHECK_EQ(framer.getNumSplit(), 1);
+  CHECK(!framer.nextLine(line));
+  CHECK_EQ(ring.count(), 0);
+}
+
+/**
+ * @brief A producer thread pushes lines as fast as it can, retrying when the ring is full, while the consumer frames
+ * them: every line arrives whole and in order.
+ *
+ */
+static void testThreads ()
+{
+  static uartRing<RING_LEN> ring;
+  lineFramer<RING_LEN> framer(ring);
+  std::thread producer([]
+                       {
+                         for (uint32_t number = 0; number < THREAD_LINES; number++)
+                         {
+                           for (char c : sensorLine(number) + "\r\n")
+                           {
+                             while (!ring.push(uint8_t(c)))
+                             {
+                               std::this_thread::yield();
+                             }
+                           }
+                         }
+                       });
+  uint32_t numLines = 0;
+  uint32_t numWrong = 0;
+  uartSlice_t line;
+  while (numLines < THREAD_LINES)
+  {
+    if (framer.nextLine(line))
+    {
+      numWrong += sliceText(line) != sensorLine(numLines);
+      numLines++;
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  printf("%u lines through a %u-byte ring across two threads, %u wrong, %u bytes dropped and pushed again\n",
+         numLines, RING_LEN, numWrong, ring.getNumDropped());
+  CHECK_EQ(numWrong, 0);
+  CHECK(!framer.nextLine(line));
+  CHECK_EQ(ring.count(), 0);
+}
+
+/**
+ * @brief Like an interrupt, the producer never waits: bytes that find the ring full are dropped and counted, and
+ * every byte is either dropped or handed to the consumer.
+ *
+ */
+static void testThreadsLossy ()
+{
+  static uartRing<RING_LEN> ring;
+  static uint32_t numPushed = 0;
+  static std::atomic<bool> done {false};
+  std::thread producer([]
+                       {
+                         for (uint32_t number = 0; number < THREAD_LINES; number++)
+                         {
+                           for (char c : sensorLine(number) + "\n")
+                           {
+                             ring.push(uint8_t(c));
+                             numPushed++;
+                           }
+                           if (number % 16 == 0)
+                           {
+                             std::this_thread::yield();
+                           }
+                         }
+                         done.store(true);
+                       });
+  uint32_t numTaken = 0;
+  uint32_t numBad = 0;
+  uint8_t byte;
+  while (!done.load() || ring.count() > 0)
+  {
+    if (ring.pop(byte))
+    {
+      numBad += !(byte == '\n' || byte == ',' || byte == '.' || (byte >= '0' && byte <= '9'));
+      numTaken++;
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  printf("Lossy: %u bytes pushed, %u taken, %u dropped\n", numPushed, numTaken, ring.getNumDropped());
+  CHECK_EQ(numTaken + ring.getNumDropped(), numPushed);
+  CHECK_EQ(numBad, 0);
+}
+
+/**
+ * @brief A ProCV sending at 9600 baud while the main loop waits out a full frame at SF9, 500kHz: the core's 64-byte
+ * buffer would overflow, the ring does not.
+ *
+ */
+static void testAirtime ()
+{
+  uartRing<SENSOR_RING_LEN> ring;
+  lineFramer<SENSOR_RING_LEN> framer(ring);
+  uint32_t const awayMicros = loraPoint2PointCommon::airtimeMicros(9, 500000, RH_RF95_MAX_PAYLOAD_LEN);
+  uint32_t const byteMicros = 10 * 1000000 / SENSOR_BAUD;
+  uint32_t number = 0;
+  std::string pending;
+  uint32_t numReceived = 0;
+  uint32_t numWrong = 0;
+  uint32_t peak = 0;
+  // Three frames' worth of time, with the loop away for each frame and back briefly in between.
+  for (uint32_t micros = 0; micros < 3 * awayMicros; micros += byteMicros)
+  {
+    if (pending.empty())
+    {
+      pending = sensorLine(number++) + "\r\n";
+    }
+    ring.push(uint8_t(pending[0]));
+    pending.erase(0, 1);
+    peak = MAX(peak, uint32_t(ring.count()));
+    if (micros % awayMicros < byteMicros)
+    {
+      uartSlice_t line;
+      while (framer.nextLine(line))
+      {
+        numWrong += sliceText(line) != sensorLine(numReceived);
+        numReceived++;
+      }
+    }
+  }
+  for (char c : pending)
+  {
+    ring.push(uint8_t(c));
+  }
+  uartSlice_t line;
+  while (framer.nextLine(line))
+  {
+    numWrong += sliceText(line) != sensorLine(numReceived);
+    numReceived++;
+  }
+  printf("Away %u ms at %u baud: at most %u bytes waiting, %u lines received, %u bytes dropped\n",
+         awayMicros / 1000, SENSOR_BAUD, peak, numReceived, ring.getNumDropped());
+  CHECK(peak > 64);
+  CHECK_EQ(ring.getNumDropped(), 0);
+  CHECK_EQ(numReceived, number);
+  CHECK_EQ(numWrong, 0);
+}
+
+int main ()
+{
+  testRing();
+  testFramer();
+  testThreads();
+  testThreadsLossy();
+  testAirtime();
+  return hostTestResult();
+}
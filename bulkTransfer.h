@@ -0,0 +1,414 @@
+/**
+ * @file bulkTransfer.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the bulkTxWindow and bulkRxWindow classes, the two ends of a selective-repeat sliding window.
+ * @version 0.0.1
+ * @date 2021-09-24
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Frames carry an 8-bit sequence number. The receiver acknowleges with the sequence number it expects next (everything
+ * before it has arrived) and a bitmap of the frames after that which have arrived out of order, so the sender only
+ * resends the frames that are actually missing. Both windows are fixed arrays indexed by sequence number modulo the
+ * window length, which must be a power of two so that the indexing survives the sequence number wrapping.
+ */
+
+#ifndef BULK_TRANSFER_H
+#define BULK_TRANSFER_H
+
+#include <Arduino.h>
+
+#define BULK_MAX_WINDOW_LEN 32 ///< Frames a bitmap of acknowlegements can cover.
+
+/**
+ * @brief State of a frame in a bulkTxWindow.
+ *
+ */
+enum bulkTxState_t : uint8_t
+{
+  bulkTxState_pending,  ///< To be sent, or sent and found missing.
+  bulkTxState_inFlight, ///< Sent, not acknowleged yet.
+  bulkTxState_acked,    ///< Acknowleged, waiting for the frames before it.
+  NUM_bulkTxStates
+};
+
+/**
+ * @brief One frame of a bulkTxWindow.
+ *
+ * @tparam frameLen Maximum length of the frame, in bytes.
+ */
+template <uint8_t frameLen>
+struct bulkTxEntry_t
+{
+  uint8_t state;
+  bool last;
+  uint8_t bufLen;
+  uint8_t buf [frameLen];
+};
+
+/**
+ * @brief Sending end of a selective-repeat window. Frames are copied in, so nothing is ever allocated.
+ *
+ * @tparam windowLen Frames that can be unacknowleged at once. A power of two, at most BULK_MAX_WINDOW_LEN.
+ * @tparam frameLen  Maximum length of one frame, in bytes.
+ */
+template <uint8_t windowLen, uint8_t frameLen>
+class bulkTxWindow
+{
+  static_assert(windowLen > 0 && windowLen <= BULK_MAX_WINDOW_LEN, "bulkTxWindow length must be 1 to BULK_MAX_WINDOW_LEN.");
+  static_assert((windowLen & (windowLen - 1)) == 0, "bulkTxWindow length must be a power of two.");
+
+  public:
+    typedef bulkTxEntry_t<frameLen> entry_t;
+
+    /**
+     * @brief Empties the window and starts again from sequence number 0.
+     *
+     */
+    void clear ()
+    {
+      base = 0;
+      nextSeq = 0;
+      ended = false;
+    }
+
+    /**
+     * @brief Copies a frame into the window, with the next sequence number.
+     *
+     * @param buf    Pointer to the array of bytes to send.
+     * @param bufLen Number of bytes to send.
+     * @param last   True if no frames follow it.
+     * @return true  Added.
+     * @return false The window is full, the frame is too long or the last frame has already been added.
+     */
+    bool push (uint8_t const * buf,
+               uint8_t const bufLen,
+               bool const last)
+    {
+      if (ended || count() >= windowLen || bufLen > frameLen)
+      {
+        return false;
+      }
+      entry_t & entry = entries[nextSeq % windowLen];
+      entry.state = bulkTxState_pending;
+      entry.last = last;
+      entry.bufLen = bufLen;
+      if (bufLen > 0)
+      {
+        memcpy(entry.buf, buf, bufLen);
+      }
+      nextSeq++;
+      ended = last;
+      return true;
+    }
+
+    /**
+     * @brief The oldest frame to be sent.
+     *
+     * @param seq    Set to its sequence number.
+     * @return true  Found.
+     * @return false Nothing to send.
+     */
+    bool nextPending (uint8_t & seq) const
+    {
+      for (uint8_t offset = 0; offset < count(); offset++)
+      {
+        if (entries[uint8_t(base + offset) % windowLen].state == bulkTxState_pending)
+        {
+          seq = base + offset;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief The frame with this sequence number. Only valid while contains(seq).
+     *
+     */
+    entry_t const & at (uint8_t const seq) const
+    {
+      return entries[seq % windowLen];
+    }
+
+    bool contains (uint8_t const seq) const
+    {
+      return uint8_t(seq - base) < count();
+    }
+
+    /**
+     * @brief Marks a pending frame as sent.
+     *
+     */
+    void markSent (uint8_t const seq)
+    {
+      if (contains(seq) && entries[seq % windowLen].state == bulkTxState_pending)
+      {
+        entries[seq % windowLen].state = bulkTxState_inFlight;
+      }
+    }
+
+    /**
+     * @brief Sends the oldest frame in flight again, e.g. to poll again after a poll went unanswered.
+     *
+     * @return true  A frame was marked to be sent again.
+     * @return false No frame is in flight.
+     */
+    bool resendOldest ()
+    {
+      for (uint8_t offset = 0; offset < count(); offset++)
+      {
+        entry_t & entry = entries[uint8_t(base + offset) % windowLen];
+        if (entry.state == bulkTxState_inFlight)
+        {
+          entry.state = bulkTxState_pending;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief Applies an acknowlegement, and slides the window past the frames at its start that have arrived.
+     *
+     * Only call this with an answer to a poll: a poll goes out after the frames before it, so any of those the
+     * acknowlegement does not cover were lost, and are marked to be sent again.
+     *
+     * @param cumulative The sequence number the receiver expects next: every frame before it has arrived.
+     * @param bitmap     Bit i set if frame cumulative + 1 + i has arrived.
+     * @return true      New frames were acknowleged.
+     * @return false     Nothing new, or the acknowlegement is stale.
+     */
+    bool acknowlege (uint8_t const cumulative,
+                     uint32_t const bitmap)
+    {
+      if (uint8_t(cumulative - base) > count())
+      {
+        return false; // Older than the window.
+      }
+      bool progress = false;
+      for (uint8_t offset = 0; offset < count(); offset++)
+      {
+        uint8_t seq = base + offset;
+        entry_t & entry = entries[seq % windowLen];
+        uint8_t after = seq - cumulative; // Wraps round for frames before cumulative.
+        bool arrived = uint8_t(seq - base) < uint8_t(cumulative - base)
+                       || (after >= 1 && after <= 32 && ((bitmap >> (after - 1)) & 1));
+        if (arrived && entry.state != bulkTxState_acked)
+        {
+          entry.state = bulkTxState_acked;
+          progress = true;
+        }
+        else if (!arrived && entry.state == bulkTxState_inFlight)
+        {
+          entry.state = bulkTxState_pending;
+        }
+      }
+      while (count() > 0 && entries[base % windowLen].state == bulkTxState_acked)
+      {
+        base++;
+      }
+      return progress;
+    }
+
+    /**
+     * @brief Number of frames in the window: to be sent, in flight, or acknowleged after a gap.
+     *
+     */
+    uint8_t count () const
+    {
+      return uint8_t(nextSeq - base);
+    }
+
+    uint8_t space () const
+    {
+      return ended ? 0 : windowLen - count();
+    }
+
+    /**
+     * @brief Sequence number the next frame pushed will get.
+     *
+     */
+    uint8_t getNextSeq () const
+    {
+      return nextSeq;
+    }
+
+    uint8_t countPending () const
+    {
+      uint8_t num = 0;
+      for (uint8_t offset = 0; offset < count(); offset++)
+      {
+        num += entries[uint8_t(base + offset) % windowLen].state == bulkTxState_pending;
+      }
+      return num;
+    }
+
+    /**
+     * @brief Whether the last frame has been added and every frame acknowleged.
+     *
+     */
+    bool isDone () const
+    {
+      return ended && count() == 0;
+    }
+
+  private:
+    entry_t entries [windowLen];
+    uint8_t base = 0;    ///< Oldest unacknowleged frame.
+    uint8_t nextSeq = 0; ///< Sequence number of the next frame pushed.
+    bool ended = false;
+};
+
+/**
+ * @brief Receiving end of a selective-repeat window: holds frames that arrive ahead of a gap until it is filled, so that they can be delivered in order.
+ *
+ * The frame the receiver expects next is never stored; it is delivered from wherever it was received into.
+ *
+ * @tparam frame_t   Type of one frame, or of a reference to a frame kept elsewhere, e.g. an rxFramePool index.
+ * @tparam windowLen Frames the sender can have unacknowleged at once. A power of two, at most BULK_MAX_WINDOW_LEN.
+ */
+template <typename frame_t, uint8_t windowLen>
+class bulkRxWindow
+{
+  static_assert(windowLen > 0 && windowLen <= BULK_MAX_WINDOW_LEN, "bulkRxWindow length must be 1 to BULK_MAX_WINDOW_LEN.");
+  static_assert((windowLen & (windowLen - 1)) == 0, "bulkRxWindow length must be a power of two.");
+
+  public:
+    /**
+     * @brief Starts receiving a transfer, from sequence number 0.
+     *
+     * @param srcAddr    The sender.
+     * @param transferId The sender's ID of the transfer.
+     */
+    void start (uint8_t const srcAddr,
+                uint8_t const transferId)
+    {
+      source = srcAddr;
+      transfer = transferId;
+      expected = 0;
+      received = 0;
+      active = true;
+    }
+
+    /**
+     * @brief Ends the transfer in progress, if any, and forgets what it stored. Take out the stored frames first if they refer to anything.
+     *
+     */
+    void stop ()
+    {
+      received = 0;
+      active = false;
+    }
+
+    bool isTransfer (uint8_t const srcAddr,
+                     uint8_t const transferId) const
+    {
+      return active && source == srcAddr && transfer == transferId;
+    }
+
+    /**
+     * @brief Whether a frame would be stored: it is ahead of the one expected next, within the window, and not stored yet.
+     *
+     * @param seq Its sequence number.
+     */
+    bool canStore (uint8_t const seq) const
+    {
+      uint8_t offset = seq - expected;
+      return offset != 0 && offset < windowLen && !((received >> offset) & 1);
+    }
+
+    /**
+     * @brief Keeps a copy of a frame that has arrived ahead of the one expected next.
+     *
+     * @param seq    Its sequence number.
+     * @param frame  The frame.
+     * @return true  Stored.
+     * @return false Already delivered or stored, the one expected next, or beyond the window.
+     */
+    bool store (uint8_t const seq,
+                frame_t const & frame)
+    {
+      if (!canStore(seq))
+      {
+        return false;
+      }
+      frames[seq % windowLen] = frame;
+      received |= uint32_t(1) << uint8_t(seq - expected);
+      return true;
+    }
+
+    /**
+     * @brief Takes out a stored frame, any one, e.g. to give back what it refers to before starting another transfer.
+     *
+     * @param frame  Set to the frame.
+     * @return true  A frame was taken out; call again for the next.
+     * @return false Nothing stored.
+     */
+    bool takeStored (frame_t & frame)
+    {
+      for (uint8_t offset = 0; offset < windowLen; offset++)
+      {
+        if ((received >> offset) & 1)
+        {
+          received &= ~(uint32_t(1) << offset);
+          frame = frames[uint8_t(expected + offset) % windowLen];
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief Moves on to the next sequence number, once the frame expected has been delivered.
+     *
+     */
+    void advance ()
+    {
+      expected++;
+      received >>= 1;
+    }
+
+    /**
+     * @brief The frame expected next, if it is already stored.
+     *
+     * @return frame_t const* The frame, or NULL if it has not arrived.
+     */
+    frame_t const * nextStored () const
+    {
+      return (received & 1) ? &frames[expected % windowLen] : NULL;
+    }
+
+    /**
+     * @brief The sequence number expected next: every frame before it has been delivered.
+     *
+     */
+    uint8_t getCumulative () const
+    {
+      return expected;
+    }
+
+    /**
+     * @brief Bit i set if frame getCumulative() + 1 + i is stored.
+     *
+     */
+    uint32_t getBitmap () const
+    {
+      return received >> 1;
+    }
+
+    uint8_t getTransferId () const
+    {
+      return transfer;
+    }
+
+  private:
+    frame_t frames [windowLen];
+    uint32_t received = 0; ///< Bit i set if frame expected + i is stored.
+    uint8_t expected = 0;
+    uint8_t source = 0;
+    uint8_t transfer = 0;
+    bool active = false;
+};
+
+#endif // BULK_TRANSFER_H
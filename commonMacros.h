@@ -0,0 +1,18 @@
+/**
+ * @file commonMacros.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Macros common to all files in this library.
+ * @version 0.1
+ * @date 2021-08-12
+ * 
+ * @copyright Copyright (c) 2021
+ * 
+ */
+
+#ifndef COMMON_MACROS
+#define COMMON_MACROS
+
+#define MIN(a, b) (((a) > (b)) ? (b) : (a))
+#define MAX(a, b) (((a) < (b)) ? (b) : (a))
+
+#endif // COMMON_MACROS
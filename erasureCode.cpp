@@ -0,0 +1,125 @@
+/**
+ * @file erasureCode.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the GF(2^8) arithmetic of the erasure code.
+ * @version 0.0.1
+ * @date 2021-09-25
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#include <erasureCode.h>
+
+uint8_t erasureCode::multiply (uint8_t a,
+                               uint8_t b)
+{
+  uint8_t product = 0;
+  while (b != 0)
+  {
+    if (b & 1)
+    {
+      product ^= a;
+    }
+    a = (a << 1) ^ ((a & 0x80) ? 0x1D : 0); // Reduce by x^8 + x^4 + x^3 + x^2 + 1.
+    b >>= 1;
+  }
+  return product;
+}
+
+uint8_t erasureCode::inverse (uint8_t const a)
+{
+  // a^254 = a^-1, as a^255 = 1 for every a other than 0.
+  uint8_t result = 1;
+  uint8_t power = a;
+  for (uint8_t exponent = 254; exponent != 0; exponent >>= 1)
+  {
+    if (exponent & 1)
+    {
+      result = multiply(result, power);
+    }
+    power = multiply(power, power);
+  }
+  return result;
+}
+
+uint8_t erasureCode::coefficient (uint8_t const parityIndex,
+                                  uint8_t const dataIndex)
+{
+  // Cauchy matrix 1 / (x_j + y_i), with x_j = 32 + j and y_i = i: the two sets never meet, so the sum is never 0.
+  return inverse(uint8_t(ERASURE_CODE_MAX_GROUP_LEN + parityIndex) ^ dataIndex);
+}
+
+void erasureCode::addScaled (uint8_t * const dest,
+                             uint8_t const * const src,
+                             uint8_t const len,
+                             uint8_t const scale)
+{
+  if (scale == 0)
+  {
+    return;
+  }
+  for (uint8_t idx = 0; idx < len; idx++)
+  {
+    dest[idx] ^= multiply(scale, src[idx]);
+  }
+}
+
+void erasureCode::recover (uint8_t const numLost,
+                           uint8_t const * const lostIndices,
+                           uint8_t const * const parityIndices,
+                           uint8_t ** const syndromes,
+                           uint8_t const len)
+{
+  // Gauss-Jordan elimination of syndromes = matrix * lost frames. Every square submatrix of a Cauchy matrix is invertible.
+  uint8_t matrix [ERASURE_CODE_MAX_PARITY][ERASURE_CODE_MAX_PARITY];
+  for (uint8_t row = 0; row < numLost; row++)
+  {
+    for (uint8_t col = 0; col < numLost; col++)
+    {
+      matrix[row][col] = coefficient(parityIndices[row], lostIndices[col]);
+    }
+  }
+  for (uint8_t col = 0; col < numLost; col++)
+  {
+    uint8_t pivot = col;
+    while (matrix[pivot][col] == 0)
+    {
+      pivot++;
+    }
+    if (pivot != col)
+    {
+      for (uint8_t idx = 0; idx < numLost; idx++)
+      {
+        uint8_t swap = matrix[col][idx];
+        matrix[col][idx] = matrix[pivot][idx];
+        matrix[pivot][idx] = swap;
+      }
+      uint8_t * swap = syndromes[col];
+      syndromes[col] = syndromes[pivot];
+      syndromes[pivot] = swap;
+    }
+    uint8_t scale = inverse(matrix[col][col]);
+    for (uint8_t idx = 0; idx < numLost; idx++)
+    {
+      matrix[col][idx] = multiply(scale, matrix[col][idx]);
+    }
+    for (uint8_t idx = 0; idx < len; idx++)
+    {
+      syndromes[col][idx] = multiply(scale, syndromes[col][idx]);
+    }
+    for (uint8_t row = 0; row < numLost; row++)
+    {
+      uint8_t factor = matrix[row][col];
+      if (row == col || factor == 0)
+      {
+        continue;
+      }
+      for (uint8_t idx = 0; idx < numLost; idx++)
+      {
+        matrix[row][idx] ^= multiply(factor, matrix[col][idx]);
+      }
+      addScaled(syndromes[row], syndromes[col], len, factor);
+    }
+  }
+}
@@ -0,0 +1,330 @@
+/**
+ * @file erasureCode.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the erasure code used for forward error correction: Reed-Solomon style parity over GF(2^8), and the fecEncoder and fecDecoder classes that apply it to a group of frames.
+ * @version 0.0.1
+ * @date 2021-09-25
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * A group of up to 32 data frames is followed by up to ERASURE_CODE_MAX_PARITY parity frames. Parity frame j holds
+ * the sum over the group of coefficient(j, i) times data frame i, byte by byte, where the coefficients form a Cauchy
+ * matrix: any m of the data frames lost can be rebuilt from any m of the parity frames. Frames of different lengths
+ * are treated as padded with zeros to the longest one.
+ *
+ * Arithmetic is done without tables to spare the RAM, which costs a few microseconds per byte and parity frame.
+ */
+
+#ifndef ERASURE_CODE_H
+#define ERASURE_CODE_H
+
+#include <Arduino.h>
+#include <commonMacros.h>
+
+#define ERASURE_CODE_MAX_GROUP_LEN 32
+#define ERASURE_CODE_MAX_PARITY 8
+
+namespace erasureCode
+{
+/**
+ * @brief Product in GF(2^8), with the Reed-Solomon polynomial x^8 + x^4 + x^3 + x^2 + 1.
+ *
+ */
+uint8_t multiply (uint8_t a,
+                  uint8_t b);
+
+/**
+ * @brief Multiplicative inverse in GF(2^8). The inverse of 0 is taken to be 0.
+ *
+ */
+uint8_t inverse (uint8_t const a);
+
+/**
+ * @brief Coefficient of data frame dataIndex in parity frame parityIndex.
+ *
+ */
+uint8_t coefficient (uint8_t const parityIndex,
+                     uint8_t const dataIndex);
+
+/**
+ * @brief dest += scale * src, byte by byte, in GF(2^8).
+ *
+ */
+void addScaled (uint8_t * const dest,
+                uint8_t const * const src,
+                uint8_t const len,
+                uint8_t const scale);
+
+/**
+ * @brief Rebuilds lost data frames from the syndromes of the parity frames that arrived.
+ *
+ * The syndrome of parity frame j is the parity frame minus the contributions of the data frames that did arrive,
+ * which leaves the sum over the lost data frames only.
+ *
+ * @param numLost       Number of data frames lost, at most ERASURE_CODE_MAX_PARITY.
+ * @param lostIndices   Their indices in the group.
+ * @param parityIndices Indices of numLost parity frames that arrived.
+ * @param syndromes     Their syndromes, each len bytes. Overwritten with the lost data frames, and reordered so that syndromes[k] points to lost frame k.
+ * @param len           Length of the syndromes.
+ */
+void recover (uint8_t const numLost,
+              uint8_t const * const lostIndices,
+              uint8_t const * const parityIndices,
+              uint8_t ** const syndromes,
+              uint8_t const len);
+}
+
+/**
+ * @brief Builds the parity frames of a group as its data frames go by, so the data frames need not be kept.
+ *
+ * @tparam maxParity Most parity frames per group.
+ * @tparam frameLen  Maximum length of one frame, in bytes.
+ */
+template <uint8_t maxParity, uint8_t frameLen>
+class fecEncoder
+{
+  static_assert(maxParity <= ERASURE_CODE_MAX_PARITY, "fecEncoder supports at most ERASURE_CODE_MAX_PARITY parity frames.");
+
+  public:
+    /**
+     * @brief Starts a group.
+     *
+     * @param parityFrames Parity frames to build, at most maxParity.
+     */
+    void start (uint8_t const parityFrames)
+    {
+      numParity = MIN(parityFrames, maxParity);
+      parityLen = 0;
+      memset(parity, 0, sizeof(parity));
+    }
+
+    /**
+     * @brief Adds a data frame of the group to the parity frames.
+     *
+     * @param index  Index of the frame in the group.
+     * @param buf    The frame.
+     * @param bufLen Its length, at most frameLen.
+     */
+    void add (uint8_t const index,
+              uint8_t const * const buf,
+              uint8_t const bufLen)
+    {
+      for (uint8_t j = 0; j < numParity; j++)
+      {
+        erasureCode::addScaled(parity[j], buf, bufLen, erasureCode::coefficient(j, index));
+      }
+      parityLen = MAX(parityLen, bufLen);
+    }
+
+    uint8_t const * getParity (uint8_t const j) const
+    {
+      return parity[j];
+    }
+
+    /**
+     * @brief Length of the parity frames: that of the longest data frame added.
+     *
+     */
+    uint8_t getParityLen () const
+    {
+      return parityLen;
+    }
+
+    uint8_t getNumParity () const
+    {
+      return numParity;
+    }
+
+  private:
+    uint8_t parity [maxParity][frameLen];
+    uint8_t parityLen = 0;
+    uint8_t numParity = 0;
+};
+
+/**
+ * @brief Collects the data and parity frames of a group as they arrive, and rebuilds the lost data frames once enough parity frames are in.
+ *
+ * @tparam maxParity Most parity frames per group.
+ * @tparam frameLen  Maximum length of one frame, in bytes.
+ */
+template <uint8_t maxParity, uint8_t frameLen>
+class fecDecoder
+{
+  static_assert(maxParity <= ERASURE_CODE_MAX_PARITY, "fecDecoder supports at most ERASURE_CODE_MAX_PARITY parity frames.");
+
+  public:
+    /**
+     * @brief Starts a group.
+     *
+     * @param groupId      Anything that tells groups apart, e.g. the sequence number of their first frame.
+     * @param parityFrames Parity frames the group has, at most maxParity.
+     */
+    void start (uint8_t const groupId,
+                uint8_t const parityFrames)
+    {
+      group = groupId;
+      numParity = MIN(parityFrames, maxParity);
+      groupLen = 0;
+      dataReceived = 0;
+      parityReceived = 0;
+      syndromeLen = 0;
+      recovered = false;
+      memset(syndromes, 0, sizeof(syndromes));
+    }
+
+    bool isGroup (uint8_t const groupId) const
+    {
+      return group == groupId;
+    }
+
+    uint8_t getGroup () const
+    {
+      return group;
+    }
+
+    /**
+     * @brief Whether a group with parity frames has been started.
+     *
+     */
+    bool isActive () const
+    {
+      return numParity > 0;
+    }
+
+    /**
+     * @brief Adds a data frame of the group. Frames already added are ignored.
+     *
+     */
+    void addData (uint8_t const index,
+                  uint8_t const * const buf,
+                  uint8_t const bufLen)
+    {
+      if (index >= ERASURE_CODE_MAX_GROUP_LEN || ((dataReceived >> index) & 1))
+      {
+        return;
+      }
+      dataReceived |= uint32_t(1) << index;
+      for (uint8_t j = 0; j < numParity; j++)
+      {
+        erasureCode::addScaled(syndromes[j], buf, MIN(bufLen, frameLen), erasureCode::coefficient(j, index));
+      }
+    }
+
+    /**
+     * @brief Adds a parity frame of the group. Frames already added are ignored.
+     *
+     * @param j        Index of the parity frame.
+     * @param numData  Number of data frames in the group.
+     * @param buf      The parity frame.
+     * @param bufLen   Its length.
+     */
+    void addParity (uint8_t const j,
+                    uint8_t const numData,
+                    uint8_t const * const buf,
+                    uint8_t const bufLen)
+    {
+      if (j >= numParity || ((parityReceived >> j) & 1) || numData > ERASURE_CODE_MAX_GROUP_LEN)
+      {
+        return;
+      }
+      parityReceived |= 1 << j;
+      groupLen = numData;
+      syndromeLen = MIN(bufLen, frameLen);
+      erasureCode::addScaled(syndromes[j], buf, syndromeLen, 1);
+    }
+
+    /**
+     * @brief Whether data frames are missing and enough parity frames have arrived to rebuild them.
+     *
+     */
+    bool canRecover () const
+    {
+      uint8_t lost = countLost();
+      return !recovered && lost > 0 && lost <= countBits(parityReceived);
+    }
+
+    /**
+     * @brief Rebuilds the lost data frames. Call once canRecover.
+     *
+     * @param lostIndices Filled with the indices of the rebuilt frames, in the order they are returned by getRecovered.
+     * @return uint8_t    Number of frames rebuilt.
+     */
+    uint8_t recover (uint8_t * const lostIndices)
+    {
+      if (!canRecover())
+      {
+        return 0;
+      }
+      uint8_t numLost = 0;
+      for (uint8_t index = 0; index < groupLen; index++)
+      {
+        if (!((dataReceived >> index) & 1))
+        {
+          lostIndices[numLost++] = index;
+        }
+      }
+      uint8_t parityIndices [maxParity];
+      uint8_t * rows [maxParity];
+      uint8_t numRows = 0;
+      for (uint8_t j = 0; j < numParity && numRows < numLost; j++)
+      {
+        if ((parityReceived >> j) & 1)
+        {
+          parityIndices[numRows] = j;
+          rows[numRows] = syndromes[j];
+          numRows++;
+        }
+      }
+      erasureCode::recover(numLost, lostIndices, parityIndices, rows, syndromeLen);
+      for (uint8_t k = 0; k < numLost; k++)
+      {
+        recoveredRows[k] = rows[k];
+      }
+      recovered = true;
+      return numLost;
+    }
+
+    /**
+     * @brief A rebuilt frame, padded with zeros to getRecoveredLen. Valid until the next group starts.
+     *
+     * @param k Position in the lostIndices given by recover.
+     */
+    uint8_t const * getRecovered (uint8_t const k) const
+    {
+      return recoveredRows[k];
+    }
+
+    uint8_t getRecoveredLen () const
+    {
+      return syndromeLen;
+    }
+
+  private:
+    uint8_t countLost () const
+    {
+      uint32_t mask = groupLen >= 32 ? 0xFFFFFFFF : (uint32_t(1) << groupLen) - 1;
+      return groupLen == 0 ? 0 : countBits(~dataReceived & mask);
+    }
+
+    static uint8_t countBits (uint32_t bits)
+    {
+      uint8_t num = 0;
+      for (; bits != 0; bits &= bits - 1)
+      {
+        num++;
+      }
+      return num;
+    }
+
+    uint8_t syndromes [maxParity][frameLen];
+    uint8_t * recoveredRows [maxParity];
+    uint32_t dataReceived = 0;
+    uint8_t parityReceived = 0;
+    uint8_t group = 0;
+    uint8_t groupLen = 0; ///< Learnt from the first parity frame; 0 until then.
+    uint8_t numParity = 0;
+    uint8_t syndromeLen = 0;
+    bool recovered = false;
+};
+
+#endif // ERASURE_CODE_H
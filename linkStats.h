@@ -0,0 +1,321 @@
+/**
+ * @file linkStats.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the linkStats class, fixed-memory link telemetry kept per peer and per radio setting.
+ * @version 0.0.1
+ * @date 2021-09-16
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <Arduino.h>
+#include <commonMacros.h>
+
+/**
+ * @brief Buckets of the acknowlegement round trip histogram. Bucket 0 holds round trips under 16ms, each following bucket twice the span of the one before, and the last everything longer.
+ *
+ */
+#define LINK_STATS_LATENCY_BUCKETS 10
+#define LINK_STATS_LATENCY_BUCKET_0_MILLIS 16
+/**
+ * @brief Number of most recent frame outcomes kept for the windowed delivery ratio. At most 32.
+ *
+ */
+#define LINK_STATS_WINDOW_LEN 32
+
+/**
+ * @brief What the statistics are kept per: the peer, and the radio settings (as indices to loraPoint2Point's tables) the frames were exchanged on.
+ *
+ */
+struct linkStatsKey_t
+{
+  uint8_t peer;
+  uint8_t spreadingFactor;
+  uint8_t signalBandwidth;
+  uint8_t frequencyChannel;
+  int8_t  txPower;
+};
+
+/**
+ * @brief Statistics of one peer on one radio setting.
+ *
+ */
+struct linkStatsEntry_t
+{
+  linkStatsKey_t key;
+  uint32_t framesSent;     ///< Unicast frames finished, acknowleged or not.
+  uint32_t framesAcked;    ///< ...of which were acknowleged.
+  uint32_t transmissions;  ///< Frames put on air to the peer, including retries but not acknowlegements.
+  uint32_t framesReceived; ///< Frames received from the peer, not counting acknowlegements.
+  uint32_t outcomeWindow;  ///< Outcomes of the last frames sent, newest in bit 0. A set bit is a lost frame.
+  uint8_t  outcomeWindowLen;
+  uint32_t signalCount;    ///< Frames, acknowlegements included, the SNR and RSSI figures are over.
+  int32_t  snrSum;
+  int8_t   snrMin;
+  int8_t   snrMax;
+  int32_t  rssiSum;
+  int16_t  rssiMin;
+  int16_t  rssiMax;
+  uint16_t latencyHistogram [LINK_STATS_LATENCY_BUCKETS]; ///< Acknowlegement round trips, from the start of the last transmission.
+  uint64_t airtimeMicros;  ///< Time on air of everything sent to the peer, acknowlegements included.
+  uint32_t lastUsed;
+
+  /**
+   * @brief Fraction of unicast frames acknowleged since the entry was created.
+   *
+   * @return float From 0 to 1, or 1 if nothing has been sent.
+   */
+  float deliveryRatio () const
+  {
+    return framesSent == 0 ? 1 : float(framesAcked) / framesSent;
+  }
+
+  /**
+   * @brief Fraction of the last LINK_STATS_WINDOW_LEN unicast frames that were acknowleged.
+   *
+   * @return float From 0 to 1, or 1 if nothing has been sent.
+   */
+  float windowDeliveryRatio () const
+  {
+    if (outcomeWindowLen == 0)
+    {
+      return 1;
+    }
+    uint8_t lost = 0;
+    for (uint32_t window = outcomeWindow; window != 0; window &= window - 1)
+    {
+      lost++;
+    }
+    return 1 - float(lost) / outcomeWindowLen;
+  }
+
+  float retriesPerFrame () const
+  {
+    return framesSent == 0 || transmissions < framesSent ? 0 : float(transmissions - framesSent) / framesSent;
+  }
+
+  float snrMean () const
+  {
+    return signalCount == 0 ? 0 : float(snrSum) / signalCount;
+  }
+
+  float rssiMean () const
+  {
+    return signalCount == 0 ? 0 : float(rssiSum) / signalCount;
+  }
+
+  /**
+   * @brief Round trip within which the given share of acknowleged frames were acknowleged, from the histogram.
+   *
+   * @param percent   0 to 100.
+   * @return uint32_t Upper edge of the bucket holding that percentile, in millis. UINT32_MAX if it is in the last bucket, 0 if nothing was acknowleged.
+   */
+  uint32_t latencyPercentileMillis (uint8_t const percent) const
+  {
+    uint32_t total = 0;
+    for (uint8_t bucket = 0; bucket < LINK_STATS_LATENCY_BUCKETS; bucket++)
+    {
+      total += latencyHistogram[bucket];
+    }
+    if (total == 0)
+    {
+      return 0;
+    }
+    uint32_t target = (total * percent + 99) / 100;
+    uint32_t count = 0;
+    for (uint8_t bucket = 0; bucket < LINK_STATS_LATENCY_BUCKETS - 1; bucket++)
+    {
+      count += latencyHistogram[bucket];
+      if (count >= target)
+      {
+        return uint32_t(LINK_STATS_LATENCY_BUCKET_0_MILLIS) << bucket;
+      }
+    }
+    return UINT32_MAX;
+  }
+};
+
+/**
+ * @brief Fixed-memory table of link statistics. Once full, the least recently used peer and setting makes way for a new one.
+ *
+ * Every update is a scan of at most capacity entries, so it is cheap enough for every frame sent and received.
+ *
+ * @tparam capacity Number of peer and setting combinations kept.
+ */
+template <uint8_t capacity>
+class linkStats
+{
+  public:
+    /**
+     * @brief Records a frame put on air.
+     *
+     * @param key           Peer and settings.
+     * @param airtimeMicros Its time on air.
+     * @param ack           True if it was an acknowlegement.
+     */
+    void recordTransmission (linkStatsKey_t const & key,
+                             uint32_t const airtimeMicros,
+                             bool const ack)
+    {
+      linkStatsEntry_t & entry = use(key);
+      entry.airtimeMicros += airtimeMicros;
+      entry.transmissions += !ack;
+    }
+
+    /**
+     * @brief Records the outcome of a unicast frame, after any retries.
+     *
+     * @param key           Peer and settings.
+     * @param acked         True if it was acknowleged.
+     * @param latencyMillis Acknowlegement round trip, if acknowleged.
+     */
+    void recordTxOutcome (linkStatsKey_t const & key,
+                          bool const acked,
+                          uint32_t const latencyMillis)
+    {
+      linkStatsEntry_t & entry = use(key);
+      entry.framesSent++;
+      entry.framesAcked += acked;
+      entry.outcomeWindow = (entry.outcomeWindow << 1) | !acked;
+      if (entry.outcomeWindowLen < LINK_STATS_WINDOW_LEN)
+      {
+        entry.outcomeWindowLen++;
+      }
+      else
+      {
+        entry.outcomeWindow &= uint32_t(0xFFFFFFFF) >> (32 - LINK_STATS_WINDOW_LEN);
+      }
+      if (acked)
+      {
+        uint8_t bucket = 0;
+        while (bucket < LINK_STATS_LATENCY_BUCKETS - 1
+               && latencyMillis >= (uint32_t(LINK_STATS_LATENCY_BUCKET_0_MILLIS) << bucket))
+        {
+          bucket++;
+        }
+        if (entry.latencyHistogram[bucket] < UINT16_MAX)
+        {
+          entry.latencyHistogram[bucket]++;
+        }
+      }
+    }
+
+    /**
+     * @brief Records a received frame.
+     *
+     * @param key  Peer and settings.
+     * @param snr  Its SNR, in dB.
+     * @param rssi Its RSSI, in dBm.
+     * @param ack  True if it was an acknowlegement.
+     */
+    void recordRx (linkStatsKey_t const & key,
+                   int8_t const snr,
+                   int16_t const rssi,
+                   bool const ack)
+    {
+      linkStatsEntry_t & entry = use(key);
+      if (entry.signalCount == 0)
+      {
+        entry.snrMin = entry.snrMax = snr;
+        entry.rssiMin = entry.rssiMax = rssi;
+      }
+      entry.snrMin = MIN(entry.snrMin, snr);
+      entry.snrMax = MAX(entry.snrMax, snr);
+      entry.rssiMin = MIN(entry.rssiMin, rssi);
+      entry.rssiMax = MAX(entry.rssiMax, rssi);
+      entry.snrSum += snr;
+      entry.rssiSum += rssi;
+      entry.signalCount++;
+      entry.framesReceived += !ack;
+    }
+
+    /**
+     * @brief Statistics of a peer on given settings.
+     *
+     * @param key                       Peer and settings.
+     * @return linkStatsEntry_t const*  The entry, or NULL if nothing has been exchanged with the peer on those settings (or it has been evicted since).
+     */
+    linkStatsEntry_t const * find (linkStatsKey_t const & key) const
+    {
+      for (uint8_t idx = 0; idx < numEntries; idx++)
+      {
+        if (matches(entries[idx].key, key))
+        {
+          return &entries[idx];
+        }
+      }
+      return NULL;
+    }
+
+    /**
+     * @brief One entry, in no particular order, e.g. to print them all.
+     *
+     * @param idx Index below count().
+     */
+    linkStatsEntry_t const & entry (uint8_t const idx) const
+    {
+      return entries[idx];
+    }
+
+    uint8_t count () const
+    {
+      return numEntries;
+    }
+
+    void clear ()
+    {
+      numEntries = 0;
+    }
+
+  private:
+    static bool matches (linkStatsKey_t const & a,
+                         linkStatsKey_t const & b)
+    {
+      return a.peer == b.peer
+             && a.spreadingFactor == b.spreadingFactor
+             && a.signalBandwidth == b.signalBandwidth
+             && a.frequencyChannel == b.frequencyChannel
+             && a.txPower == b.txPower;
+    }
+
+    /**
+     * @brief The entry for key, created (evicting the least recently used one if full) if there is none.
+     *
+     */
+    linkStatsEntry_t & use (linkStatsKey_t const & key)
+    {
+      linkStatsEntry_t * entry = const_cast<linkStatsEntry_t *>(find(key));
+      if (entry == NULL)
+      {
+        if (numEntries < capacity)
+        {
+          entry = &entries[numEntries++];
+        }
+        else
+        {
+          entry = &entries[0];
+          for (uint8_t idx = 1; idx < capacity; idx++)
+          {
+            if (useCounter - entries[idx].lastUsed > useCounter - entry->lastUsed)
+            {
+              entry = &entries[idx];
+            }
+          }
+        }
+        memset(entry, 0, sizeof(*entry));
+        entry->key = key;
+      }
+      entry->lastUsed = ++useCounter;
+      return *entry;
+    }
+
+    linkStatsEntry_t entries [capacity];
+    uint8_t numEntries = 0;
+    uint32_t useCounter = 0;
+};
+
+#endif // LINK_STATS_H
@@ -0,0 +1,222 @@
+/**
+ * @file loraCompactLink.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the loraCompactLink class.
+ * @version 0.0.1
+ * @date 2021-10-01
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#include <loraCompactLink.h>
+#include <commonMacros.h>
+
+//----------------------
+// Function Definitions
+//----------------------
+
+void loraCompactLink::init ()
+{
+  rf95.setPromiscuous(true);
+}
+
+bool loraCompactLink::send (msgType_t const msgType,
+                            uint8_t const sensorId,
+                            uint8_t const * buf,
+                            uint8_t const bufLen,
+                            bool const more)
+{
+  if (bufLen == 0
+      || bufLen > COMPACT_MAX_PAYLOAD_LEN
+      || msgType >= COMPACT_NUM_MSG_TYPES
+      || sensorId > COMPACT_SENSOR_MASK)
+  {
+    return false;
+  }
+  txSeq = (txSeq + 1) & COMPACT_SEQ_MASK;
+  return transmit(uint8_t((msgType << 4) | (more ? COMPACT_FLAG_MORE : 0)),
+                  uint8_t((txSeq << 3) | sensorId),
+                  buf,
+                  bufLen);
+}
+
+bool loraCompactLink::sendAcked (msgType_t const msgType,
+                                 uint8_t const sensorId,
+                                 uint8_t const * buf,
+                                 uint8_t const bufLen,
+                                 bool const more)
+{
+  if (bufLen == 0
+      || bufLen > COMPACT_MAX_PAYLOAD_LEN
+      || msgType >= COMPACT_NUM_MSG_TYPES
+      || sensorId > COMPACT_SENSOR_MASK)
+  {
+    return false;
+  }
+  txSeq = (txSeq + 1) & COMPACT_SEQ_MASK;
+  uint8_t const header0 = (msgType << 4) | COMPACT_FLAG_ACK_REQ | (more ? COMPACT_FLAG_MORE : 0);
+  uint8_t const header1 = (txSeq << 3) | sensorId;
+  uint8_t rxBuf [COMPACT_MAX_PAYLOAD_LEN];
+  for (uint8_t attempt = 0; attempt <= retries; attempt++)
+  {
+    if (attempt > 0)
+    {
+      numRetransmissions++;
+    }
+    if (!transmit(header0, header1, buf, bufLen))
+    {
+      return false;
+    }
+    rf95.waitPacketSent();
+    // Randomized, as in RHReliableDatagram, so that two units retrying do not keep colliding.
+    uint32_t const timeoutMillis = ackTimeoutMillis + random(0, ackTimeoutMillis);
+    uint32_t const startMillis = millis();
+    uint32_t elapsedMillis;
+    while ((elapsedMillis = millis() - startMillis) < timeoutMillis)
+    {
+      uint8_t rxHeader0;
+      uint8_t rxHeader1;
+      uint8_t rxBufLen;
+      if (!rf95.waitAvailableTimeout(timeoutMillis - elapsedMillis)
+          || !receive(rxHeader0, rxHeader1, rxBuf, rxBufLen))
+      {
+        continue;
+      }
+      if ((rxHeader0 & COMPACT_FLAG_ACK)
+          && rxHeader1 == header1
+          && rxBufLen >= COMPACT_ACK_LEN)
+      {
+        lastAckSnr = int8_t(rxBuf[0]);
+        lastAckRssi = int8_t(rxBuf[1]);
+        return true;
+      }
+      // The peer sent its last frame again: our acknowlegement of it was lost.
+      if (!(rxHeader0 & COMPACT_FLAG_ACK)
+          && (rxHeader0 & COMPACT_FLAG_ACK_REQ)
+          && accepts(rxHeader1)
+          && lastRxValid
+          && rxHeader1 == lastRxHeader1)
+      {
+        acknowlege(rxHeader0, rxHeader1);
+      }
+    }
+  }
+  return false;
+}
+
+bool loraCompactLink::recv (compactFrame_t & frame)
+{
+  uint8_t header0;
+  uint8_t header1;
+  if (!receive(header0, header1, frame.buf, frame.bufLen)
+      || (header0 & COMPACT_FLAG_ACK)
+      || (header0 >> 4) >= NUM_msgTypes
+      || !accepts(header1))
+  {
+    return false;
+  }
+  if (header0 & COMPACT_FLAG_ACK_REQ)
+  {
+    acknowlege(header0, header1);
+  }
+  // Only a frame sent with an acknowlegement is ever sent again, and then straight after the first.
+  bool const repeat = (header0 & COMPACT_FLAG_ACK_REQ)
+                      && lastRxValid
+                      && header1 == lastRxHeader1;
+  lastRxHeader1 = header1;
+  lastRxValid = true;
+  if (repeat)
+  {
+    return false;
+  }
+  frame.msgType = msgType_t(header0 >> 4);
+  frame.seq = header1 >> 3;
+  frame.sensorId = header1 & COMPACT_SENSOR_MASK;
+  frame.more = header0 & COMPACT_FLAG_MORE;
+  return true;
+}
+
+void loraCompactLink::setSensorFilter (uint8_t const sensorMask)
+{
+  sensorFilter = sensorMask;
+}
+
+void loraCompactLink::setAckTimeout (uint16_t const millis)
+{
+  ackTimeoutMillis = millis;
+}
+
+void loraCompactLink::setRetries (uint8_t const retries)
+{
+  this->retries = retries;
+}
+
+int8_t loraCompactLink::getLastAckSnr ()
+{
+  return lastAckSnr;
+}
+
+int8_t loraCompactLink::getLastAckRssi ()
+{
+  return lastAckRssi;
+}
+
+uint32_t loraCompactLink::getNumRetransmissions ()
+{
+  return numRetransmissions;
+}
+
+bool loraCompactLink::transmit (uint8_t header0,
+                                uint8_t const header1,
+                                uint8_t const * buf,
+                                uint8_t const bufLen)
+{
+  uint8_t padded [COMPACT_HEADER_LEN] = {0, 0};
+  uint8_t len = bufLen;
+  if (len == 1)
+  {
+    padded[0] = buf[0];
+    buf = padded;
+    len = COMPACT_HEADER_LEN;
+    header0 |= COMPACT_FLAG_PAD;
+  }
+  // RadioHead's header bytes carry the compact header and the first two bytes of the payload.
+  rf95.setHeaderTo(header0);
+  rf95.setHeaderFrom(header1);
+  rf95.setHeaderId(buf[0]);
+  rf95.setHeaderFlags(buf[1], 0xFF);
+  return rf95.send(buf + COMPACT_HEADER_LEN, len - COMPACT_HEADER_LEN);
+}
+
+bool loraCompactLink::receive (uint8_t & header0,
+                               uint8_t & header1,
+                               uint8_t * buf,
+                               uint8_t & bufLen)
+{
+  uint8_t len = COMPACT_MAX_PAYLOAD_LEN - COMPACT_HEADER_LEN;
+  if (!rf95.recv(buf + COMPACT_HEADER_LEN, &len))
+  {
+    return false;
+  }
+  header0 = rf95.headerTo();
+  header1 = rf95.headerFrom();
+  buf[0] = rf95.headerId();
+  buf[1] = rf95.headerFlags();
+  bufLen = (header0 & COMPACT_FLAG_PAD) ? 1 : len + COMPACT_HEADER_LEN;
+  return true;
+}
+
+void loraCompactLink::acknowlege (uint8_t const header0,
+                                  uint8_t const header1)
+{
+  uint8_t const ack [COMPACT_ACK_LEN] = {uint8_t(int8_t(rf95.lastSNR())),
+                                         uint8_t(int8_t(MAX(rf95.lastRssi(), -128)))};
+  transmit(uint8_t((header0 & 0xF0) | COMPACT_FLAG_ACK), header1, ack, sizeof(ack));
+  rf95.waitPacketSent();
+}
+
+bool loraCompactLink::accepts (uint8_t const header1)
+{
+  return sensorFilter & (1 << (header1 & COMPACT_SENSOR_MASK));
+}
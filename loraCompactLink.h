@@ -0,0 +1,206 @@
+/**
+ * @file loraCompactLink.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the loraCompactLink class, the lightweight path's framing: a 2-byte header in place of RadioHead's 4-byte header and the message type byte, with its own acknowlegements.
+ * @version 0.0.1
+ * @date 2021-10-01
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * A frame on air is the compact header followed by the payload:
+ *
+ *   byte 0: message type (bits 7-4), COMPACT_FLAG_ACK, COMPACT_FLAG_ACK_REQ, COMPACT_FLAG_MORE, COMPACT_FLAG_PAD
+ *   byte 1: sequence number (bits 7-3), sensor id (bits 2-0)
+ *
+ * RH_RF95 always sends four header bytes ahead of the data it is given, and drops frames shorter than that. So the
+ * compact header goes in RadioHead's to and from bytes and the first two payload bytes in its id and flags, and the
+ * radio is left promiscuous so that nothing is filtered on the "to" byte. A payload of one byte is padded to two and
+ * sent with COMPACT_FLAG_PAD; an empty payload cannot be sent. Frames carry no addresses: the link is between one pair
+ * of units, kept apart from others by their link settings and by the sensor ids each unit takes (see setSensorFilter).
+ *
+ * The example sketches still frame with RadioHead's header: base and endpoint have to move over together, and the
+ * endpoint's DSSS join drives rf95 directly.
+ *
+ * An acknowlegement repeats the header of the frame it acknowleges with COMPACT_FLAG_ACK set, and carries the SNR and
+ * RSSI that frame was received with.
+ */
+
+#ifndef LORA_COMPACT_LINK_H
+#define LORA_COMPACT_LINK_H
+
+#include <Arduino.h>
+#include <RH_RF95.h>
+#include <loraPoint2PointProtocolLightweight.h>
+#include <sensors.h>
+
+#define COMPACT_HEADER_LEN 2
+#define COMPACT_MAX_PAYLOAD_LEN (RH_RF95_MAX_PAYLOAD_LEN - COMPACT_HEADER_LEN)
+#define COMPACT_ACK_LEN 2 ///< SNR and RSSI.
+#define COMPACT_FLAG_ACK     0x08 ///< This frame acknowleges the frame with the same byte 1.
+#define COMPACT_FLAG_ACK_REQ 0x04 ///< The sender waits for an acknowlegement.
+#define COMPACT_FLAG_MORE    0x02 ///< More fragments of the same message follow.
+#define COMPACT_FLAG_PAD     0x01 ///< The payload is one byte, padded to two.
+#define COMPACT_SEQ_MASK 0x1F
+#define COMPACT_SENSOR_MASK 0x07
+#define COMPACT_DFLT_ACK_TIMEOUT_MILLIS 200 ///< As RHReliableDatagram.
+#define COMPACT_DFLT_RETRIES 3
+#define COMPACT_SENSOR_FILTER_ALL 0xFF ///< Take the frames of every sensor id.
+
+#define COMPACT_NUM_MSG_TYPES 16 ///< Message types the compact header can carry: the lightweight types, first in LORA_P2P_MSG_TYPES.
+
+static_assert(msgType_aggregatedDataRsp < COMPACT_NUM_MSG_TYPES, "Lightweight message types must fit in the 4 bits of the compact header.");
+static_assert(NUM_sensors <= COMPACT_SENSOR_MASK + 1, "Sensor ids must fit in the 3 bits of the compact header.");
+
+/**
+ * @brief A frame received over a loraCompactLink.
+ *
+ */
+struct compactFrame_t
+{
+  msgType_t msgType;
+  uint8_t   seq;
+  uint8_t   sensorId;
+  bool      more; ///< More fragments of the same message follow.
+  uint8_t   bufLen;
+  uint8_t   buf [COMPACT_MAX_PAYLOAD_LEN];
+};
+
+/**
+ * @brief Sends and receives frames with the compact header over an RH_RF95, acknowleging them if asked to.
+ *
+ * Like RHReliableDatagram, sending with an acknowlegement blocks until it arrives or the retries are spent, and frames
+ * other than the acknowlegement that arrive meanwhile are dropped. A repeated frame (the acknowlegement was lost) is
+ * acknowleged again but not handed back twice.
+ */
+class loraCompactLink
+{
+  public:
+    /**
+     * @brief Constructs a new loraCompactLink object.
+     *
+     * @param _rf95 The radio. Call init first, then init here.
+     */
+    loraCompactLink (RH_RF95 & _rf95
+                     ):
+                     rf95(_rf95)
+                     {
+
+                     }
+
+    /**
+     * @brief Makes the radio promiscuous, as the compact header is where RadioHead expects the "to" address.
+     *
+     */
+    void init ();
+
+    /**
+     * @brief Sends a frame without waiting for an acknowlegement. Returns once the radio has it.
+     *
+     * @param msgType  Message type.
+     * @param sensorId Sensor the payload is from or for, sensor_none if any.
+     * @param buf      Payload.
+     * @param bufLen   Payload length, 1 to COMPACT_MAX_PAYLOAD_LEN.
+     * @param more     More fragments of the same message follow.
+     * @return true    Sent.
+     * @return false   Invalid length, a message type the header cannot carry, or the radio refused it.
+     */
+    bool send (msgType_t const msgType,
+               uint8_t const sensorId,
+               uint8_t const * buf,
+               uint8_t const bufLen,
+               bool const more = false);
+
+    /**
+     * @brief Sends a frame and waits for it to be acknowleged, sending it again after each timeout.
+     *
+     * @warning Blocks until acknowleged or given up, for up to (retries + 1) * (airtime + 2 * ACK timeout): 1.6 s plus
+     * airtime with the defaults. Frames other than the acknowlegement that arrive meanwhile are dropped, so the other
+     * end must not be waiting on an acknowlegement of its own.
+     *
+     * @return true  Acknowleged. getLastAckSnr and getLastAckRssi tell how it was received.
+     * @return false Not acknowleged once the retries were spent, or not sent (see send).
+     */
+    bool sendAcked (msgType_t const msgType,
+                    uint8_t const sensorId,
+                    uint8_t const * buf,
+                    uint8_t const bufLen,
+                    bool const more = false);
+
+    /**
+     * @brief Takes a received frame, if any, acknowleging it if the sender asked to.
+     *
+     * @param frame  Filled in.
+     * @return true  frame holds a new frame.
+     * @return false Nothing new: no frame, an acknowlegement, a repeat or a frame too short.
+     */
+    bool recv (compactFrame_t & frame);
+
+    /**
+     * @brief Sets the sensor ids whose frames are taken: bit n for sensor id n.
+     *
+     * The radio is promiscuous and frames carry no addresses, so this is what keeps a unit from taking, and
+     * acknowleging, the frames of another pair of units on the same link settings. Frames of other sensor ids are
+     * neither acknowleged nor handed back by recv.
+     *
+     * @param sensorMask Bit per sensor id. COMPACT_SENSOR_FILTER_ALL, the default, takes every frame.
+     */
+    void setSensorFilter (uint8_t const sensorMask);
+
+    void setAckTimeout (uint16_t const millis);
+    void setRetries (uint8_t const retries);
+
+    int8_t getLastAckSnr ();
+    int8_t getLastAckRssi ();
+    /**
+     * @brief Frames sent again because an acknowlegement did not come in time.
+     *
+     */
+    uint32_t getNumRetransmissions ();
+
+  private:
+    /**
+     * @brief Puts the two header bytes and the payload on the air.
+     *
+     */
+    bool transmit (uint8_t const header0,
+                   uint8_t const header1,
+                   uint8_t const * buf,
+                   uint8_t const bufLen);
+
+    /**
+     * @brief Takes what the radio holds, as a compact frame.
+     *
+     * @param header0 Set to header byte 0.
+     * @param header1 Set to header byte 1.
+     * @param buf     Filled with the payload, COMPACT_MAX_PAYLOAD_LEN long.
+     * @param bufLen  Set to the payload length.
+     * @return true   A frame was taken.
+     * @return false  None.
+     */
+    bool receive (uint8_t & header0,
+                  uint8_t & header1,
+                  uint8_t * buf,
+                  uint8_t & bufLen);
+
+    void acknowlege (uint8_t const header0,
+                     uint8_t const header1);
+
+    /**
+     * @brief Whether a frame with header byte 1 passes the sensor filter.
+     *
+     */
+    bool accepts (uint8_t const header1);
+
+    RH_RF95 & rf95;
+    uint8_t txSeq = 0;
+    uint8_t lastRxHeader1 = 0;
+    bool lastRxValid = false; ///< lastRxHeader1 is that of a frame received, so a repeat of it can be told.
+    uint16_t ackTimeoutMillis = COMPACT_DFLT_ACK_TIMEOUT_MILLIS;
+    uint8_t retries = COMPACT_DFLT_RETRIES;
+    uint8_t sensorFilter = COMPACT_SENSOR_FILTER_ALL;
+    int8_t lastAckSnr = 0;
+    int8_t lastAckRssi = 0;
+    uint32_t numRetransmissions = 0;
+};
+
+#endif // LORA_COMPACT_LINK_H
@@ -0,0 +1,114 @@
+/**
+ * @file loraLog.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the deferred log sink.
+ * @version 0.1
+ * @date 2021-09-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include <loraLog.h>
+#include <commonMacros.h>
+
+//---------
+// Helpers
+//---------
+
+/**
+ * @brief Ring buffer of log text. Writing to a full ring drops the byte.
+ *
+ */
+class logRing : public Print
+{
+  public:
+    size_t write (uint8_t c) override
+    {
+      if (count >= LOG_RING_LEN)
+      {
+        numDropped++;
+        return 0;
+      }
+      buf[(head + count) % LOG_RING_LEN] = c;
+      count++;
+      return 1;
+    }
+
+    uint16_t flush (Print & port)
+    {
+      int room = port.availableForWrite();
+      uint16_t limit = room > 0 ? MIN(LOG_FLUSH_CHUNK, room) : 0;
+      uint16_t len = 0;
+      while (count > 0 && len < limit)
+      {
+        // Contiguous run up to the end of the buffer.
+        uint16_t run = MIN(MIN(count, uint16_t(LOG_RING_LEN - head)), uint16_t(limit - len));
+        port.write(buf + head, run);
+        head = (head + run) % LOG_RING_LEN;
+        count -= run;
+        len += run;
+      }
+      return len;
+    }
+
+    uint16_t pending () const
+    {
+      return count;
+    }
+
+    uint32_t getNumDropped () const
+    {
+      return numDropped;
+    }
+
+  private:
+    uint8_t buf [LOG_RING_LEN];
+    uint16_t head = 0;
+    uint16_t count = 0;
+    uint32_t numDropped = 0;
+};
+
+#if (LOG_DEFERRED == true)
+static logRing ring;
+#endif // LOG_DEFERRED
+
+//----------------------
+// Function Definitions
+//----------------------
+
+Print & loraLog::sink ()
+{
+  #if (LOG_DEFERRED == true)
+  return ring;
+  #else // LOG_DEFERRED
+  return Serial;
+  #endif // LOG_DEFERRED
+}
+
+uint16_t loraLog::flush (Print & port)
+{
+  #if (LOG_DEFERRED == true)
+  return ring.flush(port);
+  #else // LOG_DEFERRED
+  return 0;
+  #endif // LOG_DEFERRED
+}
+
+uint16_t loraLog::pending ()
+{
+  #if (LOG_DEFERRED == true)
+  return ring.pending();
+  #else // LOG_DEFERRED
+  return 0;
+  #endif // LOG_DEFERRED
+}
+
+uint32_t loraLog::getNumDropped ()
+{
+  #if (LOG_DEFERRED == true)
+  return ring.getNumDropped();
+  #else // LOG_DEFERRED
+  return 0;
+  #endif // LOG_DEFERRED
+}
@@ -0,0 +1,142 @@
+/**
+ * @file loraLog.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Leveled debug logging with a compile-time threshold and a deferred ring buffer sink.
+ * @version 0.1
+ * @date 2021-09-18
+ *
+ * @copyright Copyright (c) 2021
+ *
+ * Log with LOG_ERROR, LOG_WARN, LOG_INFO and LOG_DEBUG (and their ...LN variants, which end the line), each taking
+ * any number of things Print can print:
+ *
+ * `LOG_INFOLN("Set SF to: ", spreadingFactorToSet);`
+ *
+ * Levels above LOG_LEVEL compile to nothing; not even their arguments are evaluated.
+ *
+ * With LOG_DEFERRED, messages are only copied into a RAM ring buffer, and loraLog::flush moves them to the serial
+ * port a little at a time, never more than the port can take without blocking. loraPoint2Point::serviceRx flushes
+ * whenever no frame came in; call loraLog::flush in the main loop too if serviceRx is not called often.
+ * When the ring is full, new messages are dropped and counted.
+ */
+
+#ifndef LORA_LOG_H
+#define LORA_LOG_H
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1 ///< Something failed and was given up on.
+#define LOG_LEVEL_WARN  2 ///< Something failed and will be retried, or was refused.
+#define LOG_LEVEL_INFO  3 ///< Link and settings changes.
+#define LOG_LEVEL_DEBUG 4 ///< Every frame sent and received.
+
+/**
+ * @brief Most verbose level compiled in.
+ *
+ */
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * @brief Buffer messages in RAM and write them out from loraLog::flush instead of printing to Serial straight away.
+ *
+ */
+#ifndef LOG_DEFERRED
+#define LOG_DEFERRED true
+#endif
+
+#define LOG_RING_LEN 512
+
+/**
+ * @brief Most bytes written per call to loraLog::flush.
+ *
+ */
+#define LOG_FLUSH_CHUNK 64
+
+//--------
+// Macros
+//--------
+
+#if (LOG_LEVEL >= LOG_LEVEL_ERROR)
+#define LOG_ERROR(...)   loraLog::print(__VA_ARGS__)
+#define LOG_ERRORLN(...) loraLog::println(__VA_ARGS__)
+#else
+#define LOG_ERROR(...)   do {} while (0)
+#define LOG_ERRORLN(...) do {} while (0)
+#endif // LOG_LEVEL_ERROR
+
+#if (LOG_LEVEL >= LOG_LEVEL_WARN)
+#define LOG_WARN(...)   loraLog::print(__VA_ARGS__)
+#define LOG_WARNLN(...) loraLog::println(__VA_ARGS__)
+#else
+#define LOG_WARN(...)   do {} while (0)
+#define LOG_WARNLN(...) do {} while (0)
+#endif // LOG_LEVEL_WARN
+
+#if (LOG_LEVEL >= LOG_LEVEL_INFO)
+#define LOG_INFO(...)   loraLog::print(__VA_ARGS__)
+#define LOG_INFOLN(...) loraLog::println(__VA_ARGS__)
+#else
+#define LOG_INFO(...)   do {} while (0)
+#define LOG_INFOLN(...) do {} while (0)
+#endif // LOG_LEVEL_INFO
+
+#if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
+#define LOG_DEBUG(...)   loraLog::print(__VA_ARGS__)
+#define LOG_DEBUGLN(...) loraLog::println(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...)   do {} while (0)
+#define LOG_DEBUGLN(...) do {} while (0)
+#endif // LOG_LEVEL_DEBUG
+
+namespace loraLog
+{
+/**
+ * @brief Where log messages go: the ring buffer if LOG_DEFERRED, otherwise Serial.
+ *
+ * @return Print& The sink.
+ */
+Print & sink ();
+
+/**
+ * @brief Moves buffered messages to a port, as much as it can take right now (see Print::availableForWrite) and at most LOG_FLUSH_CHUNK bytes.
+ *
+ * @param port      Usually Serial.
+ * @return uint16_t Bytes written.
+ */
+uint16_t flush (Print & port);
+
+/**
+ * @brief Bytes waiting in the ring buffer.
+ *
+ */
+uint16_t pending ();
+
+/**
+ * @brief Bytes dropped because the ring buffer was full.
+ *
+ */
+uint32_t getNumDropped ();
+
+inline void print ()
+{
+}
+
+template <class T, class... Rest>
+void print (T const & value, Rest const &... rest)
+{
+  sink().print(value);
+  print(rest...);
+}
+
+template <class... Args>
+void println (Args const &... args)
+{
+  print(args...);
+  sink().println();
+}
+}
+
+#endif // LORA_LOG_H
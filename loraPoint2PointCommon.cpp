@@ -35,3 +35,28 @@ void loraPoint2PointCommon::printBuffer (uint8_t const * buf,
     }
   }
 }
+
+
+uint32_t loraPoint2PointCommon::airtimeMicros (uint8_t const  spreadingFactor,
+                                              uint32_t const signalBandwidthHz,
+                                              uint8_t const  payloadLen,
+                                              uint8_t const  codingRate4,
+                                              uint16_t const preambleLength,
+                                              bool const     crcOn)
+{
+  uint32_t symbolMicros = (uint32_t(1) << spreadingFactor) * 1000000UL / signalBandwidthHz;
+  int32_t lowDatarateOptimize = (symbolMicros > 16000) ? 1 : 0;
+  // Preamble is (preambleLength + 4.25) symbols.
+  uint32_t preambleMicros = ((4 * uint32_t(preambleLength) + 17) * symbolMicros) / 4;
+  int32_t numerator = 8 * int32_t(payloadLen)
+                      - 4 * int32_t(spreadingFactor)
+                      + 28
+                      + (crcOn ? 16 : 0);
+  int32_t denominator = 4 * (int32_t(spreadingFactor) - 2 * lowDatarateOptimize);
+  int32_t payloadSymbols = 8;
+  if (numerator > 0)
+  {
+    payloadSymbols += ((numerator + denominator - 1) / denominator) * int32_t(codingRate4);
+  }
+  return preambleMicros + uint32_t(payloadSymbols) * symbolMicros;
+}
\ No newline at end of file
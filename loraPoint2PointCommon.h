@@ -10,7 +10,7 @@
  */
 
 #ifndef LORA_POINT_2_POINT_COMMON_H
-#define LORA_POINT_2_POINT_PROTOCOL_H
+#define LORA_POINT_2_POINT_COMMON_H
 
 #include <Arduino.h>
 
@@ -27,5 +27,25 @@ namespace loraPoint2PointCommon
 void printBuffer (uint8_t const * buf,
                   uint8_t const bufLen,
                   bool const ascii);
+
+/**
+ * @brief Time on air of one LoRa frame, following the formula in section 4.1.1.7 of the Semtech SX1276 datasheet.
+ * 
+ * Assumes an explicit header, and turns on low data rate optimization when the symbol time exceeds 16ms, as RadioHead does.
+ * 
+ * @param spreadingFactor   Spreading factor (7 to 12).
+ * @param signalBandwidthHz Signal bandwidth in Hz.
+ * @param payloadLen        Bytes sent over the air, *including* RadioHead's 4 header bytes.
+ * @param codingRate4       Denominator of the coding rate (5 to 8 for 4/5 to 4/8).
+ * @param preambleLength    Programmed preamble length in symbols.
+ * @param crcOn             True if the payload CRC is enabled.
+ * @return uint32_t         Time on air, in microseconds.
+ */
+uint32_t airtimeMicros (uint8_t const  spreadingFactor,
+                        uint32_t const signalBandwidthHz,
+                        uint8_t const  payloadLen,
+                        uint8_t const  codingRate4 = 5,
+                        uint16_t const preambleLength = 8,
+                        bool const     crcOn = true);
 }
-#endif // LORA_POINT_2_POINT_PROTOCOL_H
\ No newline at end of file
+#endif // LORA_POINT_2_POINT_COMMON_H
\ No newline at end of file
@@ -11,7 +11,9 @@
 
 #include <Arduino.h>
 #include <loraPoint2PointProtocol.h>
+#include <loraPoint2PointCommon.h>
 #include <commonMacros.h>
+#include <loraLog.h>
 
 //----------------------
 // Function Definitions
@@ -21,15 +23,33 @@ void loraPoint2Point::updatePacketErrorFraction (bool packetSuccess)
 {
   ++packetCount;
   packetErrorCount += !packetSuccess;
-  packetErrorFraction += (float(!packetSuccess) - packetErrorFraction) /
-                         MIN(packetCount, packetErrorMovingAvgPeriod);
+  packetErrorWindow = (packetErrorWindow << 1) | !packetSuccess;
+  uint8_t windowLen = MIN(packetCount, PACKET_ERROR_WINDOW_LEN);
+  uint8_t errors = 0;
+  for (uint8_t bit = 0; bit < windowLen; bit++)
+  {
+    errors += (packetErrorWindow >> bit) & 1;
+  }
+  packetErrorFraction = float(errors) / windowLen;
 }
 
 void loraPoint2Point::resetPacketErrorFraction ()
 {
   packetErrorFraction = 0;
+  packetErrorWindow = 0;
   packetCount = 0;
   packetErrorCount = 0;
+  linkSnrCount = 0;
+  adrNextPacketCount = ADR_PACKETS_PER_STEP;
+}
+
+void loraPoint2Point::updateLinkSnr (int const snr)
+{
+  if (linkSnrCount == 0 || snr < linkSnrMin)
+  {
+    linkSnrMin = snr;
+  }
+  ++linkSnrCount;
 }
 
 float const & loraPoint2Point::getPacketErrorFraction ()
@@ -37,11 +57,36 @@ float const & loraPoint2Point::getPacketErrorFraction ()
   return packetErrorFraction;
 }
 
+linkStats<LINK_STATS_ENTRIES> const & loraPoint2Point::getLinkStats ()
+{
+  return stats;
+}
+
+linkStatsEntry_t const * loraPoint2Point::getLinkStats (uint8_t const peerAddress)
+{
+  return stats.find(linkStatsKey(peerAddress));
+}
+
+linkStatsKey_t loraPoint2Point::linkStatsKey (uint8_t const peerAddress)
+{
+  linkStatsKey_t key = {peerAddress,
+                        uint8_t(currentSpreadingFactor),
+                        uint8_t(currentSignalBandwidth),
+                        uint8_t(currentFrequencyChannel),
+                        currentTxPower};
+  return key;
+}
+
 int loraPoint2Point::getLastAckSNR ()
 {
   return ackSnr;
 }
 
+int loraPoint2Point::getLastRxSNR ()
+{
+  return rf95.lastSNR();
+}
+
 spreadingFactor_t& operator++(spreadingFactor_t& s, int)
 {
   switch(s)
@@ -117,31 +162,51 @@ bool loraPoint2Point::setupRadio ()
 {
   pinMode(rfm95Rst, OUTPUT);
   digitalWrite(rfm95Rst, HIGH);
-  Serial.println("Feather LoRa Range Test");
+  LOG_INFOLN("Feather LoRa Range Test");
   delay(100);  
   forceRadioReset();
 
   while (!rf95.init())
   {
-    Serial.println("LoRa radio init failed");
-    Serial.println("Uncomment '#define SERIAL_DEBUG' in RH_RF95.cpp for detailed debug info");
+    LOG_ERRORLN("LoRa radio init failed");
+    LOG_ERRORLN("Uncomment '#define SERIAL_DEBUG' in RH_RF95.cpp for detailed debug info");
     return false;
   }
-  Serial.println("LoRa radio init OK!");
+  LOG_INFOLN("LoRa radio init OK!");
 
-  #if (USE_RH_RELIABLE_DATAGRAM > 0)
-  while (!rhReliableDatagram.init())
-  {
-    Serial.println("Manager init failed");
-    return false;
-  }
-  Serial.println("Manager init OK!");
-  #endif // USE_RH_RELIABLE_DATAGRAM
+  rf95.setThisAddress(thisAddress);
+  rf95.setHeaderFrom(thisAddress);
+  memset(sessions, 0, sizeof(sessions));
+  txState = txState_idle;
+  txControlQueue.clear();
+  txDataQueue.clear();
+  ackPending = false;
+  linkProbesPending = 0;
+  linkChangeState = linkChangeState_idle;
+  tasks.stop(linkProbeTask);
+  hopRole = hopRole_off;
+  dutyCyclePeriodMillis = 0;
+  dutyCycleAsleep = false;
+  dutyCycleSniffing = false;
+  memset(dutyCyclePeers, 0, sizeof(dutyCyclePeers));
+  pollingActive = false;
+  pollSlotActive = false;
+  tasks.stop(pollTask);
+  polledTx = false;
+  pollWindowOpen = false;
 
-  setSpreadingFactor(RFM95_DFLT_SPREADING_FACTOR);
-  setBandwidth(RFM95_DFLT_SIGNAL_BANDWIDTH);
-  setTxPower(RFM95_DFLT_TX_POWER_dBm);
-  setFrequencyChannel(RFM95_DFLT_FREQ_CHANNEL);
+  // What init leaves in the registers: Bw125Cr45Sf128 at 13dBm.
+  radioShadow[radioRegister_paConfig] = RH_RF95_PA_SELECT | (13 - 2);
+  radioShadow[radioRegister_modemConfig1] = 0x72;
+  radioShadow[radioRegister_modemConfig2] = 0x74;
+  radioShadow[radioRegister_modemConfig3] = 0x04;
+  radioShadow[radioRegister_paDac] = RH_RF95_PA_DAC_DISABLE;
+  radioShadowValid = false;
+  linkSettings_t const defaultSettings = {RFM95_DFLT_SPREADING_FACTOR,
+                                          RFM95_DFLT_SIGNAL_BANDWIDTH,
+                                          RFM95_DFLT_FREQ_CHANNEL,
+                                          RFM95_DFLT_TX_POWER_dBm};
+  applyLinkSettings(defaultSettings);
   return true;
 }
 
@@ -173,102 +238,187 @@ int8_t loraPoint2Point::getTxPower ()
   return currentTxPower;
 }
 
-void loraPoint2Point::setSpreadingFactor (spreadingFactor_t spreadingFactor)
+linkSettings_t loraPoint2Point::getLinkSettings ()
 {
-  if (spreadingFactor >= NUM_spreadingFactors)
+  linkSettings_t settings = {currentSpreadingFactor,
+                             currentSignalBandwidth,
+                             currentFrequencyChannel,
+                             currentTxPower};
+  return settings;
+}
+
+bool loraPoint2Point::isValidLinkSettings (linkSettings_t const & settings)
+{
+  if (settings.spreadingFactor >= NUM_spreadingFactors)
   {
-    Serial.print("Invalid spreading factor setting (");
-    Serial.print(spreadingFactor);
-    Serial.println(")");
-    return;
+    LOG_WARNLN("Invalid spreading factor setting (", settings.spreadingFactor, ")");
+    return false;
   }
-  uint8_t spreadingFactorToSet = spreadingFactorTable[spreadingFactor];
-  rf95.setSpreadingFactor(spreadingFactorToSet);
-  rf95.setModeIdle(); // Required to update radio settings.
-  resetPacketErrorFraction();
-  previousSpreadingFactor = currentSpreadingFactor;
-  currentSpreadingFactor = spreadingFactor;
-  user.linkChangeInd(currentSpreadingFactor,
-                     currentSignalBandwidth,
-                     currentFrequencyChannel,
-                     currentTxPower);
-  Serial.print("Set SF to: ");
-  Serial.println(spreadingFactorToSet);
+  if (settings.signalBandwidth >= NUM_signalBandwidths)
+  {
+    LOG_WARNLN("Invalid signal bandwidth setting (", settings.signalBandwidth, ")");
+    return false;
+  }
+  if (settings.frequencyChannel >= NUM_frequencyChannels)
+  {
+    LOG_WARNLN("Invalid frequency channel setting (", settings.frequencyChannel, ")");
+    return false;
+  }
+  if ((settings.txPower > MAX_txPower) | (settings.txPower < MIN_txPower))
+  {
+    LOG_WARNLN("Invalid tx power setting (", settings.txPower, "dBm)");
+    return false;
+  }
+  return true;
 }
 
-void loraPoint2Point::setBandwidth (signalBandwidth_t bandwidth)
+bool loraPoint2Point::isSameLinkSettings (linkSettings_t const & a,
+                                          linkSettings_t const & b)
+{
+  return a.spreadingFactor == b.spreadingFactor
+         && a.signalBandwidth == b.signalBandwidth
+         && a.frequencyChannel == b.frequencyChannel
+         && a.txPower == b.txPower;
+}
+
+bool loraPoint2Point::applyLinkSettings (linkSettings_t const & settings)
 {
-  if (bandwidth >= NUM_signalBandwidths)
+  if (!isValidLinkSettings(settings))
   {
-    Serial.print("Invalid signal bandwidth setting (");
-    Serial.print(bandwidth);
-    Serial.println(")");
-    return;
+    return false;
+  }
+  linkSettings_t settingsToApply = settings;
+  if (hopRole != hopRole_off && settingsToApply.frequencyChannel != currentFrequencyChannel)
+  {
+    LOG_DEBUGLN("Frequency channel left to the hop sequence.");
+    settingsToApply.frequencyChannel = currentFrequencyChannel;
   }
-  uint32_t bandwidthToSet = signalBandwidthTable[bandwidth];
-  rf95.setSignalBandwidth(bandwidthToSet);
-  rf95.setModeIdle(); // Required to update radio settings.
+  linkSettings_t const previous = getLinkSettings();
+  if (!writeLinkSettings(settingsToApply))
+  {
+    return true; // Nothing changed: the rollback point stays where it was.
+  }
+  previousSpreadingFactor = previous.spreadingFactor;
+  previousSignalBandwidth = previous.signalBandwidth;
+  previousFrequencyChannel = previous.frequencyChannel;
+  previousTxPower = previous.txPower;
   resetPacketErrorFraction();
-  previousSignalBandwidth = currentSignalBandwidth;
-  currentSignalBandwidth = bandwidth;
   user.linkChangeInd(currentSpreadingFactor,
                      currentSignalBandwidth,
                      currentFrequencyChannel,
                      currentTxPower);
-  Serial.print("Set BW to: ");
-  Serial.println(bandwidthToSet);
+  LOG_INFOLN("Set SF ", spreadingFactorTable[currentSpreadingFactor],
+             ", BW ", signalBandwidthTable[currentSignalBandwidth],
+             " Hz, freq ", float(frequencyChannelTable[currentFrequencyChannel])/10,
+             " MHz, ", currentTxPower, " dBm");
+  return true;
 }
 
-void loraPoint2Point::setFrequencyChannel (frequencyChannel_t frequencyChannel)
+bool loraPoint2Point::writeLinkSettings (linkSettings_t const & settings)
 {
-  if (frequencyChannel >= NUM_frequencyChannels)
+  uint8_t registers [NUM_radioRegisters];
+  memcpy(registers, radioShadow, sizeof(registers));
+  uint8_t spreadingFactor = spreadingFactorTable[settings.spreadingFactor];
+  registers[radioRegister_modemConfig1] = (registers[radioRegister_modemConfig1] & ~RH_RF95_BW)
+                                          | signalBandwidthRegisterTable[settings.signalBandwidth];
+  registers[radioRegister_modemConfig2] = (registers[radioRegister_modemConfig2] & ~RH_RF95_SPREADING_FACTOR)
+                                          | uint8_t(spreadingFactor << 4);
+  // As RadioHead's setLowDatarate: optimise for symbols longer than 16ms.
+  uint32_t symbolMicros = (uint32_t(1) << spreadingFactor) * 1000000UL / signalBandwidthTable[settings.signalBandwidth];
+  if (symbolMicros > 16000)
   {
-    Serial.print("Invalid frequency channel setting (");
-    Serial.print(frequencyChannel);
-    Serial.println(")");
-    return;
+    registers[radioRegister_modemConfig3] |= RH_RF95_LOW_DATA_RATE_OPTIMIZE;
   }
-  float frequencyToSet = ((float)(frequencyChannelTable[frequencyChannel]))/10;
-  if (!rf95.setFrequency(frequencyToSet))
+  else
   {
-    Serial.println("setFrequency failed");
-    while (1);
+    registers[radioRegister_modemConfig3] &= ~RH_RF95_LOW_DATA_RATE_OPTIMIZE;
   }
-  else
+  // As RadioHead's setTxPower on PA_BOOST: the PA DAC adds 3dB above 17dBm.
+  bool paDac = settings.txPower > 17;
+  registers[radioRegister_paConfig] = RH_RF95_PA_SELECT | uint8_t((paDac ? settings.txPower - 3 : settings.txPower) - 2);
+  registers[radioRegister_paDac] = paDac ? RH_RF95_PA_DAC_ENABLE : RH_RF95_PA_DAC_DISABLE;
+
+  bool retune = !radioShadowValid || settings.frequencyChannel != currentFrequencyChannel;
+  bool changed = retune || memcmp(registers, radioShadow, sizeof(registers)) != 0;
+  if (!changed)
   {
-    rf95.setModeIdle(); // Required to update radio settings.
-    resetPacketErrorFraction();
-    previousFrequencyChannel = currentFrequencyChannel;
-    currentFrequencyChannel = frequencyChannel;
-    user.linkChangeInd(currentSpreadingFactor,
-                     currentSignalBandwidth,
-                     currentFrequencyChannel,
-                     currentTxPower);
-    Serial.print("Set Freq to: ");
-    Serial.println(frequencyToSet);
+    return false;
   }
+  rf95.setModeIdle(); // Required to update radio settings. Back in RX at the next serviceRx.
+  uint8_t reg = 0;
+  while (reg < NUM_radioRegisters)
+  {
+    if (radioShadowValid && registers[reg] == radioShadow[reg])
+    {
+      reg++;
+      continue;
+    }
+    // Registers at consecutive addresses that both change go in one burst.
+    uint8_t len = 1;
+    while (reg + len < NUM_radioRegisters
+           && radioRegisterTable[reg + len] == radioRegisterTable[reg] + len
+           && !(radioShadowValid && registers[reg + len] == radioShadow[reg + len]))
+    {
+      len++;
+    }
+    if (len == 1)
+    {
+      rf95.spiWrite(radioRegisterTable[reg], registers[reg]);
+    }
+    else
+    {
+      rf95.spiBurstWrite(radioRegisterTable[reg], &registers[reg], len);
+    }
+    reg += len;
+  }
+  memcpy(radioShadow, registers, sizeof(radioShadow));
+  if (retune)
+  {
+    // Through RadioHead, which also picks the RF port for the frequency.
+    float frequencyToSet = ((float)(frequencyChannelTable[settings.frequencyChannel]))/10;
+    if (!rf95.setFrequency(frequencyToSet))
+    {
+      LOG_ERRORLN("setFrequency failed");
+      while (1)
+      {
+        loraLog::flush(Serial);
+      }
+    }
+  }
+  radioShadowValid = true;
+  currentSpreadingFactor = settings.spreadingFactor;
+  currentSignalBandwidth = settings.signalBandwidth;
+  currentFrequencyChannel = settings.frequencyChannel;
+  currentTxPower = settings.txPower;
+  return true;
+}
+
+void loraPoint2Point::setSpreadingFactor (spreadingFactor_t spreadingFactor)
+{
+  linkSettings_t settings = getLinkSettings();
+  settings.spreadingFactor = spreadingFactor;
+  applyLinkSettings(settings);
+}
+
+void loraPoint2Point::setBandwidth (signalBandwidth_t bandwidth)
+{
+  linkSettings_t settings = getLinkSettings();
+  settings.signalBandwidth = bandwidth;
+  applyLinkSettings(settings);
+}
+
+void loraPoint2Point::setFrequencyChannel (frequencyChannel_t frequencyChannel)
+{
+  linkSettings_t settings = getLinkSettings();
+  settings.frequencyChannel = frequencyChannel;
+  applyLinkSettings(settings);
 }
 
 void loraPoint2Point::setTxPower (int8_t txPower)
 {
-  if ((txPower > MAX_txPower) | (txPower < MIN_txPower))
-  {
-    Serial.print("Invalid tx power setting (");
-    Serial.print(txPower);
-    Serial.println("dBm)");
-    return;
-  }
-  rf95.setTxPower(txPower, false);
-  rf95.setModeIdle(); // Required to update radio settings.
-  resetPacketErrorFraction();
-  previousTxPower = currentTxPower;
-  currentTxPower = txPower;
-  user.linkChangeInd(currentSpreadingFactor,
-                     currentSignalBandwidth,
-                     currentFrequencyChannel,
-                     currentTxPower);
-  Serial.print("Set TX power to: ");
-  Serial.println(txPower);
+  linkSettings_t settings = getLinkSettings();
+  settings.txPower = txPower;
+  applyLinkSettings(settings);
 }
 
 uint8_t loraPoint2Point::buildStringFromSerial (Serial_* dataPort)
@@ -389,325 +539,2278 @@ uint8_t loraPoint2Point::buildStringFromSerialInner (char inputChar)
 
 uint8_t loraPoint2Point::setTxMessage (uint8_t const * txMsgContents, uint8_t const numChars)
 {
+  uint8_t numCharsToCopy = MIN(numChars, RH_RF95_MAX_MESSAGE_LEN - 1);
   txMsg.buf[0] = msgType_dataReq;
-  memcpy(txMsg.buf + 1, txMsgContents, numChars);
-  txMsg.bufLen = numChars + 1;
-  return numChars;
+  memcpy(txMsg.buf + 1, txMsgContents, numCharsToCopy);
+  txMsg.bufLen = numCharsToCopy + 1;
+  return numCharsToCopy;
 }
 
-void loraPoint2Point::linkChangeReq (uint8_t const            destAddress,
+bool loraPoint2Point::linkChangeReq (uint8_t const            destAddress,
                                      spreadingFactor_t const  spreadingFactor,
                                      signalBandwidth_t const  signalBandwidth,
                                      frequencyChannel_t const frequencyChannel,
                                      int8_t const             txPower)
 {
-  bool acknowleged = false;
-  uint8_t linkChangeReqBuf [] = {msgType_linkChangeReq,
-                                 uint8_t(spreadingFactor),
-                                 uint8_t(signalBandwidth),
-                                 uint8_t(frequencyChannel),
-                                 uint8_t(txPower)};
-  Serial.println("Attempting to change link to: ");
-  Serial.print("SF ");
-  Serial.println(spreadingFactorTable[spreadingFactor]);
-  Serial.print("BW ");
-  Serial.print(signalBandwidthTable[signalBandwidth]);
-  Serial.println(" Hz");
-  Serial.print("Channel ");
-  Serial.print(float(frequencyChannelTable[frequencyChannel])/10);
-  Serial.println(" MHz");
-  Serial.print("TX power ");
-  Serial.print(txPower);
-  Serial.println(" dBm");
-  if (rhReliableDatagram.sendtoWait(linkChangeReqBuf, 5, destAddress) == true)
-  {
-    Serial.println("Link change request acknowleged!");
-    acknowleged = true;
-    setSpreadingFactor(spreadingFactor);
-    setBandwidth(signalBandwidth);
-    setTxPower(txPower);
-    setFrequencyChannel(frequencyChannel);
-    // Start timer
-    // call linkChangeReqTimeout if serviceLinkChangeRsp is not received in 5s.
-    linkChangeTimeoutTimer.pause();
-    linkChangeTimeoutTimer.clearDone();
-    linkChangeTimeoutTimer.setTimeout(LINK_CHANGE_TIMEOUT_MILLIS);
-    serviceTimers();
-    linkChangeTimeoutTimer.start();
+  linkSettings_t const settings = {spreadingFactor, signalBandwidth, frequencyChannel, txPower};
+  if (!isValidLinkSettings(settings))
+  {
+    return false;
   }
-  else
+  if (linkChangeState != linkChangeState_idle)
   {
-    Serial.println("Link change request not acknowleged.");
-  }
-}
-
-void loraPoint2Point::linkChangeReqTimeout ()
-{
-  Serial.println("Link change request timed out.");
-  linkChangeTimeoutTimer.clearDone(); // redundant?
-  setSpreadingFactor(previousSpreadingFactor);
-  setBandwidth(previousSignalBandwidth);
-  setTxPower(previousTxPower);
-  setFrequencyChannel(previousFrequencyChannel);
-}
-
-void loraPoint2Point::serviceLinkChangeReq (uint8_t const            srcAddress,
-                                            spreadingFactor_t const  spreadingFactor,
-                                            signalBandwidth_t const  signalBandwidth,
-                                            frequencyChannel_t const frequencyChannel,
-                                            int8_t const             txPower)
-{
-  Serial.println("Link change request received.");
-  Serial.println("Attempting to change link to: ");
-  Serial.print("SF ");
-  Serial.println(spreadingFactorTable[spreadingFactor]);
-  Serial.print("BW ");
-  Serial.print(signalBandwidthTable[signalBandwidth]);
-  Serial.println(" Hz");
-  Serial.print("Channel ");
-  Serial.print(float(frequencyChannelTable[frequencyChannel])/10);
-  Serial.println(" MHz");
-  Serial.print("TX power ");
-  Serial.print(txPower);
-  Serial.println(" dBm");
-  bool acknowleged = false;
-  setSpreadingFactor(spreadingFactor);
-  setBandwidth(signalBandwidth);
-  setTxPower(txPower);
-  setFrequencyChannel(frequencyChannel);
-  uint8_t linkChangeRspBuf [] = {msgType_linkChangeRsp,
-                                 uint8_t(currentSpreadingFactor),
-                                 uint8_t(currentSignalBandwidth),
-                                 uint8_t(currentFrequencyChannel),
-                                 uint8_t(currentTxPower)};
-  delay(100); // Prevent race conditions
-  if (rhReliableDatagram.sendtoWait(linkChangeRspBuf, 5, srcAddress) == true)
-  {
-    Serial.println("Link change response acknowleged!");
-    acknowleged = true;
+    LOG_WARNLN("Link change request not sent: a link change is under way.");
+    return false;
   }
-  else
+  msg_linkChangeReq_t req;
+  req.spreadingFactor = spreadingFactor;
+  req.signalBandwidth = signalBandwidth;
+  req.frequencyChannel = frequencyChannel;
+  req.txPower = txPower;
+  uint8_t linkChangeReqBuf [msg_linkChangeReq_t::LEN];
+  req.pack(linkChangeReqBuf);
+  LOG_INFOLN("Attempting to change link to: ");
+  LOG_INFOLN("SF ", spreadingFactorTable[spreadingFactor]);
+  LOG_INFOLN("BW ", signalBandwidthTable[signalBandwidth], " Hz");
+  LOG_INFOLN("Channel ", float(frequencyChannelTable[frequencyChannel])/10, " MHz");
+  LOG_INFOLN("TX power ", txPower, " dBm");
+  // The settings are applied in completeTx once the request is acknowleged.
+  if (!serviceTx(destAddress, linkChangeReqBuf, sizeof(linkChangeReqBuf), false))
   {
-    Serial.println("Link change response not acknowleged.");
-    setSpreadingFactor(previousSpreadingFactor);
-    setBandwidth(previousSignalBandwidth);
-    setTxPower(previousTxPower);
-    setFrequencyChannel(previousFrequencyChannel);
-    acknowleged = false;
+    LOG_WARNLN("Link change request not sent.");
+    return false;
   }
+  linkChangeState = linkChangeState_requesting;
+  return true;
 }
 
-void loraPoint2Point::serviceLinkChangeRsp ()
+linkChangeState_t loraPoint2Point::getLinkChangeState ()
 {
-  Serial.println("Link change response received. Transmission OK on new settings!");
-  linkChangeTimeoutTimer.pause();
-  linkChangeTimeoutTimer.clearDone();
-  linkChangeTimeoutTimer.setTimeout(SUCCESSFUL_PACKETS_BEFORE_LINK_IS_TRUSTED
-                                    * HEARTBEAT_TIMEOUT_MILLIS
-                                     + LINK_CHANGE_TIMEOUT_MILLIS);
-  serviceTimers();
-  linkChangeTimeoutTimer.start();
+  return linkChangeState;
 }
 
-void loraPoint2Point::startHeartbeats ()
+void loraPoint2Point::startLinkChange (linkSettings_t const & settings,
+                                       bool const initiator,
+                                       bool const rendezvous)
 {
-  heartbeatTimer.start();
-  Serial.println("started heartbeats");
+  // Worked out on the settings the request went out on.
+  linkProbeSlackMillis = linkChangeReqSpanMillis();
+  linkChangeFallbackSettings = getLinkSettings();
+  applyLinkSettings(settings);
+  linkProbeInitiator = initiator;
+  linkProbeRendezvous = rendezvous;
+  if (isSameLinkSettings(getLinkSettings(), linkChangeFallbackSettings))
+  {
+    linkProbePassed(); // Nothing changed: the request was proof enough.
+    return;
+  }
+  startLinkProbing(linkFallback_previous);
 }
 
-void loraPoint2Point::stopHeartbeats ()
+void loraPoint2Point::startLinkProbing (linkFallback_t const fallback)
 {
-  heartbeatTimer.pause();
+  uint32_t periodMillis = linkProbePeriodMillis();
+  linkChangeState = linkChangeState_probing;
+  linkProbeFallback = fallback;
+  linkProbesLeft = LINK_PROBE_BURST_LEN;
+  linkProbeHeardPeer = false;
+  // Long enough for ends that moved at different points of the request's retries to overlap.
+  linkProbeWindowEndMillis = millis() + linkProbeSlackMillis + LINK_PROBE_BURST_LEN * periodMillis;
+  // The two ends probe half a period apart, so a probe and its answer do not collide.
+  tasks.start(linkProbeTask, millis(), linkProbeInitiator ? 0 : periodMillis / 2);
 }
 
-void loraPoint2Point::heartbeatReq ()
+void loraPoint2Point::linkProbeNext ()
+{
+  if (linkChangeState != linkChangeState_probing)
+  {
+    return;
+  }
+  if (linkProbesLeft > 0)
+  {
+    sendLinkProbe(linkChangePeer);
+    linkProbesLeft--;
+    uint32_t delayMillis = linkProbePeriodMillis();
+    if (linkProbesLeft == 0)
+    {
+      delayMillis = linkProbeWindowEndMillis - millis(); // Both ends give up at the same time.
+    }
+    tasks.start(linkProbeTask, millis(), delayMillis);
+    return;
+  }
+  switch (linkProbeFallback)
+  {
+    case linkFallback_previous:
+    {
+      LOG_WARNLN("Link change not confirmed, back to the previous settings.");
+      if (adrTrial)
+      {
+        // The faster setting did not even carry the probes.
+        adrTrial = false;
+        tasks.start(adrHoldoffTask, millis(), ADR_ROLLBACK_HOLDOFF_MILLIS);
+      }
+      applyLinkSettings(linkChangeFallbackSettings);
+      startLinkProbing(linkProbeRendezvous ? linkFallback_rendezvous : linkFallback_none);
+      break;
+    }
+    case linkFallback_rendezvous:
+    {
+      LOG_WARNLN("Previous settings not confirmed, moving to the rendezvous settings.");
+      linkSettings_t const rendezvousSettings = {LINK_RENDEZVOUS_SPREADING_FACTOR,
+                                                 LINK_RENDEZVOUS_SIGNAL_BANDWIDTH,
+                                                 LINK_RENDEZVOUS_FREQ_CHANNEL,
+                                                 LINK_RENDEZVOUS_TX_POWER_dBm};
+      applyLinkSettings(rendezvousSettings);
+      startLinkProbing(linkFallback_none);
+      break;
+    }
+    default:
+      LOG_WARNLN("Link change: peer not heard.");
+      linkChangeState = linkChangeState_idle;
+      break;
+  }
+}
+
+void loraPoint2Point::linkProbePassed ()
 {
-  uint8_t heartbeatBuf [] = {msgType_heartbeatReq,
-                             thisAddress};
-  serviceTx(RH_BROADCAST_ADDRESS, heartbeatBuf, 2, false);
+  LOG_INFOLN("Link confirmed on the new settings.");
+  linkChangeState = linkChangeState_idle;
+  tasks.stop(linkProbeTask);
+  peerSession_t * peerSession = findSession(linkChangePeer);
+  if (peerSession != NULL && peerSession->hasLinkSettings)
+  {
+    peerSession->linkSettings = getLinkSettings();
+  }
 }
 
-void loraPoint2Point::serviceHeartbeatReq (uint8_t const srcAddr)
+void loraPoint2Point::sendLinkProbe (uint8_t const destAddress,
+                                     uint8_t const numProbes)
 {
-  delay(50);
-  uint8_t heartbeatRspBuf [] = {msgType_heartbeatRsp,
-                                thisAddress};
-  serviceTx(srcAddr/*RH_BROADCAST_ADDRESS*/, heartbeatRspBuf, 2, false);
+  // Sent like an acknowlegement, ahead of whatever is queued: the peer only probes for so long.
+  linkProbesPending = numProbes;
+  linkProbePendingTo = destAddress;
+  linkProbeDeadlineMillis = millis();
+  serviceTxStateMachine();
 }
 
-void loraPoint2Point::serviceHeartbeatRsp (uint8_t const srcAddr)
+uint32_t loraPoint2Point::linkChangeReqSpanMillis ()
 {
-  
+  // Each attempt is the request, then up to twice the acknowlegement timeout (see ackTimeoutMillis).
+  uint32_t ackWaitMillis = 2 * (TX_ACK_TIMEOUT_MILLIS
+                                + loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                                       signalBandwidthTable[currentSignalBandwidth],
+                                                                       RH_RF95_HEADER_LEN + 1) / 1000);
+  uint32_t reqMillis = loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                            signalBandwidthTable[currentSignalBandwidth],
+                                                            RH_RF95_HEADER_LEN + 5) / 1000;
+  return TX_RETRIES * (reqMillis + ackWaitMillis) + ackWaitMillis;
 }
 
-void loraPoint2Point::serviceTimers ()
+uint32_t loraPoint2Point::linkProbePeriodMillis ()
+{
+  return LINK_PROBE_PERIOD_AIRTIMES
+         * loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                signalBandwidthTable[currentSignalBandwidth],
+                                                RH_RF95_HEADER_LEN + LINK_PROBE_LEN) / 1000
+         + LINK_PROBE_GUARD_MILLIS;
+}
+
+void loraPoint2Point::linkProbeNextTask (void * self)
+{
+  static_cast<loraPoint2Point *>(self)->linkProbeNext();
+}
+
+void loraPoint2Point::heartbeatReqTask (void * self)
+{
+  static_cast<loraPoint2Point *>(self)->heartbeatReq();
+}
+
+void loraPoint2Point::serviceLinkChangeReq (message_t const & rxMsg)
 {
-  currentMillis = millis();
-  linkChangeTimeoutTimer.update();
-  heartbeatTimer.update();
-  if (linkChangeTimeoutTimer.isDone())
+  LOG_INFOLN("Link change request received.");
+  msg_linkChangeReq_t req;
+  if (!req.unpack(rxMsg.buf, rxMsg.bufLen))
   {
-    linkChangeReqTimeout();
-    linkChangeTimeoutTimer.clearDone();
+    return;
   }
-  if (heartbeatTimer.isDone())
+  linkSettings_t const settings = {spreadingFactor_t (req.spreadingFactor),
+                                   signalBandwidth_t (req.signalBandwidth),
+                                   frequencyChannel_t(req.frequencyChannel),
+                                   req.txPower};
+  if (!isValidLinkSettings(settings))
   {
-    heartbeatReq();
-    heartbeatTimer.clearDone();
+    return;
   }
+  LOG_INFOLN("Attempting to change link to: ");
+  LOG_INFOLN("SF ", spreadingFactorTable[settings.spreadingFactor]);
+  LOG_INFOLN("BW ", signalBandwidthTable[settings.signalBandwidth], " Hz");
+  LOG_INFOLN("Channel ", float(frequencyChannelTable[settings.frequencyChannel])/10, " MHz");
+  LOG_INFOLN("TX power ", settings.txPower, " dBm");
+  // The acknowlegement has to go out on the old settings, so the change itself waits for serviceLinkChangeSwitching.
+  tasks.stop(linkProbeTask);
+  linkChangeSettings = settings;
+  linkChangePeer = rxMsg.srcAddr;
+  linkChangeState = linkChangeState_switching;
 }
 
-void loraPoint2Point::printBuffer (uint8_t const * buf,
-                                   uint8_t const bufLen)
+void loraPoint2Point::serviceLinkChangeSwitching ()
 {
-  switch (buf[0])
+  // A frame still waiting for the channel can just as well go out on the new settings.
+  if (linkChangeState != linkChangeState_switching
+      || ackPending
+      || txState == txState_transmitting
+      || txState == txState_waitAck
+      || rf95.mode() == RHGenericDriver::RHModeTx)
   {
-    case msgType_dataReq:
-    case msgType_dataRsp:
-      printBuffer(buf + 1, bufLen - 1, true);
-      break;
-    default:
-      printBuffer(buf + 1, bufLen - 1, false);
-      break;
+    return;
   }
+  startLinkChange(linkChangeSettings, false, true);
 }
 
-void loraPoint2Point::printBuffer (uint8_t const * buf,
-                                   uint8_t const bufLen,
-                                   bool const ascii)
+void loraPoint2Point::serviceLinkProbe (message_t const & rxMsg)
 {
-  if (ascii)
+  msg_linkProbe_t probe;
+  if (!probe.unpack(rxMsg.buf, rxMsg.bufLen)
+      || probe.peerAddress != thisAddress)
   {
-    for (uint8_t i = 0; i < bufLen; i++)
-    {
-      Serial.print(char(buf[i]));
-    }
+    return;
   }
-  else
+  linkSettings_t const settings = {spreadingFactor_t (probe.spreadingFactor),
+                                   signalBandwidth_t (probe.signalBandwidth),
+                                   frequencyChannel_t(probe.frequencyChannel),
+                                   probe.txPower};
+  if (linkChangeState == linkChangeState_probing
+      && rxMsg.srcAddr == linkChangePeer
+      && (probe.flags & LINK_PROBE_HEARD))
   {
-    Serial.print("0x");
-    for (uint8_t i = 0; i < bufLen; i++)
+    if (probe.flags & LINK_PROBE_SETTLED)
     {
-      if (buf[i] < 0x10)
-      {
-        Serial.print('0');
-      }
-      Serial.print(buf[i], HEX);
+      // The peer is staying where it is, and power aside that is where this unit is too: join it.
+      applyLinkSettings(settings);
+      linkProbePassed();
+    }
+    else if (isSameLinkSettings(settings, getLinkSettings()))
+    {
+      linkProbePassed();
     }
   }
+  if (!(probe.flags & LINK_PROBE_SETTLED))
+  {
+    // A lost answer costs the peer a probe period; a repeat costs one short airtime.
+    sendLinkProbe(rxMsg.srcAddr, LINK_PROBE_ANSWER_REPEATS);
+  }
 }
 
-void loraPoint2Point::serviceTx (uint8_t const destAddress)
+void loraPoint2Point::startHeartbeats ()
 {
-  serviceTx(destAddress, txMsg.buf, txMsg.bufLen, true);
-  txMsg.bufLen = 0;
+  tasks.start(heartbeatTask, millis(), HEARTBEAT_TIMEOUT_MILLIS, HEARTBEAT_TIMEOUT_MILLIS);
+  LOG_INFOLN("started heartbeats");
 }
 
-void loraPoint2Point::serviceTx (uint8_t const destAddress,
-                                 uint8_t * const buf,
-                                 uint8_t const bufLen,
-                                 bool const ascii)
+void loraPoint2Point::stopHeartbeats ()
+{
+  tasks.stop(heartbeatTask);
+}
+
+void loraPoint2Point::heartbeatReq ()
+{
+  msg_heartbeatReq_t req;
+  req.address = thisAddress;
+  uint8_t heartbeatBuf [msg_heartbeatReq_t::LEN];
+  serviceTx(RH_BROADCAST_ADDRESS, heartbeatBuf, req.pack(heartbeatBuf), false);
+}
+
+void loraPoint2Point::serviceHeartbeatReq (message_t const & rxMsg)
+{
+  msg_heartbeatRsp_t rsp;
+  rsp.address = thisAddress;
+  uint8_t heartbeatRspBuf [msg_heartbeatRsp_t::LEN];
+  queueTx(rxMsg.srcAddr/*RH_BROADCAST_ADDRESS*/, heartbeatRspBuf, rsp.pack(heartbeatRspBuf), false, 50);
+}
+
+void loraPoint2Point::serviceHeartbeatRsp (message_t const & rxMsg)
+{
+  
+}
+
+void loraPoint2Point::startAdr (uint8_t const destAddress)
+{
+  adrDestAddress = destAddress;
+  adrEnabled = true;
+  adrTrial = false;
+  LOG_INFOLN("Started ADR");
+}
+
+void loraPoint2Point::stopAdr ()
+{
+  adrEnabled = false;
+  adrTrial = false;
+}
+
+void loraPoint2Point::serviceAdr ()
 {
-  bool acknowleged = false;
-  if (bufLen > 0)
+  if (!adrEnabled
+      || adrStepPending
+      || linkChangeState != linkChangeState_idle
+      || txState != txState_idle
+      || packetCount < adrNextPacketCount)
   {
-    Serial.print("Attempting to transmit: \"");
-    printBuffer(buf + 1, bufLen - 1, ascii);
-    Serial.println("\"");
-    rf95.waitCAD();
-    #if (USE_RH_RELIABLE_DATAGRAM > 0)
-    if (rhReliableDatagram.sendtoWait(buf, bufLen, destAddress) == true)
+    return;
+  }
+  spreadingFactor_t spreadingFactor = currentSpreadingFactor;
+  int8_t txPower = currentTxPower;
+  bool trial = false;
+  // With nothing heard at all, only the packet error fraction says anything about the link.
+  int margin = linkSnrMin - demodulationFloorTable[currentSpreadingFactor];
+  if (packetErrorFraction > ADR_TARGET_PACKET_ERROR_FRACTION
+      || (linkSnrCount > 0 && margin < ADR_SNR_MARGIN_dB))
+  {
+    if (adrTrial)
     {
-      if (destAddress != RH_BROADCAST_ADDRESS) // never acknowleged
+      LOG_INFOLN("ADR: faster setting is worse, rolling back.");
+      spreadingFactor = adrRollbackSpreadingFactor;
+      txPower = adrRollbackTxPower;
+      tasks.start(adrHoldoffTask, millis(), ADR_ROLLBACK_HOLDOFF_MILLIS);
+    }
+    else if (currentTxPower < MAX_txPower)
+    {
+      txPower = MIN(currentTxPower + ADR_TX_POWER_STEP_dB, MAX_txPower);
+    }
+    else if (currentSpreadingFactor < spreadingFactor_sf12)
+    {
+      spreadingFactor = spreadingFactor_t(currentSpreadingFactor + 1);
+    }
+  }
+  else if (linkSnrCount > 0 && !tasks.isRunning(adrHoldoffTask))
+  {
+    if (currentSpreadingFactor > spreadingFactor_sf7)
+    {
+      int fasterMargin = linkSnrMin - demodulationFloorTable[currentSpreadingFactor - 1];
+      if (fasterMargin >= ADR_SNR_MARGIN_dB + ADR_SNR_HYSTERESIS_dB)
       {
-        Serial.println("Acknowleged!");
-        ackSnr = rf95.lastSNR();
-        Serial.print("ACK SNR: ");
-        Serial.println(ackSnr);
-        acknowleged = true;
-        updatePacketErrorFraction(acknowleged);
+        spreadingFactor = spreadingFactor_t(currentSpreadingFactor - 1);
+        trial = true;
+      }
+      else if (fasterMargin + ADR_TX_POWER_STEP_dB >= ADR_SNR_MARGIN_dB + ADR_SNR_HYSTERESIS_dB
+               && currentTxPower + ADR_TX_POWER_STEP_dB <= MAX_txPower)
+      {
+        // A little more power buys a spreading factor with half the airtime.
+        txPower = currentTxPower + ADR_TX_POWER_STEP_dB;
       }
     }
-    else
+    else if (margin - ADR_TX_POWER_STEP_dB >= ADR_SNR_MARGIN_dB + ADR_SNR_HYSTERESIS_dB
+             && currentTxPower - ADR_TX_POWER_STEP_dB >= MIN_txPower)
     {
-      Serial.println("Not acknowleged.");
-      updatePacketErrorFraction(acknowleged);
+      txPower = currentTxPower - ADR_TX_POWER_STEP_dB;
+      trial = true;
     }
-    #else // USE_RH_RELIABLE_DATAGRAM
-    rf95.send(buf, bufLen);
-    rf95.waitPacketSent();
-    Serial.println("Sent successfully!");
-    #endif  // USE_RH_RELIABLE_DATAGRAM
-    user.txInd(buf, bufLen, destAddress, acknowleged);
   }
-  else
+  adrTrial = false;
+  if (spreadingFactor == currentSpreadingFactor && txPower == currentTxPower)
+  {
+    return;
+  }
+  if (linkChangeReq(adrDestAddress,
+                    spreadingFactor,
+                    currentSignalBandwidth,
+                    currentFrequencyChannel,
+                    txPower))
   {
-    Serial.println("Nothing to transmit: TX buffer empty.");
+    adrStepPending = true;
+    adrTrial = trial;
+    adrRollbackSpreadingFactor = currentSpreadingFactor;
+    adrRollbackTxPower = currentTxPower;
   }
 }
 
-void loraPoint2Point::serviceRx ()
+void loraPoint2Point::startHopping (uint16_t const seed,
+                                    uint16_t const dwellMillis)
 {
-  serviceTimers();
-  if (
-      #if (USE_RH_RELIABLE_DATAGRAM > 0)
-      rhReliableDatagram.recvfromAckTimeout(rxMsg.buf,
-                                     &rxMsg.bufLen,
-                                     200,
-                                     &rxMsg.srcAddr,
-                                     &rxMsg.destAddr,
-                                     &rxMsg.msgId,
-                                     &rxMsg.flags)
-      #else // USE_RH_RELIABLE_DATAGRAM
-      rf95.recv(rxMsg.buf, &(rxMsg.bufLen))
-      #endif  // USE_RH_RELIABLE_DATAGRAM
-     )
-  {
-    user.rxInd(rxMsg);
-    Serial.print("RX SNR: ");
-    Serial.println(rf95.lastSNR());
-    Serial.print("Received: \"");
-    printBuffer(rxMsg.buf, rxMsg.bufLen);
-    Serial.println("\"");
-    switch (rxMsg.buf[0])
-    {
-      case msgType_dataReq:
-        break;
-      case msgType_dataRsp:
-        break;
-      case msgType_linkChangeReq:
-        serviceLinkChangeReq(rxMsg.srcAddr,
-                             spreadingFactor_t (rxMsg.buf[1]),
-                             signalBandwidth_t (rxMsg.buf[2]),
-                             frequencyChannel_t(rxMsg.buf[3]),
-                             int8_t            (rxMsg.buf[4]));
-        break;
-      case msgType_linkChangeRsp:
-        serviceLinkChangeRsp();
-        break;
-      case msgType_heartbeatReq:
-        serviceHeartbeatReq(rxMsg.srcAddr);
-        break;
-      case msgType_heartbeatRsp:
-        serviceHeartbeatRsp(rxMsg.srcAddr);
-        break;
-      default:
-        break;
-    }
-    updatePacketErrorFraction(true); // update to return false if a response to a request is not recieved
-    if (linkChangeTimeoutTimer.isRunning())
-    {
-      Serial.println(packetCount);
-      Serial.println(packetErrorCount);
-      linkChangeTimeoutTimer.reset();
-      if (packetCount - packetErrorCount > SUCCESSFUL_PACKETS_BEFORE_LINK_IS_TRUSTED)
-      {
-        linkChangeTimeoutTimer.pause();
-        linkChangeTimeoutTimer.clearDone();
-        serviceTimers();
-      }
-    }
-    rxMsg.bufLen = RH_RF95_MAX_MESSAGE_LEN;
+  hopSeed = seed;
+  hopDwellMillis = dwellMillis;
+  hopRendezvousChannel = currentFrequencyChannel;
+  buildHopSequence();
+  hopClockOffsetMillis = 0;
+  hopSynced = true;
+  hopBeaconSlot = 0xFFFFFFFF;
+  hopDwellWindowStartMillis = millis();
+  memset(hopDwellMicros, 0, sizeof(hopDwellMicros));
+  memset(hopPreviousDwellMicros, 0, sizeof(hopPreviousDwellMicros));
+  hopRole = hopRole_master;
+  LOG_INFOLN("Started hopping, seed ", seed, ", dwell ", dwellMillis, " ms");
+}
+
+void loraPoint2Point::joinHopping (uint8_t const masterAddress)
+{
+  hopMasterAddress = masterAddress;
+  hopRendezvousChannel = currentFrequencyChannel;
+  hopSynced = false;
+  hopDwellWindowStartMillis = millis();
+  memset(hopDwellMicros, 0, sizeof(hopDwellMicros));
+  memset(hopPreviousDwellMicros, 0, sizeof(hopPreviousDwellMicros));
+  hopRole = hopRole_node;
+  LOG_INFOLN("Waiting for hop sync from ", masterAddress);
+}
+
+void loraPoint2Point::stopHopping ()
+{
+  if (hopRole == hopRole_off)
+  {
+    return;
+  }
+  hopRole = hopRole_off;
+  hopSynced = false;
+  tuneFrequencyChannel(hopRendezvousChannel);
+  LOG_INFOLN("Stopped hopping.");
+}
+
+bool loraPoint2Point::isHopSynced ()
+{
+  return hopSynced;
+}
+
+uint32_t loraPoint2Point::getHopClockMillis ()
+{
+  return millis() + hopClockOffsetMillis;
+}
+
+frequencyChannel_t loraPoint2Point::getHopChannel (uint32_t const slot)
+{
+  return frequencyChannel_t(hopSequence[slot % NUM_frequencyChannels]);
+}
+
+uint32_t loraPoint2Point::getChannelDwellMicros (frequencyChannel_t const frequencyChannel)
+{
+  ageHopDwell();
+  // Any HOP_DWELL_WINDOW_MILLIS up to now lies within this window and the previous one.
+  return hopDwellMicros[frequencyChannel] + hopPreviousDwellMicros[frequencyChannel];
+}
+
+void loraPoint2Point::buildHopSequence ()
+{
+  for (uint8_t idx = 0; idx < NUM_frequencyChannels; idx++)
+  {
+    hopSequence[idx] = idx;
+  }
+  // Fisher-Yates, on a linear congruential generator so that both ends draw the same order from the seed.
+  uint32_t state = hopSeed;
+  for (uint8_t idx = NUM_frequencyChannels - 1; idx > 0; idx--)
+  {
+    state = state * 1103515245 + 12345;
+    uint8_t other = (state >> 16) % (idx + 1);
+    uint8_t swap = hopSequence[idx];
+    hopSequence[idx] = hopSequence[other];
+    hopSequence[other] = swap;
+  }
+  // Every cycle starts on the rendezvous channel, where nodes that are out of sync listen for beacons.
+  for (uint8_t idx = 1; idx < NUM_frequencyChannels; idx++)
+  {
+    if (hopSequence[idx] == hopRendezvousChannel)
+    {
+      hopSequence[idx] = hopSequence[0];
+      hopSequence[0] = hopRendezvousChannel;
+    }
+  }
+}
+
+void loraPoint2Point::tuneFrequencyChannel (frequencyChannel_t const frequencyChannel)
+{
+  rf95.setFrequency(float(frequencyChannelTable[frequencyChannel])/10);
+  rf95.setModeIdle(); // Required to update radio settings. Back in RX at the next serviceRx.
+  currentFrequencyChannel = frequencyChannel;
+}
+
+void loraPoint2Point::serviceHopping ()
+{
+  if (hopRole == hopRole_off)
+  {
+    return;
+  }
+  ageHopDwell();
+  if (hopRole == hopRole_node
+      && hopSynced
+      && millis() - hopLastSyncMillis > uint32_t(HOP_SYNC_TIMEOUT_CYCLES) * NUM_frequencyChannels * hopDwellMillis)
+  {
+    LOG_WARNLN("Lost hop sync.");
+    hopSynced = false;
+  }
+  uint32_t slot = getHopClockMillis() / hopDwellMillis;
+  frequencyChannel_t channel = hopSynced ? getHopChannel(slot) : hopRendezvousChannel;
+  if (channel != currentFrequencyChannel && rf95.mode() != RHGenericDriver::RHModeTx)
+  {
+    tuneFrequencyChannel(channel);
+  }
+  if (hopRole == hopRole_master
+      && slot % NUM_frequencyChannels == 0
+      && slot != hopBeaconSlot)
+  {
+    hopBeaconSlot = slot;
+    queueHopSyncInd(RH_BROADCAST_ADDRESS);
+  }
+}
+
+void loraPoint2Point::queueHopSyncInd (uint8_t const destAddress)
+{
+  // The hop clock is filled in as the beacon goes on air.
+  msg_hopSyncInd_t beacon;
+  beacon.clockMillis = 0;
+  beacon.seed = hopSeed;
+  beacon.dwellMillis = hopDwellMillis;
+  uint8_t beaconBuf [msg_hopSyncInd_t::LEN];
+  beacon.pack(beaconBuf);
+  queueTx(destAddress, beaconBuf, sizeof(beaconBuf), false, 0);
+}
+
+bool loraPoint2Point::serviceHopSlot (uint32_t const now)
+{
+  if (!hopSynced)
+  {
+    txDeadlineMillis = now + hopDwellMillis;
+    txCadStartMillis = txDeadlineMillis;
+    return false;
+  }
+  uint32_t clock = getHopClockMillis();
+  uint32_t slot = clock / hopDwellMillis;
+  uint32_t slotLeftMillis = hopDwellMillis - clock % hopDwellMillis;
+  if (txFrame.buf[0] == msgType_hopSyncInd
+      && txFrame.destAddr == RH_BROADCAST_ADDRESS
+      && slot % NUM_frequencyChannels != 0)
+  {
+    LOG_DEBUGLN("Missed the rendezvous slot, beacon dropped.");
+    completeTx(false);
+    return false;
+  }
+  uint32_t airtime = loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                          signalBandwidthTable[currentSignalBandwidth],
+                                                          RH_RF95_HEADER_LEN + txFrame.bufLen);
+  if (txFrame.destAddr != RH_BROADCAST_ADDRESS)
+  {
+    airtime += loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                    signalBandwidthTable[currentSignalBandwidth],
+                                                    RH_RF95_HEADER_LEN + 1);
+  }
+  if (airtime / 1000 + HOP_GUARD_MILLIS >= hopDwellMillis
+      || airtime > uint32_t(HOP_MAX_DWELL_MILLIS) * 1000)
+  {
+    LOG_WARNLN("Frame too long to send while hopping.");
+    completeTx(false);
+    return false;
+  }
+  if (currentFrequencyChannel == getHopChannel(slot)
+      && airtime / 1000 + HOP_GUARD_MILLIS < slotLeftMillis
+      && getChannelDwellMicros(currentFrequencyChannel) + airtime <= uint32_t(HOP_MAX_DWELL_MILLIS) * 1000)
+  {
+    return true;
+  }
+  // Try again on the next channel. Time spent waiting for a slot is not time the channel was busy.
+  txDeadlineMillis = now + slotLeftMillis + 1;
+  txCadStartMillis = txDeadlineMillis;
+  return false;
+}
+
+void loraPoint2Point::ageHopDwell ()
+{
+  uint32_t elapsed = millis() - hopDwellWindowStartMillis;
+  if (elapsed < HOP_DWELL_WINDOW_MILLIS)
+  {
+    return;
+  }
+  if (elapsed < 2 * HOP_DWELL_WINDOW_MILLIS)
+  {
+    memcpy(hopPreviousDwellMicros, hopDwellMicros, sizeof(hopDwellMicros));
+    hopDwellWindowStartMillis += HOP_DWELL_WINDOW_MILLIS;
+  }
+  else
+  {
+    memset(hopPreviousDwellMicros, 0, sizeof(hopPreviousDwellMicros));
+    hopDwellWindowStartMillis = millis();
+  }
+  memset(hopDwellMicros, 0, sizeof(hopDwellMicros));
+}
+
+void loraPoint2Point::serviceHopSyncInd (message_t const & rxMsg)
+{
+  msg_hopSyncInd_t beacon;
+  if (hopRole != hopRole_node
+      || rxMsg.srcAddr != hopMasterAddress
+      || !beacon.unpack(rxMsg.buf, rxMsg.bufLen))
+  {
+    return;
+  }
+  // Stamped when the beacon went on air, so the master's clock has moved on by its airtime since.
+  uint32_t masterClock = beacon.clockMillis
+                         + loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                                signalBandwidthTable[currentSignalBandwidth],
+                                                                RH_RF95_HEADER_LEN + rxMsg.bufLen) / 1000;
+  uint16_t seed = beacon.seed;
+  uint16_t dwellMillis = beacon.dwellMillis;
+  hopLastSyncMillis = millis();
+  if (hopSynced && seed == hopSeed && dwellMillis == hopDwellMillis)
+  {
+    int32_t correction = int32_t(masterClock - getHopClockMillis());
+    hopClockOffsetMillis += correction;
+    LOG_DEBUGLN("Hop clock corrected by ", correction, " ms");
+    return;
+  }
+  hopSeed = seed;
+  hopDwellMillis = dwellMillis;
+  hopRendezvousChannel = currentFrequencyChannel;
+  buildHopSequence();
+  hopClockOffsetMillis = masterClock - millis();
+  hopSynced = true;
+  LOG_INFOLN("Hop sync from ", rxMsg.srcAddr, ", seed ", seed);
+  uint8_t joinBuf [msg_hopJoinReq_t::LEN];
+  queueTx(rxMsg.srcAddr, joinBuf, msg_hopJoinReq_t().pack(joinBuf), false, 0);
+}
+
+void loraPoint2Point::serviceHopJoinReq (message_t const & rxMsg)
+{
+  if (hopRole != hopRole_master)
+  {
+    return;
+  }
+  LOG_INFOLN("Hop join from ", rxMsg.srcAddr);
+  // Answered on the spot, on the channel the joining unit is on, rather than at the start of the next cycle.
+  queueHopSyncInd(rxMsg.srcAddr);
+}
+
+void loraPoint2Point::startDutyCycledRx (uint16_t const listenPeriodMillis)
+{
+  dutyCyclePeriodMillis = listenPeriodMillis;
+  dutyCycleNextListenMillis = millis() + listenPeriodMillis;
+  dutyCycleAwakeUntilMillis = millis() + DUTY_CYCLE_LINGER_MILLIS;
+  LOG_INFOLN("Duty-cycling RX, listening every ", listenPeriodMillis, " ms");
+}
+
+void loraPoint2Point::stopDutyCycledRx ()
+{
+  if (dutyCyclePeriodMillis == 0)
+  {
+    return;
+  }
+  dutyCyclePeriodMillis = 0;
+  if (dutyCycleAsleep)
+  {
+    dutyCycleAsleep = false;
+    dutyCycleSniffing = false;
+    rf95.setModeIdle(); // Back in RX at the next serviceRx.
+  }
+  LOG_INFOLN("Stopped duty-cycling RX.");
+}
+
+bool loraPoint2Point::isRadioAsleep ()
+{
+  return dutyCycleAsleep;
+}
+
+bool loraPoint2Point::sleepReq (uint8_t const destAddress,
+                                uint16_t const listenPeriodMillis)
+{
+  if (findDutyCyclePeer(destAddress, true) == NULL)
+  {
+    LOG_WARNLN("Sleep request not sent: no room for another duty-cycled peer.");
+    return false;
+  }
+  msg_sleepRequest_t req;
+  req.listenPeriodMillis = listenPeriodMillis;
+  uint8_t sleepBuf [msg_sleepRequest_t::LEN];
+  return serviceTx(destAddress, sleepBuf, req.pack(sleepBuf), false);
+}
+
+bool loraPoint2Point::wakeReq (uint8_t const destAddress)
+{
+  uint8_t wakeBuf [msg_wakeRequest_t::LEN];
+  return serviceTx(destAddress, wakeBuf, msg_wakeRequest_t().pack(wakeBuf), false);
+}
+
+void loraPoint2Point::serviceSleepRequest (message_t const & rxMsg)
+{
+  msg_sleepRequest_t req;
+  if (req.unpack(rxMsg.buf, rxMsg.bufLen))
+  {
+    startDutyCycledRx(req.listenPeriodMillis);
+  }
+}
+
+void loraPoint2Point::serviceWakeRequest (message_t const & rxMsg)
+{
+  stopDutyCycledRx();
+}
+
+void loraPoint2Point::serviceDutyCycle ()
+{
+  if (dutyCyclePeriodMillis == 0)
+  {
+    return;
+  }
+  uint32_t now = millis();
+  if (ackPending
+      || bulkAckPending
+      || linkProbesPending > 0
+      || linkChangeState == linkChangeState_switching
+      || isTxBusy()
+      || rf95.mode() == RHGenericDriver::RHModeTx)
+  {
+    if (dutyCycleAsleep)
+    {
+      dutyCycleAsleep = false;
+      dutyCycleSniffing = false;
+      rf95.setModeIdle();
+    }
+    dutyCycleAwakeUntilMillis = now + DUTY_CYCLE_LINGER_MILLIS;
+    return;
+  }
+  if (!dutyCycleAsleep)
+  {
+    if (int32_t(now - dutyCycleAwakeUntilMillis) < 0)
+    {
+      return;
+    }
+    dutyCycleAsleep = true;
+  }
+  if (dutyCycleSniffing)
+  {
+    serviceDutyCycleSniff(now);
+    return;
+  }
+  if (int32_t(now - dutyCycleNextListenMillis) < 0)
+  {
+    if (rf95.mode() != RHGenericDriver::RHModeSleep)
+    {
+      rf95.sleep(); // Also after anything that idled the radio to change its settings.
+    }
+    return;
+  }
+  dutyCycleNextListenMillis += dutyCyclePeriodMillis;
+  if (int32_t(now - dutyCycleNextListenMillis) >= 0)
+  {
+    dutyCycleNextListenMillis = now + dutyCyclePeriodMillis; // Fell behind: don't make up for missed listens.
+  }
+  rf95.setModeIdle();
+  dutyCycleSniffMillis = now + startCad();
+  dutyCycleSniffing = true;
+}
+
+void loraPoint2Point::serviceDutyCycleSniff (uint32_t const now)
+{
+  bool channelActive = false;
+  if (int32_t(now - dutyCycleSniffMillis) < 0)
+  {
+    return;
+  }
+  if (!pollCad(channelActive))
+  {
+    dutyCycleSniffMillis = now + 1;
+    return;
+  }
+  dutyCycleSniffing = false;
+  if (!channelActive)
+  {
+    rf95.sleep();
+    return;
+  }
+  // A sender's preamble spans a whole listen period, so the frame ends within a period and its own airtime.
+  LOG_DEBUGLN("Preamble heard, listening.");
+  dutyCycleAsleep = false;
+  dutyCycleAwakeUntilMillis = now
+                              + dutyCyclePeriodMillis
+                              + loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                                     signalBandwidthTable[currentSignalBandwidth],
+                                                                     RH_RF95_HEADER_LEN + RH_RF95_MAX_MESSAGE_LEN) / 1000;
+  rf95.setModeRx();
+}
+
+dutyCyclePeer_t * loraPoint2Point::findDutyCyclePeer (uint8_t const address,
+                                                      bool const orUnused)
+{
+  dutyCyclePeer_t * unused = NULL;
+  for (uint8_t idx = 0; idx < DUTY_CYCLE_PEERS; idx++)
+  {
+    if (dutyCyclePeers[idx].listenPeriodMillis == 0)
+    {
+      unused = unused != NULL ? unused : &dutyCyclePeers[idx];
+    }
+    else if (dutyCyclePeers[idx].address == address)
+    {
+      return &dutyCyclePeers[idx];
+    }
+  }
+  return orUnused ? unused : NULL;
+}
+
+uint16_t loraPoint2Point::preambleLengthFor (uint8_t const destAddress)
+{
+  dutyCyclePeer_t const * peer = findDutyCyclePeer(destAddress);
+  if (peer == NULL
+      || int32_t(millis() - peer->awakeUntilMillis) < 0)
+  {
+    return RFM95_DFLT_PREAMBLE_LENGTH;
+  }
+  uint32_t symbolMicros = (uint32_t(1) << spreadingFactorTable[currentSpreadingFactor]) * 1000000UL
+                          / signalBandwidthTable[currentSignalBandwidth];
+  uint32_t symbols = uint32_t(peer->listenPeriodMillis) * 1000 / symbolMicros + 1 + RFM95_DFLT_PREAMBLE_LENGTH;
+  if (symbols > 0xFFFF)
+  {
+    LOG_WARNLN("Listen period of ", destAddress, " is longer than the longest preamble.");
+    symbols = 0xFFFF;
+  }
+  return uint16_t(symbols);
+}
+
+peerSession_t const * loraPoint2Point::getPeerSession (uint8_t const address)
+{
+  return findSession(address);
+}
+
+peerSession_t * loraPoint2Point::findSession (uint8_t const address,
+                                              bool const create)
+{
+  peerSession_t * unused = NULL;
+  peerSession_t * oldest = NULL;
+  for (uint8_t idx = 0; idx < PEER_SESSIONS; idx++)
+  {
+    peerSession_t * session = &sessions[idx];
+    if (!session->inUse)
+    {
+      unused = unused != NULL ? unused : session;
+    }
+    else if (session->address == address)
+    {
+      return session;
+    }
+    else if (!session->polled
+             && (oldest == NULL || int32_t(session->lastHeardMillis - oldest->lastHeardMillis) < 0))
+    {
+      oldest = session;
+    }
+  }
+  if (!create)
+  {
+    return NULL;
+  }
+  peerSession_t * session = unused != NULL ? unused : oldest;
+  if (session == NULL)
+  {
+    LOG_WARNLN("No session free for ", address);
+    return NULL;
+  }
+  memset(session, 0, sizeof(*session));
+  session->address = address;
+  session->inUse = true;
+  session->lastHeardMillis = millis();
+  return session;
+}
+
+bool loraPoint2Point::setPeerLinkSettings (uint8_t const address,
+                                           spreadingFactor_t const spreadingFactor,
+                                           signalBandwidth_t const signalBandwidth,
+                                           int8_t const txPower)
+{
+  peerSession_t * session = findSession(address, true);
+  if (session == NULL)
+  {
+    return false;
+  }
+  session->hasLinkSettings = true;
+  session->linkSettings = {spreadingFactor, signalBandwidth, currentFrequencyChannel, txPower};
+  return true;
+}
+
+bool loraPoint2Point::addPolledPeer (uint8_t const address)
+{
+  peerSession_t * session = findSession(address, true);
+  if (session == NULL)
+  {
+    return false;
+  }
+  session->polled = true;
+  return true;
+}
+
+void loraPoint2Point::removePolledPeer (uint8_t const address)
+{
+  peerSession_t * session = findSession(address);
+  if (session != NULL)
+  {
+    session->polled = false;
+  }
+}
+
+void loraPoint2Point::startPolling (uint16_t const slotMillis)
+{
+  pollSlotMillis = slotMillis;
+  if (!pollingActive)
+  {
+    pollOwnSettings = getLinkSettings();
+  }
+  pollingActive = true;
+  pollSlotActive = false;
+  tasks.start(pollTask, millis(), 0);
+  LOG_INFOLN("Started polling, ", slotMillis, " ms slots");
+}
+
+void loraPoint2Point::stopPolling ()
+{
+  if (!pollingActive)
+  {
+    return;
+  }
+  pollingActive = false;
+  pollSlotActive = false;
+  tasks.start(pollTask, millis(), 0); // Retunes once the transmitter is free.
+}
+
+bool loraPoint2Point::isPolling ()
+{
+  return pollingActive;
+}
+
+void loraPoint2Point::setPolledTx (bool const enable)
+{
+  polledTx = enable;
+  pollWindowOpen = false;
+  if (!enable && txState == txState_waitChannel)
+  {
+    txDeadlineMillis = millis(); // Held for a poll.
+  }
+}
+
+void loraPoint2Point::tuneLinkSettings (linkSettings_t const & settings)
+{
+  linkSettings_t settingsToTune = settings;
+  settingsToTune.frequencyChannel = currentFrequencyChannel;
+  writeLinkSettings(settingsToTune);
+}
+
+void loraPoint2Point::pollNextTask (void * self)
+{
+  static_cast<loraPoint2Point *>(self)->pollNext();
+}
+
+void loraPoint2Point::pollNext ()
+{
+  uint32_t now = millis();
+  if (txState != txState_idle
+      || ackPending
+      || rf95.mode() == RHGenericDriver::RHModeTx)
+  {
+    // The frame in flight, or its acknowlegement, is on the slot's settings.
+    tasks.start(pollTask, now, 10);
+    return;
+  }
+  if (!pollingActive)
+  {
+    tuneLinkSettings(pollOwnSettings);
+    return;
+  }
+  if (pollSlotActive && !pollHeard)
+  {
+    peerSession_t * session = &sessions[pollIndex];
+    session->pollsUnanswered += session->pollsUnanswered < 0xFF;
+  }
+  pollSlotActive = false;
+  peerSession_t * session = NULL;
+  for (uint8_t step = 1; step <= PEER_SESSIONS && session == NULL; step++)
+  {
+    uint8_t idx = (pollIndex + step) % PEER_SESSIONS;
+    if (sessions[idx].inUse && sessions[idx].polled)
+    {
+      pollIndex = idx;
+      session = &sessions[idx];
+    }
+  }
+  if (session == NULL)
+  {
+    tuneLinkSettings(pollOwnSettings);
+    tasks.start(pollTask, now, pollSlotMillis); // Look again later.
+    return;
+  }
+  linkSettings_t const & settings = session->hasLinkSettings ? session->linkSettings : pollOwnSettings;
+  tuneLinkSettings(settings);
+  // As many frames per slot on slower settings as on the base's own: scale the slot by the symbol time.
+  uint32_t slotMillis = (uint64_t(pollSlotMillis) << spreadingFactorTable[settings.spreadingFactor])
+                        * signalBandwidthTable[pollOwnSettings.signalBandwidth]
+                        / signalBandwidthTable[settings.signalBandwidth]
+                        >> spreadingFactorTable[pollOwnSettings.spreadingFactor];
+  pollSlotLenMillis = uint16_t(MIN(slotMillis, uint32_t(0xFFFF)));
+  msg_pollReq_t poll;
+  poll.peerAddress = session->address;
+  poll.slotMillis = pollSlotLenMillis;
+  uint8_t pollBuf [POLL_REQ_LEN];
+  if (!queueTx(RH_BROADCAST_ADDRESS, pollBuf, poll.pack(pollBuf), false, 0))
+  {
+    tasks.start(pollTask, now, pollSlotMillis);
+    return;
+  }
+  // The slot is timed from when the poll is off the air, in completeTx.
+  pollSlotActive = true;
+  pollHeard = false;
+  session->polls++;
+}
+
+void loraPoint2Point::servicePollReq (message_t const & rxMsg)
+{
+  msg_pollReq_t poll;
+  if (!polledTx
+      || !poll.unpack(rxMsg.buf, rxMsg.bufLen)
+      || poll.peerAddress != thisAddress)
+  {
+    return;
+  }
+  uint16_t slotMillis = poll.slotMillis;
+  pollWindowOpen = true;
+  pollWindowUnused = true;
+  pollWindowEndMillis = millis() + slotMillis - MIN(slotMillis, POLL_GUARD_MILLIS);
+  if (txState == txState_waitChannel)
+  {
+    txDeadlineMillis = millis(); // Held for this poll.
+  }
+  servicePolledTx();
+}
+
+void loraPoint2Point::servicePollEnd (message_t const & rxMsg)
+{
+  if (pollingActive
+      && pollSlotActive
+      && sessions[pollIndex].address == rxMsg.srcAddr
+      && tasks.isRunning(pollTask))
+  {
+    tasks.start(pollTask, millis(), 0);
+  }
+}
+
+void loraPoint2Point::servicePolledTx ()
+{
+  if (!pollWindowOpen)
+  {
+    return;
+  }
+  if (int32_t(millis() - pollWindowEndMillis) >= 0)
+  {
+    pollWindowOpen = false;
+    return;
+  }
+  if (ackPending
+      || bulkAckPending
+      || linkProbesPending > 0
+      || isTxBusy())
+  {
+    return;
+  }
+  // Nothing left: hand the rest of the slot back to the base.
+  pollWindowOpen = false;
+  uint8_t pollEndBuf [msg_pollEnd_t::LEN];
+  queueTx(RH_BROADCAST_ADDRESS, pollEndBuf, msg_pollEnd_t().pack(pollEndBuf), false, 0);
+}
+
+bool loraPoint2Point::servicePollWindow (uint32_t const now)
+{
+  if (pollWindowOpen)
+  {
+    uint32_t needMillis = TX_ACK_TIMEOUT_MILLIS
+                          + (loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                                  signalBandwidthTable[currentSignalBandwidth],
+                                                                  RH_RF95_HEADER_LEN + txFrame.bufLen)
+                             + loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                                    signalBandwidthTable[currentSignalBandwidth],
+                                                                    RH_RF95_HEADER_LEN + 1)) / 1000;
+    // A frame longer than a whole slot would wait forever: it goes at the start of one instead.
+    if (int32_t(pollWindowEndMillis - now) >= int32_t(needMillis) || pollWindowUnused)
+    {
+      pollWindowUnused = false;
+      return true;
+    }
+    pollWindowOpen = false; // Too little of the slot left for this frame. The base will see the slot out.
+  }
+  txDeadlineMillis = now + (TASK_SCHEDULER_IDLE_MILLIS >> 1); // Until the next poll.
+  return false;
+}
+
+bool loraPoint2Point::startBulkTx (uint8_t const destAddress,
+                                   bulkTxContext_t & context)
+{
+  if (bulkTxActive)
+  {
+    LOG_WARNLN("Bulk transfer already in progress.");
+    return false;
+  }
+  bulkTxActive = true;
+  bulkTxDestAddr = destAddress;
+  bulkTxTransferId++;
+  bulkTxPolls = 0;
+  bulkTxContext = &context;
+  bulkTxContext->frames.clear();
+  bulkTxFecGroupLen = bulkFecGroupLen;
+  bulkTxFecParity = bulkFecParity;
+  bulkTxParityPending = 0;
+  return true;
+}
+
+bool loraPoint2Point::bulkTx (uint8_t const * buf,
+                              uint8_t const bufLen,
+                              bool const last)
+{
+  if (!bulkTxActive
+      || bulkTxParityPending > 0
+      || (bulkTxFecParity > 0 && bufLen > BULK_FEC_MAX_PAYLOAD_LEN))
+  {
+    return false;
+  }
+  uint8_t seq = bulkTxContext->frames.getNextSeq();
+  if (!bulkTxContext->frames.push(buf, bufLen, last))
+  {
+    return false;
+  }
+  #if (BULK_FEC_MAX_PARITY > 0)
+  if (bulkTxFecParity > 0)
+  {
+    // The parity covers the payload length and flags as well, so that rebuilt frames come out whole.
+    uint8_t index = seq & (bulkTxFecGroupLen - 1);
+    uint8_t symbol [BULK_FEC_SYMBOL_LEN];
+    symbol[0] = bufLen;
+    symbol[1] = (last ? BULK_FLAG_LAST : 0) | bulkTxFecFlags();
+    if (bufLen > 0)
+    {
+      memcpy(symbol + 2, buf, bufLen);
+    }
+    if (index == 0)
+    {
+      bulkTxContext->fec.start(bulkTxFecParity);
+    }
+    bulkTxContext->fec.add(index, symbol, 2 + bufLen);
+    if (index == bulkTxFecGroupLen - 1 || last)
+    {
+      bulkTxParityPending = bulkTxContext->fec.getNumParity();
+      bulkTxParityGroup = seq - index;
+      bulkTxParityGroupLen = index + 1;
+    }
+  }
+  #endif // BULK_FEC_MAX_PARITY
+  serviceTxStateMachine();
+  return true;
+}
+
+void loraPoint2Point::stopBulkTx ()
+{
+  if (bulkTxActive)
+  {
+    if (isBulkTxFrame() && (txState == txState_waitChannel || txState == txState_cad || txState == txState_waitAck))
+    {
+      if (txState == txState_cad)
+      {
+        rf95.setModeIdle(); // Back in RX at the next serviceRx.
+      }
+      txState = txState_idle;
+    }
+    completeBulkTx(false);
+  }
+}
+
+uint8_t loraPoint2Point::getBulkTxSpace ()
+{
+  return (bulkTxActive && bulkTxParityPending == 0) ? bulkTxContext->frames.space() : 0;
+}
+
+bool loraPoint2Point::isBulkTxActive ()
+{
+  return bulkTxActive;
+}
+
+void loraPoint2Point::setBulkRx (bulkRxContext_t * const context)
+{
+  dropBulkRxFrames();
+  bulkAckPending = false;
+  bulkRxContext = context;
+  if (bulkRxContext != NULL)
+  {
+    bulkRxContext->frames.stop();
+    #if (BULK_FEC_MAX_PARITY > 0)
+    bulkRxContext->fec.start(0, 0);
+    #endif // BULK_FEC_MAX_PARITY
+  }
+}
+
+bool loraPoint2Point::setBulkFec (uint8_t const groupLen,
+                                  uint8_t const parityFrames)
+{
+  if (groupLen == 0
+      || groupLen > BULK_WINDOW_LEN
+      || (groupLen & (groupLen - 1)) != 0
+      || parityFrames > BULK_FEC_MAX_PARITY)
+  {
+    return false;
+  }
+  bulkFecGroupLen = groupLen;
+  bulkFecParity = parityFrames;
+  return true;
+}
+
+bool loraPoint2Point::isBulkTxFrame ()
+{
+  return txFrame.buf[0] == msgType_bulkData || txFrame.buf[0] == msgType_bulkParity;
+}
+
+uint8_t loraPoint2Point::bulkTxFecFlags ()
+{
+  if (bulkTxFecParity == 0)
+  {
+    return 0;
+  }
+  uint8_t log2GroupLen = 0;
+  while ((1 << log2GroupLen) < bulkTxFecGroupLen)
+  {
+    log2GroupLen++;
+  }
+  return uint8_t(((log2GroupLen + 1) << BULK_FLAG_FEC_GROUP_SHIFT) | (bulkTxFecParity << BULK_FLAG_FEC_PARITY_SHIFT));
+}
+
+bool loraPoint2Point::loadBulkTxFrame ()
+{
+  uint8_t seq;
+  bool data = bulkTxActive && bulkTxContext->frames.nextPending(seq);
+  if (!data && !(bulkTxActive && bulkTxParityPending > 0))
+  {
+    return false;
+  }
+  if (data)
+  {
+    bulkTxEntry_t<BULK_MAX_PAYLOAD_LEN> const & entry = bulkTxContext->frames.at(seq);
+    msg_bulkData_t header;
+    header.transferId = bulkTxTransferId;
+    header.seq = seq;
+    // Poll at the end of a burst: once the window is full, or the transfer has ended. The receiver can't get a word in while frames are still going out.
+    header.flags = (entry.last ? BULK_FLAG_LAST : 0)
+                   | bulkTxFecFlags()
+                   | (bulkTxContext->frames.countPending() == 1 && bulkTxParityPending == 0 && bulkTxContext->frames.space() == 0 ? BULK_FLAG_POLL : 0);
+    header.pack(txFrame.buf);
+    memcpy(txFrame.buf + BULK_HEADER_LEN, entry.buf, entry.bufLen);
+    txFrame.bufLen = BULK_HEADER_LEN + entry.bufLen;
+  }
+  #if (BULK_FEC_MAX_PARITY > 0)
+  else
+  {
+    // Parity goes out once the group's data has, and is never sent again: the data frames it stands for are.
+    uint8_t j = bulkTxContext->fec.getNumParity() - bulkTxParityPending;
+    bulkTxParityPending--;
+    msg_bulkParity_t header;
+    header.transferId = bulkTxTransferId;
+    header.group = bulkTxParityGroup;
+    header.flags = bulkTxFecFlags() | (bulkTxParityPending == 0 && bulkTxContext->frames.space() == 0 ? BULK_FLAG_POLL : 0);
+    header.parityIndex = j;
+    header.groupLen = bulkTxParityGroupLen;
+    header.pack(txFrame.buf);
+    memcpy(txFrame.buf + BULK_PARITY_HEADER_LEN, bulkTxContext->fec.getParity(j), bulkTxContext->fec.getParityLen());
+    txFrame.bufLen = BULK_PARITY_HEADER_LEN + bulkTxContext->fec.getParityLen();
+  }
+  #endif // BULK_FEC_MAX_PARITY
+  txFrame.destAddr = bulkTxDestAddr;
+  txFrame.msgId = ++txSequenceNumber;
+  txFrameAscii = false;
+  txFrameControl = false;
+  txAttempt = 0;
+  txCadStartMillis = millis();
+  txDeadlineMillis = txCadStartMillis;
+  txState = txState_waitChannel;
+  return true;
+}
+
+void loraPoint2Point::serviceBulkTxSent ()
+{
+  if (!bulkTxActive || txFrame.buf[1] != bulkTxTransferId)
+  {
+    txState = txState_idle; // Stopped while on air.
+    return;
+  }
+  if (txFrame.buf[0] == msgType_bulkData)
+  {
+    bulkTxContext->frames.markSent(txFrame.buf[2]);
+  }
+  if (txFrame.buf[3] & BULK_FLAG_POLL)
+  {
+    txDeadlineMillis = millis() + ackTimeoutMillis(BULK_ACK_LEN);
+    txState = txState_waitAck;
+    rf95.setModeRx();
+  }
+  else
+  {
+    txState = txState_idle;
+  }
+}
+
+void loraPoint2Point::serviceBulkTxTimeout ()
+{
+  txState = txState_idle;
+  if (!bulkTxActive || txFrame.buf[1] != bulkTxTransferId)
+  {
+    return;
+  }
+  if (++bulkTxPolls > BULK_TX_RETRIES)
+  {
+    LOG_WARNLN("Bulk transfer not acknowleged: giving up.");
+    completeBulkTx(false);
+    return;
+  }
+  if (txFrame.buf[3] & BULK_FLAG_POLL)
+  {
+    // Poll again with the oldest frame not acknowleged. Its acknowlegement will say what else is missing.
+    bulkTxContext->frames.resendOldest();
+  }
+}
+
+void loraPoint2Point::completeBulkTx (bool const success)
+{
+  bulkTxActive = false;
+  bulkTxContext = NULL;
+  bulkTxParityPending = 0;
+  if (user.bulkTxInd != NULL)
+  {
+    user.bulkTxInd(bulkTxDestAddr, success);
+  }
+}
+
+void loraPoint2Point::serviceBulkRx (message_t const & rxMsg)
+{
+  if (rxMsg.destAddr != thisAddress)
+  {
+    return;
+  }
+  if (rxMsg.buf[0] == msgType_bulkAck)
+  {
+    msg_bulkAck_t ack;
+    if (!bulkTxActive
+        || !ack.unpack(rxMsg.buf, rxMsg.bufLen)
+        || rxMsg.srcAddr != bulkTxDestAddr
+        || ack.transferId != bulkTxTransferId)
+    {
+      return;
+    }
+    if (bulkTxContext->frames.acknowlege(ack.cumulative, ack.bitmap))
+    {
+      bulkTxPolls = 0;
+    }
+    if (txState == txState_waitAck && isBulkTxFrame())
+    {
+      txState = txState_idle;
+    }
+    if (bulkTxContext->frames.isDone())
+    {
+      completeBulkTx(true);
+    }
+    return;
+  }
+  if (rxMsg.bufLen < (rxMsg.buf[0] == msgType_bulkParity ? BULK_PARITY_HEADER_LEN : BULK_HEADER_LEN))
+  {
+    return;
+  }
+  if (bulkRxContext == NULL)
+  {
+    return;
+  }
+  if (!bulkRxContext->frames.isTransfer(rxMsg.srcAddr, rxMsg.buf[1]))
+  {
+    dropBulkRxFrames();
+    bulkRxContext->frames.start(rxMsg.srcAddr, rxMsg.buf[1]);
+    #if (BULK_FEC_MAX_PARITY > 0)
+    bulkRxContext->fec.start(0, 0);
+    #endif // BULK_FEC_MAX_PARITY
+  }
+  if (rxMsg.buf[0] == msgType_bulkData)
+  {
+    deliverBulkData(rxMsg);
+  }
+  #if (BULK_FEC_MAX_PARITY > 0)
+  serviceBulkRxFec(rxMsg);
+  #endif // BULK_FEC_MAX_PARITY
+  if (rxMsg.buf[3] & BULK_FLAG_POLL)
+  {
+    bulkAckPending = true;
+    bulkAckPendingTo = rxMsg.srcAddr;
+    serviceTxStateMachine();
+  }
+}
+
+void loraPoint2Point::deliverBulkData (message_t const & rxMsg)
+{
+  bulkRxWindow<uint8_t, BULK_WINDOW_LEN> & window = bulkRxContext->frames;
+  if (rxMsg.buf[2] == window.getCumulative())
+  {
+    // Next in order: straight from the RX buffer, then any stored frames it was holding up.
+    deliverRx(rxMsg);
+    window.advance();
+    uint8_t const * slot;
+    while ((slot = window.nextStored()) != NULL)
+    {
+      // Handed over as if just received: the application may hold it, and it is given back if not.
+      message_t & next = rxPool.at(*slot);
+      rxPool.unhold(next);
+      window.advance();
+      deliverRx(next);
+      if (!rxPool.isHeld(next))
+      {
+        rxPool.release(next);
+      }
+    }
+  }
+  else if (window.canStore(rxMsg.buf[2]))
+  {
+    // Kept where it was received into. Without a buffer to spare it is dropped, and sent again.
+    int16_t slot = rxPool.indexOf(rxMsg);
+    if (slot >= 0 && rxPool.hold(rxMsg))
+    {
+      window.store(rxMsg.buf[2], uint8_t(slot));
+    }
+  }
+}
+
+void loraPoint2Point::dropBulkRxFrames ()
+{
+  if (bulkRxContext == NULL)
+  {
+    return;
+  }
+  uint8_t slot;
+  while (bulkRxContext->frames.takeStored(slot))
+  {
+    rxPool.release(rxPool.at(slot));
+  }
+}
+
+#if (BULK_FEC_MAX_PARITY > 0)
+void loraPoint2Point::serviceBulkRxFec (message_t const & rxMsg)
+{
+  uint8_t flags = rxMsg.buf[3];
+  uint8_t groupBits = (flags >> BULK_FLAG_FEC_GROUP_SHIFT) & 0x07;
+  uint8_t parityFrames = flags >> BULK_FLAG_FEC_PARITY_SHIFT;
+  if (groupBits == 0 || parityFrames == 0)
+  {
+    return;
+  }
+  uint8_t groupLen = 1 << (groupBits - 1);
+  uint8_t group = rxMsg.buf[0] == msgType_bulkParity ? rxMsg.buf[2] : rxMsg.buf[2] & ~(groupLen - 1);
+  if (!bulkRxContext->fec.isActive() || int8_t(group - bulkRxContext->fec.getGroup()) > 0)
+  {
+    bulkRxContext->fec.start(group, parityFrames); // One group at a time: the latest.
+  }
+  else if (!bulkRxContext->fec.isGroup(group))
+  {
+    return; // An earlier group, sent again.
+  }
+  if (rxMsg.buf[0] == msgType_bulkParity)
+  {
+    bulkRxContext->fec.addParity(rxMsg.buf[4], rxMsg.buf[5], rxMsg.buf + BULK_PARITY_HEADER_LEN, rxMsg.bufLen - BULK_PARITY_HEADER_LEN);
+  }
+  else
+  {
+    uint8_t symbol [BULK_FEC_SYMBOL_LEN];
+    uint8_t payloadLen = MIN(rxMsg.bufLen - BULK_HEADER_LEN, BULK_FEC_MAX_PAYLOAD_LEN);
+    symbol[0] = payloadLen;
+    symbol[1] = flags & ~BULK_FLAG_POLL;
+    memcpy(symbol + 2, rxMsg.buf + BULK_HEADER_LEN, payloadLen);
+    bulkRxContext->fec.addData(rxMsg.buf[2] - group, symbol, 2 + payloadLen);
+  }
+  if (!bulkRxContext->fec.canRecover())
+  {
+    return;
+  }
+  uint8_t lostIndices [BULK_FEC_MAX_PARITY];
+  uint8_t numLost = bulkRxContext->fec.recover(lostIndices);
+  for (uint8_t k = 0; k < numLost; k++)
+  {
+    uint8_t const * symbol = bulkRxContext->fec.getRecovered(k);
+    if (symbol[0] > BULK_FEC_MAX_PAYLOAD_LEN)
+    {
+      continue;
+    }
+    // Rebuilt into an RX buffer, so that it can be stored like a frame received. Without one it is sent again.
+    message_t * rebuilt = rxPool.acquire();
+    if (rebuilt == NULL)
+    {
+      return;
+    }
+    rebuilt->srcAddr = rxMsg.srcAddr;
+    rebuilt->destAddr = rxMsg.destAddr;
+    rebuilt->msgId = 0;
+    rebuilt->flags = RH_FLAGS_NONE;
+    msg_bulkData_t header;
+    header.transferId = rxMsg.buf[1];
+    header.seq = group + lostIndices[k];
+    header.flags = symbol[1];
+    header.pack(rebuilt->buf);
+    memcpy(rebuilt->buf + BULK_HEADER_LEN, symbol + 2, symbol[0]);
+    rebuilt->bufLen = BULK_HEADER_LEN + symbol[0];
+    deliverBulkData(*rebuilt);
+    if (!rxPool.isHeld(*rebuilt))
+    {
+      rxPool.release(*rebuilt);
+    }
+  }
+}
+#endif // BULK_FEC_MAX_PARITY
+
+uint32_t loraPoint2Point::ackTimeoutMillis (uint8_t const ackLen)
+{
+  // Allow for the acknowlegement's own airtime, which is far longer than TX_ACK_TIMEOUT_MILLIS at high spreading factors.
+  uint32_t ackTimeout = TX_ACK_TIMEOUT_MILLIS
+                        + loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                               signalBandwidthTable[currentSignalBandwidth],
+                                                               RH_RF95_HEADER_LEN + ackLen) / 1000;
+  return ackTimeout + random(0, ackTimeout);
+}
+
+void loraPoint2Point::serviceTimers ()
+{
+  tasks.run(millis());
+  serviceHopping();
+  serviceDutyCycle();
+  serviceAdr();
+  servicePolledTx();
+  serviceTxStateMachine();
+}
+
+void loraPoint2Point::printBuffer (uint8_t const * buf,
+                                   uint8_t const bufLen,
+                                   Print & port)
+{
+  switch (buf[0])
+  {
+    case msgType_dataReq:
+    case msgType_dataRsp:
+      printBuffer(buf + 1, bufLen - 1, true, port);
+      break;
+    default:
+      printBuffer(buf + 1, bufLen - 1, false, port);
+      break;
+  }
+}
+
+void loraPoint2Point::printBuffer (uint8_t const * buf,
+                                   uint8_t const bufLen,
+                                   bool const ascii,
+                                   Print & port)
+{
+  if (ascii)
+  {
+    for (uint8_t i = 0; i < bufLen; i++)
+    {
+      port.print(char(buf[i]));
+    }
+  }
+  else
+  {
+    port.print("0x");
+    for (uint8_t i = 0; i < bufLen; i++)
+    {
+      if (buf[i] < 0x10)
+      {
+        port.print('0');
+      }
+      port.print(buf[i], HEX);
+    }
+  }
+}
+
+bool loraPoint2Point::serviceTx (uint8_t const destAddress)
+{
+  if (!serviceTx(destAddress, txMsg.buf, txMsg.bufLen, true))
+  {
+    return false;
+  }
+  txMsg.bufLen = 0;
+  return true;
+}
+
+bool loraPoint2Point::serviceTx (uint8_t const destAddress,
+                                 uint8_t * const buf,
+                                 uint8_t const bufLen,
+                                 bool const ascii)
+{
+  return queueTx(destAddress, buf, bufLen, ascii, 0);
+}
+
+bool loraPoint2Point::isTxBusy ()
+{
+  return txState != txState_idle
+         || !txControlQueue.isEmpty()
+         || !txDataQueue.isEmpty()
+         || (bulkTxActive && (bulkTxContext->frames.countPending() > 0 || bulkTxParityPending > 0));
+}
+
+bool loraPoint2Point::isTxBackpressured ()
+{
+  return txBackpressured;
+}
+
+uint32_t loraPoint2Point::getMillisUntilNextDeadline ()
+{
+  uint32_t now = millis();
+  uint32_t wait = tasks.millisUntilNext(now);
+  if (ackPending
+      || bulkAckPending
+      || linkProbesPending > 0
+      || linkChangeState == linkChangeState_switching
+      || (txState == txState_idle && isTxBusy()))
+  {
+    return 0;
+  }
+  if (rf95.mode() == RHGenericDriver::RHModeTx)
+  {
+    int32_t left = int32_t(txEndMillis - now);
+    wait = MIN(wait, left > 0 ? uint32_t(left) : 0);
+  }
+  else if (txState == txState_transmitting)
+  {
+    return 0;
+  }
+  if (txState == txState_waitChannel || txState == txState_cad || txState == txState_waitAck)
+  {
+    int32_t left = int32_t(txDeadlineMillis - now);
+    wait = MIN(wait, left > 0 ? uint32_t(left) : 0);
+  }
+  if (hopRole != hopRole_off)
+  {
+    // Retune at the next slot boundary.
+    wait = MIN(wait, hopDwellMillis - getHopClockMillis() % hopDwellMillis);
+  }
+  if (dutyCyclePeriodMillis > 0)
+  {
+    if (!dutyCycleAsleep)
+    {
+      return 0; // Listening: frames are few and short-lived, so don't keep them waiting.
+    }
+    int32_t left = int32_t((dutyCycleSniffing ? dutyCycleSniffMillis : dutyCycleNextListenMillis) - now);
+    wait = MIN(wait, left > 0 ? uint32_t(left) : 0);
+  }
+  return wait;
+}
+
+uint8_t loraPoint2Point::getTxQueueSpace ()
+{
+  return txDataQueue.space();
+}
+
+bool loraPoint2Point::queueTx (uint8_t const destAddress,
+                               uint8_t const * const buf,
+                               uint8_t const bufLen,
+                               bool const ascii,
+                               uint16_t const holdoffMillis)
+{
+  if (bufLen == 0)
+  {
+    LOG_WARNLN("Nothing to transmit: TX buffer empty.");
+    return false;
+  }
+  if (bufLen > RH_RF95_MAX_MESSAGE_LEN)
+  {
+    LOG_WARNLN("Not transmitting: message too long.");
+    return false;
+  }
+  bool queued;
+  if (buf[0] < NUM_msgTypes && msgTypeQueues[buf[0]] == msgQueue_control)
+  {
+    queued = txControlQueue.push(destAddress, buf, bufLen, ascii, holdoffMillis);
+  }
+  else
+  {
+    queued = txDataQueue.push(destAddress, buf, bufLen, ascii, holdoffMillis);
+    updateTxBackpressure();
+  }
+  if (!queued)
+  {
+    LOG_WARNLN("Not transmitting: TX queue full.");
+    return false;
+  }
+  serviceTxStateMachine();
+  return true;
+}
+
+bool loraPoint2Point::loadNextTxFrame ()
+{
+  txQueueEntry_t<RH_RF95_MAX_MESSAGE_LEN> const * entry;
+  if (!txControlQueue.isEmpty())
+  {
+    entry = &txControlQueue.front();
+  }
+  else if (!txDataQueue.isEmpty())
+  {
+    entry = &txDataQueue.front();
+  }
+  else
+  {
+    return loadBulkTxFrame(); // Bulk data backfills what the queues leave of the channel.
+  }
+  #if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
+  LOG_DEBUG("Attempting to transmit: \"");
+  printBuffer(entry->buf + 1, entry->bufLen - 1, entry->ascii, loraLog::sink());
+  LOG_DEBUGLN("\"");
+  #endif // LOG_LEVEL
+  memcpy(txFrame.buf, entry->buf, entry->bufLen);
+  txFrame.bufLen = entry->bufLen;
+  txFrame.destAddr = entry->destAddr;
+  txFrame.msgId = ++txSequenceNumber;
+  txFrameAscii = entry->ascii;
+  txAttempt = 0;
+  txCadStartMillis = millis() + entry->holdoffMillis;
+  txDeadlineMillis = txCadStartMillis;
+  txState = txState_waitChannel;
+  txFrameControl = !txControlQueue.isEmpty();
+  if (txFrameControl)
+  {
+    txControlQueue.pop();
+  }
+  else
+  {
+    txDataQueue.pop();
+    updateTxBackpressure();
+  }
+  return true;
+}
+
+void loraPoint2Point::updateTxBackpressure ()
+{
+  bool backpressured = txBackpressured;
+  if (txDataQueue.count() >= TX_QUEUE_DATA_HIGH_WATERMARK)
+  {
+    backpressured = true;
+  }
+  else if (txDataQueue.count() <= TX_QUEUE_DATA_LOW_WATERMARK)
+  {
+    backpressured = false;
+  }
+  if (backpressured != txBackpressured)
+  {
+    txBackpressured = backpressured;
+    if (user.txBackpressureInd != NULL)
+    {
+      user.txBackpressureInd(txBackpressured);
+    }
+  }
+}
+
+void loraPoint2Point::startTransmission (uint8_t const destAddress,
+                                         uint8_t const msgId,
+                                         uint8_t const flags,
+                                         uint8_t const * buf,
+                                         uint8_t const bufLen)
+{
+  rf95.setHeaderTo(destAddress);
+  rf95.setHeaderFrom(thisAddress);
+  rf95.setHeaderId(msgId);
+  rf95.setHeaderFlags(flags, RH_FLAGS_ACK | RH_FLAGS_RETRY);
+  uint16_t preambleLength = (flags & RH_FLAGS_ACK) ? RFM95_DFLT_PREAMBLE_LENGTH : preambleLengthFor(destAddress);
+  if (preambleLength != txPreambleLength)
+  {
+    rf95.setPreambleLength(preambleLength);
+    txPreambleLength = preambleLength;
+  }
+  rf95.send(buf, bufLen); // Returns as soon as the radio is in TX mode.
+  uint32_t airtime = loraPoint2PointCommon::airtimeMicros(spreadingFactorTable[currentSpreadingFactor],
+                                                          signalBandwidthTable[currentSignalBandwidth],
+                                                          RH_RF95_HEADER_LEN + bufLen,
+                                                          5,
+                                                          preambleLength);
+  stats.recordTransmission(linkStatsKey(destAddress), airtime, flags & RH_FLAGS_ACK);
+  txEndMillis = millis() + (airtime + 999) / 1000;
+  if (hopRole != hopRole_off)
+  {
+    ageHopDwell();
+    hopDwellMicros[currentFrequencyChannel] += airtime;
+  }
+  if (!(flags & RH_FLAGS_ACK))
+  {
+    txAttemptStartMillis = millis();
+  }
+}
+
+uint32_t loraPoint2Point::startCad ()
+{
+  rf95.spiWrite(RH_RF95_REG_40_DIO_MAPPING1, 0x00); // DIO0 on RxDone, which CAD never raises.
+  rf95.spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+  rf95.spiWrite(RH_RF95_REG_01_OP_MODE, RH_RF95_MODE_CAD);
+  rf95.setMode(RHGenericDriver::RHModeCad);
+  uint32_t symbolMicros = (uint32_t(1) << spreadingFactorTable[currentSpreadingFactor]) * 1000000UL
+                          / signalBandwidthTable[currentSignalBandwidth];
+  return (2 * symbolMicros + 999) / 1000;
+}
+
+bool loraPoint2Point::pollCad (bool & active)
+{
+  if (rf95.mode() != RHGenericDriver::RHModeCad)
+  {
+    active = true;
+    return true;
+  }
+  uint8_t irqFlags = rf95.spiRead(RH_RF95_REG_12_IRQ_FLAGS);
+  if (!(irqFlags & RH_RF95_CAD_DONE))
+  {
+    return false;
+  }
+  rf95.spiWrite(RH_RF95_REG_12_IRQ_FLAGS, 0xff);
+  rf95.setModeIdle();
+  active = irqFlags & RH_RF95_CAD_DETECTED;
+  return true;
+}
+
+void loraPoint2Point::serviceTxStateMachine ()
+{
+  // completeTx calls back into the user, who may well call serviceTx or serviceRx.
+  if (txStateMachineActive)
+  {
+    return;
+  }
+  txStateMachineActive = true;
+  uint32_t now = millis();
+  if (rf95.mode() != RHGenericDriver::RHModeTx)
+  {
+    // Acknowlegements jump the queue: the other end is waiting for them.
+    if (ackPending)
+    {
+      static uint8_t const ackBuf [] = {'!'};
+      ackPending = false;
+      startTransmission(ackPendingTo, ackPendingId, RH_FLAGS_ACK, ackBuf, sizeof(ackBuf));
+    }
+    else if (bulkAckPending)
+    {
+      msg_bulkAck_t ack;
+      ack.transferId = bulkRxContext->frames.getTransferId();
+      ack.cumulative = bulkRxContext->frames.getCumulative();
+      ack.bitmap = bulkRxContext->frames.getBitmap();
+      uint8_t bulkAckBuf [BULK_ACK_LEN];
+      ack.pack(bulkAckBuf);
+      bulkAckPending = false;
+      startTransmission(bulkAckPendingTo, ++txSequenceNumber, RH_FLAGS_NONE, bulkAckBuf, sizeof(bulkAckBuf));
+    }
+    else if (linkProbesPending > 0 && int32_t(now - linkProbeDeadlineMillis) >= 0)
+    {
+      #if (USE_TX_CAD == true)
+      bool channelActive = false;
+      if (rf95.mode() != RHGenericDriver::RHModeCad)
+      {
+        startCad();
+      }
+      else if (!pollCad(channelActive))
+      {
+        // Still running.
+      }
+      else if (channelActive)
+      {
+        // Unlike an acknowlegement, nothing clears the channel for a probe.
+        linkProbeDeadlineMillis = now + random(1, 10) * linkProbePeriodMillis() / 10;
+      }
+      else
+      #endif // USE_TX_CAD
+      {
+        bool const probing = linkChangeState == linkChangeState_probing;
+        // Unless probing, a unit only sends probes in answer to one it heard.
+        msg_linkProbe_t probe;
+        probe.peerAddress = linkProbePendingTo;
+        probe.flags = (!probing || linkProbeHeardPeer ? LINK_PROBE_HEARD : 0)
+                      | (probing ? 0 : LINK_PROBE_SETTLED);
+        probe.spreadingFactor = currentSpreadingFactor;
+        probe.signalBandwidth = currentSignalBandwidth;
+        probe.frequencyChannel = currentFrequencyChannel;
+        probe.txPower = currentTxPower;
+        uint8_t linkProbeBuf [LINK_PROBE_LEN];
+        probe.pack(linkProbeBuf);
+        linkProbesPending--;
+        startTransmission(RH_BROADCAST_ADDRESS, ++txSequenceNumber, RH_FLAGS_NONE, linkProbeBuf, sizeof(linkProbeBuf));
+      }
+    }
+    else
+    {
+      serviceLinkChangeSwitching();
+      switch (txState)
+      {
+        case txState_idle:
+          if (!loadNextTxFrame())
+          {
+            break;
+          }
+          // fall through
+        case txState_waitChannel:
+          if (int32_t(now - txDeadlineMillis) < 0)
+          {
+            break;
+          }
+          if (hopRole != hopRole_off && !serviceHopSlot(now))
+          {
+            break;
+          }
+          if (polledTx && !txFrameControl && !servicePollWindow(now))
+          {
+            break;
+          }
+          #if (USE_TX_CAD == true)
+          txDeadlineMillis = now + startCad();
+          txState = txState_cad;
+          break;
+        case txState_cad:
+          {
+            bool channelActive = false;
+            if (int32_t(now - txDeadlineMillis) < 0)
+            {
+              break;
+            }
+            if (!pollCad(channelActive))
+            {
+              txDeadlineMillis = now + 1;
+              break;
+            }
+            if (channelActive)
+            {
+              if (int32_t(now - txCadStartMillis) > TX_CAD_TIMEOUT_MILLIS)
+              {
+                LOG_WARNLN("Channel busy: giving up.");
+                completeTx(false);
+                break;
+              }
+              txDeadlineMillis = now + random(1, 10) * 100; // Same backoff as RHGenericDriver::waitCAD.
+              txState = txState_waitChannel;
+              break;
+            }
+          }
+          #endif // USE_TX_CAD
+          msg_hopSyncInd_t beacon;
+          if (beacon.unpack(txFrame.buf, txFrame.bufLen))
+          {
+            beacon.clockMillis = getHopClockMillis();
+            beacon.pack(txFrame.buf);
+          }
+          startTransmission(txFrame.destAddr,
+                            txFrame.msgId,
+                            txAttempt > 0 ? RH_FLAGS_RETRY : RH_FLAGS_NONE,
+                            txFrame.buf,
+                            txFrame.bufLen);
+          txState = txState_transmitting;
+          break;
+        case txState_transmitting:
+          if (isBulkTxFrame())
+          {
+            serviceBulkTxSent();
+            break;
+          }
+          #if (USE_RH_RELIABLE_DATAGRAM > 0)
+          if (txFrame.destAddr != RH_BROADCAST_ADDRESS)
+          {
+            txDeadlineMillis = now + ackTimeoutMillis(1);
+            txState = txState_waitAck;
+            rf95.setModeRx();
+            break;
+          }
+          #endif // USE_RH_RELIABLE_DATAGRAM
+          completeTx(false);
+          break;
+        case txState_waitAck:
+          if (int32_t(now - txDeadlineMillis) < 0)
+          {
+            break;
+          }
+          if (isBulkTxFrame())
+          {
+            serviceBulkTxTimeout();
+          }
+          else if (txAttempt < TX_RETRIES)
+          {
+            txAttempt++;
+            txCadStartMillis = now;
+            txDeadlineMillis = now;
+            txState = txState_waitChannel;
+          }
+          else
+          {
+            completeTx(false);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  txStateMachineActive = false;
+}
+
+void loraPoint2Point::completeTx (bool const ack)
+{
+  if (isBulkTxFrame())
+  {
+    serviceBulkTxTimeout(); // Bulk frames are only ever acknowleged through serviceBulkRx.
+    return;
+  }
+  // Keep the next frame out of txFrame until this one has been reported.
+  bool wasActive = txStateMachineActive;
+  txStateMachineActive = true;
+  txState = txState_idle;
+  if (txFrame.destAddr != RH_BROADCAST_ADDRESS) // never acknowleged
+  {
+    #if (USE_RH_RELIABLE_DATAGRAM > 0)
+    if (ack)
+    {
+      LOG_DEBUGLN("Acknowleged!");
+      ackSnr = rf95.lastSNR();
+      updateLinkSnr(ackSnr);
+      LOG_DEBUGLN("ACK SNR: ", ackSnr);
+    }
+    else
+    {
+      LOG_DEBUGLN("Not acknowleged.");
+    }
+    updatePacketErrorFraction(ack);
+    stats.recordTxOutcome(linkStatsKey(txFrame.destAddr), ack, millis() - txAttemptStartMillis);
+    peerSession_t * session = findSession(txFrame.destAddr, true);
+    if (session != NULL)
+    {
+      session->txFrames++;
+      session->txFailures += !ack;
+    }
+    #else // USE_RH_RELIABLE_DATAGRAM
+    LOG_DEBUGLN("Sent successfully!");
+    #endif // USE_RH_RELIABLE_DATAGRAM
+  }
+  switch (txFrame.buf[0])
+  {
+    case msgType_linkChangeReq:
+    {
+      msg_linkChangeReq_t req;
+      req.unpack(txFrame.buf, txFrame.bufLen); // Checked by linkChangeReq.
+      linkSettings_t const settings = {spreadingFactor_t (req.spreadingFactor),
+                                       signalBandwidth_t (req.signalBandwidth),
+                                       frequencyChannel_t(req.frequencyChannel),
+                                       req.txPower};
+      if (ack)
+      {
+        LOG_INFOLN("Link change request acknowleged!");
+      }
+      else
+      {
+        // Only the acknowlegement may have been lost, so the server may have moved: look for it there too.
+        LOG_WARNLN("Link change request not acknowleged.");
+      }
+      linkChangePeer = txFrame.destAddr;
+      startLinkChange(settings, true, ack);
+      adrStepPending = false;
+      break;
+    }
+    case msgType_sleepRequest:
+    {
+      msg_sleepRequest_t req;
+      if (ack && req.unpack(txFrame.buf, txFrame.bufLen))
+      {
+        dutyCyclePeer_t * peer = findDutyCyclePeer(txFrame.destAddr, true);
+        if (peer != NULL)
+        {
+          peer->address = txFrame.destAddr;
+          peer->listenPeriodMillis = req.listenPeriodMillis;
+          peer->awakeUntilMillis = millis() + DUTY_CYCLE_LINGER_MILLIS / 2;
+        }
+      }
+      break;
+    }
+    case msgType_wakeRequest:
+      if (ack && findDutyCyclePeer(txFrame.destAddr) != NULL)
+      {
+        findDutyCyclePeer(txFrame.destAddr)->listenPeriodMillis = 0;
+      }
+      break;
+    case msgType_pollReq:
+      if (pollSlotActive)
+      {
+        tasks.start(pollTask, millis(), pollSlotLenMillis);
+      }
+      break;
+    case msgType_hopJoinReq:
+      if (ack)
+      {
+        LOG_INFOLN("Joined hopping.");
+      }
+      else if (hopRole == hopRole_node)
+      {
+        LOG_WARNLN("Hop join not acknowleged, resyncing.");
+        hopSynced = false;
+      }
+      break;
+    default:
+      break;
+  }
+  user.txInd(txFrame.buf, txFrame.bufLen, txFrame.destAddr, ack);
+  txStateMachineActive = wasActive;
+}
+
+void loraPoint2Point::serviceAck (uint8_t const srcAddress,
+                                  uint8_t const msgId)
+{
+  if ((txState == txState_waitAck || txState == txState_transmitting)
+      && srcAddress == txFrame.destAddr
+      && msgId == txFrame.msgId)
+  {
+    completeTx(true);
+  }
+}
+
+bool loraPoint2Point::holdRxFrame (message_t const & rxMsg)
+{
+  return rxPool.hold(rxMsg);
+}
+
+void loraPoint2Point::releaseRxFrame (message_t const & rxMsg)
+{
+  rxPool.release(rxMsg);
+}
+
+bool loraPoint2Point::setRxHandler (msgType_t const msgType,
+                                    rxHandler_t const handler,
+                                    void * const context)
+{
+  if (msgType >= NUM_msgTypes)
+  {
+    return false;
+  }
+  appRxHandlers[msgType] = handler;
+  appRxContexts[msgType] = context;
+  return true;
+}
+
+uint8_t loraPoint2Point::getRxFramesFree ()
+{
+  return rxPool.countFree();
+}
+
+void loraPoint2Point::serviceRx ()
+{
+  serviceTimers();
+  message_t * frame = rxPool.acquire();
+  if (frame == NULL)
+  {
+    // Only if a callback re-enters serviceRx while every other buffer is held. Leave the frame in the radio rather than lose it.
+    if (!rxPoolExhausted)
+    {
+      LOG_WARNLN("No RX buffer free.");
+      rxPoolExhausted = true;
+    }
+    return;
+  }
+  rxPoolExhausted = false;
+  frame->bufLen = RH_RF95_MAX_MESSAGE_LEN;
+  if (dutyCycleAsleep // recv would put the radio back into RX.
+      || rf95.mode() == RHGenericDriver::RHModeCad // And cut the CAD short.
+      || !rf95.recv(frame->buf, &frame->bufLen)) // Also puts the radio back into RX once a transmission is done.
+  {
+    rxPool.release(*frame);
+    loraLog::flush(Serial); // Nothing else to do.
+    return;
+  }
+  serviceRxFrame(*frame);
+  if (!rxPool.isHeld(*frame))
+  {
+    rxPool.release(*frame);
+  }
+}
+
+// The message types the library handles itself. The others are only for rxInd and the application's handlers.
+#define SERVICE_RX_HANDLER(msgType, handler)                                                  \
+  template <>                                                                                 \
+  constexpr loraPoint2Point::serviceRxHandler_t loraPoint2Point::serviceRxHandler<msgType> () \
+  {                                                                                           \
+    return &loraPoint2Point::handler;                                                         \
+  }
+
+SERVICE_RX_HANDLER(msgType_linkChangeReq, serviceLinkChangeReq)
+SERVICE_RX_HANDLER(msgType_linkProbe,     serviceLinkProbe)
+SERVICE_RX_HANDLER(msgType_wakeRequest,   serviceWakeRequest)
+SERVICE_RX_HANDLER(msgType_sleepRequest,  serviceSleepRequest)
+SERVICE_RX_HANDLER(msgType_heartbeatReq,  serviceHeartbeatReq)
+SERVICE_RX_HANDLER(msgType_heartbeatRsp,  serviceHeartbeatRsp)
+SERVICE_RX_HANDLER(msgType_hopSyncInd,    serviceHopSyncInd)
+SERVICE_RX_HANDLER(msgType_hopJoinReq,    serviceHopJoinReq)
+SERVICE_RX_HANDLER(msgType_bulkData,      serviceBulkRx)
+SERVICE_RX_HANDLER(msgType_bulkAck,       serviceBulkRx)
+SERVICE_RX_HANDLER(msgType_bulkParity,    serviceBulkRx)
+SERVICE_RX_HANDLER(msgType_pollReq,       servicePollReq)
+SERVICE_RX_HANDLER(msgType_pollEnd,       servicePollEnd)
+
+#define SERVICE_RX_HANDLERS_ENTRY(name, queue) serviceRxHandler<msgType_##name>(),
+
+loraPoint2Point::serviceRxHandler_t const loraPoint2Point::serviceRxHandlers [NUM_msgTypes] {LORA_P2P_MSG_TYPES(SERVICE_RX_HANDLERS_ENTRY)};
+
+void loraPoint2Point::serviceRxFrame (message_t & rxMsg)
+{
+  dutyCycleAwakeUntilMillis = millis() + DUTY_CYCLE_LINGER_MILLIS;
+  rxMsg.srcAddr = rf95.headerFrom();
+  rxMsg.destAddr = rf95.headerTo();
+  rxMsg.msgId = rf95.headerId();
+  rxMsg.flags = rf95.headerFlags();
+  stats.recordRx(linkStatsKey(rxMsg.srcAddr), rf95.lastSNR(), rf95.lastRssi(), rxMsg.flags & RH_FLAGS_ACK);
+  dutyCyclePeer_t * peer = findDutyCyclePeer(rxMsg.srcAddr);
+  if (peer != NULL)
+  {
+    peer->awakeUntilMillis = millis() + DUTY_CYCLE_LINGER_MILLIS / 2; // It lingers after sending.
+  }
+  if (linkChangeState == linkChangeState_probing && rxMsg.srcAddr == linkChangePeer)
+  {
+    linkProbeHeardPeer = true;
+  }
+  peerSession_t * session = findSession(rxMsg.srcAddr, true);
+  if (session != NULL)
+  {
+    session->lastHeardMillis = millis();
+    session->lastSnr = int8_t(rf95.lastSNR());
+    session->rxFrames++;
+    if (pollSlotActive && session == &sessions[pollIndex])
+    {
+      pollHeard = true;
+      session->pollsUnanswered = 0;
+    }
+  }
+  bool const bulk = rxMsg.buf[0] == msgType_bulkData
+                    || rxMsg.buf[0] == msgType_bulkAck
+                    || rxMsg.buf[0] == msgType_bulkParity; // Acknowleged, and delivered in order, by serviceBulkRx.
+  #if (USE_RH_RELIABLE_DATAGRAM > 0)
+  if (rxMsg.flags & RH_FLAGS_ACK)
+  {
+    serviceAck(rxMsg.srcAddr, rxMsg.msgId);
+    return;
+  }
+  if (rxMsg.destAddr == thisAddress && !bulk)
+  {
+    ackPending = true;
+    ackPendingTo = rxMsg.srcAddr;
+    ackPendingId = rxMsg.msgId;
+    serviceTxStateMachine();
+  }
+  if (session != NULL)
+  {
+    if ((rxMsg.flags & RH_FLAGS_RETRY) && session->rxSeenId == rxMsg.msgId)
+    {
+      return; // Duplicate: acknowleged again, but not delivered twice.
+    }
+    session->rxSeenId = rxMsg.msgId;
+  }
+  #endif  // USE_RH_RELIABLE_DATAGRAM
+  if (!bulk)
+  {
+    deliverRx(rxMsg);
+  }
+  #if (LOG_LEVEL >= LOG_LEVEL_DEBUG)
+  LOG_DEBUGLN("RX SNR: ", rf95.lastSNR());
+  LOG_DEBUG("Received: \"");
+  printBuffer(rxMsg.buf, rxMsg.bufLen, loraLog::sink());
+  LOG_DEBUGLN("\"");
+  #endif // LOG_LEVEL
+  if (rxMsg.buf[0] < NUM_msgTypes && serviceRxHandlers[rxMsg.buf[0]] != NULL)
+  {
+    (this->*serviceRxHandlers[rxMsg.buf[0]])(rxMsg);
+  }
+  if (rxMsg.buf[0] != msgType_linkProbe) // A burst of probes would drown out the frames ADR judges the settings by.
+  {
+    updatePacketErrorFraction(true); // update to return false if a response to a request is not recieved
+  }
+  updateLinkSnr(rf95.lastSNR());
+}
+
+void loraPoint2Point::deliverRx (message_t const & rxMsg)
+{
+  user.rxInd(rxMsg);
+  if (rxMsg.buf[0] < NUM_msgTypes && appRxHandlers[rxMsg.buf[0]] != NULL)
+  {
+    appRxHandlers[rxMsg.buf[0]](rxMsg, appRxContexts[rxMsg.buf[0]]);
   }
 }
 
@@ -13,10 +13,15 @@
 #define LORA_POINT_2_POINT_PROTOCOL_H
 #include <Arduino.h>
 //#include <list.h>
-#include <simpleTimer.h>
+#include <taskScheduler.h>
+#include <rxFramePool.h>
+#include <bulkTransfer.h>
+#include <erasureCode.h>
+#include <txQueue.h>
+#include <linkStats.h>
+#include <msgRegistry.h>
 #include <SPI.h>
 #include <RH_RF95.h>
-#include <RHReliableDatagram.h>
 
 // The default transmitter power is 13dBm, using PA_BOOST.
 // If you are using RFM95/96/97/98 modules which uses the PA_BOOST transmitter pin, then 
@@ -30,17 +35,187 @@
 #define MAX_txPower 20
 
 /**
- * @brief Millis to wait after sending a link change request before resetting radio settings if a link change response is not recieved.
+ * @brief Probes each end of a link change sends on a setting before falling back from it. See loraPoint2Point::linkChangeReq.
  * 
  */
-#define LINK_CHANGE_TIMEOUT_MILLIS 3000
+#define LINK_PROBE_BURST_LEN 4
+#define LINK_PROBE_PERIOD_AIRTIMES 4   ///< Probe period in probe airtimes, leaving room for the answer.
+#define LINK_PROBE_GUARD_MILLIS 100    ///< Added to the probe period.
+#define LINK_PROBE_ANSWER_REPEATS 2    ///< Probes sent back to back in answer to one.
+#define LINK_PROBE_LEN msg_linkProbe_t::LEN ///< msgType_linkProbe, the peer's address, LINK_PROBE_* flags and the sender's link settings.
+#define LINK_PROBE_HEARD   0x01        ///< The sender has heard the peer on these settings.
+#define LINK_PROBE_SETTLED 0x02        ///< The sender is not probing: no answer needed.
+/**
+ * @brief Settings both ends of a link change fall back to when neither the new nor the previous settings carry the link.
+ * 
+ */
+#define LINK_RENDEZVOUS_SPREADING_FACTOR spreadingFactor_sf10
+#define LINK_RENDEZVOUS_SIGNAL_BANDWIDTH signalBandwidth_125kHz
+#define LINK_RENDEZVOUS_FREQ_CHANNEL     RFM95_DFLT_FREQ_CHANNEL
+#define LINK_RENDEZVOUS_TX_POWER_dBm     MAX_txPower
 #define HEARTBEAT_TIMEOUT_MILLIS 7000
-#define SUCCESSFUL_PACKETS_BEFORE_LINK_IS_TRUSTED 3
+#define LORA_P2P_NUM_TASKS 4 ///< Link probes, heartbeats, ADR holdoff and poll slots.
+/**
+ * @brief Number of most recent packets getPacketErrorFraction is over. At most 32.
+ *
+ */
+#define PACKET_ERROR_WINDOW_LEN 6
+/**
+ * @brief Peer and radio setting combinations to keep link statistics for. See linkStats.
+ *
+ */
+#define LINK_STATS_ENTRIES 8
+/**
+ * @brief Receive buffers. The application can hold all but one of them; see loraPoint2Point::holdRxFrame.
+ *
+ */
+#define RX_FRAME_POOL_LEN 4
 
+/**
+ * @brief Acknowlege unicast frames and retry unacknowleged ones.
+ * 
+ * Frames use RHReliableDatagram's header, ACK and retry conventions, so either end may still be an RHReliableDatagram.
+ */
 #define USE_RH_RELIABLE_DATAGRAM true
+#define TX_ACK_TIMEOUT_MILLIS 200
+#define TX_RETRIES 3
+/**
+ * @brief Listen before talk: do channel activity detection before every transmission and back off while the channel is busy.
+ * 
+ */
+#define USE_TX_CAD true
+/**
+ * @brief Give up on a frame if the channel has been busy for this long.
+ * 
+ */
+#define TX_CAD_TIMEOUT_MILLIS 10000
+
+/**
+ * @brief Frames that can wait to be sent. Link change and heartbeat traffic has its own queue and always goes first.
+ * 
+ * Each slot holds a whole frame (about 130 bytes), so mind the RAM.
+ */
+#define TX_QUEUE_CONTROL_LEN 2
+#define TX_QUEUE_DATA_LEN    6
+/**
+ * @brief Backpressure is raised when this many data frames are queued...
+ * 
+ */
+#define TX_QUEUE_DATA_HIGH_WATERMARK 5
+/**
+ * @brief ...and released once the data queue has drained down to this many.
+ * 
+ */
+#define TX_QUEUE_DATA_LOW_WATERMARK  2
+
+/**
+ * @brief Adaptive data rate, see loraPoint2Point::startAdr. Highest packet error fraction at which the link may be made faster.
+ *
+ */
+#define ADR_TARGET_PACKET_ERROR_FRACTION 0.1
+/**
+ * @brief SNR to keep above the demodulation floor of the spreading factor. Below it the link is made slower.
+ *
+ */
+#define ADR_SNR_MARGIN_dB 5
+/**
+ * @brief Extra SNR margin the faster setting must have before stepping to it, so that the link does not flap between two settings.
+ *
+ */
+#define ADR_SNR_HYSTERESIS_dB 3
+#define ADR_TX_POWER_STEP_dB 3
+/**
+ * @brief Packets to count on a setting before judging it.
+ *
+ */
+#define ADR_PACKETS_PER_STEP 8
+/**
+ * @brief Millis to stay off faster settings after one has had to be rolled back.
+ *
+ */
+#define ADR_ROLLBACK_HOLDOFF_MILLIS 120000
+
+/**
+ * @brief Frequency hopping, see loraPoint2Point::startHopping. Default time spent on each channel of the hop sequence.
+ *
+ */
+#define HOP_DFLT_DWELL_MILLIS 400
+/**
+ * @brief Most airtime on any one channel within HOP_DWELL_WINDOW_MILLIS (FCC 15.247(a)(1)(i): 0.4s in 10s for 250kHz and wider channels).
+ *
+ */
+#define HOP_MAX_DWELL_MILLIS 400
+#define HOP_DWELL_WINDOW_MILLIS 10000
+/**
+ * @brief Time left unused at the end of each hop slot, for the acknowlegement turnaround and clock error between the two ends.
+ *
+ */
+#define HOP_GUARD_MILLIS 20
+/**
+ * @brief Hop sequence cycles without a sync beacon from the master after which a node falls back to the rendezvous channel to resync.
+ *
+ */
+#define HOP_SYNC_TIMEOUT_CYCLES 3
+
+/**
+ * @brief Duty-cycled receive, see loraPoint2Point::startDutyCycledRx. Millis a duty-cycled unit keeps listening after it last sent or received anything, for replies and follow-ups.
+ *
+ */
+#define DUTY_CYCLE_LINGER_MILLIS 500
+/**
+ * @brief Number of duty-cycled peers a unit can wake. See loraPoint2Point::sleepReq.
+ *
+ */
+#define DUTY_CYCLE_PEERS 4
+#define RFM95_DFLT_PREAMBLE_LENGTH 8
+
+/**
+ * @brief Peers to keep a session for, see loraPoint2Point::getPeerSession. A new peer takes the place of the one heard least recently that is not polled.
+ *
+ */
+#define PEER_SESSIONS 8
+/**
+ * @brief Polling, see loraPoint2Point::startPolling. Default length of each peer's slot.
+ *
+ */
+#define POLL_DFLT_SLOT_MILLIS 2000
+/**
+ * @brief Time a polled peer leaves unused at the end of its slot, for the base's turnaround to the next poll.
+ *
+ */
+#define POLL_GUARD_MILLIS 50
+#define POLL_REQ_LEN msg_pollReq_t::LEN ///< Message type, address of the polled peer and the slot length in millis (little-endian uint16).
+
+/**
+ * @brief Bulk transfer, see loraPoint2Point::startBulkTx. Frames that can be in flight unacknowleged: a power of two, at most BULK_MAX_WINDOW_LEN.
+ *
+ * The sender's window of whole frames is a bulkTxContext_t of its own, so only units that send bulk pay the RAM for it.
+ */
+#define BULK_WINDOW_LEN 8
+/**
+ * @brief Polls in a row that may go unanswered before a bulk transfer is given up on.
+ *
+ */
+#define BULK_TX_RETRIES 5
+#define BULK_HEADER_LEN msg_bulkData_t::LEN ///< Message type, transfer ID, sequence number and flags.
+#define BULK_MAX_PAYLOAD_LEN (RH_RF95_MAX_MESSAGE_LEN - BULK_HEADER_LEN)
+#define BULK_ACK_LEN msg_bulkAck_t::LEN ///< Message type, transfer ID, next sequence number expected and the bitmap of frames received after it (little-endian uint32).
+#define BULK_FLAG_LAST 0x01 ///< No frames follow this one.
+#define BULK_FLAG_POLL 0x02 ///< Acknowlege now: the sender is waiting.
+#define BULK_FLAG_FEC_GROUP_SHIFT 2  ///< Flags bits 2-4: log2 of the FEC group length plus one, 0 without FEC.
+#define BULK_FLAG_FEC_PARITY_SHIFT 5 ///< Flags bits 5-7: parity frames per FEC group.
+/**
+ * @brief Forward error correction of bulk transfers, see loraPoint2Point::setBulkFec. Most parity frames per group, at most 7.
+ *
+ * Each bulk context keeps this many frames of parity (sending) or syndromes (receiving), so mind the RAM. 0 leaves
+ * forward error correction out altogether.
+ */
+#define BULK_FEC_MAX_PARITY 4
+#define BULK_PARITY_HEADER_LEN msg_bulkParity_t::LEN ///< Message type, transfer ID, sequence number of the group's first frame, flags, parity index and number of data frames in the group.
+#define BULK_FEC_SYMBOL_LEN (RH_RF95_MAX_MESSAGE_LEN - BULK_PARITY_HEADER_LEN) ///< Payload length, flags and payload of a data frame: what the parity covers.
+#define BULK_FEC_MAX_PAYLOAD_LEN (BULK_FEC_SYMBOL_LEN - 2)
 
 #define DEBUG_MAKE_RF95_PUBLIC false
-#define DEBUG_MAKE_RELIABLE_DATAGRAM_PUBLIC false
 
 //--------
 // Macros
@@ -98,23 +273,65 @@ enum eventStatus_t
 };
 
 /**
- * @brief Enum of message types.
+ * @brief States of the asynchronous transmitter. See loraPoint2Point::serviceTxStateMachine.
+ * 
+ */
+enum txState_t
+{
+  txState_idle,         ///< Nothing to send.
+  txState_waitChannel,  ///< Holding off or backing off before CAD.
+  txState_cad,          ///< CAD running, polled until the radio raises CadDone.
+  txState_transmitting, ///< Frame on air.
+  txState_waitAck,      ///< Frame sent, listening for its acknowlegement.
+  NUM_txStates
+};
+
+/**
+ * @brief A duty-cycled peer, see loraPoint2Point::sleepReq.
+ *
+ */
+struct dutyCyclePeer_t
+{
+  uint8_t address;
+  uint16_t listenPeriodMillis; ///< 0 for an unused entry.
+  uint32_t awakeUntilMillis;   ///< Until when the peer is known to be listening anyway, after the last frame heard from it.
+};
+
+/**
+ * @brief Part a unit plays in frequency hopping. See loraPoint2Point::startHopping.
+ * 
+ */
+enum hopRole_t
+{
+  hopRole_off,    ///< Fixed frequency channel.
+  hopRole_master, ///< Keeps the hop clock and sends sync beacons.
+  hopRole_node,   ///< Follows a master's hop clock.
+  NUM_hopRoles
+};
+
+/**
+ * @brief Where a unit is in a link change. See loraPoint2Point::linkChangeReq.
  * 
- * @todo Implement wake and sleep requests.
+ */
+enum linkChangeState_t
+{
+  linkChangeState_idle,       ///< Settled.
+  linkChangeState_requesting, ///< Request queued or on the air; the settings change once it is acknowleged or its retries are spent.
+  linkChangeState_switching,  ///< Request received; the settings change once its acknowlegement is off the air.
+  linkChangeState_probing,    ///< On the new (or a fallback) settings, probing until the peer is heard.
+  NUM_linkChangeStates
+};
+
+/**
+ * @brief Settings a unit moves to if probing the current ones fails.
  * 
  */
-enum msgType_t
+enum linkFallback_t
 {
-  msgType_undefined,
-  msgType_dataReq,
-  msgType_dataRsp,
-  msgType_linkChangeReq,
-  msgType_linkChangeRsp,
-  msgType_wakeRequest,
-  msgType_sleepRequest,
-  msgType_heartbeatReq,
-  msgType_heartbeatRsp,
-  NUM_msgTypes
+  linkFallback_previous,   ///< The settings before the link change.
+  linkFallback_rendezvous, ///< The LINK_RENDEZVOUS_* settings.
+  linkFallback_none,       ///< Stay.
+  NUM_linkFallbacks
 };
 
 /**
@@ -203,9 +420,83 @@ enum frequencyChannel_t
  */
 frequencyChannel_t& operator++(frequencyChannel_t& f, int);
 
+/**
+ * @brief Radio settings of a link, applied together by loraPoint2Point::applyLinkSettings.
+ *
+ */
+struct linkSettings_t
+{
+  spreadingFactor_t spreadingFactor;
+  signalBandwidth_t signalBandwidth;
+  frequencyChannel_t frequencyChannel; ///< Polling keeps the unit's own channel whatever a peer's settings say.
+  int8_t txPower;
+};
+
+/**
+ * @brief Radio registers behind the link settings, in address order. Serves as indices to radioRegisterTable and radioShadow.
+ *
+ */
+enum radioRegister_t
+{
+  radioRegister_paConfig,
+  radioRegister_modemConfig1,
+  radioRegister_modemConfig2,
+  radioRegister_modemConfig3,
+  radioRegister_paDac,
+  NUM_radioRegisters
+};
+
+/**
+ * @brief What a unit keeps about one peer from frame to frame. See loraPoint2Point::getPeerSession.
+ *
+ */
+struct peerSession_t
+{
+  uint8_t address;
+  bool inUse;
+  bool polled;                 ///< Given a slot by startPolling.
+  bool hasLinkSettings;        ///< Its slots are on linkSettings rather than the unit's own settings, see setPeerLinkSettings.
+  linkSettings_t linkSettings;
+  uint8_t rxSeenId;            ///< ID of the last frame received from it, so that retries are not delivered twice.
+  uint32_t lastHeardMillis;
+  int8_t lastSnr;
+  uint32_t rxFrames;           ///< Frames heard from it, acknowlegements included.
+  uint32_t txFrames;           ///< Frames sent to it that asked for an acknowlegement...
+  uint32_t txFailures;         ///< ...and those that did not get one.
+  uint32_t polls;              ///< Slots it was polled for...
+  uint8_t pollsUnanswered;     ///< ...and the number in a row in which it was not heard.
+};
+
+/**
+ * @brief What a bulk transfer is sent from: the window of frames not acknowleged yet and the parity of the FEC group
+ * being sent. Owned by the caller of loraPoint2Point::startBulkTx, and in use until bulkTxInd.
+ *
+ */
+struct bulkTxContext_t
+{
+  bulkTxWindow<BULK_WINDOW_LEN, BULK_MAX_PAYLOAD_LEN> frames;
+  #if (BULK_FEC_MAX_PARITY > 0)
+  fecEncoder<BULK_FEC_MAX_PARITY, BULK_FEC_SYMBOL_LEN> fec;
+  #endif // BULK_FEC_MAX_PARITY
+};
+
+/**
+ * @brief What bulk transfers are received into: the frames that arrived ahead of a gap, by index into the unit's
+ * RX buffers, and the FEC group being rebuilt. See loraPoint2Point::setBulkRx.
+ *
+ */
+struct bulkRxContext_t
+{
+  bulkRxWindow<uint8_t, BULK_WINDOW_LEN> frames;
+  #if (BULK_FEC_MAX_PARITY > 0)
+  fecDecoder<BULK_FEC_MAX_PARITY, BULK_FEC_SYMBOL_LEN> fec;
+  #endif // BULK_FEC_MAX_PARITY
+};
+
 /**
  * @brief Struct of pointers to callback functions. This struct is defined in the file in which the loraPoint2Point object is constructed.
  * 
+ * Members added after linkChangeInd are optional: leave them out of the initializer (or set them to NULL) if unused.
  */
 struct userCallbacks_t
 {
@@ -213,13 +504,37 @@ struct userCallbacks_t
                  uint8_t const bufLen, 
                  uint8_t const destAddr, 
                  bool ack);
+  /**
+   * @brief Called with every message received. rxMsg is only valid until rxInd returns, unless it is held with loraPoint2Point::holdRxFrame.
+   *
+   */
   void (*rxInd) (message_t const & rxMsg);
   void (*linkChangeInd) (spreadingFactor_t const newSpreadingFactor,
                          signalBandwidth_t const newSignalBandwidth,
                          frequencyChannel_t const newFrequencyChannel,
                          int8_t const newTxPower);
+  /**
+   * @brief Called with true when the data TX queue reaches TX_QUEUE_DATA_HIGH_WATERMARK (stop reading the sensor) and with false once it has drained to TX_QUEUE_DATA_LOW_WATERMARK.
+   * 
+   */
+  void (*txBackpressureInd) (bool const backpressured);
+  /**
+   * @brief Called when a bulk transfer ends: with true once every frame has been acknowleged, with false if it was given up on or stopped.
+   *
+   */
+  void (*bulkTxInd) (uint8_t const destAddr,
+                     bool const success);
 };
 
+/**
+ * @brief Application handler for one message type, see loraPoint2Point::setRxHandler.
+ *
+ * @param rxMsg   The message, valid as for userCallbacks_t::rxInd.
+ * @param context As passed to setRxHandler.
+ */
+typedef void (* rxHandler_t) (message_t const & rxMsg,
+                              void * context);
+
 //-----------------------
 // Class Declarations
 //-----------------------
@@ -227,7 +542,7 @@ struct userCallbacks_t
 /**
  * @brief Class handling LoRa point to point communication using the RFM95 radio module.
  * @note This class currently only supports the US915 frequency band.
- * @warning This class currently does not support automatic frequency hopping! Solutions using this are not guaranteed to comply with all regulatory requirements. For North-American users, refer to section 15.247 of the FCC's title 47, volume 1 regulations. This may be found at: https://www.govinfo.gov/content/pkg/CFR-2013-title47-vol1/pdf/CFR-2013-title47-vol1-sec15-247.pdf
+ * @warning Frequency hopping (see startHopping) keeps the airtime on each channel within the 0.4s dwell limit, but the US915 channel table here has 16 channels, fewer than the 25 that section 15.247(a)(1)(i) asks of hopping systems. Solutions using this are not guaranteed to comply with all regulatory requirements. For North-American users, refer to section 15.247 of the FCC's title 47, volume 1 regulations. This may be found at: https://www.govinfo.gov/content/pkg/CFR-2013-title47-vol1/pdf/CFR-2013-title47-vol1-sec15-247.pdf
  * 
  * This class uses the RadioHead packet library by AirSpayce for point-to-point communication.
  * RadioHead's documentation and downloads may be found at: http://www.airspayce.com/mikem/arduino/RadioHead/
@@ -256,10 +571,8 @@ struct userCallbacks_t
  * 
  * @todo Support regions other than US915.
  * @todo Clean up class and put all members in alpabetical order.
- * @todo Add automatic frequency hopping.
  * @todo Add an option to use LoRaWAN or RadioHead's mesh networking system.
  * @todo Break out serial-port processing into a separate class.
- * @todo Add sleep and over-the-air wake functionality.
  * @todo Convert to Python module for CircuitPython users.
  * @todo Move enums and their operators into this class so that Doxygen documents them properly.
  */
@@ -283,19 +596,17 @@ class loraPoint2Point
                      ):
                        thisAddress{_thisAddress},
                        user{userCallbacks},
-                       rf95(rfm95CS, rfm95Int),
-                       rhReliableDatagram(rf95, _thisAddress)
+                       rf95(rfm95CS, rfm95Int)
                        {
-
+                         linkProbeTask = tasks.add(linkProbeNextTask, this);
+                         heartbeatTask = tasks.add(heartbeatReqTask, this);
+                         adrHoldoffTask = tasks.add(NULL, this);
+                         pollTask = tasks.add(pollNextTask, this);
                        }
     
     #if (DEBUG_MAKE_RF95_PUBLIC == true)
     RH_RF95 rf95;
     #endif // DEBUG_MAKE_RF95_PUBLIC
-    
-    #if (DEBUG_MAKE_RELIABLE_DATAGRAM_PUBLIC == true)
-    RHReliableDatagram rhReliableDatagram;
-    #endif // DEBUG_MAKE_RELIABLE_DATAGRAM_PUBLIC
 
     //------------------
     // Public functions
@@ -308,6 +619,21 @@ class loraPoint2Point
      */
     float const & getPacketErrorFraction ();
 
+    /**
+     * @brief Get the statistics of every peer and radio setting seen recently.
+     *
+     * @return linkStats<LINK_STATS_ENTRIES> const& The statistics table.
+     */
+    linkStats<LINK_STATS_ENTRIES> const & getLinkStats ();
+
+    /**
+     * @brief Get the statistics of a peer on the current radio settings.
+     *
+     * @param peerAddress              The address of the peer.
+     * @return linkStatsEntry_t const* Its statistics, or NULL if nothing has been exchanged with it on these settings yet.
+     */
+    linkStatsEntry_t const * getLinkStats (uint8_t const peerAddress);
+
     /**
      * @brief Get the signal to noise ratio of the last received radio transmission.
      * 
@@ -315,6 +641,13 @@ class loraPoint2Point
      */
     int getLastAckSNR ();
 
+    /**
+     * @brief Get the signal to noise ratio of the last frame received, acknowlegement or not.
+     * 
+     * @return int Signal to noise ratio, in dB.
+     */
+    int getLastRxSNR ();
+
     /**
      * @brief Get the radio's current spreading factor setting.
      * 
@@ -356,38 +689,56 @@ class loraPoint2Point
     bool setupRadio ();
     
     /**
-     * @brief Set the radio's frequency channel.
+     * @brief Get all of the radio's current link settings.
+     *
+     * @return linkSettings_t The current settings.
+     */
+    linkSettings_t getLinkSettings ();
+
+    /**
+     * @brief Set the radio's spreading factor, signal bandwidth, frequency channel and transmission power at once.
+     *
+     * The modem and PA registers are shadowed, so only those that change are written, with adjacent ones in a single SPI burst.
+     * The radio is retuned only if the channel changes; while hopping, the channel is left to the hop sequence. Triggers one link
+     * change indication to the user, and none if nothing changes.
+     *
+     * @param settings The settings to which you wish to set this radio.
+     * @return true    Applied, or already in place.
+     * @return false   A setting is invalid; nothing was changed.
+     */
+    bool applyLinkSettings (linkSettings_t const & settings);
+
+    /**
+     * @brief Set the radio's frequency channel. See applyLinkSettings.
      * 
-     * Invalid inputs set the radio to RFM95_DFLT_FREQ_CHANNEL. Triggers a link change indication to the user.
+     * Invalid inputs are ignored. Triggers a link change indication to the user.
      * 
      * @param frequencyChannel The frequency channel to which you wish to set this radio.
-     * 
-     * @todo Return instead of setting the radio to RFM95_DFLT_FREQ_CHANNEL. 
      */
     void setFrequencyChannel (frequencyChannel_t frequencyChannel);
 
     /**
-     * @brief Set the radio's spreading factor.
+     * @brief Set the radio's spreading factor. See applyLinkSettings.
      * 
-     * Invalid inputs set the radio to RFM95_DFLT_SPREADING_FACTOR. Triggers a link change indication to the user.
+     * Invalid inputs are ignored. Triggers a link change indication to the user.
      * 
      * @param spreadingFactor The spreading factor to which you wish to set this radio.
      */
     void setSpreadingFactor (spreadingFactor_t spreadingFactor);
 
     /**
-     * @brief Set the radio's signal bandwidth.
+     * @brief Set the radio's signal bandwidth. See applyLinkSettings.
      * 
-     * Invalid inputs set the radio to RFM95_DFLT_SIGNAL_BANDWIDTH. Triggers a link change indication to the user.
+     * Invalid inputs are ignored. Triggers a link change indication to the user.
      * 
      * @param bandwidth The signal bandwidth to which you wish to set this radio.
      */
     void setBandwidth (signalBandwidth_t bandwidth); 
 
     /**
-     * @brief Set the radio's transmission power.
+     * @brief Set the radio's transmission power. See applyLinkSettings.
      * 
-     * Invalid inputs set the radio to RFM95_DFLT_TX_POWER_dBm. Triggers a link change indication to the user.
+     * Invalid inputs are ignored. Triggers a link change indication to the user.
      * 
      * @param txPower The transmission power to which you wish to set this radio, in dBm.
      */
@@ -400,9 +751,8 @@ class loraPoint2Point
      * @param numChars      Number of bytes to copy from the array.
      * @return uint8_t      Number of bytes copied into the buffer.
      * 
-     * @warning **For debugging only.** Not guaranteed to be memory safe.
+     * Contents longer than the buffer are truncated. Call serviceTx to move the message into the TX queue before building the next one.
      * 
-     * @todo Smarter way of doing this to avoid clobbering the contents of the txMessage.
      * @todo Replace with data request in application.
      */
     uint8_t setTxMessage (uint8_t const * txMsgContents,
@@ -447,20 +797,24 @@ class loraPoint2Point
      * @param buf    Pointer to the array of bytes to print.
      * @param bufLen Number of bytes to print.
      * @param ascii  True: Prints buffer as characters. False: Prints buffer as hexadecimal number.
+     * @param port   Where to print it, e.g. loraLog::sink().
      */
     void printBuffer (uint8_t const * buf,
                       uint8_t const bufLen,
-                      bool const ascii);
+                      bool const ascii,
+                      Print & port = Serial);
     
     /**
      * @brief Quick way of printing an array of bytes. Assumes it has a message ID at index 0.
      * 
      * @param buf    Pointer to the array of bytes to print.
      * @param bufLen Number of bytes to print.
+     * @param port   Where to print it, e.g. loraLog::sink().
      * @overload
      */
     void printBuffer (uint8_t const * buf,
-                      uint8_t const bufLen);
+                      uint8_t const bufLen,
+                      Print & port = Serial);
     
     /**
      * @brief Start transmitting a brief 'heartbeat' signal to let any endpoints in the vicinity know that the base is still there.
@@ -475,113 +829,581 @@ class loraPoint2Point
     void stopHeartbeats ();
 
     /**
-     * @brief Transmits the current TX message's buffer contents to the specified destination.
-     * 
-     * @param destAddress The address of the destination, specified on that unit in the constructor of loraPoint2Point.
+     * @brief Start adapting the data rate of the link to the given unit. Run this on one end of the link only.
+     *
+     * Every ADR_PACKETS_PER_STEP packets, the worst SNR heard on the current settings (acknowlegements and received frames) and the packet error fraction are checked, and a link change is requested:
+     * - Faster, when the packet error fraction is within ADR_TARGET_PACKET_ERROR_FRACTION and the SNR clears the demodulation floor of the next spreading factor down by ADR_SNR_MARGIN_dB + ADR_SNR_HYSTERESIS_dB.
+     *   If it does not, but would with ADR_TX_POWER_STEP_dB more TX power, the TX power is raised first. At SF7, surplus SNR lowers the TX power instead.
+     * - Slower, when the packet error fraction is above target or the SNR is less than ADR_SNR_MARGIN_dB above the current floor: TX power up first, then spreading factor.
+     *
+     * A faster setting that turns out worse than the one it replaced is rolled back, and faster settings are left alone for ADR_ROLLBACK_HOLDOFF_MILLIS.
+     * The signal bandwidth and frequency channel are kept.
+     *
+     * @param destAddress The address of the other unit.
      */
-    void serviceTx (uint8_t destAddress);
-    
+    void startAdr (uint8_t const destAddress);
+
     /**
-     * @brief Transmits the current TX message's buffer contents to the specified destination.
-     * 
-     * @param destAddress The address of the destination, specified on that unit in the constructor of loraPoint2Point.
-     * @param buf         Pointer to the array of bytes to send.
-     * @param bufLen      Number of bytes to send.
-     * @param ascii       True: Sending ascii text. False: Sending binary data. Purely changes format of debug printing.
+     * @brief Stop adapting the data rate. The current settings are kept.
+     *
      */
-    void serviceTx (uint8_t const destAddress,
-                    uint8_t * const buf,
-                    uint8_t const bufLen,
-                    bool const ascii);
-    
+    void stopAdr ();
+
     /**
-     * @brief Checks if there is a pending message. 
-     * If so, acknowleges the message and calls the appropriate handler function.
-     * Also handles timer ticking.
-     * **Call this often to avoid missing messages.**
-     * 
+     * @brief Start hopping over all frequency channels, as the master that others follow. Run this on one end of the link only; the other calls joinHopping.
+     *
+     * Time is split into slots of dwellMillis, and slot n is spent on channel getHopChannel(n): a pseudo-random order of all the channels, drawn from seed, that starts every cycle on the current channel (the rendezvous channel).
+     * Frames only go out if they (and their acknowlegement) end HOP_GUARD_MILLIS before the slot does, and if the channel has airtime left within HOP_MAX_DWELL_MILLIS per HOP_DWELL_WINDOW_MILLIS; otherwise they wait for a later slot.
+     * At the start of every cycle the master broadcasts a sync beacon with its hop clock, the seed and the dwell time on the rendezvous channel.
+     * It also answers every join request with a beacon of its own, on the spot, so the joining unit's hop clock is corrected within the slot it joined in.
+     *
+     * linkChangeInd is not called for hops. Link changes keep their spreading factor, bandwidth and TX power, but not their frequency channel, while hopping.
+     *
+     * @param seed        Seed of the hop sequence.
+     * @param dwellMillis Length of a hop slot.
      */
-    void serviceRx ();
-    
+    void startHopping (uint16_t const seed,
+                       uint16_t const dwellMillis = HOP_DFLT_DWELL_MILLIS);
+
     /**
-     * @brief Requests a data message to be sent to a given destination.
-     * 
-     * @todo Complete prototype and definition.
+     * @brief Follow a master's hop sequence. Call on the master's current channel, which is its rendezvous channel.
+     *
+     * The unit listens on the rendezvous channel until it hears a sync beacon, takes the seed, dwell time and hop clock from it, and confirms with a join request on the hop sequence.
+     * If the join request is not acknowleged, or HOP_SYNC_TIMEOUT_CYCLES cycles go by without a beacon, it goes back to the rendezvous channel and waits for the next beacon.
+     * Every beacon also corrects the drift of the hop clock. Nothing but acknowlegements is sent while out of sync.
+     *
+     * @param masterAddress The address of the unit that called startHopping.
      */
-    void dataReq (uint8_t const  destAddress,
-                  uint8_t * const buf,
-                  uint8_t const  numChars);
-    
+    void joinHopping (uint8_t const masterAddress);
+
     /**
-     * @brief Requests that both the client and the server change their radio settings to those provided.
+     * @brief Stop hopping and go back to the rendezvous channel.
      *
-     * It works like this:
-     * 1. After recieving the request, the server acknowleges the transmission, changes its radio settings, and waits for a short delay.
-     * 2. Upon recieving the acknowlegement, the client changes its radio settings.
-     * 3. After both change their radio settings, the server sends a response to test the new link settings.
-     * 4. If the client does not recieve the response in 3 seconds, it reverts its settings.
-     * 5. Upon recieving the response, the client stops and resets the timer that will cause it to revert its settings on timeout.
-     * 6. If the server does not recieve the acknowlegement, the server reverts its settings.
-     * 
-     * @todo If the server does not recieve the response-acknowlegement, it should send an indication for the client to reset its radio settings before resetting its own settings. This will prevent a situation in which the client changes its settings but the server resets its own settings.
-     * 
-     * @param destAddress      The address of the other unit (the server) that should have its link changed.
-     * @param spreadingFactor  The new spreading factor (0-5) that both units should adopt.
-     * @param signalBandwidth  The new signal bandwidth (0-3) that both units should adopt.
-     * @param frequencyChannel The new frequency channel (0-15) that both units should adopt.
-     * @param txPower          The new transmission power (1-20dBm) that both units should adopt.
      */
-    void linkChangeReq  (uint8_t const            destAddress,
-                         spreadingFactor_t const  spreadingFactor,
-                         signalBandwidth_t const  signalBandwidth,
-                         frequencyChannel_t const frequencyChannel,
-                         int8_t const             txPower);
-    
+    void stopHopping ();
+
     /**
-     * @brief Advance and check all timers in loraPoint2Point.
-     * 
-     * This is automatically called in serviceRx, but if serviceRx is not called for whatever reason, call this regularly in the main loop.
+     * @brief Whether the hop clock is in sync with the master's. Always true on the master.
+     *
      */
-    void serviceTimers ();
-    
-    //sendLinkChangeRequest (uint8_t destAddr;
-    //                       spreadingFactor_t spreadingFactor,
-    //                       signalBandwidth_t signalBandwidth,
-    //                       int8_t txPower);
-    //checkForMessages ();
-    //sendSleepRequest (uint8_t destAddr);
-    //sendWakeRequest (uint8_t destAddr);
-    //goToSleep ();
+    bool isHopSynced ();
 
-  private:
+    /**
+     * @brief Get the hop clock: millis() on the master, and the master's millis() as best known on a node.
+     *
+     * @return uint32_t Hop clock, in millis.
+     */
+    uint32_t getHopClockMillis ();
 
-    //-------------------
-    // Private variables
-    //-------------------
+    /**
+     * @brief Get the channel of a hop slot.
+     *
+     * @param slot                Hop clock divided by the dwell time.
+     * @return frequencyChannel_t The channel hopped to in that slot.
+     */
+    frequencyChannel_t getHopChannel (uint32_t const slot);
 
-    int ackSnr = 0;
-    bool serialCommandMode = false;
-    uint8_t rfm95Rst = 4;
-    uint8_t thisAddress = 0;
-    spreadingFactor_t  currentSpreadingFactor  = RFM95_DFLT_SPREADING_FACTOR;
-    signalBandwidth_t  currentSignalBandwidth  = RFM95_DFLT_SIGNAL_BANDWIDTH;
-    frequencyChannel_t currentFrequencyChannel = RFM95_DFLT_FREQ_CHANNEL;
-    int8_t             currentTxPower          = RFM95_DFLT_TX_POWER_dBm;
-    spreadingFactor_t  previousSpreadingFactor  = currentSpreadingFactor;
-    signalBandwidth_t  previousSignalBandwidth  = currentSignalBandwidth;
-    frequencyChannel_t previousFrequencyChannel = currentFrequencyChannel;
-    int8_t             previousTxPower          = currentTxPower;
+    /**
+     * @brief Get the airtime used on a channel as counted for the dwell limit: at least that within the last HOP_DWELL_WINDOW_MILLIS, at most that within the last two.
+     *
+     * @param frequencyChannel The channel.
+     * @return uint32_t        Airtime, in microseconds.
+     */
+    uint32_t getChannelDwellMicros (frequencyChannel_t const frequencyChannel);
+
+    /**
+     * @brief Duty-cycle the receiver to save power: sleep the radio, and wake it every listenPeriodMillis for a channel activity detection (CAD) of about two symbols.
+     *
+     * If the CAD hears a preamble, the radio listens until the frame it belongs to has had time to end. After anything is sent or received, it keeps listening for DUTY_CYCLE_LINGER_MILLIS.
+     * Frames queued here are sent as usual, waking the radio. A sender reaches this unit by stretching the preamble over a whole listen period (see sleepReq), so a frame arrives at most a listen period and its own airtime after it is sent.
+     * Call serviceRx as usual; it leaves the radio asleep between listens. getMillisUntilNextDeadline says when the next listen is due.
+     * Usually started by a sleepRequest from the base rather than called directly.
+     *
+     * @param listenPeriodMillis Millis between listens.
+     */
+    void startDutyCycledRx (uint16_t const listenPeriodMillis);
+
+    /**
+     * @brief Stop duty-cycling and listen continuously again.
+     *
+     */
+    void stopDutyCycledRx ();
+
+    /**
+     * @brief Whether the radio is asleep between duty-cycled listens.
+     *
+     */
+    bool isRadioAsleep ();
+
+    /**
+     * @brief Ask an endpoint to duty-cycle its receiver (see startDutyCycledRx).
+     *
+     * Once it is acknowleged, frames to the endpoint go out with a preamble as long as the listen period, unless the endpoint was heard within the last DUTY_CYCLE_LINGER_MILLIS / 2 and so is still listening.
+     * The preamble is at most 65535 symbols, which covers 16.7s at SF7 and 500kHz and much more at higher spreading factors.
+     *
+     * @param destAddress        The endpoint.
+     * @param listenPeriodMillis Millis between its listens.
+     * @return true              Request queued.
+     * @return false             Not queued: the TX queue is full, or DUTY_CYCLE_PEERS endpoints are already duty-cycled.
+     */
+    bool sleepReq (uint8_t const destAddress,
+                   uint16_t const listenPeriodMillis);
+
+    /**
+     * @brief Ask a duty-cycled endpoint to listen continuously again. Sent with a long preamble, like any frame to it.
+     *
+     * @param destAddress The endpoint.
+     * @return true       Request queued.
+     * @return false      Not queued: the TX queue is full.
+     */
+    bool wakeReq (uint8_t const destAddress);
+
+    /**
+     * @brief Get what is known of a peer: its link settings, the state of its frames, statistics and polls.
+     *
+     * A session is started for every peer heard, and for those given settings or polled. There are PEER_SESSIONS of them.
+     *
+     * @param address               The peer's address.
+     * @return peerSession_t const* Its session, or NULL if there is none.
+     */
+    peerSession_t const * getPeerSession (uint8_t const address);
+
+    /**
+     * @brief Radio settings to poll a peer on, for peers that need a slower (or can take a faster) link than the others.
+     *
+     * The peer has to be on the same settings already, e.g. through linkChangeReq, which also updates them here once acknowleged.
+     *
+     * @param address         The peer's address.
+     * @param spreadingFactor Its spreading factor.
+     * @param signalBandwidth Its signal bandwidth.
+     * @param txPower         The TX power to reach it with, in dBm.
+     * @return true           Set.
+     * @return false          No session free: every one is polled.
+     */
+    bool setPeerLinkSettings (uint8_t const address,
+                              spreadingFactor_t const spreadingFactor,
+                              signalBandwidth_t const signalBandwidth,
+                              int8_t const txPower);
+
+    /**
+     * @brief Give a peer a slot in every polling round, see startPolling.
+     *
+     * @param address The peer's address.
+     * @return true   Added.
+     * @return false  No session free: every one is polled.
+     */
+    bool addPolledPeer (uint8_t const address);
+
+    void removePolledPeer (uint8_t const address);
+
+    /**
+     * @brief Serve the polled peers in turn instead of letting them all send at once, so that they do not collide (which they do even with CAD when they cannot hear each other).
+     *
+     * Each peer added with addPolledPeer gets a slot in turn, round robin. The slot starts with a broadcast poll, on the peer's own settings if it has any (see setPeerLinkSettings).
+     * It lasts slotMillis on the settings polling was started on, and longer in proportion to the symbol time on slower ones, so that every peer can send about as many frames per round.
+     * The peer sends what it has queued (see setPolledTx) until the slot is up, and says when it has nothing more, so that the next slot starts early.
+     * A peer with a lot to send therefore gets at most its share of the channel, and one with nothing gets a poll.
+     * Run this on the base only. Frames the base sends in the meantime go out on the settings of the slot in progress.
+     *
+     * @param slotMillis Longest slot of a peer.
+     */
+    void startPolling (uint16_t const slotMillis = POLL_DFLT_SLOT_MILLIS);
+
+    /**
+     * @brief Stop polling, and go back to the settings polling was started on once the frame in flight, if any, is done.
+     *
+     */
+    void stopPolling ();
+
+    bool isPolling ();
+
+    /**
+     * @brief Hold data and bulk frames until the base polls this unit (see startPolling), and only send those that fit in its slot.
+     *
+     * Link change, heartbeat and other control frames are not held.
+     *
+     * @param enable True to wait for polls, false to send as soon as the channel is free again.
+     */
+    void setPolledTx (bool const enable);
+
+    /**
+     * @brief Queues the current TX message's buffer contents for transmission to the specified destination.
+     * 
+     * The TX message buffer is copied into the TX queue and cleared, so the next message can be built straight away.
+     * It is left untouched if the frame was not queued.
+     * 
+     * @param destAddress The address of the destination, specified on that unit in the constructor of loraPoint2Point.
+     * @return true       Queued. The outcome is reported later through txInd.
+     * @return false      Not queued: the buffer is empty or the TX queue is full.
+     */
+    bool serviceTx (uint8_t destAddress);
+    
+    /**
+     * @brief Queues a frame for transmission to the specified destination and returns at once.
+     * 
+     * Link change and heartbeat frames go ahead of everything else; other frames are sent in the order they were queued.
+     * CAD, transmission, the wait for the acknowlegement and any retries are driven from serviceRx and serviceTimers.
+     * Completion is reported through txInd. The buffer is copied, so it may be reused as soon as this returns.
+     * 
+     * @param destAddress The address of the destination, specified on that unit in the constructor of loraPoint2Point.
+     * @param buf         Pointer to the array of bytes to send.
+     * @param bufLen      Number of bytes to send.
+     * @param ascii       True: Sending ascii text. False: Sending binary data. Purely changes format of debug printing.
+     * @return true       Queued.
+     * @return false      Not queued: the buffer is empty or too long, or the TX queue is full.
+     */
+    bool serviceTx (uint8_t const destAddress,
+                    uint8_t * const buf,
+                    uint8_t const bufLen,
+                    bool const ascii);
+    
+    /**
+     * @brief Whether a frame is still queued or in flight.
+     * 
+     * @return true  Frames are waiting to be sent or being sent.
+     * @return false The transmitter is idle and the TX queue is empty.
+     */
+    bool isTxBusy ();
+
+    /**
+     * @brief Millis until loraPoint2Point next has something to do, so that the main loop can sleep instead of spinning.
+     *
+     * A frame received in the meantime is held by the radio and picked up by the next serviceRx.
+     *
+     * @return uint32_t 0 if serviceRx or serviceTimers should be called again right away, or TASK_SCHEDULER_IDLE_MILLIS if nothing is pending at all.
+     */
+    uint32_t getMillisUntilNextDeadline ();
+
+    /**
+     * @brief Whether the data TX queue is above its high watermark. Stop reading sensor data until this clears.
+     * 
+     * @return true  Backpressure raised. See userCallbacks_t::txBackpressureInd.
+     * @return false Room for more data.
+     */
+    bool isTxBackpressured ();
+
+    /**
+     * @brief Number of data frames that can still be queued.
+     * 
+     * @return uint8_t Free slots in the data TX queue.
+     */
+    uint8_t getTxQueueSpace ();
+
+    /**
+     * @brief Start a bulk transfer to a unit, e.g. to send it the ProCV's logged data. Add the data with bulkTx.
+     *
+     * Instead of waiting for an acknowlegement after every frame, frames go out back to back, up to BULK_WINDOW_LEN unacknowleged at once.
+     * Once the window is full or the last frame has been added, the last frame of the burst asks for a selective acknowlegement, which says which frames have arrived; only the missing ones are sent again.
+     * Lossy links can add parity frames, see setBulkFec.
+     * Bulk frames go out when nothing else is queued. The receiver gets the frames through rxInd, in order and exactly once, with msgType_bulkData in buf[0], the flags in buf[3] and the payload from buf[BULK_HEADER_LEN].
+     * The receiver must have called setBulkRx. A unit receives one bulk transfer at a time: a frame of a new transfer drops the one in progress.
+     * The outcome is reported through bulkTxInd.
+     *
+     * @param destAddress The address of the destination.
+     * @param context     Holds the frames not acknowleged yet. It must outlive the transfer, until bulkTxInd.
+     * @return true       Started.
+     * @return false      A bulk transfer is already in progress.
+     */
+    bool startBulkTx (uint8_t const destAddress,
+                      bulkTxContext_t & context);
+
+    /**
+     * @brief Adds a frame to the bulk transfer. The buffer is copied, so it may be reused as soon as this returns.
+     *
+     * @param buf    Pointer to the array of bytes to send. May be NULL if bufLen is 0, to end a transfer whose last frame has already been added.
+     * @param bufLen Number of bytes to send, at most BULK_MAX_PAYLOAD_LEN.
+     * @param last   True if this ends the transfer.
+     * @return true  Added.
+     * @return false Not added: no transfer in progress, the frame is too long, or the window is full (see getBulkTxSpace).
+     */
+    bool bulkTx (uint8_t const * buf,
+                 uint8_t const bufLen,
+                 bool const last = false);
+
+    /**
+     * @brief Abandon the bulk transfer in progress. bulkTxInd is called with false.
+     *
+     */
+    void stopBulkTx ();
+
+    /**
+     * @brief Number of frames that can still be added to the bulk transfer.
+     *
+     */
+    uint8_t getBulkTxSpace ();
+
+    bool isBulkTxActive ();
+
+    /**
+     * @brief Receive bulk transfers (see startBulkTx) into context. Without one, bulk frames are ignored and never acknowleged.
+     *
+     * Frames that arrive ahead of a gap are kept in the RX buffers they were received into until the gap is filled,
+     * so they count against the buffers the application can hold (see holdRxFrame). When none is left, such frames
+     * are dropped and sent again.
+     *
+     * @param context Kept in use until setBulkRx is called again. NULL to stop receiving bulk transfers.
+     */
+    void setBulkRx (bulkRxContext_t * const context);
+
+    /**
+     * @brief Forward error correction for the bulk transfers started from now on, for links that lose too many frames for retransmission alone.
+     *
+     * After every groupLen data frames (and after the last one) the sender adds parityFrames parity frames, built with a Reed-Solomon style erasure code.
+     * The receiver can rebuild any parityFrames data frames of the group that it lost, without waiting for them to be sent again.
+     * This costs parityFrames / groupLen extra airtime on every transfer, and limits frames to BULK_FEC_MAX_PAYLOAD_LEN bytes.
+     * The receiver needs no setting: the data frames' flags describe the groups.
+     *
+     * @param groupLen     Data frames per group: a power of two, at most BULK_WINDOW_LEN.
+     * @param parityFrames Parity frames per group, at most BULK_FEC_MAX_PARITY. 0 turns forward error correction off.
+     * @return true        Set.
+     * @return false       Out of range.
+     */
+    bool setBulkFec (uint8_t const groupLen,
+                     uint8_t const parityFrames);
+
+    /**
+     * @brief Keeps a received message past the end of rxInd, without copying it, until releaseRxFrame. Call from rxInd.
+     *
+     * Lets slow consumers (an SD card, a sensor UART at 4800 baud) work through a message while the next ones are received into other buffers.
+     * One of the RX_FRAME_POOL_LEN buffers is always kept free for receiving. While the application holds all the others, received messages wait in the radio.
+     *
+     * @param rxMsg  The message passed to rxInd.
+     * @return true  Held: rxMsg stays valid and unchanged until released.
+     * @return false No buffer to spare; rxMsg is only valid until rxInd returns.
+     */
+    bool holdRxFrame (message_t const & rxMsg);
+
+    /**
+     * @brief Gives a message held with holdRxFrame back for receiving. rxMsg must not be used afterwards.
+     *
+     * @param rxMsg The held message.
+     */
+    void releaseRxFrame (message_t const & rxMsg);
+
+    /**
+     * @brief Calls handler with every message of this type received, right after rxInd. Bulk data reaches it in order, as it does rxInd.
+     *
+     * @param msgType The message type.
+     * @param handler The handler, or NULL to remove it.
+     * @param context Passed to handler.
+     * @return true   Set.
+     * @return false  Not a message type.
+     */
+    bool setRxHandler (msgType_t const msgType,
+                       rxHandler_t const handler,
+                       void * const context = NULL);
+
+    /**
+     * @brief Number of receive buffers that are not held by the application, including the one always kept free.
+     *
+     */
+    uint8_t getRxFramesFree ();
+    
+    /**
+     * @brief Checks if there is a pending message. 
+     * If so, acknowleges the message and calls the appropriate handler function.
+     * Also handles timer ticking and advances the transmitter. Never blocks waiting for the radio.
+     * **Call this often to avoid missing messages.**
+     * 
+     */
+    void serviceRx ();
+    
+    /**
+     * @brief Requests a data message to be sent to a given destination.
+     * 
+     * @todo Complete prototype and definition.
+     */
+    void dataReq (uint8_t const  destAddress,
+                  uint8_t * const buf,
+                  uint8_t const  numChars);
+    
+    /**
+     * @brief Requests that both the client and the server change their radio settings to those provided.
+     *
+     * The request is queued like any other frame; the steps below happen as serviceRx runs.
+     * 1. Prepare: the client sends the request on the current settings. The server acknowleges it and, once the
+     *    acknowlegement is off the air, moves to the new settings.
+     * 2. Commit: once the request is acknowleged, or its retries are spent (only the acknowlegement may have been lost),
+     *    the client moves to the new settings too. Both ends then probe: the client at once, the server half a probe
+     *    period later, with up to LINK_PROBE_BURST_LEN short broadcast msgType_linkProbe frames. The window they probe
+     *    for also allows for the request's retries, so the two ends overlap whichever attempt got through.
+     * 3. Confirm: a probe is answered with one saying the peer was heard. An end trusts the new settings as soon as it hears
+     *    it was heard by a peer on the same settings, so a change normally completes in three probe airtimes.
+     * 
+     * An end that gets no such answer by the end of its window falls back to the previous settings and probes there, and
+     * if that fails too, to the LINK_RENDEZVOUS_* settings; a client whose request went unacknowleged stops at the
+     * previous settings, as the server may never have had it. Both ends step down the same ladder at the same pace. A
+     * settled unit answers every probe it hears, and a probing unit that hears its settled peer joins it, so an end left
+     * behind is found where it stayed. A change to the current settings completes without probing.
+     * 
+     * @param destAddress      The address of the other unit (the server) that should have its link changed.
+     * @param spreadingFactor  The new spreading factor (0-5) that both units should adopt.
+     * @param signalBandwidth  The new signal bandwidth (0-3) that both units should adopt.
+     * @param frequencyChannel The new frequency channel (0-15) that both units should adopt.
+     * @param txPower          The new transmission power (1-20dBm) that both units should adopt.
+     * @return true            Request queued.
+     * @return false           Not queued: invalid settings, a link change is already under way or the TX queue is full.
+     */
+    bool linkChangeReq  (uint8_t const            destAddress,
+                         spreadingFactor_t const  spreadingFactor,
+                         signalBandwidth_t const  signalBandwidth,
+                         frequencyChannel_t const frequencyChannel,
+                         int8_t const             txPower);
+    
+    /**
+     * @brief Run any timed tasks of loraPoint2Point that are due, and advance the transmitter.
+     * 
+     * This is automatically called in serviceRx, but if serviceRx is not called for whatever reason, call this regularly in the main loop.
+     */
+    void serviceTimers ();
+
+    /**
+     * @brief Where this unit is in a link change. See linkChangeReq.
+     * 
+     * @return linkChangeState_t linkChangeState_idle once the link is settled.
+     */
+    linkChangeState_t getLinkChangeState ();
+    
+    //sendLinkChangeRequest (uint8_t destAddr;
+    //                       spreadingFactor_t spreadingFactor,
+    //                       signalBandwidth_t signalBandwidth,
+    //                       int8_t txPower);
+    //checkForMessages ();
+    //sendSleepRequest (uint8_t destAddr);
+    //sendWakeRequest (uint8_t destAddr);
+    //goToSleep ();
+
+  private:
+
+    //-------------------
+    // Private variables
+    //-------------------
+
+    int ackSnr = 0;
+    bool serialCommandMode = false;
+    uint8_t rfm95Rst = 4;
+    uint8_t thisAddress = 0;
+    spreadingFactor_t  currentSpreadingFactor  = RFM95_DFLT_SPREADING_FACTOR;
+    signalBandwidth_t  currentSignalBandwidth  = RFM95_DFLT_SIGNAL_BANDWIDTH;
+    frequencyChannel_t currentFrequencyChannel = RFM95_DFLT_FREQ_CHANNEL;
+    int8_t             currentTxPower          = RFM95_DFLT_TX_POWER_dBm;
+    spreadingFactor_t  previousSpreadingFactor  = currentSpreadingFactor;
+    signalBandwidth_t  previousSignalBandwidth  = currentSignalBandwidth;
+    frequencyChannel_t previousFrequencyChannel = currentFrequencyChannel;
+    int8_t             previousTxPower          = currentTxPower;
     message_t txMsg = {0, 0, 0, 0, 0};
-    message_t rxMsg = {0, 0, 0, 0, RH_RF95_MAX_MESSAGE_LEN};
+    rxFramePool<message_t, RX_FRAME_POOL_LEN> rxPool;
+    bool rxPoolExhausted = false;
     message_t serialCmd = {0, 0, 0, 0, 0};
     const uint8_t spreadingFactorTable [NUM_spreadingFactors] = {7, 8, 9, 10, 11, 12};
     const uint32_t signalBandwidthTable [NUM_signalBandwidths] = {125000, 250000, 500000};
+    const uint8_t signalBandwidthRegisterTable [NUM_signalBandwidths] = {RH_RF95_BW_125KHZ, RH_RF95_BW_250KHZ, RH_RF95_BW_500KHZ};
     const uint16_t frequencyChannelTable [NUM_frequencyChannels] = {9030, 9046, 9062, 9078, 9094, 9110, 9126, 9142, 9233, 9239, 9245, 9251, 9257, 9263, 9269, 9275};
-    uint32_t currentMillis = 0;
+    const uint8_t radioRegisterTable [NUM_radioRegisters] = {RH_RF95_REG_09_PA_CONFIG,
+                                                             RH_RF95_REG_1D_MODEM_CONFIG1,
+                                                             RH_RF95_REG_1E_MODEM_CONFIG2,
+                                                             RH_RF95_REG_26_MODEM_CONFIG3,
+                                                             RH_RF95_REG_4D_PA_DAC};
+    uint8_t radioShadow [NUM_radioRegisters];   ///< What the radio's link setting registers were last set to.
+    bool radioShadowValid = false;              ///< Once false, the next change writes every register and retunes.
     float packetErrorFraction = 0;
     uint32_t packetCount = 0;
     uint32_t packetErrorCount = 0;
-    uint16_t packetErrorMovingAvgPeriod = 6;
+    uint32_t packetErrorWindow = 0;
+    linkStats<LINK_STATS_ENTRIES> stats;
+    uint32_t txAttemptStartMillis = 0;
+    txState_t txState = txState_idle;
+    txQueue<TX_QUEUE_CONTROL_LEN, RH_RF95_MAX_MESSAGE_LEN> txControlQueue;
+    txQueue<TX_QUEUE_DATA_LEN, RH_RF95_MAX_MESSAGE_LEN> txDataQueue;
+    bool txBackpressured = false;
+    message_t txFrame = {0, 0, 0, 0, 0};
+    bool txFrameAscii = false;
+    uint8_t txAttempt = 0;
+    uint8_t txSequenceNumber = 0;
+    uint32_t txDeadlineMillis = 0;
+    uint32_t txCadStartMillis = 0;
+    uint32_t txEndMillis = 0; ///< When the frame on air should be done, from its airtime.
+    uint16_t txPreambleLength = RFM95_DFLT_PREAMBLE_LENGTH;
+    bool txStateMachineActive = false;
+    bool ackPending = false;
+    uint8_t ackPendingTo = 0;
+    uint8_t ackPendingId = 0;
+    bool txFrameControl = false; ///< txFrame came from the control queue.
+    peerSession_t sessions [PEER_SESSIONS];
+    linkChangeState_t linkChangeState = linkChangeState_idle;
+    uint8_t linkChangePeer = 0;
+    linkSettings_t linkChangeSettings;         ///< Requested by the peer, applied once switching is done.
+    linkSettings_t linkChangeFallbackSettings; ///< Settings before the link change.
+    linkFallback_t linkProbeFallback = linkFallback_none;
+    uint8_t linkProbesLeft = 0;
+    uint32_t linkProbeWindowEndMillis = 0;
+    uint32_t linkProbeSlackMillis = 0;  ///< Added to each probing window, see linkChangeReqSpanMillis.
+    bool linkProbeRendezvous = false;   ///< Fall back as far as the rendezvous: the peer is known to have had the request.
+    bool linkProbeInitiator = false; ///< Probes at the start of each period; the other end probes half way through.
+    bool linkProbeHeardPeer = false;
+    int linkSnrMin = 0;
+    uint32_t linkSnrCount = 0;
+    /**
+     * @brief Lowest SNR, in dB, at which the SX1276 demodulates each spreading factor (datasheet table 13), rounded up.
+     *
+     */
+    const int8_t demodulationFloorTable [NUM_spreadingFactors] = {-7, -10, -12, -15, -17, -20};
+    bool adrEnabled = false;
+    uint8_t adrDestAddress = 0;
+    bool adrStepPending = false;
+    uint32_t adrNextPacketCount = ADR_PACKETS_PER_STEP;
+    bool adrTrial = false;
+    spreadingFactor_t adrRollbackSpreadingFactor = currentSpreadingFactor;
+    int8_t            adrRollbackTxPower         = currentTxPower;
+    hopRole_t hopRole = hopRole_off;
+    uint8_t hopMasterAddress = 0;
+    uint16_t hopSeed = 0;
+    uint16_t hopDwellMillis = HOP_DFLT_DWELL_MILLIS;
+    frequencyChannel_t hopRendezvousChannel = RFM95_DFLT_FREQ_CHANNEL;
+    uint8_t hopSequence [NUM_frequencyChannels];
+    uint32_t hopClockOffsetMillis = 0;
+    bool hopSynced = false;
+    uint32_t hopLastSyncMillis = 0;
+    uint32_t hopBeaconSlot = 0xFFFFFFFF;
+    uint32_t hopDwellWindowStartMillis = 0;
+    uint32_t hopDwellMicros [NUM_frequencyChannels];         ///< Airtime per channel in the current dwell window...
+    uint32_t hopPreviousDwellMicros [NUM_frequencyChannels]; ///< ...and in the one before, which may still overlap the last HOP_DWELL_WINDOW_MILLIS.
+    uint16_t dutyCyclePeriodMillis = 0; ///< 0 while listening continuously.
+    bool dutyCycleAsleep = false;
+    uint32_t dutyCycleNextListenMillis = 0;
+    uint32_t dutyCycleAwakeUntilMillis = 0;
+    bool dutyCycleSniffing = false; ///< The CAD of a periodic listen is running.
+    uint32_t dutyCycleSniffMillis = 0; ///< When to poll that CAD.
+    dutyCyclePeer_t dutyCyclePeers [DUTY_CYCLE_PEERS];
+    bulkTxContext_t * bulkTxContext = NULL; ///< Of the transfer in progress.
+    bool bulkTxActive = false;
+    uint8_t bulkTxDestAddr = 0;
+    uint8_t bulkTxTransferId = 0;
+    uint8_t bulkTxPolls = 0; ///< Polls in a row that went unanswered.
+    uint8_t bulkFecGroupLen = 1;     ///< For the transfers started from now on...
+    uint8_t bulkFecParity = 0;       ///< ...0 without FEC.
+    uint8_t bulkTxFecGroupLen = 1;   ///< For the transfer in progress...
+    uint8_t bulkTxFecParity = 0;     ///< ...0 without FEC.
+    uint8_t bulkTxParityPending = 0; ///< Parity frames of the last group still to be sent. No data is added until they are.
+    uint8_t bulkTxParityGroup = 0;   ///< Sequence number of that group's first frame...
+    uint8_t bulkTxParityGroupLen = 0; ///< ...and its number of data frames.
+    bulkRxContext_t * bulkRxContext = NULL;
+    bool bulkAckPending = false;
+    uint8_t bulkAckPendingTo = 0;
+    uint8_t linkProbesPending = 0;
+    uint8_t linkProbePendingTo = 0;
+    uint32_t linkProbeDeadlineMillis = 0; ///< Channel busy: wait until then before trying again.
+    bool pollingActive = false;
+    uint16_t pollSlotMillis = POLL_DFLT_SLOT_MILLIS;
+    uint16_t pollSlotLenMillis = 0;  ///< Length of the slot in progress, scaled to its peer's settings.
+    uint8_t pollIndex = 0;           ///< Session of the slot in progress.
+    bool pollSlotActive = false;
+    bool pollHeard = false;          ///< Whether the peer of the slot in progress has been heard in it.
+    linkSettings_t pollOwnSettings;  ///< Settings polling was started on, for peers without their own.
+    bool polledTx = false;
+    bool pollWindowOpen = false;
+    bool pollWindowUnused = false;   ///< Nothing has been sent in this unit's slot yet.
+    uint32_t pollWindowEndMillis = 0;
 
     //-----------------
     // Private classes
@@ -591,18 +1413,14 @@ class loraPoint2Point
     RH_RF95 rf95;
     #endif // DEBUG_MAKE_RF95_PUBLIC
 
-    #if (DEBUG_MAKE_RELIABLE_DATAGRAM_PUBLIC == false)
-    RHReliableDatagram rhReliableDatagram;
-    #endif // DEBUG_MAKE_RELIABLE_DATAGRAM_PUBLIC
-
-    simpleTimer linkChangeTimeoutTimer = simpleTimer(LINK_CHANGE_TIMEOUT_MILLIS,
-                                                     currentMillis,
-                                                     false);
-    simpleTimer heartbeatTimer = simpleTimer(HEARTBEAT_TIMEOUT_MILLIS,
-                                             currentMillis,
-                                             true);
+    taskScheduler<LORA_P2P_NUM_TASKS> tasks;
+    taskId_t linkProbeTask;
+    taskId_t heartbeatTask;
+    taskId_t adrHoldoffTask; ///< Only marks time: faster settings are left alone while it runs.
+    taskId_t pollTask;       ///< Ends the slot in progress and polls the next peer.
     userCallbacks_t user;
-    //list<simpleTimer*> simpleTimerList;
+    rxHandler_t appRxHandlers [NUM_msgTypes] = {}; ///< See setRxHandler.
+    void * appRxContexts [NUM_msgTypes] = {};
     
     //-------------------
     // Private functions
@@ -618,14 +1436,14 @@ class loraPoint2Point
      * @brief Respond to the heartbeat signal with the address of this unit.
      * 
      */
-    void serviceHeartbeatReq (uint8_t srcAddr);
+    void serviceHeartbeatReq (message_t const & rxMsg);
     
     /**
      * @brief Perform some action in response to the response with the heartbeat signal.
      * 
-     * @param srcAddr The address of the unit that recieved the heartbeat.
+     * @param rxMsg The response, from the unit that recieved the heartbeat.
      */
-    void serviceHeartbeatRsp (uint8_t srcAddr);
+    void serviceHeartbeatRsp (message_t const & rxMsg);
     
     /**
      * @brief Processes input from the serial port.
@@ -644,17 +1462,356 @@ class loraPoint2Point
     void forceRadioReset ();
 
     /**
-     * @brief Resets radio settings to previous values if 3s have elapsed without recieving a link change response.
+     * @brief Whether every link setting is in range.
+     * 
+     */
+    bool isValidLinkSettings (linkSettings_t const & settings);
+    static bool isSameLinkSettings (linkSettings_t const & a,
+                                    linkSettings_t const & b);
+
+    /**
+     * @brief Moves to the settings of a link change and starts probing them for linkChangePeer, see linkChangeReq.
+     * 
+     * @param settings   The new settings.
+     * @param initiator  This unit sent the request.
+     * @param rendezvous Fall back as far as the rendezvous settings if the previous ones fail too.
+     */
+    void startLinkChange (linkSettings_t const & settings,
+                          bool const initiator,
+                          bool const rendezvous);
+
+    /**
+     * @brief Starts probing the current settings for the link change peer, see linkChangeReq.
+     * 
+     * @param fallback Where to go if the burst goes unanswered.
+     */
+    void startLinkProbing (linkFallback_t const fallback);
+
+    /**
+     * @brief Sends the next probe of the burst or, once the burst is over without an answer, falls back.
+     * 
+     */
+    void linkProbeNext ();
+
+    /**
+     * @brief The peer has heard this unit on the current settings: the link change is done.
+     * 
+     */
+    void linkProbePassed ();
+
+    /**
+     * @brief Sends probes to a peer as soon as the radio is free, ahead of the TX queues.
+     * 
+     * @param destAddress The peer.
+     * @param numProbes   How many, back to back.
+     */
+    void sendLinkProbe (uint8_t const destAddress,
+                        uint8_t const numProbes = 1);
+
+    /**
+     * @brief Longest a link change request and its retries can take on the current settings, from the first
+     * acknowlegement timeout on: how far apart the two ends may move.
      * 
      */
-    void linkChangeReqTimeout ();
+    uint32_t linkChangeReqSpanMillis ();
 
     /**
-     * @brief Resets current packet error fraction to 0%.
+     * @brief Time between the probes of a burst on the current settings.
      * 
      */
+    uint32_t linkProbePeriodMillis ();
+
+    /**
+     * @brief Task callbacks: call linkProbeNext and heartbeatReq on the loraPoint2Point given as context.
+     *
+     */
+    static void linkProbeNextTask (void * self);
+    static void heartbeatReqTask (void * self);
+
+    /**
+     * @brief Resets current packet error fraction to 0% and forgets the SNR heard on the previous settings.
+     *
+     */
     void resetPacketErrorFraction ();
 
+    /**
+     * @brief Key of a peer's link statistics on the current radio settings.
+     *
+     */
+    linkStatsKey_t linkStatsKey (uint8_t const peerAddress);
+
+    /**
+     * @brief Records the SNR of a frame heard on the current settings.
+     *
+     * @param snr SNR in dB.
+     */
+    void updateLinkSnr (int const snr);
+
+    /**
+     * @brief Judges the current settings once enough packets have been counted on them, and requests a faster or slower link if needed. See startAdr.
+     *
+     */
+    void serviceAdr ();
+
+    /**
+     * @brief Shuffles the channels into hopSequence from hopSeed, with the rendezvous channel first.
+     *
+     */
+    void buildHopSequence ();
+
+    /**
+     * @brief Retunes the radio to a channel without touching the packet error fraction or calling linkChangeInd, as for a hop.
+     *
+     */
+    void tuneFrequencyChannel (frequencyChannel_t const frequencyChannel);
+
+    /**
+     * @brief Hops to the channel of the current slot, ages the dwell accounting, sends the master's beacons and drops a node's sync once beacons stop.
+     *
+     */
+    void serviceHopping ();
+
+    /**
+     * @brief Queues a sync beacon, broadcast at the start of a cycle or sent to a unit that just joined.
+     *
+     * @param destAddress RH_BROADCAST_ADDRESS, or the joining unit. Only broadcast beacons are held to the rendezvous slot.
+     */
+    void queueHopSyncInd (uint8_t const destAddress);
+
+    /**
+     * @brief Whether the frame in txFrame may go out now while hopping. If not, pushes txDeadlineMillis back to when it might, or gives up on frames that never can.
+     *
+     * @param now    millis().
+     * @return true  Transmit now.
+     * @return false Not now; the transmitter has been rescheduled or the frame completed.
+     */
+    bool serviceHopSlot (uint32_t const now);
+
+    /**
+     * @brief Moves the dwell accounting on to a new window once HOP_DWELL_WINDOW_MILLIS is up.
+     *
+     */
+    void ageHopDwell ();
+
+    /**
+     * @brief Handler for a master's sync beacon: syncs (and joins) or corrects the drift of the hop clock.
+     *
+     * @param rxMsg The beacon.
+     */
+    void serviceHopSyncInd (message_t const & rxMsg);
+
+    /**
+     * @brief Handler for a node joining this master's hopping.
+     *
+     */
+    void serviceHopJoinReq (message_t const & rxMsg);
+
+    /**
+     * @brief Handles a received frame: acknowleges it, drops duplicates and acknowlegements, calls rxInd and the handler of its message type.
+     *
+     * @param rxMsg The frame, in a buffer from rxPool.
+     */
+    void serviceRxFrame (message_t & rxMsg);
+
+    /**
+     * @brief Hands a received message to rxInd and to the application's handler of its type, if any.
+     *
+     */
+    void deliverRx (message_t const & rxMsg);
+
+    /**
+     * @brief Handler of a received message type, see serviceRxHandlers.
+     *
+     */
+    typedef void (loraPoint2Point::* serviceRxHandler_t) (message_t const & rxMsg);
+
+    /**
+     * @brief The library's handler of each message type, or NULL, indexed by type. Built from LORA_P2P_MSG_TYPES and serviceRxHandler at compile time.
+     *
+     */
+    static serviceRxHandler_t const serviceRxHandlers [NUM_msgTypes];
+
+    /**
+     * @brief The library's handler of a message type: none, unless specialized in loraPoint2PointProtocol.cpp.
+     *
+     */
+    template <msgType_t msgType>
+    static constexpr serviceRxHandler_t serviceRxHandler ()
+    {
+      return NULL;
+    }
+
+    /**
+     * @brief Handler for a request to duty-cycle the receiver, see sleepReq.
+     *
+     */
+    void serviceSleepRequest (message_t const & rxMsg);
+
+    /**
+     * @brief Handler for a request to stop duty-cycling the receiver, see wakeReq.
+     *
+     */
+    void serviceWakeRequest (message_t const & rxMsg);
+
+    /**
+     * @brief Sleeps the radio once the linger time is up, and does the periodic listens. Keeps the radio awake while anything is waiting to be sent.
+     *
+     */
+    void serviceDutyCycle ();
+
+    /**
+     * @brief Polls the CAD of a periodic listen: sleeps the radio again if the channel is clear, or listens for the frame whose preamble it heard.
+     *
+     * @param now millis() of this service call.
+     */
+    void serviceDutyCycleSniff (uint32_t const now);
+
+    /**
+     * @brief The duty-cycled peer with this address.
+     *
+     * @param address           The peer's address.
+     * @param orUnused          Whether to return an unused entry if the peer is not duty-cycled.
+     * @return dutyCyclePeer_t* The entry, or NULL.
+     */
+    dutyCyclePeer_t * findDutyCyclePeer (uint8_t const address,
+                                         bool const orUnused = false);
+
+    /**
+     * @brief The session of a peer.
+     *
+     * @param address         The peer's address.
+     * @param create          Whether to start one if there is none, in place of the least recently heard peer that is not polled if need be.
+     * @return peerSession_t* The session, or NULL.
+     */
+    peerSession_t * findSession (uint8_t const address,
+                                 bool const create = false);
+
+    /**
+     * @brief Writes the registers of the settings that differ from radioShadow, and retunes if the channel changes. Updates the current settings.
+     *
+     * @return true  Something was written.
+     * @return false The radio was already on these settings.
+     */
+    bool writeLinkSettings (linkSettings_t const & settings);
+
+    /**
+     * @brief Retunes the radio to a peer's settings, on the unit's own channel, without touching the packet error fraction or calling linkChangeInd, as for a poll slot.
+     *
+     */
+    void tuneLinkSettings (linkSettings_t const & settings);
+
+    /**
+     * @brief Ends the slot in progress and polls the next peer, once the transmitter is free.
+     *
+     */
+    void pollNext ();
+    static void pollNextTask (void * self);
+
+    /**
+     * @brief Handler for a poll: opens this unit's slot if it is addressed to it and it is waiting for polls.
+     *
+     */
+    void servicePollReq (message_t const & rxMsg);
+
+    /**
+     * @brief Handler for the end of a polled peer's frames: starts the next slot early.
+     *
+     */
+    void servicePollEnd (message_t const & rxMsg);
+
+    /**
+     * @brief Closes the slot once it is up, or hands it back to the base with a pollEnd once there is nothing left to send.
+     *
+     */
+    void servicePolledTx ();
+
+    /**
+     * @brief Whether the frame in txFrame, and its acknowlegement, fit in what is left of the slot. If not, holds it until the next poll.
+     *
+     * @param now    millis().
+     * @return true  Transmit now.
+     * @return false Not now; the transmitter waits for a poll.
+     */
+    bool servicePollWindow (uint32_t const now);
+
+    /**
+     * @brief Preamble to send a frame to destAddress with: long enough to span a listen if it is a duty-cycled peer that may be asleep.
+     *
+     */
+    uint16_t preambleLengthFor (uint8_t const destAddress);
+
+    /**
+     * @brief Loads the oldest bulk frame still to be sent into txFrame, asking for an acknowlegement if it is the last one that can go out for now.
+     *
+     * @return true  A frame was loaded.
+     * @return false Nothing to send.
+     */
+    bool loadBulkTxFrame ();
+
+    /**
+     * @brief Whether txFrame holds a bulk data or parity frame.
+     *
+     */
+    bool isBulkTxFrame ();
+
+    /**
+     * @brief Flags of the bulk transfer in progress that describe its FEC groups.
+     *
+     */
+    uint8_t bulkTxFecFlags ();
+
+    /**
+     * @brief Called once the bulk frame in txFrame is off the air: waits for the acknowlegement if it was a poll, and moves on to the next frame if not.
+     *
+     */
+    void serviceBulkTxSent ();
+
+    /**
+     * @brief Called when the bulk frame in txFrame could not be sent, or its poll went unanswered: sends it again, or gives up after BULK_TX_RETRIES.
+     *
+     */
+    void serviceBulkTxTimeout ();
+
+    /**
+     * @brief Ends the bulk transfer in progress and reports it through bulkTxInd.
+     *
+     */
+    void completeBulkTx (bool const success);
+
+    /**
+     * @brief Handler for bulk data frames and their acknowlegements. Delivers data frames to rxInd in order.
+     *
+     * @param rxMsg The frame.
+     */
+    void serviceBulkRx (message_t const & rxMsg);
+
+    /**
+     * @brief Delivers a bulk data frame to rxInd if it is the next in order, with any stored frames it was holding up, or stores it until it is.
+     *
+     */
+    void deliverBulkData (message_t const & rxMsg);
+
+    /**
+     * @brief Gives back the RX buffers of the frames bulkRxContext holds, e.g. before starting another transfer.
+     *
+     */
+    void dropBulkRxFrames ();
+
+    #if (BULK_FEC_MAX_PARITY > 0)
+    /**
+     * @brief Adds a bulk data or parity frame to its FEC group, and delivers the data frames of the group that can then be rebuilt.
+     *
+     */
+    void serviceBulkRxFec (message_t const & rxMsg);
+    #endif // BULK_FEC_MAX_PARITY
+
+    /**
+     * @brief Millis to wait for an acknowlegement before sending again.
+     *
+     * @param ackLen Length of the acknowlegement, without the header.
+     */
+    uint32_t ackTimeoutMillis (uint8_t const ackLen);
+
     /**
      * @brief Handler to be called in the event that a unit recieves a data request.
      * @note Currently not implemented.
@@ -671,26 +1828,107 @@ class loraPoint2Point
      * @brief Handler to be called in the event that a unit recieves a link change request.
      * See linkChangeReq for details.
      * 
-     * @param srcAddress       The address of the unit requesting the link change.
-     * @param spreadingFactor  The spreading factor being requested.
-     * @param signalBandwidth  The signal bandwidth being requested.
-     * @param frequencyChannel The frequency channel being requested.
-     * @param txPower          The TX power being requested.
+     * @param rxMsg The request, with the settings being requested (see msg_linkChangeReq_t).
      * 
      * @related linkChangeReq
      */
-    void serviceLinkChangeReq (uint8_t const            srcAddress,
-                               spreadingFactor_t const  spreadingFactor,
-                               signalBandwidth_t const  signalBandwidth,
-                               frequencyChannel_t const frequencyChannel,
-                               int8_t const             txPower);
+    void serviceLinkChangeReq (message_t const & rxMsg);
     /**
-     * @brief Handler to be called in the event that a unit recieves a link change response.
+     * @brief Handler to be called in the event that a unit recieves a link probe: answers it if it is addressed to this unit, and ends this unit's probing if the peer has heard it.
      * See linkChangeReq for details.
      * 
+     * @param rxMsg The probe, with the probing unit's LINK_PROBE_* flags and link settings (see msg_linkProbe_t).
+     * 
      * @related linkChangeReq
      */
-    void serviceLinkChangeRsp ();
+    void serviceLinkProbe (message_t const & rxMsg);
+
+    /**
+     * @brief Copies a frame into the TX queue matching its message type.
+     * 
+     * @param destAddress   The address of the destination.
+     * @param buf           Pointer to the array of bytes to send.
+     * @param bufLen        Number of bytes to send.
+     * @param ascii         Format of debug printing.
+     * @param holdoffMillis Millis to wait before the first CAD.
+     * @return true         Queued.
+     * @return false        Not queued.
+     */
+    bool queueTx (uint8_t const destAddress,
+                  uint8_t const * const buf,
+                  uint8_t const bufLen,
+                  bool const ascii,
+                  uint16_t const holdoffMillis);
+
+    /**
+     * @brief Moves the next frame out of the TX queues into the transmitter, control frames first.
+     * 
+     * @return true  A frame was loaded.
+     * @return false Both queues are empty.
+     */
+    bool loadNextTxFrame ();
+
+    /**
+     * @brief Raises or releases backpressure as the data TX queue crosses its watermarks.
+     * 
+     */
+    void updateTxBackpressure ();
+
+    /**
+     * @brief Advances the transmitter without blocking: sends pending acknowlegements first, then moves the queued frame through CAD, transmission, the acknowlegement wait and retries.
+     * 
+     */
+    void serviceTxStateMachine ();
+
+    /**
+     * @brief Starts a channel activity detection and returns at once. Unlike RH_RF95::isChannelActive, which spins for the two symbols it takes (about 65ms at SF12 and 125kHz).
+     * 
+     * CadDone is kept off DIO0, so the driver's interrupt handler leaves the IRQ flags for pollCad.
+     * 
+     * @return Millis until CadDone is due.
+     */
+    uint32_t startCad ();
+
+    /**
+     * @brief Polls the CAD started by startCad, and idles the radio once it is done.
+     * 
+     * @param active Set once done: whether the CAD heard a preamble. Also set if anything took the radio out of CAD mode first, so that the caller backs off and tries again.
+     * @return true  Done.
+     * @return false Still running.
+     */
+    bool pollCad (bool & active);
+
+    /**
+     * @brief Sets the radio's TX headers and starts transmitting. The radio must not be transmitting already.
+     * 
+     */
+    void startTransmission (uint8_t const destAddress,
+                            uint8_t const msgId,
+                            uint8_t const flags,
+                            uint8_t const * buf,
+                            uint8_t const bufLen);
+
+    /**
+     * @brief Finishes the frame in flight, updates the link statistics and reports it through txInd.
+     * 
+     * @param ack True if the frame was acknowleged.
+     */
+    void completeTx (bool const ack);
+
+    /**
+     * @brief Handler for an acknowlegement received from another unit.
+     * 
+     * @param srcAddress The address of the acknowleging unit.
+     * @param msgId      The ID of the frame being acknowleged.
+     */
+    void serviceAck (uint8_t const srcAddress,
+                     uint8_t const msgId);
+
+    /**
+     * @brief Applies the settings of a received link change request once its acknowlegement is off the air, then starts probing.
+     * 
+     */
+    void serviceLinkChangeSwitching ();
 
     /**
      * @brief Adds to packet error fraction if packet is unsuccessful.
@@ -1,7 +1,7 @@
 /**
  * @file loraPoint2PointProtocolLightweight.h
  * @author Sophie Bernier (sophie.liz.ber@gmail.com)
- * @brief Less overhead for high datarate applications. Currently just contains common message type definitions.
+ * @brief Less overhead for high datarate applications: common message type definitions, from msgRegistry.h. See loraCompactLink.h for the compact frame header.
  * @version 0.1
  * @date 2021-07-19
  * 
@@ -13,44 +13,6 @@
 #ifndef LORA_POINT_2_POINT_LIGHTWEIGHT
 #define LORA_POINT_2_POINT_LIGHTWEIGHT
 
-/**
- * @brief Enum of message types.
- * 
- * @todo Implement wake and sleep requests.
- * 
- */
-enum msgType_t
-{
-  msgType_undefined,     // 0
-  msgType_dataReq,       // 1
-  msgType_dataRsp,       // 2
-  msgType_linkChangeReq, // 3, unsupported in Lightweight
-  msgType_linkChangeRsp, // 4, unsupported in Lightweight
-  msgType_wakeRequest,   // 5, unsupported in Lightweight
-  msgType_sleepRequest,  // 6, unsupported in Lightweight
-  msgType_heartbeatReq,  // 7, unsupported in Lightweight
-  msgType_heartbeatRsp,  // 8, unsupported in Lightweight
-  msgType_procvDataReq,  // 9
-  msgType_procvDataRsp,  // 10
-  msgType_seaphoxDataReq,// 11
-  msgType_seaphoxDataRsp,// 12
-  msgType_ack, // 13
-  NUM_msgTypes           // 14
-};
-
-String const msgTypeNames [] {"undefined message type", // 0
-                                    "dataReq",       // 1
-                                    "dataRsp",       // 2
-                                    "linkChangeReq", // 3
-                                    "linkChangeRsp", // 4
-                                    "wakeRequest",   // 5
-                                    "sleepRequest",  // 6
-                                    "heartbeatReq",  // 7
-                                    "heartbeatRsp",  // 8
-                                    "procvDataReq",  // 9
-                                    "procvDataRsp",  // 10
-                                    "seaphoxDataReq", // 11
-                                    "seaphoxDataRsp", // 12
-                                    "ack"}; // 13
+#include <msgRegistry.h> // The message types, shared with loraPoint2Point.
 
 #endif // LORA_POINT_2_POINT_LIGHTWEIGHT
\ No newline at end of file
@@ -0,0 +1,229 @@
+/**
+ * @file msgRegistry.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief The message types of loraPoint2Point and of the lightweight path, each declared once with its payload layout: the msgType_t enum, their names, the TX queue they take, and a msg_<type>_t struct per type that packs and unpacks its fields.
+ * @version 0.0.1
+ * @date 2021-10-02
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Byte 0 of every frame is its message type. The fields listed in the type's MSG_FIELDS_ macro follow it, in order and
+ * little-endian; whatever comes after them (the data of a dataReq, the payload of a bulkData frame) is left to the
+ * code that sends the type. For each type, msg_<type>_t has the fields as members, LEN (the type byte and the fields),
+ * pack, which writes them to a buffer, and unpack, which checks the type and length of a buffer and reads them back.
+ *
+ * The values go on air: add new types at the end of LORA_P2P_MSG_TYPES. The lightweight path's types come first, as
+ * the compact header (see loraCompactLink.h) carries the type in 4 bits.
+ */
+
+#ifndef MSG_REGISTRY_H
+#define MSG_REGISTRY_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Every message type, in the order of their values, with the TX queue it takes (see msgQueue_t).
+ *
+ */
+#define LORA_P2P_MSG_TYPES(X)        \
+  X(undefined,         data)         \
+  X(dataReq,           data)         \
+  X(dataRsp,           data)         \
+  X(linkChangeReq,     control)      \
+  X(linkProbe,         control)      \
+  X(wakeRequest,       control)      \
+  X(sleepRequest,      control)      \
+  X(heartbeatReq,      control)      \
+  X(heartbeatRsp,      control)      \
+  X(procvDataReq,      data)         \
+  X(procvDataRsp,      data)         \
+  X(seaphoxDataReq,    data)         \
+  X(seaphoxDataRsp,    data)         \
+  X(ack,               data)         \
+  X(aggregatedDataRsp, data)         \
+  X(hopSyncInd,        control)      \
+  X(hopJoinReq,        control)      \
+  X(bulkData,          data)         \
+  X(bulkAck,           data)         \
+  X(bulkParity,        data)         \
+  X(storedData,        data)         \
+  X(pollReq,           control)      \
+  X(pollEnd,           control)
+
+//---------------------------------------------------------------------------
+// Payload Layouts: F(type, field) for each field after the message type byte
+//---------------------------------------------------------------------------
+
+#define MSG_FIELDS_undefined(F)
+#define MSG_FIELDS_dataReq(F)
+#define MSG_FIELDS_dataRsp(F)
+/// See loraPoint2Point::linkChangeReq. The settings are the indices of the spreadingFactor_t, signalBandwidth_t and frequencyChannel_t enums.
+#define MSG_FIELDS_linkChangeReq(F) \
+  F(uint8_t, spreadingFactor)       \
+  F(uint8_t, signalBandwidth)       \
+  F(uint8_t, frequencyChannel)      \
+  F(int8_t,  txPower)
+/// Broadcast on new link settings: the peer's address, LINK_PROBE_* flags and the sender's settings. See loraPoint2Point::linkChangeReq.
+#define MSG_FIELDS_linkProbe(F) \
+  F(uint8_t, peerAddress)       \
+  F(uint8_t, flags)             \
+  F(uint8_t, spreadingFactor)   \
+  F(uint8_t, signalBandwidth)   \
+  F(uint8_t, frequencyChannel)  \
+  F(int8_t,  txPower)
+/// Stop duty-cycling the receiver. See loraPoint2Point::wakeReq.
+#define MSG_FIELDS_wakeRequest(F)
+/// Duty-cycle the receiver with this listen period. See loraPoint2Point::sleepReq.
+#define MSG_FIELDS_sleepRequest(F) \
+  F(uint16_t, listenPeriodMillis)
+#define MSG_FIELDS_heartbeatReq(F) \
+  F(uint8_t, address)
+#define MSG_FIELDS_heartbeatRsp(F) \
+  F(uint8_t, address)
+#define MSG_FIELDS_procvDataReq(F)
+#define MSG_FIELDS_procvDataRsp(F)
+#define MSG_FIELDS_seaphoxDataReq(F)
+#define MSG_FIELDS_seaphoxDataRsp(F)
+/// Lightweight acknowlegement of a frame of type ackedType.
+#define MSG_FIELDS_ack(F) \
+  F(uint8_t, ackedType)
+/// See sensorAggregator.h.
+#define MSG_FIELDS_aggregatedDataRsp(F)
+/// A hop master's beacon: its hop clock, stamped as the beacon goes on air, and the hop sequence's seed and dwell.
+#define MSG_FIELDS_hopSyncInd(F) \
+  F(uint32_t, clockMillis)       \
+  F(uint16_t, seed)              \
+  F(uint16_t, dwellMillis)
+#define MSG_FIELDS_hopJoinReq(F)
+/// Followed by the payload. See loraPoint2Point::startBulkTx.
+#define MSG_FIELDS_bulkData(F) \
+  F(uint8_t, transferId)       \
+  F(uint8_t, seq)              \
+  F(uint8_t, flags)
+/// Selective acknowlegement: the next sequence number expected and the bitmap of frames received after it.
+#define MSG_FIELDS_bulkAck(F) \
+  F(uint8_t,  transferId)     \
+  F(uint8_t,  cumulative)     \
+  F(uint32_t, bitmap)
+/// Followed by the parity of a group of bulk data frames. See loraPoint2Point::setBulkFec.
+#define MSG_FIELDS_bulkParity(F) \
+  F(uint8_t, transferId)         \
+  F(uint8_t, group)              \
+  F(uint8_t, flags)              \
+  F(uint8_t, parityIndex)        \
+  F(uint8_t, groupLen)
+/// Followed by a record kept by storeAndForward until it is acknowleged.
+#define MSG_FIELDS_storedData(F) \
+  F(uint32_t, seq)
+/// Broadcast: the peer addressed may send for a slot. See loraPoint2Point::startPolling.
+#define MSG_FIELDS_pollReq(F) \
+  F(uint8_t,  peerAddress)    \
+  F(uint16_t, slotMillis)
+/// Broadcast: the polled peer has nothing more to send in its slot.
+#define MSG_FIELDS_pollEnd(F)
+
+//------------------
+// Generated Types
+//------------------
+
+#define MSG_TYPE_ENUMERATOR(name, queue) msgType_##name,
+
+/**
+ * @brief Enum of message types. See LORA_P2P_MSG_TYPES.
+ *
+ */
+enum msgType_t
+{
+  LORA_P2P_MSG_TYPES(MSG_TYPE_ENUMERATOR)
+  NUM_msgTypes
+};
+
+/**
+ * @brief TX queues, see loraPoint2Point::queueTx. Control frames go ahead of data and do not count toward backpressure.
+ *
+ */
+enum msgQueue_t
+{
+  msgQueue_data,
+  msgQueue_control,
+  NUM_msgQueues
+};
+
+#define MSG_TYPE_NAME(name, queue) #name,
+#define MSG_TYPE_QUEUE(name, queue) msgQueue_##queue,
+
+char const * const msgTypeNames [NUM_msgTypes] {LORA_P2P_MSG_TYPES(MSG_TYPE_NAME)};
+constexpr msgQueue_t msgTypeQueues [NUM_msgTypes] {LORA_P2P_MSG_TYPES(MSG_TYPE_QUEUE)};
+
+/**
+ * @brief Writes a field little-endian.
+ *
+ * @return uint8_t Index of the byte after it.
+ */
+template <typename T>
+inline uint8_t msgPackField (uint8_t * const buf,
+                             uint8_t const idx,
+                             T const value)
+{
+  for (uint8_t byte = 0; byte < sizeof(T); byte++)
+  {
+    buf[idx + byte] = uint8_t(uint32_t(value) >> (8 * byte));
+  }
+  return idx + sizeof(T);
+}
+
+/**
+ * @brief Reads a little-endian field.
+ *
+ * @return uint8_t Index of the byte after it.
+ */
+template <typename T>
+inline uint8_t msgUnpackField (uint8_t const * const buf,
+                               uint8_t const idx,
+                               T & value)
+{
+  uint32_t raw = 0;
+  for (uint8_t byte = 0; byte < sizeof(T); byte++)
+  {
+    raw |= uint32_t(buf[idx + byte]) << (8 * byte);
+  }
+  value = T(raw);
+  return idx + sizeof(T);
+}
+
+#define MSG_FIELD_LEN(type, field) + sizeof(type)
+#define MSG_FIELD_MEMBER(type, field) type field;
+#define MSG_FIELD_PACK(type, field) idx = msgPackField(buf, idx, field);
+#define MSG_FIELD_UNPACK(type, field) idx = msgUnpackField(buf, idx, field);
+
+#define MSG_PAYLOAD_STRUCT(name, queue)                                   \
+  struct msg_##name##_t                                                   \
+  {                                                                       \
+    static constexpr msgType_t type = msgType_##name;                     \
+    static constexpr uint8_t LEN = 1 MSG_FIELDS_##name(MSG_FIELD_LEN);    \
+    MSG_FIELDS_##name(MSG_FIELD_MEMBER)                                   \
+                                                                          \
+    uint8_t pack (uint8_t * const buf) const                              \
+    {                                                                     \
+      buf[0] = type;                                                      \
+      uint8_t idx = 1;                                                    \
+      MSG_FIELDS_##name(MSG_FIELD_PACK)                                   \
+      return idx;                                                         \
+    }                                                                     \
+                                                                          \
+    bool unpack (uint8_t const * const buf,                               \
+                 uint8_t const bufLen)                                    \
+    {                                                                     \
+      if (bufLen < LEN || buf[0] != type)                                 \
+      {                                                                   \
+        return false;                                                     \
+      }                                                                   \
+      uint8_t idx = 1;                                                    \
+      MSG_FIELDS_##name(MSG_FIELD_UNPACK)                                 \
+      return idx == LEN;                                                  \
+    }                                                                     \
+  };
+
+LORA_P2P_MSG_TYPES(MSG_PAYLOAD_STRUCT)
+
+#endif // MSG_REGISTRY_H
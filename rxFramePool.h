@@ -0,0 +1,170 @@
+/**
+ * @file rxFramePool.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the rxFramePool class, a fixed pool of receive buffers that the application can hold on to.
+ * @version 0.0.1
+ * @date 2021-09-23
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#ifndef RX_FRAME_POOL_H
+#define RX_FRAME_POOL_H
+
+#include <Arduino.h>
+
+/**
+ * @brief State of a frame in an rxFramePool.
+ *
+ */
+enum rxFrameState_t : uint8_t
+{
+  rxFrameState_free,      ///< Available to receive into.
+  rxFrameState_receiving, ///< Being received into or handed to the application.
+  rxFrameState_held,      ///< Kept by the application until it releases it.
+  NUM_rxFrameStates
+};
+
+/**
+ * @brief Fixed pool of frames. Frames are received straight into the pool and handed out by reference, so nothing is copied or allocated.
+ *
+ * @tparam frame_t  Type of one frame.
+ * @tparam capacity Number of frames.
+ */
+template <typename frame_t, uint8_t capacity>
+class rxFramePool
+{
+  public:
+    rxFramePool ()
+    {
+      memset(states, rxFrameState_free, sizeof(states));
+    }
+
+    /**
+     * @brief Takes a free frame to receive into.
+     *
+     * @return frame_t* The frame, or NULL if every frame is taken.
+     */
+    frame_t * acquire ()
+    {
+      for (uint8_t idx = 0; idx < capacity; idx++)
+      {
+        if (states[idx] == rxFrameState_free)
+        {
+          states[idx] = rxFrameState_receiving;
+          return &frames[idx];
+        }
+      }
+      return NULL;
+    }
+
+    /**
+     * @brief Keeps an acquired frame for the application.
+     *
+     * The last free frame is never given up, so that there is always somewhere to receive acknowlegements.
+     *
+     * @param frame  A frame from acquire.
+     * @return true  Held until release.
+     * @return false Not a frame of this pool, or it would leave no free frame.
+     */
+    bool hold (frame_t const & frame)
+    {
+      int16_t idx = indexOf(frame);
+      if (idx < 0 || states[idx] == rxFrameState_free)
+      {
+        return false;
+      }
+      if (states[idx] == rxFrameState_receiving && countFree() == 0)
+      {
+        return false;
+      }
+      states[idx] = rxFrameState_held;
+      return true;
+    }
+
+    /**
+     * @brief Returns a frame to the pool. Releasing a frame that is not from this pool does nothing.
+     *
+     * @param frame The frame.
+     */
+    void release (frame_t const & frame)
+    {
+      int16_t idx = indexOf(frame);
+      if (idx >= 0)
+      {
+        states[idx] = rxFrameState_free;
+      }
+    }
+
+    /**
+     * @brief Puts a held frame back as if it had just been received, to hand it to the application again: it is then released unless held anew.
+     *
+     * @param frame A held frame.
+     */
+    void unhold (frame_t const & frame)
+    {
+      int16_t idx = indexOf(frame);
+      if (idx >= 0 && states[idx] == rxFrameState_held)
+      {
+        states[idx] = rxFrameState_receiving;
+      }
+    }
+
+    bool isHeld (frame_t const & frame) const
+    {
+      int16_t idx = indexOf(frame);
+      return idx >= 0 && states[idx] == rxFrameState_held;
+    }
+
+    uint8_t countFree () const
+    {
+      return count(rxFrameState_free);
+    }
+
+    uint8_t countHeld () const
+    {
+      return count(rxFrameState_held);
+    }
+
+    /**
+     * @brief Index of a frame of this pool, to refer to it in a byte rather than by pointer.
+     *
+     * @return int16_t The index, or -1 if the frame is not from this pool.
+     */
+    int16_t indexOf (frame_t const & frame) const
+    {
+      // Compare addresses as integers: relational comparison of unrelated pointers is unspecified.
+      uintptr_t offset = uintptr_t(&frame) - uintptr_t(&frames[0]);
+      if (offset >= sizeof(frames) || offset % sizeof(frame_t) != 0)
+      {
+        return -1;
+      }
+      return int16_t(offset / sizeof(frame_t));
+    }
+
+    /**
+     * @brief The frame at an index from indexOf.
+     *
+     */
+    frame_t & at (uint8_t const idx)
+    {
+      return frames[idx];
+    }
+
+  private:
+    uint8_t count (rxFrameState_t const state) const
+    {
+      uint8_t num = 0;
+      for (uint8_t idx = 0; idx < capacity; idx++)
+      {
+        num += states[idx] == state;
+      }
+      return num;
+    }
+
+    frame_t frames [capacity];
+    uint8_t states [capacity];
+};
+
+#endif // RX_FRAME_POOL_H
@@ -0,0 +1,215 @@
+/**
+ * @file sdLogger.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the sdLogger class.
+ * @version 0.0.1
+ * @date 2021-09-19
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#include <sdLogger.h>
+#include <commonMacros.h>
+
+//----------------------
+// Function Definitions
+//----------------------
+
+bool sdLogger::begin ()
+{
+  file = SD.open(fileName, FILE_WRITE);
+  if (!file)
+  {
+    return false;
+  }
+  // Start on a sector boundary, so that every later write is a whole sector.
+  memset(sector, 0, sizeof(sector));
+  sectorLen = 0;
+  uint16_t tail = file.size() % SD_LOGGER_SECTOR_LEN;
+  if (tail != 0 && file.write(sector, SD_LOGGER_SECTOR_LEN - tail) != size_t(SD_LOGGER_SECTOR_LEN - tail))
+  {
+    file.close();
+    return false;
+  }
+  lastSyncMillis = millis();
+  sdLogRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.timestampMillis = lastSyncMillis;
+  record.kind = sdLogKind_sessionStart;
+  return log(record);
+}
+
+bool sdLogger::logTx (loraPoint2Point & unit,
+                      uint8_t const srcAddr,
+                      uint8_t const * txBuf,
+                      uint8_t const bufLen,
+                      uint8_t const destAddr,
+                      bool const ack)
+{
+  sdLogRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.timestampMillis = millis();
+  record.kind = sdLogKind_tx;
+  record.srcAddr = srcAddr;
+  record.destAddr = destAddr;
+  record.ack = ack;
+  record.spreadingFactor = unit.getSpreadingfactor();
+  record.signalBandwidth = unit.getSignalBandwidth();
+  record.frequencyChannel = unit.getFrequencyChannel();
+  record.txPower = unit.getTxPower();
+  record.snr = ack ? unit.getLastAckSNR() : 0;
+  record.payloadLen = bufLen;
+  memcpy(record.payload, txBuf, MIN(bufLen, SD_LOGGER_PAYLOAD_LEN));
+  return log(record);
+}
+
+bool sdLogger::logRx (loraPoint2Point & unit,
+                      message_t const & rxMsg)
+{
+  sdLogRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.timestampMillis = millis();
+  record.kind = sdLogKind_rx;
+  record.srcAddr = rxMsg.srcAddr;
+  record.destAddr = rxMsg.destAddr;
+  record.msgId = rxMsg.msgId;
+  record.flags = rxMsg.flags;
+  record.ack = 1;
+  record.spreadingFactor = unit.getSpreadingfactor();
+  record.signalBandwidth = unit.getSignalBandwidth();
+  record.frequencyChannel = unit.getFrequencyChannel();
+  record.txPower = unit.getTxPower();
+  record.snr = unit.getLastRxSNR();
+  record.payloadLen = rxMsg.bufLen;
+  memcpy(record.payload, rxMsg.buf, MIN(rxMsg.bufLen, SD_LOGGER_PAYLOAD_LEN));
+  return log(record);
+}
+
+bool sdLogger::log (sdLogRecord_t const & record)
+{
+  if (!file)
+  {
+    numDropped++;
+    return false;
+  }
+  memcpy(sector + sectorLen, &record, SD_LOGGER_RECORD_LEN);
+  sectorLen += SD_LOGGER_RECORD_LEN;
+  numRecords++;
+  unsynced = true;
+  if (sectorLen == SD_LOGGER_SECTOR_LEN)
+  {
+    return writeSector();
+  }
+  return true;
+}
+
+void sdLogger::service ()
+{
+  if (unsynced && (millis() - lastSyncMillis) >= syncPeriodMillis)
+  {
+    sync();
+  }
+}
+
+bool sdLogger::sync ()
+{
+  if (!file)
+  {
+    return false;
+  }
+  bool ok = true;
+  if (sectorLen > 0)
+  {
+    // The rest of the sector is already zero: filler records.
+    ok = writeSector();
+  }
+  file.flush();
+  unsynced = false;
+  lastSyncMillis = millis();
+  return ok;
+}
+
+void sdLogger::end ()
+{
+  sync();
+  file.close();
+}
+
+uint32_t sdLogger::getNumRecords ()
+{
+  return numRecords;
+}
+
+uint32_t sdLogger::getNumSectorsWritten ()
+{
+  return numSectorsWritten;
+}
+
+uint32_t sdLogger::getNumDropped ()
+{
+  return numDropped;
+}
+
+void sdLogger::printCsvHeader (Print & port)
+{
+  port.println("Timestamp,Source Address,Destination Address,Message ID,Message Flags,Acknowleged,Message,spreadingFactor,signalBandwidth,frequencyChannel,txPower");
+}
+
+bool sdLogger::printCsv (sdLogRecord_t const & record,
+                         Print & port)
+{
+  if (record.kind != sdLogKind_tx && record.kind != sdLogKind_rx)
+  {
+    return false;
+  }
+  port.print(record.timestampMillis);
+  port.print(",");
+  port.print(record.srcAddr, HEX);
+  port.print(",");
+  port.print(record.destAddr, HEX);
+  port.print(",");
+  port.print(int(record.payload[0]));
+  port.print(",");
+  if (record.kind == sdLogKind_rx)
+  {
+    port.print(int(record.flags));
+  }
+  port.print(",");
+  port.print(int(record.ack));
+  port.print(",");
+  for (uint8_t i = 1; i < MIN(record.payloadLen, SD_LOGGER_PAYLOAD_LEN); i++)
+  {
+    port.print(char(record.payload[i]));
+  }
+  port.print(",");
+  port.print(int(record.spreadingFactor));
+  port.print(",");
+  port.print(int(record.signalBandwidth));
+  port.print(",");
+  port.print(int(record.frequencyChannel));
+  port.print(",");
+  port.print(int(record.txPower));
+  port.println();
+  return true;
+}
+
+//---------
+// Helpers
+//---------
+
+bool sdLogger::writeSector ()
+{
+  bool ok = file.write(sector, SD_LOGGER_SECTOR_LEN) == SD_LOGGER_SECTOR_LEN;
+  if (ok)
+  {
+    numSectorsWritten++;
+  }
+  else
+  {
+    numDropped += sectorLen / SD_LOGGER_RECORD_LEN;
+  }
+  memset(sector, 0, sizeof(sector));
+  sectorLen = 0;
+  return ok;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file sdLogger.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the sdLogger class, which logs radio traffic to an SD card as fixed-size binary records.
+ * @version 0.0.1
+ * @date 2021-09-19
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Opening, printing to and closing a file for every frame costs a directory and FAT update each time. sdLogger
+ * instead keeps the file open, gathers records in a RAM block, writes whole SD_LOGGER_SECTOR_LEN byte sectors, and
+ * only syncs (updating the directory entry) every so often. At most the records since the last sync are lost if
+ * power is cut.
+ *
+ * A record is SD_LOGGER_RECORD_LEN bytes, so a sector holds a whole number of them and the file can be read back as
+ * an array of records. Records of kind sdLogKind_none are filler, from syncing with a part-filled sector.
+ * sdLogToCsv (in the host build) turns a log into the CSV format LoRaRangeTest_Base used to write.
+ */
+
+#ifndef SD_LOGGER_H
+#define SD_LOGGER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <loraPoint2PointProtocol.h>
+
+#define SD_LOGGER_SECTOR_LEN 512
+#define SD_LOGGER_RECORD_LEN 64
+#define SD_LOGGER_PAYLOAD_LEN 48 ///< Bytes of each message kept. Longer messages are cut off; payloadLen still says how long they were.
+#define SD_LOGGER_DFLT_SYNC_MILLIS 10000
+
+enum sdLogKind_t : uint8_t
+{
+  sdLogKind_none = 0,    ///< Filler.
+  sdLogKind_tx,          ///< A message sent, from txInd.
+  sdLogKind_rx,          ///< A message received, from rxInd.
+  sdLogKind_sessionStart ///< The logger started; timestamps start over from here.
+};
+
+/**
+ * @brief One logged message. Little-endian on both the SAMD21 and the host, and laid out without padding.
+ *
+ */
+struct sdLogRecord_t
+{
+  uint32_t timestampMillis;
+  uint8_t  kind;             ///< sdLogKind_t.
+  uint8_t  srcAddr;
+  uint8_t  destAddr;
+  uint8_t  msgId;            ///< RadioHead header ID, of received messages only.
+  uint8_t  flags;            ///< RadioHead header flags, of received messages only.
+  uint8_t  ack;              ///< Whether a sent message was acknowleged. 1 for received messages.
+  uint8_t  spreadingFactor;  ///< Radio settings, as indices to loraPoint2Point's tables.
+  uint8_t  signalBandwidth;
+  uint8_t  frequencyChannel;
+  int8_t   txPower;
+  int8_t   snr;              ///< Of the acknowlegement of a sent message, or of a received message.
+  uint8_t  payloadLen;
+  uint8_t  payload [SD_LOGGER_PAYLOAD_LEN]; ///< The message, starting with its message type.
+};
+
+static_assert(sizeof(sdLogRecord_t) == SD_LOGGER_RECORD_LEN, "sdLogRecord_t must be SD_LOGGER_RECORD_LEN bytes.");
+static_assert(SD_LOGGER_SECTOR_LEN % SD_LOGGER_RECORD_LEN == 0, "Records must not straddle sectors.");
+
+/**
+ * @brief Logs sent and received messages to a file on an SD card.
+ *
+ */
+class sdLogger
+{
+  public:
+    /**
+     * @brief Constructs a new sdLogger object.
+     *
+     * @param _fileName         Name of the log file. Appended to if it exists.
+     * @param _syncPeriodMillis How often to sync the file, at most.
+     */
+    sdLogger (char const * _fileName,
+              uint32_t const _syncPeriodMillis = SD_LOGGER_DFLT_SYNC_MILLIS
+              ):
+                fileName{_fileName},
+                syncPeriodMillis{_syncPeriodMillis}
+                {
+
+                }
+
+    /**
+     * @brief Opens the log file and logs a session start. Call once SD.begin has succeeded.
+     *
+     * @return true  File open.
+     * @return false The file could not be opened; nothing will be logged.
+     */
+    bool begin ();
+
+    /**
+     * @brief Logs a sent message. Call from txInd.
+     *
+     * @param unit     The sender, for its radio settings and acknowlegement SNR.
+     * @param srcAddr  The sender's address.
+     * @param txBuf    As passed to txInd.
+     * @param bufLen   As passed to txInd.
+     * @param destAddr As passed to txInd.
+     * @param ack      As passed to txInd.
+     * @return true    Logged.
+     * @return false   Not logged: the file is not open or writing failed.
+     */
+    bool logTx (loraPoint2Point & unit,
+                uint8_t const srcAddr,
+                uint8_t const * txBuf,
+                uint8_t const bufLen,
+                uint8_t const destAddr,
+                bool const ack);
+
+    /**
+     * @brief Logs a received message. Call from rxInd.
+     *
+     * @param unit   The receiver, for its radio settings and the message's SNR.
+     * @param rxMsg  As passed to rxInd.
+     * @return true  Logged.
+     * @return false Not logged: the file is not open or writing failed.
+     */
+    bool logRx (loraPoint2Point & unit,
+                message_t const & rxMsg);
+
+    /**
+     * @brief Adds a record to the current sector, writing the sector out once it is full.
+     *
+     * @param record Record to log. Its timestamp is left as is.
+     * @return true  Logged.
+     * @return false Not logged: the file is not open or writing failed.
+     */
+    bool log (sdLogRecord_t const & record);
+
+    /**
+     * @brief Syncs the file if the sync period has passed and anything was logged since the last sync. Call from the main loop.
+     *
+     */
+    void service ();
+
+    /**
+     * @brief Writes out the current sector, filled up with filler records, and syncs the file. Call before removing the card.
+     *
+     * @return true  Synced.
+     * @return false The file is not open or writing failed.
+     */
+    bool sync ();
+
+    /**
+     * @brief Syncs and closes the file.
+     *
+     */
+    void end ();
+
+    uint32_t getNumRecords ();
+    uint32_t getNumSectorsWritten ();
+    /**
+     * @brief Records that could not be logged, because the file was not open or writing to it failed.
+     *
+     */
+    uint32_t getNumDropped ();
+
+    /**
+     * @brief Prints the column names of the CSV format, followed by a line break.
+     *
+     * @param port Where to print them.
+     */
+    static void printCsvHeader (Print & port);
+
+    /**
+     * @brief Prints a record as a line of CSV, in the format LoRaRangeTest_Base used to log in.
+     *
+     * @param record The record.
+     * @param port   Where to print it.
+     * @return true  Printed.
+     * @return false Filler or session start, nothing printed.
+     */
+    static bool printCsv (sdLogRecord_t const & record,
+                          Print & port);
+
+  private:
+    bool writeSector ();
+
+    char const * fileName;
+    uint32_t syncPeriodMillis;
+    File file;
+    uint8_t sector [SD_LOGGER_SECTOR_LEN];
+    uint16_t sectorLen = 0;
+    bool unsynced = false;
+    uint32_t lastSyncMillis = 0;
+    uint32_t numRecords = 0;
+    uint32_t numSectorsWritten = 0;
+    uint32_t numDropped = 0;
+};
+
+#endif // SD_LOGGER_H
@@ -0,0 +1,206 @@
+/**
+ * @file sensorAggregator.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the sensorAggregator class, which packs several sensor records into one radio frame.
+ * @version 0.0.1
+ * @date 2021-09-10
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Every frame pays for the preamble, the header, CAD and (if used) an acknowlegement, so sending one short sensor
+ * line per frame wastes most of the airtime. sensorAggregator collects complete records until the frame is full or
+ * the oldest record has waited long enough, and the receiving end splits them up again with unpack().
+ *
+ * Frame layout:
+ *
+ * | Byte    | Content                                |
+ * | :------ | :------------------------------------- |
+ * | 0       | Message type, given to the constructor |
+ * | 1       | Sensor of record 1 (sensors_t)         |
+ * | 2       | Length of record 1, n1                 |
+ * | 3..n1+2 | Record 1                               |
+ * | ...     | Further records, same layout           |
+ *
+ * A sensor byte with SENSOR_AGGREGATOR_PACKED_FLAG set marks a packed binary record.
+ */
+
+#ifndef SENSOR_AGGREGATOR_H
+#define SENSOR_AGGREGATOR_H
+
+#include <Arduino.h>
+#include <sensors.h>
+
+/**
+ * @brief Bytes added to each record: the sensor tag and the record length.
+ *
+ */
+#define SENSOR_AGGREGATOR_RECORD_OVERHEAD 2
+
+/**
+ * @brief Set in a record's sensor tag when the record is a packed binary record (e.g. a ProCVData bitfield) rather than an ASCII line.
+ *
+ */
+#define SENSOR_AGGREGATOR_PACKED_FLAG 0x80
+
+/**
+ * @brief Packs complete sensor records, tagged by sensor, into frames of up to frameLen bytes.
+ *
+ * @tparam frameLen Maximum frame length, in bytes. Usually the radio driver's maximum message length.
+ */
+template <uint8_t frameLen>
+class sensorAggregator
+{
+  public:
+    /**
+     * @brief Constructs a new sensorAggregator object.
+     *
+     * @param _msgType      Message type written into byte 0 of every frame.
+     * @param _maxAgeMillis Longest a record may wait in the frame before isDue returns true.
+     * @param _flushLen     Frame length at which isDue returns true, even if the records are fresh.
+     */
+    sensorAggregator (uint8_t const _msgType,
+                      uint32_t const _maxAgeMillis,
+                      uint8_t const _flushLen = frameLen
+                      ):
+                        msgType{_msgType},
+                        maxAgeMillis{_maxAgeMillis},
+                        flushLen{_flushLen}
+                        {
+                          clear();
+                        }
+
+    /**
+     * @brief Whether a record of the given length still fits in the current frame. If not, send the frame first.
+     *
+     * @param recordLen Length of the record, without tag and length bytes.
+     * @return true     Fits.
+     * @return false    Does not fit.
+     */
+    bool hasRoomFor (uint8_t const recordLen) const
+    {
+      return uint16_t(bufLen) + SENSOR_AGGREGATOR_RECORD_OVERHEAD + recordLen <= frameLen;
+    }
+
+    /**
+     * @brief Appends a complete record to the current frame.
+     *
+     * @param sensor     The sensor the record came from.
+     * @param record     Pointer to the record.
+     * @param recordLen  Length of the record.
+     * @param nowMillis  Current time, used for the age deadline.
+     * @param packed     Whether the record is packed binary rather than ASCII.
+     * @return true      Added.
+     * @return false     No room. Send the frame, clear, and add the record again.
+     */
+    bool addRecord (sensors_t const sensor,
+                    uint8_t const * record,
+                    uint8_t const recordLen,
+                    uint32_t const nowMillis,
+                    bool const packed = false)
+    {
+      if (!hasRoomFor(recordLen))
+      {
+        return false;
+      }
+      if (numRecords == 0)
+      {
+        firstRecordMillis = nowMillis;
+      }
+      buf[bufLen++] = uint8_t(sensor) | (packed ? SENSOR_AGGREGATOR_PACKED_FLAG : 0);
+      buf[bufLen++] = recordLen;
+      memcpy(buf + bufLen, record, recordLen);
+      bufLen += recordLen;
+      numRecords++;
+      return true;
+    }
+
+    /**
+     * @brief Whether the current frame should be sent now, because it is full enough or its oldest record is too old.
+     *
+     * @param nowMillis Current time.
+     * @return true     Send getFrame() then call clear().
+     * @return false    Keep collecting.
+     */
+    bool isDue (uint32_t const nowMillis) const
+    {
+      if (numRecords == 0)
+      {
+        return false;
+      }
+      return bufLen >= flushLen
+             || (nowMillis - firstRecordMillis) >= maxAgeMillis;
+    }
+
+    uint8_t const * getFrame () const
+    {
+      return buf;
+    }
+
+    uint8_t getFrameLen () const
+    {
+      return bufLen;
+    }
+
+    uint8_t getNumRecords () const
+    {
+      return numRecords;
+    }
+
+    /**
+     * @brief Empties the frame after it has been sent.
+     *
+     */
+    void clear ()
+    {
+      buf[0] = msgType;
+      bufLen = 1;
+      numRecords = 0;
+    }
+
+    /**
+     * @brief Splits a received frame into its records.
+     *
+     * Stops at the first record that runs past the end of the frame, so a truncated frame still yields its complete records.
+     *
+     * @param frame     Pointer to the received frame, including the message type byte.
+     * @param frameLen_ Length of the received frame.
+     * @param recordInd Called once for each record, in order.
+     * @return uint8_t  Number of records delivered.
+     */
+    static uint8_t unpack (uint8_t const * frame,
+                           uint8_t const frameLen_,
+                           void (*recordInd) (sensors_t const sensor,
+                                              uint8_t const * record,
+                                              uint8_t const recordLen,
+                                              bool const packed))
+    {
+      uint8_t count = 0;
+      uint16_t idx = 1;
+      while (idx + SENSOR_AGGREGATOR_RECORD_OVERHEAD <= frameLen_)
+      {
+        uint8_t recordLen = frame[idx + 1];
+        if (idx + SENSOR_AGGREGATOR_RECORD_OVERHEAD + recordLen > frameLen_)
+        {
+          break;
+        }
+        recordInd(sensors_t(frame[idx] & ~SENSOR_AGGREGATOR_PACKED_FLAG),
+                  frame + idx + SENSOR_AGGREGATOR_RECORD_OVERHEAD,
+                  recordLen,
+                  frame[idx] & SENSOR_AGGREGATOR_PACKED_FLAG);
+        idx += SENSOR_AGGREGATOR_RECORD_OVERHEAD + recordLen;
+        count++;
+      }
+      return count;
+    }
+
+  private:
+    uint8_t msgType;
+    uint32_t maxAgeMillis;
+    uint8_t flushLen;
+    uint8_t buf [frameLen];
+    uint8_t bufLen = 1;
+    uint8_t numRecords = 0;
+    uint32_t firstRecordMillis = 0;
+};
+
+#endif // SENSOR_AGGREGATOR_H
@@ -32,4 +32,4 @@ class Sensors
 }
 */
 
-#endif SENSORS_H
\ No newline at end of file
+#endif // SENSORS_H
\ No newline at end of file
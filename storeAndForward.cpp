@@ -0,0 +1,467 @@
+/**
+ * @file storeAndForward.cpp
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Implementation file for the storeAndForward class.
+ * @version 0.0.1
+ * @date 2021-09-26
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#include <storeAndForward.h>
+#include <commonMacros.h>
+
+/**
+ * @brief What the head file holds, appended each time the head is saved. The last one counts.
+ *
+ */
+struct storedHead_t
+{
+  uint32_t headSeq;
+  uint32_t baseSeq;
+};
+
+//----------------------
+// Function Definitions
+//----------------------
+
+bool storeAndForward::begin ()
+{
+  file = SD.open(fileName, FILE_WRITE);
+  headFile = SD.open(headFileName, FILE_WRITE);
+  if (!file || !headFile)
+  {
+    file.close();
+    headFile.close();
+    return false;
+  }
+  storedHead_t head = {0, 0};
+  uint32_t headLen = headFile.size() - headFile.size() % sizeof(head);
+  if (headLen > 0)
+  {
+    headFile.seek(headLen - sizeof(head));
+    headFile.read(&head, sizeof(head));
+  }
+  baseSeq = head.baseSeq;
+  // A record cut short by a reset is padded out, so the ones after it stay aligned. It will not read back.
+  uint8_t padding [STORE_FORWARD_RECORD_LEN] = {0};
+  uint16_t tail = file.size() % STORE_FORWARD_RECORD_LEN;
+  if (tail != 0 && file.write(padding, STORE_FORWARD_RECORD_LEN - tail) != size_t(STORE_FORWARD_RECORD_LEN - tail))
+  {
+    file.close();
+    headFile.close();
+    return false;
+  }
+  uint32_t numRecords = file.size() / STORE_FORWARD_RECORD_LEN;
+  storedRecord_t first;
+  if (numRecords > 0
+      && file.seek(0)
+      && file.read(&first, sizeof(first)) == int(sizeof(first))
+      && first.marker == STORE_FORWARD_MARKER)
+  {
+    baseSeq = first.seq; // Trusted over the head file, which may have been cut short while being started afresh.
+  }
+  tailSeq = baseSeq + numRecords;
+  headSeq = uint32_t(head.headSeq - baseSeq) <= numRecords ? head.headSeq : baseSeq;
+  savedHeadSeq = headSeq;
+  liveSeq = tailSeq; // Whatever the last session left goes out as backlog.
+  numAckedAhead = 0;
+  numLiveInFlight = 0;
+  batchActive = false;
+  linkUp = true;
+  unsynced = false;
+  lastSyncMillis = millis();
+  return true;
+}
+
+bool storeAndForward::push (uint8_t const * buf,
+                            uint8_t const bufLen)
+{
+  if (!file || bufLen > STORE_FORWARD_MAX_DATA_LEN)
+  {
+    return false;
+  }
+  storedRecord_t record;
+  memset(&record, 0, sizeof(record));
+  record.seq = tailSeq;
+  record.dataLen = bufLen;
+  record.marker = STORE_FORWARD_MARKER;
+  memcpy(record.data, buf, bufLen);
+  if (file.write((uint8_t const *)&record, sizeof(record)) != sizeof(record))
+  {
+    return false;
+  }
+  tailSeq++;
+  numStored++;
+  unsynced = true;
+  return true;
+}
+
+void storeAndForward::service (loraPoint2Point & unit,
+                               uint8_t const destAddr)
+{
+  uint32_t now = millis();
+  uint8_t frame [STORE_FORWARD_FRAME_HEADER_LEN + STORE_FORWARD_MAX_DATA_LEN];
+  uint8_t frameLen;
+
+  // Live: new records go out at once, ahead of the backlog.
+  if (!linkUp)
+  {
+    liveSeq = tailSeq; // They join the backlog.
+  }
+  while (liveSeq != tailSeq && numLiveInFlight < STORE_FORWARD_LIVE_LEN && unit.getTxQueueSpace() > 0)
+  {
+    frameLen = loadFrame(liveSeq, frame);
+    if (frameLen > 0)
+    {
+      if (!unit.serviceTx(destAddr, frame, frameLen, false))
+      {
+        break;
+      }
+      liveInFlight[numLiveInFlight++] = liveSeq;
+    }
+    else
+    {
+      acknowlege(liveSeq); // Unreadable: nothing to send.
+    }
+    liveSeq++;
+  }
+
+  // Backlog: bulk transfers fill the channel between live records.
+  uint32_t seq;
+  if (!batchActive
+      && !unit.isBulkTxActive()
+      && (linkUp || int32_t(now - retryMillis) >= 0)
+      && nextBacklog(headSeq, liveSeq, seq)
+      && unit.startBulkTx(destAddr, bulkContext))
+  {
+    batchActive = true;
+    batchEnded = false;
+    batchLen = 0;
+    batchNext = seq;
+  }
+  while (batchActive && !batchEnded && unit.getBulkTxSpace() > 0)
+  {
+    uint32_t after;
+    if (!nextBacklog(batchNext, liveSeq, seq))
+    {
+      // Sent live or acknowleged since it was looked up: end the transfer with an empty frame.
+      batchEnded = unit.bulkTx(NULL, 0, true);
+      break;
+    }
+    batchNext = seq + 1;
+    frameLen = loadFrame(seq, frame);
+    if (frameLen == 0)
+    {
+      acknowlege(seq);
+      continue;
+    }
+    bool last = batchLen == STORE_FORWARD_BATCH_LEN - 1 || !nextBacklog(batchNext, liveSeq, after);
+    if (!unit.bulkTx(frame, frameLen, last))
+    {
+      unit.stopBulkTx();
+      break;
+    }
+    batch[batchLen++] = seq;
+    batchEnded = last;
+  }
+
+  if ((unsynced || headSeq != savedHeadSeq) && (now - lastSyncMillis) >= syncPeriodMillis)
+  {
+    sync();
+  }
+}
+
+void storeAndForward::txInd (uint8_t const * txBuf,
+                             uint8_t const bufLen,
+                             bool const ack)
+{
+  msg_storedData_t header;
+  if (!header.unpack(txBuf, bufLen))
+  {
+    return;
+  }
+  uint32_t const seq = header.seq;
+  for (uint8_t idx = 0; idx < numLiveInFlight; idx++)
+  {
+    if (liveInFlight[idx] == seq)
+    {
+      liveInFlight[idx] = liveInFlight[--numLiveInFlight];
+      if (ack)
+      {
+        acknowlege(seq);
+      }
+      else
+      {
+        // Left for the backlog, which tries the link again in a while.
+        linkUp = false;
+        retryMillis = millis() + STORE_FORWARD_RETRY_MILLIS;
+      }
+      return;
+    }
+  }
+}
+
+void storeAndForward::bulkTxInd (bool const success)
+{
+  if (!batchActive)
+  {
+    return;
+  }
+  batchActive = false;
+  linkUp = success;
+  if (success)
+  {
+    for (uint8_t idx = 0; idx < batchLen; idx++)
+    {
+      acknowlege(batch[idx]);
+    }
+  }
+  else
+  {
+    retryMillis = millis() + STORE_FORWARD_RETRY_MILLIS;
+  }
+}
+
+bool storeAndForward::sync ()
+{
+  if (!file || !headFile)
+  {
+    return false;
+  }
+  file.flush();
+  bool ok = true;
+  if (headSeq == tailSeq
+      && numLiveInFlight == 0
+      && !batchActive
+      && tailSeq - baseSeq >= STORE_FORWARD_COMPACT_RECORDS)
+  {
+    ok = compact();
+  }
+  else if (headSeq != savedHeadSeq)
+  {
+    ok = saveHead();
+  }
+  unsynced = false;
+  lastSyncMillis = millis();
+  return ok;
+}
+
+void storeAndForward::end ()
+{
+  sync();
+  file.close();
+  headFile.close();
+}
+
+uint32_t storeAndForward::getNumPending ()
+{
+  uint32_t num = tailSeq - headSeq;
+  for (uint8_t idx = 0; idx < numAckedAhead; idx++)
+  {
+    num -= ackedAhead[idx].last - ackedAhead[idx].first + 1;
+  }
+  return num;
+}
+
+uint32_t storeAndForward::getNumStored ()
+{
+  return numStored;
+}
+
+uint32_t storeAndForward::getNumAcked ()
+{
+  return numAcked;
+}
+
+bool storeAndForward::isLinkUp ()
+{
+  return linkUp;
+}
+
+bool storeAndForward::read (uint32_t const seq,
+                            storedRecord_t & record)
+{
+  if (!file
+      || uint32_t(seq - baseSeq) >= uint32_t(tailSeq - baseSeq)
+      || !file.seek((seq - baseSeq) * STORE_FORWARD_RECORD_LEN)
+      || file.read(&record, sizeof(record)) != int(sizeof(record)))
+  {
+    return false;
+  }
+  return record.marker == STORE_FORWARD_MARKER
+         && record.seq == seq
+         && record.dataLen <= STORE_FORWARD_MAX_DATA_LEN;
+}
+
+bool storeAndForward::parse (message_t const & rxMsg,
+                             uint32_t & seq,
+                             uint8_t const * & data,
+                             uint8_t & dataLen)
+{
+  uint8_t offset = rxMsg.buf[0] == msgType_bulkData ? BULK_HEADER_LEN : 0;
+  msg_storedData_t header;
+  if (rxMsg.bufLen < offset || !header.unpack(rxMsg.buf + offset, rxMsg.bufLen - offset))
+  {
+    return false;
+  }
+  seq = header.seq;
+  data = rxMsg.buf + offset + STORE_FORWARD_FRAME_HEADER_LEN;
+  dataLen = rxMsg.bufLen - offset - STORE_FORWARD_FRAME_HEADER_LEN;
+  return true;
+}
+
+//---------
+// Helpers
+//---------
+
+uint8_t storeAndForward::loadFrame (uint32_t const seq,
+                                    uint8_t * const frame)
+{
+  storedRecord_t record;
+  if (!read(seq, record))
+  {
+    return 0;
+  }
+  msg_storedData_t header;
+  header.seq = seq;
+  header.pack(frame);
+  memcpy(frame + STORE_FORWARD_FRAME_HEADER_LEN, record.data, record.dataLen);
+  return STORE_FORWARD_FRAME_HEADER_LEN + record.dataLen;
+}
+
+void storeAndForward::acknowlege (uint32_t const seq)
+{
+  if (int32_t(seq - headSeq) < 0 || int32_t(seq - tailSeq) >= 0 || findAckedAhead(seq) != NULL)
+  {
+    return;
+  }
+  if (seq != headSeq)
+  {
+    // Extend a run it is next to, else start one if there is room. If not, it is sent again later and acknowleged again.
+    storedRange_t * before = findAckedAhead(seq - 1);
+    storedRange_t * after = findAckedAhead(seq + 1);
+    if (before != NULL && after != NULL)
+    {
+      before->last = after->last;
+      *after = ackedAhead[--numAckedAhead];
+    }
+    else if (before != NULL)
+    {
+      before->last = seq;
+    }
+    else if (after != NULL)
+    {
+      after->first = seq;
+    }
+    else if (numAckedAhead < STORE_FORWARD_ACKED_RANGES)
+    {
+      ackedAhead[numAckedAhead++] = {seq, seq};
+    }
+    else
+    {
+      return;
+    }
+    numAcked++;
+    return;
+  }
+  headSeq++;
+  numAcked++;
+  storedRange_t * next = findAckedAhead(headSeq);
+  if (next != NULL)
+  {
+    headSeq = next->last + 1;
+    *next = ackedAhead[--numAckedAhead];
+  }
+}
+
+storedRange_t * storeAndForward::findAckedAhead (uint32_t const seq)
+{
+  for (uint8_t idx = 0; idx < numAckedAhead; idx++)
+  {
+    if (uint32_t(seq - ackedAhead[idx].first) <= uint32_t(ackedAhead[idx].last - ackedAhead[idx].first))
+    {
+      return &ackedAhead[idx];
+    }
+  }
+  return NULL;
+}
+
+bool storeAndForward::isLive (uint32_t const seq)
+{
+  for (uint8_t idx = 0; idx < numLiveInFlight; idx++)
+  {
+    if (liveInFlight[idx] == seq)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool storeAndForward::nextBacklog (uint32_t seq,
+                                   uint32_t const limit,
+                                   uint32_t & next)
+{
+  if (int32_t(seq - headSeq) < 0)
+  {
+    seq = headSeq;
+  }
+  while (int32_t(limit - seq) > 0)
+  {
+    storedRange_t * acked = findAckedAhead(seq);
+    if (acked != NULL)
+    {
+      seq = acked->last + 1;
+    }
+    else if (isLive(seq))
+    {
+      seq++;
+    }
+    else
+    {
+      next = seq;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool storeAndForward::saveHead ()
+{
+  if (headFile.size() >= STORE_FORWARD_HEAD_FILE_LEN && tailSeq != baseSeq)
+  {
+    // Start it afresh. Were it lost, the data file's first record still gives the sequence numbers.
+    headFile.close();
+    SD.remove(headFileName);
+    headFile = SD.open(headFileName, FILE_WRITE);
+  }
+  storedHead_t head = {headSeq, baseSeq};
+  if (!headFile || headFile.write((uint8_t const *)&head, sizeof(head)) != sizeof(head))
+  {
+    return false;
+  }
+  headFile.flush();
+  savedHeadSeq = headSeq;
+  return true;
+}
+
+bool storeAndForward::compact ()
+{
+  // Save the new base first: a reset part way through then only leaves acknowleged records behind, which don't read back.
+  uint32_t oldBaseSeq = baseSeq;
+  baseSeq = tailSeq;
+  if (!saveHead())
+  {
+    baseSeq = oldBaseSeq;
+    return false;
+  }
+  file.close();
+  SD.remove(fileName);
+  file = SD.open(fileName, FILE_WRITE);
+  headFile.close();
+  SD.remove(headFileName);
+  headFile = SD.open(headFileName, FILE_WRITE);
+  return file && saveHead();
+}
@@ -0,0 +1,244 @@
+/**
+ * @file storeAndForward.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the storeAndForward class, a FIFO of sensor records on an SD card that keeps each record until the base has acknowleged it.
+ * @version 0.0.1
+ * @date 2021-09-26
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Every record is appended to a file with a sequence number before it is sent. While the link is up, new records go
+ * out straight away through the TX queue ("live"), acknowleged one by one. Records that are not acknowleged stay in
+ * the file as a backlog, which is drained with bulk transfers (see loraPoint2Point::startBulkTx) in whatever time the
+ * live records leave; a failed transfer marks the link as down until a later one gets through. The base may see a
+ * record twice, e.g. if an acknowlegement is lost, and should drop repeated sequence numbers.
+ *
+ * Records are STORE_FORWARD_RECORD_LEN bytes, so a sector holds a whole number of them and record n of the file is at
+ * n * STORE_FORWARD_RECORD_LEN. The oldest record not acknowleged (the head) is saved to a second, append-only file
+ * when the data file is synced; at worst, records acknowleged since are sent again after a reset. Once every record
+ * has been acknowleged, both files are started afresh.
+ */
+
+#ifndef STORE_AND_FORWARD_H
+#define STORE_AND_FORWARD_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <loraPoint2PointProtocol.h>
+
+#define STORE_FORWARD_RECORD_LEN 64
+#define STORE_FORWARD_RECORD_HEADER_LEN 6 ///< Sequence number (little-endian uint32), data length and STORE_FORWARD_MARKER.
+#define STORE_FORWARD_MAX_DATA_LEN (STORE_FORWARD_RECORD_LEN - STORE_FORWARD_RECORD_HEADER_LEN)
+#define STORE_FORWARD_MARKER 0xA5 ///< Tells a record that was written whole from one cut short.
+#define STORE_FORWARD_FRAME_HEADER_LEN msg_storedData_t::LEN ///< msgType_storedData and the sequence number (little-endian uint32).
+#define STORE_FORWARD_DFLT_SYNC_MILLIS 10000
+#define STORE_FORWARD_RETRY_MILLIS 30000 ///< Wait after a bulk transfer fails before trying the link again.
+#define STORE_FORWARD_BATCH_LEN 32       ///< Most records per bulk transfer of the backlog.
+#define STORE_FORWARD_LIVE_LEN 4         ///< Most live records awaiting acknowlegement at once.
+#define STORE_FORWARD_ACKED_RANGES 8     ///< Runs of records acknowleged ahead of the head that are remembered, so they are not sent again.
+#define STORE_FORWARD_COMPACT_RECORDS 64 ///< Start the files afresh once at least this many records have all been acknowleged.
+#define STORE_FORWARD_HEAD_FILE_LEN 512  ///< Start the head file afresh once it is this long.
+
+/**
+ * @brief A stored record, as laid out in the file. Little-endian on both the SAMD21 and the host.
+ *
+ */
+struct storedRecord_t
+{
+  uint32_t seq;
+  uint8_t  dataLen;
+  uint8_t  marker; ///< STORE_FORWARD_MARKER.
+  uint8_t  data [STORE_FORWARD_MAX_DATA_LEN];
+};
+
+static_assert(sizeof(storedRecord_t) == STORE_FORWARD_RECORD_LEN, "storedRecord_t must be STORE_FORWARD_RECORD_LEN bytes.");
+
+/**
+ * @brief A run of consecutive sequence numbers, first to last inclusive.
+ *
+ */
+struct storedRange_t
+{
+  uint32_t first;
+  uint32_t last;
+};
+
+/**
+ * @brief An SD card backed FIFO of records, forwarded over a loraPoint2Point link until each is acknowleged.
+ *
+ * It starts the unit's bulk transfers itself, so the application should not start any of its own.
+ */
+class storeAndForward
+{
+  public:
+    /**
+     * @brief Constructs a new storeAndForward object.
+     *
+     * @param _fileName         Name of the file the records are kept in.
+     * @param _headFileName     Name of the file the head is saved to.
+     * @param _syncPeriodMillis How often to sync the files, at most.
+     */
+    storeAndForward (char const * _fileName,
+                     char const * _headFileName,
+                     uint32_t const _syncPeriodMillis = STORE_FORWARD_DFLT_SYNC_MILLIS
+                     ):
+                     fileName{_fileName},
+                     headFileName{_headFileName},
+                     syncPeriodMillis{_syncPeriodMillis}
+                     {
+
+                     }
+
+    /**
+     * @brief Opens the files, picking up the records left unacknowleged by the last session. Call once SD.begin has succeeded.
+     *
+     * @return true  Files open.
+     * @return false A file could not be opened; nothing will be stored.
+     */
+    bool begin ();
+
+    /**
+     * @brief Appends a record to the FIFO. It goes out from service.
+     *
+     * @param buf    The record.
+     * @param bufLen Its length, at most STORE_FORWARD_MAX_DATA_LEN.
+     * @return true  Stored.
+     * @return false Not stored: too long, the file is not open or writing failed.
+     */
+    bool push (uint8_t const * buf,
+               uint8_t const bufLen);
+
+    /**
+     * @brief Sends live records and the backlog, and syncs the files every so often. Call from the main loop.
+     *
+     * @param unit     The radio to send on.
+     * @param destAddr The base.
+     */
+    void service (loraPoint2Point & unit,
+                  uint8_t const destAddr);
+
+    /**
+     * @brief Call from txInd: a live record acknowleged is done with; one that is not goes to the backlog.
+     *
+     */
+    void txInd (uint8_t const * txBuf,
+                uint8_t const bufLen,
+                bool const ack);
+
+    /**
+     * @brief Call from bulkTxInd: on success, the records of the transfer are done with.
+     *
+     */
+    void bulkTxInd (bool const success);
+
+    /**
+     * @brief Syncs the files and saves the head.
+     *
+     * @return true  Synced.
+     * @return false A file is not open or writing failed.
+     */
+    bool sync ();
+
+    /**
+     * @brief Syncs and closes the files.
+     *
+     */
+    void end ();
+
+    /**
+     * @brief Records stored and not acknowleged yet.
+     *
+     */
+    uint32_t getNumPending ();
+    uint32_t getNumStored ();
+    uint32_t getNumAcked ();
+    /**
+     * @brief Whether the last attempt to send got through.
+     *
+     */
+    bool isLinkUp ();
+
+    /**
+     * @brief Reads a stored record back.
+     *
+     * @param seq    Its sequence number.
+     * @param record Filled in.
+     * @return true  Read.
+     * @return false Not in the file, or cut short.
+     */
+    bool read (uint32_t const seq,
+               storedRecord_t & record);
+
+    /**
+     * @brief Finds a stored record in a received message, sent live or in a bulk transfer. For the base's rxInd.
+     *
+     * @param rxMsg   As passed to rxInd.
+     * @param seq     Set to the record's sequence number.
+     * @param data    Set to point to the record, in rxMsg.
+     * @param dataLen Set to its length.
+     * @return true   rxMsg holds a stored record.
+     * @return false  It does not.
+     */
+    static bool parse (message_t const & rxMsg,
+                       uint32_t & seq,
+                       uint8_t const * & data,
+                       uint8_t & dataLen);
+
+  private:
+    /**
+     * @brief Builds the frame a record is sent in: msgType_storedData, the sequence number and the data.
+     *
+     * @return uint8_t Frame length, or 0 if the record could not be read.
+     */
+    uint8_t loadFrame (uint32_t const seq,
+                       uint8_t * const frame);
+    void acknowlege (uint32_t const seq);
+    /**
+     * @brief The run of records acknowleged ahead of the head that seq is in, if any.
+     *
+     */
+    storedRange_t * findAckedAhead (uint32_t const seq);
+    bool isLive (uint32_t const seq);
+    /**
+     * @brief The first record from seq on that the backlog should send, if any before limit.
+     *
+     */
+    bool nextBacklog (uint32_t seq,
+                      uint32_t const limit,
+                      uint32_t & next);
+    bool saveHead ();
+    /**
+     * @brief Starts both files afresh, keeping the sequence numbers going.
+     *
+     */
+    bool compact ();
+
+    char const * fileName;
+    char const * headFileName;
+    uint32_t syncPeriodMillis;
+    File file;
+    File headFile;
+    uint32_t baseSeq = 0;   ///< Sequence number of the first record in the file.
+    uint32_t headSeq = 0;   ///< Oldest record not acknowleged.
+    uint32_t tailSeq = 0;   ///< Sequence number the next record pushed gets.
+    uint32_t liveSeq = 0;   ///< Records from here on have not been offered live yet.
+    uint32_t savedHeadSeq = 0;
+    storedRange_t ackedAhead [STORE_FORWARD_ACKED_RANGES]; ///< Live records are acknowleged in runs while the backlog drains.
+    uint8_t numAckedAhead = 0;
+    uint32_t liveInFlight [STORE_FORWARD_LIVE_LEN];
+    uint8_t numLiveInFlight = 0;
+    uint32_t batch [STORE_FORWARD_BATCH_LEN]; ///< Records of the bulk transfer in progress.
+    bulkTxContext_t bulkContext;
+    uint8_t batchLen = 0;
+    uint32_t batchNext = 0;  ///< Where to look for the next record of the batch.
+    bool batchActive = false;
+    bool batchEnded = false; ///< The last record of the batch has been added.
+    bool linkUp = true;
+    uint32_t retryMillis = 0;
+    bool unsynced = false;
+    uint32_t lastSyncMillis = 0;
+    uint32_t numStored = 0;
+    uint32_t numAcked = 0;
+};
+
+#endif // STORE_AND_FORWARD_H
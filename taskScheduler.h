@@ -0,0 +1,277 @@
+/**
+ * @file taskScheduler.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the taskScheduler class, a fixed-capacity scheduler of one-shot and periodic tasks.
+ * @version 0.0.1
+ * @date 2021-09-21
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * Tasks are added once, up front, and then started and stopped as often as needed, so nothing is ever allocated and
+ * a task ID stays valid for the life of the scheduler. Running tasks are kept in a binary min-heap ordered by
+ * deadline: run() only looks at the top of the heap, and millisUntilNext() says how long the main loop can sleep.
+ *
+ * Deadlines are compared as signed differences, so they keep working across the wraparound of millis() every 49.7
+ * days, as long as no task is started more than 2^31 millis ahead.
+ */
+
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <Arduino.h>
+
+#define TASK_SCHEDULER_INVALID_ID 0xFF       ///< Returned by add when the scheduler is full.
+#define TASK_SCHEDULER_IDLE_MILLIS 0xFFFFFFFF ///< Returned by millisUntilNext when no task is running.
+
+typedef uint8_t taskId_t;
+
+/**
+ * @brief Task callback.
+ *
+ * @param context The context pointer given to add, e.g. the object whose member to call.
+ */
+typedef void (* taskCallback_t) (void * context);
+
+/**
+ * @brief One task.
+ *
+ */
+struct task_t
+{
+  taskCallback_t callback; ///< May be NULL, for a task that only marks time (see isRunning).
+  void * context;
+  uint32_t deadlineMillis;
+  uint32_t periodMillis;   ///< 0 for a one-shot task.
+  uint8_t heapIndex;       ///< Position in the heap, or TASK_SCHEDULER_INVALID_ID while stopped.
+};
+
+/**
+ * @brief Fixed-capacity scheduler of one-shot and periodic tasks, dispatched in deadline order.
+ *
+ * @tparam capacity Maximum number of tasks. At most 254.
+ */
+template <uint8_t capacity>
+class taskScheduler
+{
+  static_assert(capacity < TASK_SCHEDULER_INVALID_ID, "taskScheduler capacity must be below TASK_SCHEDULER_INVALID_ID.");
+
+  public:
+    /**
+     * @brief Adds a stopped task.
+     *
+     * @param callback Function to call when the task is due.
+     * @param context  Passed to the callback.
+     * @return taskId_t ID of the task, or TASK_SCHEDULER_INVALID_ID if the scheduler is full.
+     */
+    taskId_t add (taskCallback_t const callback,
+                  void * const context)
+    {
+      if (numTasks >= capacity)
+      {
+        return TASK_SCHEDULER_INVALID_ID;
+      }
+      task_t & task = tasks[numTasks];
+      task.callback = callback;
+      task.context = context;
+      task.deadlineMillis = 0;
+      task.periodMillis = 0;
+      task.heapIndex = TASK_SCHEDULER_INVALID_ID;
+      return numTasks++;
+    }
+
+    /**
+     * @brief Starts a task, or restarts it if it is already running.
+     *
+     * @param id           The task.
+     * @param now          The current time, from millis().
+     * @param delayMillis  Millis from now until the task is first due.
+     * @param periodMillis Millis between later runs, or 0 to run once and stop.
+     * @return true        Started.
+     * @return false       No such task.
+     */
+    bool start (taskId_t const id,
+                uint32_t const now,
+                uint32_t const delayMillis,
+                uint32_t const periodMillis = 0)
+    {
+      if (id >= numTasks)
+      {
+        return false;
+      }
+      stop(id);
+      tasks[id].deadlineMillis = now + delayMillis;
+      tasks[id].periodMillis = periodMillis;
+      push(id);
+      return true;
+    }
+
+    /**
+     * @brief Stops a task. Stopping a stopped task does nothing.
+     *
+     * @param id The task.
+     */
+    void stop (taskId_t const id)
+    {
+      if (id < numTasks && tasks[id].heapIndex != TASK_SCHEDULER_INVALID_ID)
+      {
+        remove(tasks[id].heapIndex);
+      }
+    }
+
+    bool isRunning (taskId_t const id) const
+    {
+      return id < numTasks && tasks[id].heapIndex != TASK_SCHEDULER_INVALID_ID;
+    }
+
+    /**
+     * @brief Runs every task that is due, earliest deadline first.
+     *
+     * A periodic task is due again a period after its last deadline, or a period after now if it has fallen more than
+     * a period behind, so a late main loop does not cause a burst of catch-up runs. Callbacks may start and stop any
+     * task, themselves included. To keep a task that restarts itself with no delay from starving the main loop, at most
+     * capacity tasks are run per call.
+     *
+     * @param now        The current time, from millis().
+     * @return uint8_t   Number of tasks run.
+     */
+    uint8_t run (uint32_t const now)
+    {
+      uint8_t numRun = 0;
+      while (heapLen > 0
+             && numRun < capacity
+             && int32_t(now - tasks[heap[0]].deadlineMillis) >= 0)
+      {
+        taskId_t id = heap[0];
+        task_t & task = tasks[id];
+        remove(0);
+        if (task.periodMillis > 0)
+        {
+          task.deadlineMillis += task.periodMillis;
+          if (int32_t(now - task.deadlineMillis) >= 0)
+          {
+            task.deadlineMillis = now + task.periodMillis;
+          }
+          push(id);
+        }
+        numRun++;
+        if (task.callback != NULL)
+        {
+          task.callback(task.context);
+        }
+      }
+      return numRun;
+    }
+
+    /**
+     * @brief Millis until the earliest running task is due.
+     *
+     * @param now       The current time, from millis().
+     * @return uint32_t 0 if a task is already due, or TASK_SCHEDULER_IDLE_MILLIS if no task is running.
+     */
+    uint32_t millisUntilNext (uint32_t const now) const
+    {
+      if (heapLen == 0)
+      {
+        return TASK_SCHEDULER_IDLE_MILLIS;
+      }
+      int32_t left = int32_t(tasks[heap[0]].deadlineMillis - now);
+      return left > 0 ? uint32_t(left) : 0;
+    }
+
+    uint8_t count () const
+    {
+      return numTasks;
+    }
+
+    uint8_t countRunning () const
+    {
+      return heapLen;
+    }
+
+  private:
+    /**
+     * @brief Whether task a is due before task b.
+     *
+     */
+    bool earlier (taskId_t const a,
+                  taskId_t const b) const
+    {
+      return int32_t(tasks[a].deadlineMillis - tasks[b].deadlineMillis) < 0;
+    }
+
+    void place (uint8_t const index,
+                taskId_t const id)
+    {
+      heap[index] = id;
+      tasks[id].heapIndex = index;
+    }
+
+    void siftUp (uint8_t index)
+    {
+      taskId_t id = heap[index];
+      while (index > 0 && earlier(id, heap[(index - 1) / 2]))
+      {
+        place(index, heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+      }
+      place(index, id);
+    }
+
+    void siftDown (uint8_t index)
+    {
+      taskId_t id = heap[index];
+      while (true)
+      {
+        uint16_t child = 2 * uint16_t(index) + 1;
+        if (child >= heapLen)
+        {
+          break;
+        }
+        if (child + 1 < heapLen && earlier(heap[child + 1], heap[child]))
+        {
+          child++;
+        }
+        if (!earlier(heap[child], id))
+        {
+          break;
+        }
+        place(index, heap[child]);
+        index = child;
+      }
+      place(index, id);
+    }
+
+    void push (taskId_t const id)
+    {
+      place(heapLen, id);
+      heapLen++;
+      siftUp(heapLen - 1);
+    }
+
+    void remove (uint8_t const index)
+    {
+      tasks[heap[index]].heapIndex = TASK_SCHEDULER_INVALID_ID;
+      heapLen--;
+      if (index == heapLen)
+      {
+        return;
+      }
+      // Move the last task into the gap, then restore the heap in whichever direction it is out of order.
+      place(index, heap[heapLen]);
+      if (index > 0 && earlier(heap[index], heap[(index - 1) / 2]))
+      {
+        siftUp(index);
+      }
+      else
+      {
+        siftDown(index);
+      }
+    }
+
+    task_t tasks [capacity];
+    taskId_t heap [capacity];
+    uint8_t numTasks = 0;
+    uint8_t heapLen = 0;
+};
+
+#endif // TASK_SCHEDULER_H
@@ -0,0 +1,130 @@
+/**
+ * @file txQueue.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the txQueue class, a fixed-capacity ring queue of outgoing frames.
+ * @version 0.0.1
+ * @date 2021-09-08
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ */
+
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include <Arduino.h>
+
+/**
+ * @brief One queued frame.
+ *
+ * @tparam frameLen Maximum length of the frame, in bytes.
+ */
+template <uint8_t frameLen>
+struct txQueueEntry_t
+{
+  uint8_t destAddr;
+  uint8_t bufLen;
+  bool ascii;
+  uint16_t holdoffMillis;
+  uint8_t buf [frameLen];
+};
+
+/**
+ * @brief Fixed-capacity ring queue of outgoing frames. Frames are copied in, so nothing is ever allocated.
+ *
+ * @tparam capacity Maximum number of frames held.
+ * @tparam frameLen Maximum length of one frame, in bytes.
+ */
+template <uint8_t capacity, uint8_t frameLen>
+class txQueue
+{
+  public:
+    typedef txQueueEntry_t<frameLen> entry_t;
+
+    /**
+     * @brief Copies a frame onto the back of the queue.
+     *
+     * @param destAddr      The address of the destination.
+     * @param buf           Pointer to the array of bytes to send.
+     * @param bufLen        Number of bytes to send.
+     * @param ascii         Format of debug printing.
+     * @param holdoffMillis Millis to wait after the frame reaches the front of the queue before sending it.
+     * @return true         Queued.
+     * @return false        Queue full or frame too long.
+     */
+    bool push (uint8_t const destAddr,
+               uint8_t const * buf,
+               uint8_t const bufLen,
+               bool const ascii,
+               uint16_t const holdoffMillis)
+    {
+      if (isFull() || bufLen > frameLen)
+      {
+        return false;
+      }
+      entry_t & entry = entries[(head + numEntries) % capacity];
+      entry.destAddr = destAddr;
+      entry.bufLen = bufLen;
+      entry.ascii = ascii;
+      entry.holdoffMillis = holdoffMillis;
+      memcpy(entry.buf, buf, bufLen);
+      numEntries++;
+      return true;
+    }
+
+    /**
+     * @brief The frame at the front of the queue. Only valid while the queue is not empty.
+     *
+     * @return entry_t const& Oldest frame.
+     */
+    entry_t const & front () const
+    {
+      return entries[head];
+    }
+
+    /**
+     * @brief Removes the frame at the front of the queue.
+     *
+     */
+    void pop ()
+    {
+      if (numEntries > 0)
+      {
+        head = (head + 1) % capacity;
+        numEntries--;
+      }
+    }
+
+    void clear ()
+    {
+      head = 0;
+      numEntries = 0;
+    }
+
+    uint8_t count () const
+    {
+      return numEntries;
+    }
+
+    uint8_t space () const
+    {
+      return capacity - numEntries;
+    }
+
+    bool isEmpty () const
+    {
+      return numEntries == 0;
+    }
+
+    bool isFull () const
+    {
+      return numEntries >= capacity;
+    }
+
+  private:
+    entry_t entries [capacity];
+    uint8_t head = 0;
+    uint8_t numEntries = 0;
+};
+
+#endif // TX_QUEUE_H
@@ -0,0 +1,279 @@
+/**
+ * @file uartRing.h
+ * @author Sophie Bernier (sophie.liz.ber@gmail.com)
+ * @brief Header file for the uartRing and lineFramer classes: a lock-free byte ring filled from a UART interrupt, and the lines of text in it handed to the main loop without copying.
+ * @version 0.0.1
+ * @date 2021-09-30
+ *
+ * @warning Under heavy development. Use at your own risk.
+ *
+ * The core's UART buffer is small, so a main loop that blocks for a packet's airtime loses sensor bytes. A uartRing
+ * holds as many bytes as the longest time the loop may be away; size it as baud / 10 bytes per second of that.
+ *
+ * One producer (the interrupt handler) and one consumer (the main loop) share the ring without disabling interrupts:
+ * only the producer writes the head and only the consumer writes the tail. The indices run freely and wrap at 2^16,
+ * which the capacity, a power of two, divides.
+ */
+
+#ifndef UART_RING_H
+#define UART_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <commonMacros.h>
+
+/**
+ * @brief Bytes in a uartRing, in place: up to two runs, as the bytes may wrap past the end of the ring.
+ *
+ */
+struct uartSlice_t
+{
+  uint8_t const * first;
+  uint16_t firstLen;
+  uint8_t const * second; ///< The bytes wrapped to the start of the ring, if any.
+  uint16_t secondLen;
+
+  uint16_t length () const
+  {
+    return firstLen + secondLen;
+  }
+
+  uint8_t operator[] (uint16_t const idx) const
+  {
+    return idx < firstLen ? first[idx] : second[idx - firstLen];
+  }
+
+  /**
+   * @brief Copies the bytes out.
+   *
+   * @return uint16_t Number of bytes copied, at most destLen.
+   */
+  uint16_t copyTo (uint8_t * const dest,
+                   uint16_t const destLen) const
+  {
+    uint16_t const len1 = MIN(firstLen, destLen);
+    uint16_t const len2 = MIN(secondLen, uint16_t(destLen - len1));
+    memcpy(dest, first, len1);
+    memcpy(dest + len1, second, len2);
+    return len1 + len2;
+  }
+};
+
+/**
+ * @brief Single-producer, single-consumer byte ring.
+ *
+ * push is for the producer alone; pop, peek, slice and release are for the consumer alone. count may be called from
+ * either.
+ *
+ * @tparam capacity Bytes held, a power of two.
+ */
+template <uint16_t capacity>
+class uartRing
+{
+  static_assert(capacity >= 2 && (capacity & (capacity - 1)) == 0, "uartRing capacity must be a power of two.");
+
+  public:
+    /**
+     * @brief Adds a byte. Call from the interrupt handler.
+     *
+     * @return true  Added.
+     * @return false The ring is full: the byte is dropped and counted.
+     */
+    bool push (uint8_t const byte)
+    {
+      uint16_t const h = head.load(std::memory_order_relaxed);
+      if (uint16_t(h - tail.load(std::memory_order_acquire)) >= capacity)
+      {
+        // Only the producer writes numDropped, so no read-modify-write is needed.
+        numDropped.store(numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+      }
+      buf[h & (capacity - 1)] = byte;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    /**
+     * @brief Takes the oldest byte.
+     *
+     * @return true  byte set.
+     * @return false The ring is empty.
+     */
+    bool pop (uint8_t & byte)
+    {
+      if (count() == 0)
+      {
+        return false;
+      }
+      byte = peek(0);
+      release(1);
+      return true;
+    }
+
+    /**
+     * @brief A byte, without taking it. Only valid for offset < count().
+     *
+     * @param offset From the oldest byte.
+     */
+    uint8_t peek (uint16_t const offset) const
+    {
+      return buf[(tail.load(std::memory_order_relaxed) + offset) & (capacity - 1)];
+    }
+
+    /**
+     * @brief Bytes in place, without taking them. Valid until they are released. offset + len must not exceed count().
+     *
+     * @param offset From the oldest byte.
+     * @param len    Number of bytes.
+     */
+    uartSlice_t slice (uint16_t const offset,
+                       uint16_t const len) const
+    {
+      uint16_t const start = (tail.load(std::memory_order_relaxed) + offset) & (capacity - 1);
+      uint16_t const firstLen = MIN(len, uint16_t(capacity - start));
+      return {buf + start, firstLen, buf, uint16_t(len - firstLen)};
+    }
+
+    /**
+     * @brief Takes the oldest bytes, making room for the producer.
+     *
+     * @param len Number of bytes, at most count().
+     */
+    void release (uint16_t const len)
+    {
+      tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    }
+
+    uint16_t count () const
+    {
+      return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    uint16_t space () const
+    {
+      return capacity - count();
+    }
+
+    /**
+     * @brief Bytes dropped since construction because the ring was full.
+     *
+     */
+    uint32_t getNumDropped () const
+    {
+      return numDropped.load(std::memory_order_relaxed);
+    }
+
+  private:
+    uint8_t buf [capacity];
+    std::atomic<uint16_t> head {0}; ///< Written by the producer only.
+    std::atomic<uint16_t> tail {0}; ///< Written by the consumer only.
+    std::atomic<uint32_t> numDropped {0};
+};
+
+/**
+ * @brief Splits the bytes of a uartRing into lines, ended by '\n' or '\r'. Lines are handed back in place.
+ *
+ * Empty lines, such as between the '\r' and '\n' of a CRLF, are skipped. A line longer than maxLineLen is handed back
+ * in pieces of maxLineLen, so a sensor that never ends its line cannot fill the ring.
+ *
+ * @tparam capacity Of the ring.
+ */
+template <uint16_t capacity>
+class lineFramer
+{
+  public:
+    /**
+     * @brief Constructs a new lineFramer object.
+     *
+     * @param _ring       The ring to take lines from. The framer is its only consumer.
+     * @param _maxLineLen Longest line handed back whole, at most capacity - 1.
+     */
+    lineFramer (uartRing<capacity> & _ring,
+                uint16_t const _maxLineLen = capacity - 1
+                ):
+                ring(_ring),
+                maxLineLen{MIN(_maxLineLen, uint16_t(capacity - 1))}
+                {
+
+                }
+
+    /**
+     * @brief Releases the line handed back last and finds the next whole one.
+     *
+     * @param line   Set to the line, without its terminator. Valid until the next call.
+     * @return true  line set.
+     * @return false No whole line yet.
+     */
+    bool nextLine (uartSlice_t & line)
+    {
+      ring.release(heldLen);
+      heldLen = 0;
+      while (scanned < ring.count())
+      {
+        uint8_t const byte = ring.peek(scanned);
+        if (byte == '\n' || byte == '\r')
+        {
+          if (scanned == 0)
+          {
+            ring.release(1);
+            continue;
+          }
+          line = ring.slice(0, scanned);
+          heldLen = scanned + 1;
+          scanned = 0;
+          return true;
+        }
+        scanned++;
+        if (scanned >= maxLineLen)
+        {
+          line = ring.slice(0, scanned);
+          heldLen = scanned;
+          scanned = 0;
+          numSplit++;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief Lines too long to hand back whole.
+     *
+     */
+    uint32_t getNumSplit () const
+    {
+      return numSplit;
+    }
+
+  private:
+    uartRing<capacity> & ring;
+    uint16_t maxLineLen;
+    uint16_t scanned = 0; ///< Bytes of the next line already looked at, so they are not looked at again.
+    uint16_t heldLen = 0; ///< The line handed back last, with its terminator, still in the ring.
+    uint32_t numSplit = 0;
+};
+
+#if defined(ARDUINO_ARCH_SAMD)
+/**
+ * @brief Moves the bytes a SERCOM UART has received into a ring, then lets the core's handler deal with the rest
+ * (framing errors and transmission). Call from the SERCOMn_Handler of a UART the sketch constructs.
+ *
+ * @param uart   The Uart on the SERCOM.
+ * @param sercom The SERCOM.
+ * @param ring   Where the bytes go.
+ */
+template <uint16_t capacity>
+inline void uartRingIrqHandler (Uart & uart,
+                                SERCOM & sercom,
+                                uartRing<capacity> & ring)
+{
+  // A byte with a framing error is left for the core's handler to discard.
+  while (!sercom.isFrameErrorUART() && sercom.availableDataUART())
+  {
+    ring.push(sercom.readDataUART());
+  }
+  uart.IrqHandler();
+}
+#endif // ARDUINO_ARCH_SAMD
+
+#endif // UART_RING_H